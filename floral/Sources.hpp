@@ -19,7 +19,6 @@
 #include "src/Parser.hpp"
 #include "src/Timer.hpp"
 #include "src/Compiler.hpp"
-#include "src/Other.h"
 #include "src/SPA.hpp"
 #include "src/CommandParser.hpp"
 #include "src/Colors.hpp"
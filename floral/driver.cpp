@@ -27,20 +27,40 @@ void driver(CommandParser& commandParser) {
             "\n"
             "-###                   Print (but do not run) the commands to run for this compilation\n"
             "-c                     Compile the source without linking\n"
+            "-cache-stats           Print how often the compilation cache was hit, and how large it is\n"
             "-cat-src, -s           Concatenate the preprocessed source code\n"
             "-dump-type-trace, -t   Dump the static analyzer's type trace\n"
             "-stack-guard, -g       Inserts the xor of the return address and the base pointer and ensures that it remains unmodified\n"
+            "-stack-probe           Touch each page of frames larger than a page, so stack overflow always faults\n"
+            "-j <n>                 Compile up to n files at once (one per core when n is omitted)\n"
+            "-MD                    Write the headers each source includes to a Make/Ninja depfile beside it\n"
+            "-MF <file>             Write the depfile of the one source being compiled to file (implies -MD)\n"
             "-o <target>            Specifies the executable target name\n"
             "-open-asm              Open the generated assembly for debugging purposes\n"
+            "-mavx2                 Let -O vectorize loops with AVX2 instead of SSE2\n"
+            "-no-cache              Compile every file, neither reading nor filling the compilation cache\n"
             "-O                     Use optimizations\n"
             "-print-ast, -a         Print the AST for debugging purposes\n"
-            "-S                     Stop after assembly generation\n"
+            "-project-build [file]  Build the project described by config.floralattr, or the given attributes file, recompiling only what changed\n"
+            "-S                     Stop after assembly generation, writing nasm source instead of an object file\n"
+            "-target <os>           Compile for 'linux' or 'macos' (defaults to the host)\n"
             "-use <lib>, -U<lib>    Link with the specified library (e.g. 'stl', 'C')\n"
             "-verbose, -v           Produce verbose (colored) output"
         );
         return;
     }
     
+    if (commandParser.projectBuild()) {
+        projectBuild(commandParser);
+        return;
+    }
+    
+    Cache cache { commandParser.noCache() ? "" : Cache::defaultDirectory(), Cache::defaultCapacity() };
+    if (commandParser.cacheStats() && commandParser.infiles().empty()) {
+        printCacheStats(cache);
+        return;
+    }
+    
     ON_VERBOSE title("floralc - The Floral Compiler");
     
     const std::string outfile { commandParser.outfile().first };
@@ -50,51 +70,69 @@ void driver(CommandParser& commandParser) {
     Timer t;
     t.reset();
     
-    _setup();
-    
     // Config
-    compiler.optimization = commandParser.optimization();
-    compiler._stackGuard = commandParser.stackGuard();
-    compiler.showTypeTrace(commandParser.typeTrace());
+    configure(compiler, commandParser);
     
-    int compileError {};
     std::set<std::string> libs;
     commandParser.initLibs(libs);
+    Intermediates intermediates { commandParser };
+    const unsigned jobs = commandParser.printNotRunCmds() ? 1 : commandParser.jobs();
     
+    // every translation unit gets a compiler of its own, so they can be compiled side by side
+    std::vector<CompileJob> compileJobs;
     for (auto &infile: commandParser.infiles()) {
         if (infile.second == CmdFileExt::floral) {
             ON_VERBOSE annotated("Compiling", infile.first);
-            compileError += (compile(infile, commandParser, compiler, libs) != 0);
+            compileJobs.push_back({ &infile });
+        }
+    }
+    parallel(compileJobs.size(), jobs, [&](size_t index) {
+        Compiler unit;
+        configure(unit, commandParser);
+        compile(compileJobs[index], commandParser, unit, intermediates, cache);
+    });
+    cache.finish();
+    if (commandParser.cacheStats()) printCacheStats(cache);
+    
+    // reported in input order once everything is done, rather than as each file finishes
+    int compileError {};
+    for (auto &job: compileJobs) {
+        report(job);
+        libs.insert(job.libs.begin(), job.libs.end());
+        compileError += (job.status != 0);
+        // the target is what a build system asked for: the object or assembly when kept, otherwise the executable
+        if (commandParser.writeDepfile() && job.status == 0 && !commandParser.printNotRunCmds()) {
+            writeDepfile(job, commandParser.justCompile() || commandParser.stopAtASM() ? job.infile->first : outfile, commandParser);
         }
     }
     
     ON_VERBOSE annotated("Target", outfile);
 
-    ON_VERBOSE note("Compiliation " + (compiler.hasErrors() || compileError ? "failed" : "finished in " + std::to_string(t.elapsed()) + " seconds"));
-    if (compiler.hasErrors() || compileError || commandParser.stopAtASM()) return;
+    ON_VERBOSE note("Compiliation " + (compileError ? "failed" : "finished in " + std::to_string(t.elapsed()) + " seconds"));
+    if (compileError || commandParser.stopAtASM()) return;
     
     ON_VERBOSE heading2("\nModifiers", (std::string)(commandParser.usingSTL() ? "[link standard lib] " : "") + (commandParser.usingCBridge() ? "[link C bridge] " : ""));
     
+    const bool usesC = !libs.empty() || std::any_of(commandParser.infiles().begin(), commandParser.infiles().end(), [](const CmdFile& infile) {
+        return infile.second == CmdFileExt::c;
+    });
+    std::vector<int> objfileErrors(commandParser.infiles().size());
+    parallel(commandParser.infiles().size(), jobs, [&](size_t index) {
+        objfileErrors[index] = make_objfile(commandParser.infiles()[index], compiler, commandParser, intermediates);
+    });
+    if (std::any_of(objfileErrors.begin(), objfileErrors.end(), [](int error) { return error != 0; })) return;
+    
     std::vector<std::string> objfiles {
-        FLORAL_RUNTIME(core)
+        expandHome(FLORAL_RUNTIME(core))
     };
     for (auto &lib: libs) {
-        objfiles.push_back(liblocFromName(lib));
+        objfiles.push_back(expandHome(liblocFromName(lib)));
     }
     for (auto &infile: commandParser.infiles()) {
-        make_objfile(objfiles, infile, compiler, commandParser);
+        if (infile.second == CmdFileExt::object) objfiles.push_back(infile.first);
     }
     
     if (commandParser.justCompile()) return;
     
-    std::string link_exec_cmd {
-        "ld -o " + outfile
-    };
-    for (auto objf: objfiles) {
-        link_exec_cmd += ' ' + objf;
-    }
-    link_exec_cmd += " -lSystem";
-    execute(link_exec_cmd, commandParser);
-    
-    _free();
+    link(objfiles, outfile, compiler._target, usesC, commandParser);
 }
@@ -15,7 +15,12 @@
 #include "File IO.hpp"
 #include "Lexer.hpp"
 #include "Parser.hpp"
+#include "Cache.hpp"
+#include "Floral.hpp"
 #include <set>
+#include <vector>
+#include <mutex>
+#include <functional>
 using namespace Floral;
 
 void title(const std::string& str);
@@ -23,10 +28,48 @@ void heading(const std::string& str);
 void heading2(const std::string& h, const std::string& str);
 void note(const std::string& str);
 void annotated(const std::string& caption, const std::string& content);
-void execute(const std::string& cmd, const CommandParser& cmdParser);
+int execute(const std::vector<std::string>& args, const CommandParser& cmdParser);
 void print(const std::string& str);
 
-int compile(CmdFile& infile, const CommandParser& cmdParser, Compiler& compiler, std::set<std::string>& libs);
-void make_objfile(std::vector<std::string>& objfiles, CmdFile& infile, const Compiler& compiler, const CommandParser& cmdParser);
+// Where files passed between compilation steps go: next to their sources when -c, -S or -open-asm asks for
+// them, otherwise in a temporary directory, on tmpfs where there is one, that is removed afterwards
+class Intermediates {
+    std::string _directory;
+    std::vector<std::string> _files;
+    bool _isKept;
+    bool _isPersistent {};
+    std::mutex _mutex; // taken by workers naming their outputs
+public:
+    Intermediates(const CommandParser& cmdParser);
+    Intermediates(const std::string& directory); // a build directory kept between runs, with files named after their sources
+    ~Intermediates();
+    std::string path(const std::string& source, const std::string& extension);
+};
+
+// A source file on its way to an object file. Workers fill in its diagnostics, which the driver prints in
+// input order once they are done.
+struct CompileJob {
+    CmdFile* infile;
+    std::string path; // the source as given, since infile comes to name its output
+    std::string source; // preprocessed, which the diagnostics point into
+    std::vector<Error> diagnostics;
+    bool isAnalyzed {}; // the diagnostics come from the analyzer and compiler rather than the front end
+    std::string failure; // a problem outside of the source itself, such as a missing file
+    std::vector<std::string> includes; // files the preprocessor read for it
+    std::set<std::string> libs;
+    int status {};
+};
+void configure(Compiler& compiler, const CommandParser& cmdParser);
+void parallel(size_t count, unsigned jobs, const std::function<void(size_t)>& work);
+
+std::string codegenFlags(const Compiler& compiler);
+int compile(CompileJob& job, const CommandParser& cmdParser, Compiler& compiler, Intermediates& intermediates, Cache& cache);
+void printCacheStats(const Cache& cache);
+void report(const CompileJob& job);
+void writeDepfile(const CompileJob& job, const std::string& target, const CommandParser& cmdParser);
+int make_objfile(CmdFile& infile, const Compiler& compiler, const CommandParser& cmdParser, Intermediates& intermediates);
+int link(const std::vector<std::string>& objfiles, const std::string& outfile, Target target, bool usesC, const CommandParser& cmdParser);
+
+void projectBuild(const CommandParser& cmdParser);
 
 #endif /* test_hpp */
@@ -7,6 +7,14 @@
 //
 
 #include "driver.hpp"
+#include "SHA256.hpp"
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <thread>
+#include <atomic>
+extern char** environ;
 ColoredStream out(std::cout);
 
 void title(const std::string& str) {
@@ -29,139 +37,264 @@ void annotated(const std::string& caption, const std::string& content) {
     out << Color::cyan << caption << ": " << Color::reset << content << '\n';
 }
 
-void execute(const std::string& cmd, const CommandParser& cmdParser) {
-    if (cmdParser.printNotRunCmds()) {
-        annotated("Command", cmd);
-        return;
+int execute(const std::vector<std::string>& args, const CommandParser& cmdParser) {
+    std::string cmd;
+    for (auto &arg: args) {
+        if (!cmd.empty()) cmd.push_back(' ');
+        cmd += arg.find(' ') == std::string::npos ? arg : '\"' + arg + '\"';
+    }
+    {
+        static std::mutex printing; // tools may be started from several workers at once
+        std::lock_guard<std::mutex> lock { printing };
+        if (cmdParser.printNotRunCmds()) {
+            annotated("Command", cmd);
+            return 0;
+        }
+        if (cmdParser.isVerbose()) {
+            annotated("Executing", cmd);
+        }
     }
-    if (cmdParser.isVerbose()) {
-        annotated("Executing", cmd);
+    // spawned directly rather than through system(), which starts a shell for every step
+    std::vector<char*> argv;
+    for (auto &arg: args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
     }
-    system(cmd.c_str());
+    argv.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+        std::cout << "Unable to run " << args[0] << '\n';
+        return 1;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return 1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
 }
 
-void print(const std::string& str) {
-    out << str;
+Intermediates::Intermediates(const CommandParser& cmdParser): _isKept(cmdParser.justCompile() || cmdParser.stopAtASM() || cmdParser.openASM()) {}
+Intermediates::Intermediates(const std::string& directory): _directory(directory), _isKept(false), _isPersistent(true) {}
+Intermediates::~Intermediates() {
+    for (auto &file: _files) {
+        unlink(file.c_str());
+    }
+    if (!_directory.empty() && !_isPersistent) rmdir(_directory.c_str());
 }
-
-int compile(CmdFile& infile, const CommandParser& cmdParser, Compiler& compiler, std::set<std::string>& libs) {
-    if (cmdParser.printNotRunCmds()) {
-        while (infile.first.back() != '.') {
-            infile.first.pop_back();
-        }
-        infile.first.pop_back();
-        infile.first += ".nasm";
-        infile.second = CmdFileExt::nasm;
-        annotated("Generate", infile.first);
-        if (cmdParser.openASM()) {
-            execute("open -a /Applications/Atom.app \"" + infile.first + '\"', cmdParser);
-        }
-        return 0;
+std::string Intermediates::path(const std::string& source, const std::string& extension) {
+    std::string stem { source.substr(0, source.rfind('.')) };
+    if (_isKept) return stem + extension;
+    if (_isPersistent) {
+        if (stem.compare(0, _directory.size() + 1, _directory + '/') == 0) return stem + extension; // already one of ours
+        // the same name each build, and distinct for sources of one name in different folders
+        return _directory + '/' + stem.substr(stem.rfind('/') + 1) + '-' + SHA256().update(source).hex().substr(0, 8) + extension;
     }
-    
-    std::string result {'\n'};
-    read(infile.first, result);
-    if (result.empty()) {
-        std::cout << "Unable to locate file at path\n";
-        return 1;
+    std::lock_guard<std::mutex> lock { _mutex };
+    if (_directory.empty()) {
+        const char* tmpdir = getenv("TMPDIR");
+        std::string pattern { access("/dev/shm", W_OK) == 0 ? "/dev/shm" : tmpdir ? tmpdir : "/tmp" };
+        if (pattern.back() == '/') pattern.pop_back();
+        pattern += "/floralc.XXXXXX";
+        if (!mkdtemp(pattern.data())) return stem + extension; // no temporary directory, so fall back to beside the source
+        _directory = pattern;
     }
+    // numbered, since sources in different directories may share a name
+    stem.erase(0, stem.rfind('/') + 1);
+    _files.push_back(_directory + '/' + std::to_string(_files.size()) + '_' + stem + extension);
+    return _files.back();
+}
 
-    // Lexing
-    v2::Lexer lexer { result, infile.first, cmdParser };
+void print(const std::string& str) {
+    out << str;
+}
 
-    // Tokens into vector
-    std::vector<Token> tokens {lexer.lex()};
-    //for (const auto &tkn: tokens) tkn.print();
-    result = lexer.preprocessor().source();
-    if (cmdParser.catSource()) {
-        std::cout << result << '\n';
-    }
+void configure(Compiler& compiler, const CommandParser& cmdParser) {
+    compiler.optimization = cmdParser.optimization();
+    compiler._stackGuard = cmdParser.stackGuard();
+    compiler._avx2 = cmdParser.avx2();
+    compiler._stackProbe = cmdParser.stackProbe();
+    compiler._target = cmdParser.target();
+    compiler._emitAssembly = cmdParser.stopAtASM() || cmdParser.openASM() || compiler._target == Target::macOS; // the encoder only writes ELF64, so Mach-O goes through nasm
+    compiler.showTypeTrace(cmdParser.typeTrace());
+}
 
-    if (lexer.hasErrors()) {
-        for (auto &error: lexer.errors()) {
-            error.print(result);
+void parallel(size_t count, unsigned jobs, const std::function<void(size_t)>& work) {
+    std::atomic<size_t> next {};
+    auto worker = [&]() {
+        for (size_t index; (index = next++) < count;) {
+            work(index);
         }
-        return 1;
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < std::min<size_t>(jobs, count); i++) {
+        workers.emplace_back(worker);
+    }
+    worker(); // this thread takes a share too
+    for (auto &thread: workers) {
+        thread.join();
     }
+}
 
-    // Parsing
-    Parser parser { tokens };
-    parser.setPath(infile.first);
-    File *file { parser.parse() };
-    if (!file) return 1;
+// Everything besides the source that changes what the compiler writes
+std::string codegenFlags(const Compiler& compiler) {
+    return "-O" + std::to_string(compiler.optimization) + (compiler._stackGuard ? " -g" : "") + (compiler._stackProbe ? " -stack-probe" : "") + (compiler._avx2 ? " -mavx2" : "") + (compiler._target == Target::macOS ? " -target macos" : " -target linux") + (compiler._emitAssembly ? " -S" : "");
+}
 
-    if (parser.hasErrors()) {
-        for (auto &error: parser.errors()) {
-            error.print(result);
+int compile(CompileJob& job, const CommandParser& cmdParser, Compiler& compiler, Intermediates& intermediates, Cache& cache) {
+    CmdFile& infile = *job.infile;
+    job.path = infile.first;
+    job.status = 1;
+    if (cmdParser.printNotRunCmds()) {
+        infile.first = intermediates.path(infile.first, compiler._emitAssembly ? ".nasm" : ".o");
+        infile.second = compiler._emitAssembly ? CmdFileExt::nasm : CmdFileExt::object;
+        annotated("Generate", infile.first);
+        if (cmdParser.openASM()) {
+            execute({ "open", "-a", "/Applications/Atom.app", infile.first }, cmdParser);
         }
-        return 1;
+        return job.status = 0;
     }
-
-    for (auto &use: parser.use()) {
-        switch (use) {
-            case Use::stl:
-                libs.insert("stl");
-                break;
-            case Use::libc:
-                libs.insert("libc");
-                break;
-            default:
-                break;
-        }
+    
+    std::string source;
+    read(infile.first, source);
+    if (source.empty()) {
+        job.failure = "Unable to locate file at path";
+        return job.status;
     }
-
-    if (cmdParser.logDebugInfo()) {
+    
+    // the compiler encodes the object file itself unless the assembly was asked for
+    const std::string path { infile.first };
+    infile.first = intermediates.path(path, compiler._emitAssembly ? ".nasm" : ".o");
+    infile.second = compiler._emitAssembly ? CmdFileExt::nasm : CmdFileExt::object;
+    
+    // A source whose text and headers are unchanged needs no compiling, unless its AST or type trace is to be shown
+    const bool isCached = cache.isUsable() && !cmdParser.logDebugInfo() && !cmdParser.typeTrace();
+    std::string key;
+    Cache::Entry entry;
+    bool isHit {};
+    CompileHooks hooks;
+    hooks.preprocessed = [&](const CompileResult& preprocessed) {
+        if (cmdParser.catSource()) {
+            std::cout << preprocessed.source << '\n';
+        }
+        if (!isCached) return true;
+        key = cache.key(preprocessed.source, preprocessed.includes, codegenFlags(compiler));
+        isHit = cache.lookup(key, entry);
+        return !isHit;
+    };
+    hooks.parsed = [&](const File* file) {
+        if (!cmdParser.logDebugInfo()) return;
         // View file node
         out << Color::blue << Color::bold << "AST Info" << Color::reset << "\n--------\n" << Color::cyan << "";
         file->print();
         file->dump();
-    }
-
-    // Compiling
-    compiler.setSource(result);
-    compiler.setPath(infile.first);
-
-    while (infile.first.back() != '.') {
-        infile.first.pop_back();
-    }
-    infile.first.pop_back();
-    infile.first += ".nasm";
-    infile.second = CmdFileExt::nasm;
-
-    compiler.setOutputDestination(infile.first);
-    compiler.compile(file);
+    };
+    compiler.setOutputDestination(isCached ? "" : infile.first); // kept in memory when it is to be cached too
+    const CompileResult result { Floral::compile(source, path, compiler, hooks) };
+    job.source = result.source;
+    job.includes = result.includes;
+    job.isAnalyzed = result.isAnalyzed;
+    for (auto &diagnostic: result.diagnostics) job.diagnostics.push_back(diagnostic);
     
-    if (compiler.hasErrors()) {
-        for (auto &error: compiler.errors()) {
-            error.print(result);
+    if (isHit) {
+        write(infile.first, entry.output);
+        job.libs = entry.libs;
+        job.isAnalyzed = true;
+        for (auto &diagnostic: entry.diagnostics) {
+            diagnostic.path = path;
+            job.diagnostics.push_back(diagnostic);
+        }
+    } else if (!result.succeeded) {
+        return job.status;
+    } else {
+        job.libs = result.libs;
+        if (isCached) {
+            entry.output = compiler._emitAssembly ? result.assembly : result.object;
+            entry.libs = job.libs;
+            for (auto &warning: result.diagnostics) entry.diagnostics.push_back(warning);
+            write(infile.first, entry.output);
+            cache.store(key, entry);
         }
-        dealloc(file);
-        return 1;
     }
+    
     if (cmdParser.openASM()) {
-        execute("open -a /Applications/Atom.app \"" + infile.first + '\"', cmdParser);
+        execute({ "open", "-a", "/Applications/Atom.app", infile.first }, cmdParser);
     }
+    return job.status = 0;
+}
 
-    // Delete dynamically allocated memory
-    dealloc(file);
+void printCacheStats(const Cache& cache) {
+    const Cache::Stats stats { cache.stats() };
+    const auto megabytes = [](uint64_t bytes) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.1f MB", bytes / 1048576.0);
+        return std::string(text);
+    };
+    const uint64_t lookups = stats.hits + stats.misses;
+    annotated("Cache", cache.isUsable() ? cache.directory() : "disabled");
+    annotated("Entries", std::to_string(stats.entries) + " (" + megabytes(stats.size) + " of " + megabytes(stats.capacity) + ")");
+    annotated("Hits", std::to_string(stats.hits) + ", misses: " + std::to_string(stats.misses) + (lookups ? " (" + std::to_string(stats.hits * 100 / lookups) + "% hit rate)" : ""));
+}
 
-    return 0;
+void report(const CompileJob& job) {
+    if (!job.failure.empty()) {
+        std::cout << job.failure << '\n';
+    }
+    if (job.isAnalyzed && !job.diagnostics.empty()) {
+        ColoredStream out(std::cerr);
+        out << Color::blue << Color::bold << "Analyzer Output" << Color::reset << "\n---------------\n";
+    }
+    for (auto &diagnostic: job.diagnostics) {
+        diagnostic.print(job.source);
+    }
 }
 
-void make_objfile(std::vector<std::string>& objfiles, CmdFile& infile, const Compiler& compiler, const CommandParser& cmdParser) {
+// Make syntax, which Ninja reads too: `target: source headers...`, with spaces, # and $ escaped
+static std::string depfileEscaped(const std::string& path) {
+    std::string escaped;
+    for (char c: path) {
+        if (c == ' ' || c == '#') escaped += '\\';
+        if (c == '$') escaped += '$';
+        escaped += c;
+    }
+    return escaped;
+}
+void writeDepfile(const CompileJob& job, const std::string& target, const CommandParser& cmdParser) {
+    const std::string depfile { cmdParser.depfile().empty() ? job.path.substr(0, job.path.rfind('.')) + ".d" : cmdParser.depfile() };
+    std::string contents { depfileEscaped(target) + ": " + depfileEscaped(job.path) };
+    std::set<std::string> listed;
+    for (auto &include: job.includes) {
+        if (listed.insert(include).second) contents += " \\\n  " + depfileEscaped(include); // headers guarded against a second inclusion are still read twice
+    }
+    contents += '\n';
+    write(depfile, contents);
+}
+
+int make_objfile(CmdFile& infile, const Compiler& compiler, const CommandParser& cmdParser, Intermediates& intermediates) {
     if (infile.second == CmdFileExt::nasm) {
-        std::string objfile { infile.first };
-        objfile.erase(objfile.end() - 4, objfile.end());
-        objfile.push_back('o');
-        execute("/usr/local/bin/nasm -f macho64 -o \"" + objfile + "\" \"" + infile.first + '\"', cmdParser);
-        objfiles.push_back('\"' + objfile + '\"');
+        const std::string objfile { intermediates.path(infile.first, ".o") };
+        const bool isMachO = compiler._target == Target::macOS;
+        if (execute({ isMachO ? "/usr/local/bin/nasm" : "nasm", "-f", isMachO ? "macho64" : "elf64", "-o", objfile, infile.first }, cmdParser) != 0) return 1;
         infile.first = objfile;
         infile.second = CmdFileExt::object;
     } else if (infile.second == CmdFileExt::c) {
-        execute("gcc -c \"" + infile.first + " \"-O" + std::to_string(compiler.optimization), cmdParser);
-        infile.first.pop_back();
-        infile.first.push_back('o');
-        infile.first = '\"' + infile.first + '\"';
+        const std::string objfile { intermediates.path(infile.first, ".o") };
+        if (execute({ "gcc", "-c", infile.first, "-O" + std::to_string(compiler.optimization), "-o", objfile }, cmdParser) != 0) return 1;
+        infile.first = objfile;
         infile.second = CmdFileExt::object;
     }
+    return 0;
+}
+
+int link(const std::vector<std::string>& objfiles, const std::string& outfile, Target target, bool usesC, const CommandParser& cmdParser) {
+    std::vector<std::string> link_exec_cmd {
+        "ld", "-o", outfile
+    };
+    link_exec_cmd.insert(link_exec_cmd.end(), objfiles.begin(), objfiles.end());
+    if (target == Target::macOS) {
+        link_exec_cmd.push_back("-lSystem");
+    } else if (usesC) {
+        link_exec_cmd.insert(link_exec_cmd.end(), { "-lc", "-dynamic-linker", "/lib64/ld-linux-x86-64.so.2" });
+    } else {
+        link_exec_cmd.push_back("-static"); // only the Floral runtime, so no libc or dynamic loader to start up
+    }
+    return execute(link_exec_cmd, cmdParser);
 }
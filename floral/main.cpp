@@ -26,15 +26,14 @@ int main(int argc, const char* argv[]) {
     Floral::CommandParser commandParser (
         { argc, argv }
     );
-    //driver(commandParser);
-
-    Token::invalid = new Token(TokenLoc::zero, TokenType::invalid, "");
-    std::string buffer;
-    read("/Users/ethanuppal/Library/Mobile Documents/com~apple~CloudDocs/Xcode Projects/floral/floral/proj/main.floral", buffer);
-    v2::Preprocessor preprocessor(buffer, "main.floral");
-    preprocessor.preprocess();
-    return_if_errors(preprocessor)
-    std::cout << preprocessor.preprocessedSource() << '\n';
+    driver(commandParser);
+    
+//    std::string buffer;
+//    read("/Users/ethanuppal/Library/Mobile Documents/com~apple~CloudDocs/Xcode Projects/floral/floral/proj/main.floral", buffer);
+//    v2::Preprocessor preprocessor(buffer, "main.floral");
+//    preprocessor.preprocess();
+//    return_if_errors(preprocessor)
+//    std::cout << preprocessor.preprocessedSource() << '\n';
 //    std::vector<Token> tokens = lexer.lex();
 //    for (const auto &tkn: tokens) tkn.print();
 //    return_if_errors(lexer);
@@ -46,6 +45,5 @@ int main(int argc, const char* argv[]) {
 //    file->print();
 //    file->dump();
     static_assert(alignof(int) == 4, "oh no!");
-    delete Token::invalid;
     return 0;
 }
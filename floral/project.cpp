@@ -0,0 +1,306 @@
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <algorithm> // ahead of Compiler.hpp, whose max macro it would trip over
+#include "driver.hpp"
+#include "SHA256.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PROJECT_INTERNAL "internal"
+#define PROJECT_OBJECTS PROJECT_INTERNAL "/objects"
+#define PROJECT_FILECHANGE PROJECT_INTERNAL "/filechange.txt"
+
+#define ON_VERBOSE if (cmdParser.isVerbose() && !cmdParser.printNotRunCmds())
+
+// MARK: Attributes
+// What config.floralattr describes: lines of `Name: "value";`, with `!` starting a comment
+struct Project {
+    std::string folder; // searched for sources, along with the folders inside it
+    std::string target; // the executable
+    std::vector<std::string> ignores; // files and folders whose names end in one of these are left out
+    std::string build { "Debug" }; // or "Release", which optimizes
+};
+
+static bool readAttributes(const std::string& path, Project& project) {
+    std::string source;
+    read(path, source);
+    if (source.empty()) {
+        std::cout << "Unable to locate project attributes at " << path << '\n';
+        return false;
+    }
+    const auto fail = [&](const std::string& text, size_t pos, size_t length, size_t line) {
+        Error error { Error::parseDomain, text, { pos, length, line, line }, { pos, length } };
+        error.path = path;
+        error.print(source);
+        return false;
+    };
+    size_t line {};
+    for (size_t start = 0, end; start < source.size(); start = end + 1) {
+        end = source.find('\n', start);
+        line++;
+        const std::string text { source.substr(start, source.find('!', start) < end ? source.find('!', start) - start : end - start) };
+        if (text.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        const size_t colon = text.find(':');
+        const size_t open = text.find('"', colon == std::string::npos ? 0 : colon);
+        const size_t close = open == std::string::npos ? open : text.find('"', open + 1);
+        if (colon == std::string::npos || close == std::string::npos || text.find(';', close) == std::string::npos) {
+            return fail("Expected an attribute of the form Name: \"value\";", start, text.size(), line);
+        }
+        std::string name { text.substr(0, colon) };
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        const std::string value { text.substr(open + 1, close - open - 1) };
+        if (name == "Folder") {
+            project.folder = value;
+        } else if (name == "Target") {
+            project.target = value;
+        } else if (name == "Ignore") {
+            project.ignores.push_back(value);
+        } else if (name == "Build") {
+            if (value != "Debug" && value != "Release") return fail("Unknown build, use \"Debug\" or \"Release\"", start + open, value.size() + 2, line);
+            project.build = value;
+        } // others, such as Version, describe the project without changing how it is built
+    }
+    if (project.folder.empty() || project.target.empty()) {
+        std::cout << path << " needs both a Folder and a Target attribute\n";
+        return false;
+    }
+    return true;
+}
+
+static bool isIgnored(const std::string& name, const Project& project) {
+    return std::any_of(project.ignores.begin(), project.ignores.end(), [&name](const std::string& ignore) {
+        return ends_with(name, ignore);
+    });
+}
+static void findSources(const std::string& folder, const Project& project, std::vector<std::string>& sources) {
+    DIR* dir = opendir(folder.c_str());
+    if (!dir) return;
+    while (dirent* item = readdir(dir)) {
+        const std::string name { item->d_name };
+        if (name.front() == '.' || isIgnored(name, project)) continue;
+        const std::string path { folder + '/' + name };
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) continue;
+        if (S_ISDIR(info.st_mode)) {
+            findSources(path, project, sources);
+        } else if (ends_with(name, ".floral") || ends_with(name, ".c")) {
+            sources.push_back(path);
+        }
+    }
+    closedir(dir);
+}
+
+// MARK: Change tracking
+// A file as it was when its translation unit was last built. Matching size and modification time are taken
+// to mean it is unchanged; otherwise its contents decide, so touching a file rebuilds nothing.
+struct FileState {
+    std::string path;
+    long long size;
+    long long modified; // in nanoseconds
+    std::string hash;
+};
+struct UnitRecord {
+    std::string object;
+    std::set<std::string> libs;
+    std::vector<FileState> files; // the source, then everything it includes
+};
+
+static bool statFile(const std::string& path, FileState& state) {
+    struct stat info;
+    if (stat(expandHome(path).c_str(), &info) != 0) return false;
+    state.path = path;
+    state.size = info.st_size;
+#ifdef __APPLE__
+    state.modified = info.st_mtimespec.tv_sec * 1000000000ll + info.st_mtimespec.tv_nsec;
+#else
+    state.modified = info.st_mtim.tv_sec * 1000000000ll + info.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+static std::string hashFile(const std::string& path) {
+    std::ifstream file { expandHome(path), std::ios::binary };
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return SHA256().update(contents.str()).hex();
+}
+static bool isUpToDate(UnitRecord& record) {
+    if (access(record.object.c_str(), R_OK) != 0) return false;
+    for (auto &file: record.files) {
+        FileState now;
+        if (!statFile(file.path, now)) return false;
+        if (now.size == file.size && now.modified == file.modified) continue;
+        if (now.size != file.size || hashFile(file.path) != file.hash) return false;
+        file.modified = now.modified; // only touched, so the next build need not read it again
+    }
+    return true;
+}
+
+// internal/filechange.txt: the code generation flags, then each unit as `unit`, `object`, `lib` and `file` lines.
+// Paths come last on their line, so they may hold spaces.
+static std::map<std::string, UnitRecord> readRecords(const std::string& path, const std::string& flags) {
+    std::map<std::string, UnitRecord> records;
+    std::ifstream file { path };
+    std::string line;
+    if (!getline(file, line) || line != "flags " + flags) return records; // built differently before, so nothing is reusable
+    UnitRecord* unit = nullptr;
+    while (getline(file, line)) {
+        const size_t space = line.find(' ');
+        const std::string kind { line.substr(0, space) };
+        const std::string rest { space == std::string::npos ? "" : line.substr(space + 1) };
+        if (kind == "unit") {
+            unit = &records[rest];
+        } else if (!unit) {
+            break;
+        } else if (kind == "object") {
+            unit->object = rest;
+        } else if (kind == "lib") {
+            unit->libs.insert(rest);
+        } else if (kind == "file") {
+            std::istringstream fields { rest };
+            FileState state;
+            fields >> state.size >> state.modified >> state.hash;
+            fields.get();
+            getline(fields, state.path);
+            unit->files.push_back(state);
+        }
+    }
+    return records;
+}
+static void writeRecords(const std::string& path, const std::string& flags, const std::map<std::string, UnitRecord>& records) {
+    std::ostringstream out;
+    out << "flags " << flags << '\n';
+    for (auto &pair: records) {
+        out << "unit " << pair.first << "\nobject " << pair.second.object << '\n';
+        for (auto &lib: pair.second.libs) out << "lib " << lib << '\n';
+        for (auto &file: pair.second.files) out << "file " << file.size << ' ' << file.modified << ' ' << file.hash << ' ' << file.path << '\n';
+    }
+    write(path, out.str());
+}
+static UnitRecord recordUnit(const std::string& object, const std::set<std::string>& libs, const std::string& source, const std::vector<std::string>& includes) {
+    UnitRecord record { object, libs, {} };
+    std::vector<std::string> paths { source };
+    paths.insert(paths.end(), includes.begin(), includes.end());
+    for (auto &path: paths) {
+        FileState state { path, -1, -1, "" }; // a file that cannot be read now never matches, so it is looked at again
+        if (statFile(path, state)) state.hash = hashFile(path);
+        record.files.push_back(state);
+    }
+    return record;
+}
+
+// MARK: Building
+void projectBuild(const CommandParser& cmdParser) {
+    const std::string& attributes { cmdParser.projectFile() };
+    Project project;
+    if (!readAttributes(attributes, project)) return;
+
+    // internal/ lives beside the attributes file, while the attributes name paths from the current directory
+    const size_t slash = attributes.rfind('/');
+    const std::string base { slash == std::string::npos ? "." : attributes.substr(0, slash) };
+
+    Compiler compiler;
+    configure(compiler, cmdParser);
+    if (project.build == "Release" && !compiler.optimization) compiler.optimization = 1;
+    const std::string flags { codegenFlags(compiler) };
+    const std::string filechange { base + "/" PROJECT_FILECHANGE };
+    std::map<std::string, UnitRecord> records { readRecords(filechange, flags) };
+
+    std::vector<std::string> sources;
+    findSources(project.folder, project, sources);
+    std::sort(sources.begin(), sources.end()); // linked in the same order every time
+    if (sources.empty()) {
+        std::cout << "No .floral or .c files in " << project.folder << '\n';
+        return;
+    }
+    if (!makeDirectories(base + "/" PROJECT_OBJECTS)) {
+        std::cout << "Unable to create " << base << "/" PROJECT_OBJECTS << '\n';
+        return;
+    }
+
+    // Units whose sources are gone take their objects with them
+    bool isRelinked = access(project.target.c_str(), X_OK) != 0;
+    for (auto iter = records.begin(); iter != records.end();) {
+        if (std::binary_search(sources.begin(), sources.end(), iter->first)) {
+            iter++;
+            continue;
+        }
+        unlink(iter->second.object.c_str());
+        iter = records.erase(iter);
+        isRelinked = true;
+    }
+
+    std::vector<std::string> dirtySources;
+    for (auto &source: sources) {
+        auto record = records.find(source);
+        if (record == records.end() || !isUpToDate(record->second)) dirtySources.push_back(source);
+    }
+    ON_VERBOSE annotated("Project", std::to_string(dirtySources.size()) + " of " + std::to_string(sources.size()) + " files to rebuild");
+
+    // each becomes its object file as it is built
+    std::vector<CmdFile> dirty;
+    for (auto &source: dirtySources) {
+        dirty.push_back({ source, ends_with(source, ".c") ? CmdFileExt::c : CmdFileExt::floral });
+    }
+    Intermediates intermediates { base + "/" PROJECT_OBJECTS };
+    Cache cache { cmdParser.noCache() ? "" : Cache::defaultDirectory(), Cache::defaultCapacity() };
+    const unsigned jobs = cmdParser.printNotRunCmds() ? 1 : cmdParser.jobs();
+    std::vector<CompileJob> compileJobs(dirty.size());
+    for (size_t i = 0; i < dirty.size(); i++) {
+        compileJobs[i].infile = &dirty[i];
+    }
+    parallel(dirty.size(), jobs, [&](size_t index) {
+        CompileJob& job = compileJobs[index];
+        if (job.infile->second == CmdFileExt::floral) {
+            ON_VERBOSE annotated("Compiling", job.infile->first);
+            Compiler unit;
+            configure(unit, cmdParser);
+            unit.optimization = compiler.optimization;
+            if (compile(job, cmdParser, unit, intermediates, cache) != 0) return;
+        }
+        job.status = make_objfile(*job.infile, compiler, cmdParser, intermediates);
+    });
+    cache.finish();
+    if (cmdParser.printNotRunCmds()) return;
+
+    // A unit that failed is forgotten, so the next build tries it again
+    bool hasFailed {};
+    for (size_t i = 0; i < dirty.size(); i++) {
+        report(compileJobs[i]);
+        if (compileJobs[i].status != 0) {
+            records.erase(dirtySources[i]);
+            hasFailed = true;
+            continue;
+        }
+        records[dirtySources[i]] = recordUnit(dirty[i].first, compileJobs[i].libs, dirtySources[i], compileJobs[i].includes);
+        isRelinked = true;
+    }
+    writeRecords(filechange, flags, records);
+    if (hasFailed || !isRelinked) {
+        ON_VERBOSE note(hasFailed ? "Build failed" : project.target + " is up to date");
+        return;
+    }
+
+    std::set<std::string> libs;
+    cmdParser.initLibs(libs);
+    std::vector<std::string> objfiles {
+        expandHome(FLORAL_RUNTIME(core))
+    };
+    bool usesC = false;
+    for (auto &source: sources) {
+        const UnitRecord& record = records.at(source);
+        libs.insert(record.libs.begin(), record.libs.end());
+        usesC |= ends_with(source, ".c");
+    }
+    for (auto &lib: libs) {
+        objfiles.push_back(expandHome(liblocFromName(lib)));
+    }
+    for (auto &source: sources) {
+        objfiles.push_back(records.at(source).object);
+    }
+    ON_VERBOSE annotated("Target", project.target);
+    link(objfiles, project.target, compiler._target, usesC || !libs.empty(), cmdParser);
+}
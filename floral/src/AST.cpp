@@ -163,8 +163,8 @@ namespace Floral {
         return true;
     }
     #define REPLACE_BIT(v, b, i)\
-        (v) |= (1 << (i));\
-        (v) &= ((b) << (i))
+        (v) &= ~(1 << (i));\
+        (v) |= ((b) ? 1 : 0) << (i)
     const Function::AttributeStorage Function::isStatic() const {
         return _attributes & (1 << static_);
     }
@@ -183,6 +183,12 @@ namespace Floral {
     void Function::setUseRegAllocOnly(AttributeStorage bit) {
         REPLACE_BIT(_attributes, bit, onlyReg);
     }
+    const Function::AttributeStorage Function::isConstEval() const {
+        return _attributes & (1 << constEval);
+    }
+    void Function::setConstEval(AttributeStorage bit) {
+        REPLACE_BIT(_attributes, bit, constEval);
+    }
 
 const std::optional<std::string>& deprecationWarning();
     FunctionForwardDeclaration::FunctionForwardDeclaration(TextRegion loc, const Token& name, const Function::Parameters& parameters, Type* returnType): Declaration(loc), _name(name), _parameters(parameters), _retType(returnType) {}
@@ -337,7 +343,7 @@ const std::optional<std::string>& deprecationWarning();
                 if (var->name().contents == memberName) {
                     break;
                 }
-                offset -= var->type()->size();
+                offset -= (var->type()->size() + 7) & -8; // members take whole slots, as in Type::size()
             }
             index++;
         }
@@ -677,6 +683,8 @@ const std::optional<std::string>& deprecationWarning();
     }
     size_t OperatorComponentExpression::precedence(const OperatorMode mode) const {
         switch (_op.type) {
+            case TokenType::bool_or: return 4;
+            case TokenType::bool_and: return 6;
             case TokenType::equal:
             case TokenType::unequal: return 10;
             case TokenType::less:
@@ -686,7 +694,8 @@ const std::optional<std::string>& deprecationWarning();
             case TokenType::plus:
             case TokenType::minus: return mode != infix ? 60 : 40;
             case TokenType::multiply: if (mode == prefix) return 70;
-            case TokenType::divide: return 50;
+            case TokenType::divide:
+            case TokenType::modulus: return 50;
             case TokenType::leftBracket:
             case TokenType::inc:
             case TokenType::dec: return 60;
@@ -789,8 +798,8 @@ const std::optional<std::string>& deprecationWarning();
     Expression* UnsafeCast::expr() const {
         return _expr;
     }
-    ConstructExpression::ConstructExpression(TextRegion loc, const Token& name, const std::vector<Expression*>& args, Mode mode): Expression(loc), _name(name), _args(args), _mode(mode) {
-        _struct = new Type(0, name.contents);
+    ConstructExpression::ConstructExpression(TextRegion loc, const Token& name, StructDeclaration* struct_, const std::vector<Expression*>& args, Mode mode): Expression(loc), _name(name), _args(args), _mode(mode) {
+        _struct = new Type(struct_);
     }
     ConstructExpression::~ConstructExpression() {
         for (auto arg: _args) delete arg;
@@ -102,7 +102,8 @@ namespace Floral {
         enum Attributes {
             static_ = 0,
             inline_,
-            onlyReg
+            onlyReg,
+            constEval
         };
         
         #define __cat(x, y) x ## y
@@ -140,6 +141,8 @@ namespace Floral {
         void setInline(AttributeStorage bit);
         const AttributeStorage useRegAllocOnly() const;
         void setUseRegAllocOnly(AttributeStorage bit);
+        const AttributeStorage isConstEval() const; // may be run at compile time, see Interpreter
+        void setConstEval(AttributeStorage bit);
 
         const std::optional<std::string>& deprecationWarning();
     };
@@ -527,7 +530,7 @@ namespace Floral {
         Type* _struct;
 
     public:
-        ConstructExpression(TextRegion loc, const Token& name, const std::vector<Expression*>& args, Mode mode);
+        ConstructExpression(TextRegion loc, const Token& name, StructDeclaration* struct_, const std::vector<Expression*>& args, Mode mode);
         ~ConstructExpression();
         
         virtual void print() const override;
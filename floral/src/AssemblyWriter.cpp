@@ -0,0 +1,32 @@
+#include "AssemblyWriter.hpp"
+#include "Instruction.hpp"
+
+namespace Floral {
+    AssemblyWriter::AssemblyWriter(): _stream(nullptr) {}
+    AssemblyWriter::AssemblyWriter(std::ostream& stream): _stream(&stream) {
+        _buffer.reserve(ASSEMBLY_BUFFER_SIZE + 4096); // room for the instruction that crosses the threshold
+    }
+    AssemblyWriter::~AssemblyWriter() {
+        flush();
+    }
+
+    AssemblyWriter& AssemblyWriter::offset(long long offset) {
+        if (offset > 0) _buffer.push_back('+');
+        if (offset) integer(offset);
+        return *this;
+    }
+    AssemblyWriter& AssemblyWriter::comment(const std::string& comment) {
+        if (NO_COMMENTS || comment.empty()) return *this;
+        _buffer.append(" ; ");
+        return *this << comment;
+    }
+
+    void AssemblyWriter::flush() {
+        if (!_stream || _buffer.empty()) return;
+        _stream->write(_buffer.data(), _buffer.size());
+        _buffer.clear(); // keeps its capacity for the next batch
+    }
+    const std::string& AssemblyWriter::text() const {
+        return _buffer;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef AssemblyWriter_hpp
+#define AssemblyWriter_hpp
+
+#include <string>
+#include <ostream>
+#include <charconv>
+
+#define ASSEMBLY_BUFFER_SIZE (1 << 20)
+
+namespace Floral {
+    // Renders nasm source into one reusable buffer, which is handed to the stream whenever it fills, so
+    // instructions append their pieces without building strings of their own. Without a stream the
+    // whole text is kept in memory instead.
+    class AssemblyWriter {
+        std::string _buffer;
+        std::ostream* _stream;
+
+        void drain() {
+            if (_stream && _buffer.size() >= ASSEMBLY_BUFFER_SIZE) flush();
+        }
+
+    public:
+        AssemblyWriter();
+        AssemblyWriter(std::ostream& stream);
+        ~AssemblyWriter();
+
+        AssemblyWriter& operator <<(const std::string& str) {
+            _buffer.append(str);
+            drain();
+            return *this;
+        }
+        AssemblyWriter& operator <<(const char* str) {
+            _buffer.append(str);
+            drain();
+            return *this;
+        }
+        AssemblyWriter& operator <<(char c) {
+            _buffer.push_back(c);
+            return *this;
+        }
+        template <typename Integer>
+        AssemblyWriter& integer(Integer value) {
+            char digits[24];
+            const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+            _buffer.append(digits, end - digits);
+            return *this;
+        }
+        AssemblyWriter& offset(long long offset); // +n or -n, nothing for 0
+        AssemblyWriter& comment(const std::string& comment); // ` ; comment`, unless there is none
+
+        void flush();
+        const std::string& text() const; // everything written, when there is no stream
+    };
+}
+
+#endif /* AssemblyWriter_hpp */
@@ -0,0 +1,234 @@
+#include "Cache.hpp"
+#include "SHA256.hpp"
+#include "File IO.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#define CACHE_STATS_FILE "stats"
+
+namespace Floral {
+    // MARK: Setup
+    static std::string executableIdentity() {
+        char path[4096] {};
+#ifdef __APPLE__
+        uint32_t size = sizeof(path);
+        if (_NSGetExecutablePath(path, &size) != 0) return "";
+#else
+        if (readlink("/proc/self/exe", path, sizeof(path) - 1) < 0) return "";
+#endif
+        struct stat info;
+        if (stat(path, &info) != 0) return "";
+        return std::to_string(info.st_size) + ' ' + std::to_string(info.st_mtime);
+    }
+
+    Cache::Cache(const std::string& directory, uint64_t capacity): _identity(FLORAL_VERSION " " + executableIdentity()), _capacity(capacity) {
+        if (!directory.empty() && makeDirectories(directory)) _directory = directory;
+    }
+    std::string Cache::defaultDirectory() {
+        if (const char* dir = getenv("FLORAL_CACHE_DIR")) return dir;
+        if (const char* xdg = getenv("XDG_CACHE_HOME")) return std::string(xdg) + "/floral";
+        if (const char* home = getenv("HOME")) return std::string(home) + "/.cache/floral";
+        return "";
+    }
+    uint64_t Cache::defaultCapacity() {
+        const char* size = getenv("FLORAL_CACHE_SIZE");
+        return (size ? strtoull(size, nullptr, 10) : CACHE_DEFAULT_CAPACITY) << 20;
+    }
+    bool Cache::isUsable() const {
+        return !_directory.empty();
+    }
+    const std::string& Cache::directory() const {
+        return _directory;
+    }
+
+    // MARK: Entries
+    std::string Cache::key(const std::string& source, const std::vector<std::string>& includes, const std::string& flags) const {
+        // the pieces are length-prefixed, so moving text from one into the next changes the key
+        SHA256 digest;
+        const auto update = [&digest](const std::string& piece) {
+            const uint64_t size = piece.size();
+            digest.update(&size, sizeof(size)).update(piece);
+        };
+        update(_identity);
+        update(flags);
+        update(source);
+        for (auto &include: includes) {
+            std::ifstream file { include, std::ios::binary };
+            std::stringstream contents;
+            if (file) contents << file.rdbuf();
+            update(include);
+            update(contents.str()); // a header can change what the source means without changing its expansion
+        }
+        return digest.hex();
+    }
+    std::string Cache::entryPath(const std::string& key) const {
+        return _directory + '/' + key;
+    }
+
+    bool Cache::lookup(const std::string& key, Entry& entry) {
+        if (!isUsable()) return false;
+        const std::string path { entryPath(key) };
+        std::ifstream file { path, std::ios::binary };
+        if (!file) {
+            _misses++;
+            return false;
+        }
+        std::stringstream contents;
+        contents << file.rdbuf();
+        
+        std::string magic;
+        size_t count;
+        std::istream& in = contents;
+        if (!(in >> magic) || magic != "floral-cache" || !(in >> count)) {
+            _misses++;
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            std::string lib;
+            in >> lib;
+            entry.libs.insert(lib);
+        }
+        in >> count;
+        for (size_t i = 0; i < count && in; i++) {
+            int domain, isWarning;
+            size_t pos, length, startLine, endLine, errpos, errlen, textSize, fixSize;
+            in >> domain >> isWarning >> pos >> length >> startLine >> endLine >> errpos >> errlen >> textSize >> fixSize;
+            in.get(); // the newline before the text
+            std::string text(textSize, '\0'), fix(fixSize, '\0');
+            in.read(text.data(), textSize);
+            in.read(fix.data(), fixSize);
+            Error error { static_cast<Error::Domain>(domain), text, { pos, length, startLine, endLine }, { errpos, errlen } };
+            error.isWarning = isWarning;
+            error.fix = fix;
+            entry.diagnostics.push_back(error);
+        }
+        size_t outputSize {};
+        in >> outputSize;
+        in.get();
+        entry.output.resize(outputSize);
+        if (!in.read(entry.output.data(), outputSize)) { // cut short, perhaps by a full disk
+            entry = {};
+            _misses++;
+            return false;
+        }
+        utimes(path.c_str(), nullptr); // most recently used
+        _hits++;
+        return true;
+    }
+
+    void Cache::store(const std::string& key, const Entry& entry) {
+        if (!isUsable()) return;
+        std::ostringstream out;
+        out << "floral-cache\n" << entry.libs.size() << '\n';
+        for (auto &lib: entry.libs) out << lib << '\n';
+        out << entry.diagnostics.size() << '\n';
+        for (auto &error: entry.diagnostics) {
+            out << error.domain << ' ' << error.isWarning << ' ' << error.location.pos << ' ' << error.location.length << ' ' << error.location.startLine << ' ' << error.location.endLine << ' ' << error.errloc.pos << ' ' << error.errloc.len << ' ' << error.text.size() << ' ' << error.fix.size() << '\n' << error.text << error.fix << '\n';
+        }
+        out << entry.output.size() << '\n' << entry.output;
+        
+        // written aside and renamed into place, so a concurrent lookup never sees half an entry
+        const std::string path { entryPath(key) };
+        const std::string temporary { path + '.' + std::to_string(getpid()) + '.' + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp" };
+        {
+            std::ofstream file { temporary, std::ios::binary };
+            const std::string contents { out.str() };
+            if (!file.write(contents.data(), contents.size())) return;
+        }
+        if (rename(temporary.c_str(), path.c_str()) != 0) unlink(temporary.c_str());
+    }
+
+    // MARK: Bookkeeping
+    struct CacheFile {
+        std::string path;
+        uint64_t size;
+        time_t used;
+    };
+    static std::vector<CacheFile> listEntries(const std::string& directory) {
+        std::vector<CacheFile> entries;
+        if (DIR* dir = opendir(directory.c_str())) {
+            while (dirent* item = readdir(dir)) {
+                const std::string name { item->d_name };
+                if (name.size() != 64 || name.find_first_not_of("0123456789abcdef") != std::string::npos) continue; // stats and files being written
+                struct stat info;
+                const std::string path { directory + '/' + name };
+                if (stat(path.c_str(), &info) == 0) entries.push_back({ path, static_cast<uint64_t>(info.st_size), info.st_mtime });
+            }
+            closedir(dir);
+        }
+        return entries;
+    }
+    static bool readCounts(int fd, uint64_t& hits, uint64_t& misses) {
+        char buffer[64] {};
+        if (pread(fd, buffer, sizeof(buffer) - 1, 0) < 0) return false;
+        unsigned long long storedHits {}, storedMisses {};
+        sscanf(buffer, "%llu %llu", &storedHits, &storedMisses);
+        hits = storedHits;
+        misses = storedMisses;
+        return true;
+    }
+
+    void Cache::finish() {
+        if (!isUsable()) return;
+        // other compilers may be finishing at the same time, so the totals are updated under a lock
+        const int fd = open((_directory + "/" CACHE_STATS_FILE).c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd >= 0) {
+            flock(fd, LOCK_EX);
+            uint64_t hits, misses;
+            if (readCounts(fd, hits, misses)) {
+                const std::string counts { std::to_string(hits + _hits.exchange(0)) + ' ' + std::to_string(misses + _misses.exchange(0)) + '\n' };
+                if (ftruncate(fd, 0) != 0 || pwrite(fd, counts.data(), counts.size(), 0) < 0) {
+                    unlink((_directory + "/" CACHE_STATS_FILE).c_str()); // better to start counting afresh than keep a torn count
+                }
+            }
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+        
+        std::vector<CacheFile> entries { listEntries(_directory) };
+        uint64_t size {};
+        for (auto &entry: entries) size += entry.size;
+        if (size <= _capacity) return;
+        std::sort(entries.begin(), entries.end(), [](const CacheFile& lhs, const CacheFile& rhs) {
+            return lhs.used < rhs.used;
+        });
+        for (auto &entry: entries) {
+            if (size <= _capacity * CACHE_TRIMMED_FRACTION) break;
+            if (unlink(entry.path.c_str()) == 0) size -= entry.size;
+        }
+    }
+
+    Cache::Stats Cache::stats() const {
+        Stats stats { 0, 0, _capacity, _hits, _misses };
+        if (!isUsable()) return stats;
+        for (auto &entry: listEntries(_directory)) {
+            stats.entries++;
+            stats.size += entry.size;
+        }
+        const int fd = open((_directory + "/" CACHE_STATS_FILE).c_str(), O_RDONLY);
+        if (fd >= 0) {
+            uint64_t hits, misses;
+            flock(fd, LOCK_SH);
+            if (readCounts(fd, hits, misses)) {
+                stats.hits += hits;
+                stats.misses += misses;
+            }
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+        return stats;
+    }
+}
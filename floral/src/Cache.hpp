@@ -0,0 +1,57 @@
+#ifndef Cache_hpp
+#define Cache_hpp
+
+#include <string>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <cstdint>
+#include "Error.hpp"
+
+#define FLORAL_VERSION "2.0"
+#define CACHE_DEFAULT_CAPACITY 256 // megabytes
+#define CACHE_TRIMMED_FRACTION 0.9 // eviction stops below this much of the capacity
+
+namespace Floral {
+    // Compiled modules kept on disk under a hash of their preprocessed source, the files it included, the
+    // compiler that built them and the flags that affect code generation, so an unchanged file is never compiled twice. Every entry is a
+    // single file; lookups touch it, and once the cache grows past its capacity the least recently used
+    // entries are removed.
+    class Cache {
+        std::string _directory; // empty when the cache could not be created
+        std::string _identity; // of this compiler, so a rebuilt one never reads an older one's output
+        uint64_t _capacity;
+        std::atomic<uint64_t> _hits {};
+        std::atomic<uint64_t> _misses {};
+        
+        std::string entryPath(const std::string& key) const;
+
+    public:
+        struct Entry {
+            std::string output; // the object file or nasm source
+            std::set<std::string> libs;
+            std::vector<Error> diagnostics; // warnings; failed compilations are never stored
+        };
+        struct Stats {
+            size_t entries;
+            uint64_t size;
+            uint64_t capacity;
+            uint64_t hits;
+            uint64_t misses;
+        };
+        
+        Cache(const std::string& directory, uint64_t capacity);
+        static std::string defaultDirectory(); // $FLORAL_CACHE_DIR, else floral under the user's cache directory
+        static uint64_t defaultCapacity(); // $FLORAL_CACHE_SIZE megabytes, else CACHE_DEFAULT_CAPACITY
+        
+        bool isUsable() const;
+        const std::string& directory() const;
+        std::string key(const std::string& source, const std::vector<std::string>& includes, const std::string& flags) const;
+        bool lookup(const std::string& key, Entry& entry);
+        void store(const std::string& key, const Entry& entry);
+        void finish(); // records this run's hits and misses, then evicts down to capacity
+        Stats stats() const;
+    };
+}
+
+#endif /* Cache_hpp */
@@ -7,6 +7,8 @@
 //
 
 #include "CommandParser.hpp"
+#include <thread>
+#include <algorithm>
 
 namespace Floral {
     std::unordered_map<std::string, std::string> libmap {
@@ -95,6 +97,54 @@ namespace Floral {
                     packed_options_0 |= (1 << _printNotRunCmds);
                 } else if (strncmp(arg + 1, "stack-guard", 12) == 0 || strncmp(arg + 1, "g", 2) == 0) {
                     packed_options_0 |= (1 << _stackGuard);
+                } else if (strncmp(arg + 1, "mavx2", 6) == 0) {
+                    packed_options_0 |= (1 << _avx2);
+                } else if (strncmp(arg + 1, "stack-probe", 12) == 0) {
+                    packed_options_0 |= (1 << _stackProbe);
+                } else if (strncmp(arg + 1, "no-cache", 9) == 0) {
+                    packed_options_0 |= (1 << _noCache);
+                } else if (strncmp(arg + 1, "cache-stats", 12) == 0) {
+                    packed_options_0 |= (1 << _cacheStats);
+                } else if (strncmp(arg + 1, "project-build", 14) == 0) {
+                    packed_options_0 |= (1 << _projectBuild);
+                    // the attributes file may follow, otherwise the one in the current directory is used
+                    if (command.argc > 1 && ends_with(command.argv[index + 1], ".floralattr")) {
+                        index++; command.argc--;
+                        _projectFile = command.argv[index];
+                    }
+                } else if (strncmp(arg + 1, "MD", 3) == 0) {
+                    packed_options_0 |= (1 << _writeDepfile);
+                } else if (strncmp(arg + 1, "MF", 3) == 0) {
+                    index++; command.argc--;
+                    if (!command.argv[index]) {
+                        report(Error::parseDomain, "Expected a file after -MF", "args", { 0, 0, 0, 0 }, { 0, 0 });
+                        break;
+                    }
+                    packed_options_0 |= (1 << _writeDepfile);
+                    _depfile = command.argv[index];
+                } else if (strncmp(arg + 1, "j", 1) == 0) {
+                    // -jN or -j N; with no count, one job per core
+                    const char* count = arg + 2;
+                    if (!*count && command.argc > 1 && isdigit(*command.argv[index + 1])) {
+                        index++; command.argc--;
+                        count = command.argv[index];
+                    }
+                    _jobs = atoi(count);
+                    if (!_jobs) _jobs = std::max(1u, std::thread::hardware_concurrency());
+                } else if (strncmp(arg + 1, "target", 7) == 0) {
+                    index++; command.argc--;
+                    const char* target = command.argv[index];
+                    if (!target) {
+                        report(Error::parseDomain, "Expected a target after -target", "args", { 0, 0, 0, 0 }, { 0, 0 });
+                        break;
+                    }
+                    if (strncmp(target, "linux", 6) == 0) {
+                        _target = Target::Linux;
+                    } else if (strncmp(target, "macos", 6) == 0) {
+                        _target = Target::macOS;
+                    } else {
+                        report(Error::parseDomain, "Unknown target", "args", { 0, 0, 0, 0 }, { 0, 0 }, "use 'linux' or 'macos'");
+                    }
                 }
             } else {
                 const std::string str { arg };
@@ -110,6 +160,9 @@ namespace Floral {
                 };
             }
         }
+        if (!_depfile.empty() && std::count_if(_infiles.begin(), _infiles.end(), [](const CmdFile& infile) { return infile.second == CmdFileExt::floral; }) > 1) {
+            report(Error::parseDomain, "Cannot write the dependencies of several files to one -MF file", "args", { 0, 0, 0, 0 }, { 0, 0 }, "use -MD to write one beside each source");
+        }
     }
 
     void CommandParser::report(Error::Domain domain, const std::string& text, const std::string& path, TextRegion loc, ErrorLoc errloc, const std::string& fix) {
@@ -148,6 +201,12 @@ namespace Floral {
     const int CommandParser::optimization() const {
         return _optimization;
     }
+    const Target CommandParser::target() const {
+        return _target;
+    }
+    const unsigned CommandParser::jobs() const {
+        return _jobs;
+    }
     const int CommandParser::usingCBridge() const {
         return libs.find("libc") != libs.end();
     }
@@ -186,4 +245,28 @@ namespace Floral {
     const uint32_t CommandParser::stackGuard() const {
         return packed_options_0 & (1 << _stackGuard);
     }
+    const uint32_t CommandParser::avx2() const {
+        return packed_options_0 & (1 << _avx2);
+    }
+    const uint32_t CommandParser::stackProbe() const {
+        return packed_options_0 & (1 << _stackProbe);
+    }
+    const uint32_t CommandParser::noCache() const {
+        return packed_options_0 & (1 << _noCache);
+    }
+    const uint32_t CommandParser::cacheStats() const {
+        return packed_options_0 & (1 << _cacheStats);
+    }
+    const uint32_t CommandParser::projectBuild() const {
+        return packed_options_0 & (1 << _projectBuild);
+    }
+    const std::string& CommandParser::projectFile() const {
+        return _projectFile;
+    }
+    const uint32_t CommandParser::writeDepfile() const {
+        return packed_options_0 & (1 << _writeDepfile);
+    }
+    const std::string& CommandParser::depfile() const {
+        return _depfile;
+    }
 }
@@ -13,12 +13,15 @@
 #include <vector>
 #include <set>
 #include "Error.hpp"
+#include "Target.hpp"
 
 #define FLORAL_OBJS "/usr/local"
 #define FLORAL_SRCS "/usr/local/src"
-#define FLORAL_HDR(name) "~/Programming/floral-src/include/" #name ".fh"
+#define FLORAL_HDRS "~/Programming/floral-src/include/"
+#define FLORAL_HDR(name) FLORAL_HDRS #name ".fh"
 #define FLORAL_OBJ(name) "~/Programming/floral-src/stdlib/obj/" #name ".o"
 #define FLORAL_RUNTIME(name) "~/Programming/floral-src/runtime/" #name ".o"
+#define FLORAL_PROJECT_FILE "config.floralattr"
 
 namespace Floral {
     enum class Use {
@@ -44,6 +47,10 @@ namespace Floral {
         CmdFile _outfile;
         
         int _optimization = 0;
+        Target _target = hostTarget;
+        unsigned _jobs = 1;
+        std::string _projectFile { FLORAL_PROJECT_FILE };
+        std::string _depfile; // from -MF, otherwise each source's dependencies go beside it
         std::set<std::string> libs;
         enum Options {
             _showHelp = 0,
@@ -55,7 +62,13 @@ namespace Floral {
             _openASM,
             _verbose,
             _printNotRunCmds,
-            _stackGuard
+            _stackGuard,
+            _avx2,
+            _stackProbe,
+            _noCache,
+            _cacheStats,
+            _projectBuild,
+            _writeDepfile
         };
         uint32_t packed_options_0 {};
         
@@ -75,6 +88,8 @@ namespace Floral {
         const CmdFile& outfile() const;
         const uint32_t showHelp() const;
         const int optimization() const;
+        const Target target() const;
+        const unsigned jobs() const;
         const int usingCBridge() const;
         const int usingSTL() const;
         void initLibs(std::set<std::string>& libs) const;
@@ -87,6 +102,14 @@ namespace Floral {
         const uint32_t isVerbose() const;
         const uint32_t printNotRunCmds() const;
         const uint32_t stackGuard() const;
+        const uint32_t avx2() const;
+        const uint32_t stackProbe() const;
+        const uint32_t noCache() const;
+        const uint32_t cacheStats() const;
+        const uint32_t projectBuild() const;
+        const std::string& projectFile() const;
+        const uint32_t writeDepfile() const;
+        const std::string& depfile() const;
     };
 }
 
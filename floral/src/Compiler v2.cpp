@@ -8,7 +8,10 @@
 // ld -r -o std.o colored256io.o coloredio.o dynamic.o intmap.o itoa.o print_buffered.o print.o read.o strtowstr.o swap8.o sys.o upperlowerascii.o util.o wideio.o wreadc.o wstring.o
 #include "Compiler.hpp"
 #include "File IO.hpp"
+#include "Encoder.hpp"
+#include "AssemblyWriter.hpp"
 #include <cassert>
+#include <fstream>
 #include "Colors.hpp"
 #include "floral_cdef.h"
 
@@ -36,11 +39,19 @@ namespace Floral {
     void Compiler::setOutputDestination(const std::string &dest) {
         outputDest = dest;
     }
+    const std::string& Compiler::outputDestination() const {
+        return outputDest;
+    }
     void Compiler::reset() {
         textSection.instructions.clear();
         bssSection.instructions.clear();
         rodataSection.instructions.clear();
         dataSection.instructions.clear();
+        _constants.clear();
+        _globalConstants.clear();
+        _globals.clear();
+        _referencedGlobals.clear();
+        _labels = {};
         
         textSection.spaceOutLabels = true;
         analyzer.reset();
@@ -70,8 +81,8 @@ namespace Floral {
                 case TokenType::plus:
                     return std::to_string(atoll(staticEvalulate(left).c_str()) + atoll(staticEvalulate(right).c_str()));
                 case TokenType::minus:
-                    if (left && right) return std::to_string(atoll(staticEvalulate(left).c_str()) + atoll(staticEvalulate(right).c_str()));
-                    else if (!left && right) return std::to_string(-atoll(staticEvalulate(left).c_str()));
+                    if (left && right) return std::to_string(atoll(staticEvalulate(left).c_str()) - atoll(staticEvalulate(right).c_str()));
+                    else if (!left && right) return std::to_string(-atoll(staticEvalulate(right).c_str()));
                 case TokenType::multiply:
                     if (left && right) return std::to_string(atoll(staticEvalulate(left).c_str()) * atoll(staticEvalulate(right).c_str()));
                 default:
@@ -101,6 +112,11 @@ namespace Floral {
             }
             return acc;
         }
+        // anything else, such as a call to a const func, was run by the analyzer's interpreter
+        Interpreter::Value value;
+        if (analyzer._interpreter.evaluate(staticEvalExpr, value)) {
+            return Interpreter::describe(value, staticEvalExpr->type);
+        }
         assert(false && "Should not reach here");
     }
 
@@ -108,15 +124,19 @@ namespace Floral {
         if (auto add = dynamic_cast<AddOperation*>(instr)) {
             if (add->dest.reg == static_cast<int>(Register::rsp) && add->src.isLiteral) {
                 _stackFromMain -= add->src.value.s;
+                if (!frames.empty()) currentFrame().pushed -= add->src.value.s;
             }
         } else if (auto sub = dynamic_cast<SubOperation*>(instr)) {
             if (sub->dest.reg == static_cast<int>(Register::rsp) && sub->src.isLiteral) {
                 _stackFromMain += sub->src.value.s;
+                if (!frames.empty()) currentFrame().pushed += sub->src.value.s;
             }
         } else if (auto push = dynamic_cast<PushOperation*>(instr)) {
             _stackFromMain += 8;
+            if (!frames.empty()) currentFrame().pushed += 8;
         } else if (auto pop = dynamic_cast<PopOperation*>(instr)) {
             _stackFromMain -= 8;
+            if (!frames.empty()) currentFrame().pushed -= 8;
         } else if (auto call = dynamic_cast<CallOperation*>(instr)) {
             _stackFromMain += 8;
         } else if (auto ret = dynamic_cast<ReturnOperation*>(instr)) {
@@ -149,6 +169,7 @@ namespace Floral {
 
     // MARK: Emit general statement
     void Compiler::emitStatement(Statement *stm) {
+        const std::vector<Register> live = frames.empty() ? std::vector<Register>() : currentFrame().registersInUse;
         if (auto letStm = dynamic_cast<LetStatement*>(stm)) {
             emitLocalConst(letStm);
         } else if (auto varStm = dynamic_cast<VarStatement*>(stm)) {
@@ -172,17 +193,36 @@ namespace Floral {
         } else if (auto block = dynamic_cast<Block*>(stm)) {
             emitBlock(block); // block of code
         }
+        if (!frames.empty()) checkRegistersReleased(live);
+    }
+
+    // MARK: Register bookkeeping
+    void Compiler::checkRegistersReleased(const std::vector<Register>& live) {
+        // A statement may only leave behind what was live before it or a register that now holds a variable
+        for (const Register reg: currentFrame().registersInUse) {
+            if (std::find(live.begin(), live.end(), reg) == live.end() && !currentFrame().holdsVariable(reg)) {
+                assert(false && "Statement did not release a register it reserved");
+            }
+        }
     }
 
     // MARK: Call statement
     void Compiler::emitCallStatement(CallStatement *callStm) {
-        emitCall(callStm->call); /* call statements && calls are the same
-                                  * thing in assembly, however plain calls
-                                  * can also be used in the context of expressions */
+        const Location result = emitCall(callStm->call); /* call statements && calls are the same
+                                                          * thing in assembly, however plain calls
+                                                          * can also be used in the context of expressions */
+        if (IS_REG(result)) {
+            returnRegister(static_cast<Register>(result.reg)); // discard result
+        }
     }
 
     // MARK: Return specific value
-    void Compiler::emitReturnSpecificValue(Location src) {
+    void Compiler::emitReturnSpecificValue(Location src, const Type* type) {
+        if (type && type->isFloat()) { // Floats are returned in xmm0
+            if (src.isLiteral) src = RegisterLocation(emitFloatOperand(src));
+            if (src.reg != static_cast<int>(Register::xmm0)) emit(new MoveOperation(RegisterLocation(Register::xmm0), src, SizeType::qword, "result to be returned"), SectionType::text);
+            return;
+        }
         if (src.reg != static_cast<int>(Register::rax)) { // if the expression result isn't already in rax...
             emit(new MoveOperation(RegisterLocation(Register::rax), src, SizeType::qword, "result to be returned"), SectionType::text); // ...move it to rax
         }
@@ -190,6 +230,24 @@ namespace Floral {
 
     // MARK: Return statement
     void Compiler::emitReturnStatement(ReturnStatement *rtnStm) {
+        if (!_inlineSites.empty()) { // returning from a substituted body only leaves the substitution
+            InlineSite& site = _inlineSites.back();
+            if (rtnStm->value()) {
+                const Location result = emitExpression(rtnStm->value());
+                if (site.result != LOC_IS_NOT_REG && !(result == RegisterLocation(static_cast<Register>(site.result)))) {
+                    emitLoad(static_cast<Register>(site.result), result, site.callee->returnType(), "inlined result");
+                }
+                if (IS_REG(result) && result.reg != site.result) returnRegister(static_cast<Register>(result.reg));
+            }
+            if (rtnStm != site.finalReturn) {
+                emit(new JumpOperation(JumpOperation::JType::normal, site.exitLabel, "return from inlined " + site.callee->name().contents), SectionType::text);
+                site.exitUsed = true;
+            }
+            return;
+        }
+        if (auto call = dynamic_cast<Call*>(rtnStm->value())) {
+            if (emitTailCall(call)) return; // the callee returns straight to our caller
+        }
         emitSGEpilogue();
         if (rtnStm->value()) { // if we are retruning a value...
             if (auto literal = dynamic_cast<Literal*>(rtnStm->value())) {
@@ -197,12 +255,12 @@ namespace Floral {
                     emit(new XorOperation(RETURN_VALUE_LOC_32b, RETURN_VALUE_LOC_32b, "result to be returned"), SectionType::text); // then just xor rax, rax
                 } else {
                     Location result = emitExpression(rtnStm->value()); // calculate the value
-                    emitReturnSpecificValue(result); // put the result in the RETURN_VALUE_LOC
+                    emitReturnSpecificValue(result, rtnStm->value()->type); // put the result in the RETURN_VALUE_LOC
                     if (result.reg != LOC_IS_NOT_REG) returnRegister(static_cast<Register>(result.reg));
                 }
             } else { // otherwise
                 Location result = emitExpression(rtnStm->value()); // calculate the value
-                emitReturnSpecificValue(result); // put the result in the RETURN_VALUE_LOC
+                emitReturnSpecificValue(result, rtnStm->value()->type); // put the result in the RETURN_VALUE_LOC
                 if (result.reg != LOC_IS_NOT_REG) returnRegister(static_cast<Register>(result.reg));
             }
         }
@@ -215,10 +273,13 @@ namespace Floral {
         const Location loc = emitExpression(exprStm->expr()); // execute expression
         if (IS_REG(loc)) {
             returnRegister(static_cast<Register>(loc.reg)); // discard result
+        } else if (loc.isDereference && loc.reg != LOC_IS_NOT_REG && !IS_RBPOFFSET(loc) && !currentFrame().holdsVariable(static_cast<Register>(loc.reg))) {
+            returnRegister(static_cast<Register>(loc.reg)); // discard the pointer to the result, e.g. after +=
         }
     }
 
     // MARK: Assignment statement
+    static Location structMemory(Location address, const Type* type);
     void Compiler::emitAssignmentStatement(Assignment* assignStm) {
 //        if (auto layer1 = dynamic_cast<BinaryExpression*>(assignStm->lval())) {
 //            if (layer1->op() && layer1->op()->tkntype() == TokenType::multiply && !layer1->left()) {
@@ -240,10 +301,16 @@ namespace Floral {
 //        PointerAssignment ptrAssign { assignStm->_loc, pointer, assignStm->rval() };
 //        emitPointerAssignmentStatement(&ptrAssign);
 //        ptrAssign.makenull();
+        if (assignStm->lval()->type->isStruct() && dynamic_cast<SymbolExpression*>(assignStm->lval())) {
+            const Location dest = emitExpression(assignStm->lval(), true);
+            if (emitStructCopy(structMemory(dest, assignStm->lval()->type), assignStm->rval(), "struct assignment")) {
+                return;
+            }
+        }
         const auto lhsloc = emitExpression(assignStm->lval(), true);
         const auto rhsloc = emitExpression(assignStm->rval());
         if (IS_REG(lhsloc)) {
-            emit(new MoveOperation(ValueAtRegisterLocation(static_cast<Register>(lhsloc.reg)), rhsloc, SizeType::qword, "assignment"), SectionType::text);
+            emitStore(ValueAtRegisterLocation(static_cast<Register>(lhsloc.reg)), rhsloc, assignStm->lval()->type, "assignment");
             returnRegister(static_cast<Register>(lhsloc.reg));
         } else if (IS_RBPOFFSET(lhsloc)) {
             const Register temp = static_cast<Register>(currentFrame().avaliableScratch());
@@ -254,7 +321,7 @@ namespace Floral {
             } else {
                 emit(new LoadAddressOperation(RegisterLocation(temp), lhslocd, SizeType::qword, "put lval in temp reg"), SectionType::text);
             }
-            emit(new MoveOperation(ValueAtRegisterLocation(temp), rhsloc, SizeType::qword, "assignment into dereference"), SectionType::text);
+            emitStore(ValueAtRegisterLocation(temp), rhsloc, assignStm->lval()->type, "assignment into dereference");
             returnRegister(temp);
         }
         if (IS_REG(rhsloc)) {
@@ -272,7 +339,7 @@ namespace Floral {
             const Location dest = _wasRegisterParameter ? RegisterLocation(destreg) : ValueAtRegisterLocation(destreg);
             _wasRegisterParameter = false;
             
-            emit(new MoveOperation(dest, newval, SizeType::qword, "assignment"), SectionType::text); // move src into [dest]
+            emitStore(dest, newval, ptrAssign->newValue()->type, "assignment"); // move src into [dest]
             
             returnRegister(destreg);
             if (IS_REG(newval)) {
@@ -284,99 +351,609 @@ namespace Floral {
 
     // MARK: If statement
     void Compiler::emitIfStatement(IfStatement* ifStm) {
-        static int counter {};
+        if (optimization && emitConditionalMove(ifStm)) {
+            return; // lowered without a branch
+        }
         
-        const std::string name = currentFrame().id + "_#if_skip_" + std::to_string(counter++);
-        const auto [loc, cond] = emitCondition(ifStm->condition(), true, true); // calculate condition
+        const std::string name = currentFrame().id + "_#if_skip_" + std::to_string(_labels.ifs++);
+        if (emitBranch(ifStm->condition(), false, name) != StaticBranch::always) { // jump past the body if false
+            emitBlock(ifStm->body()); // skipped if condition is false
+        }
+        emit(new Label(name, false), SectionType::text); // label to skip to
+    }
 
-        if (loc.isLiteral) {
-            if (loc.value.u) {
-                emitBlock(ifStm->body()); // unconditionally emit block
-            } else {
-                return;
+    // MARK: If-conversion
+    // `if (cond) { x = y; }` where x is a scalar variable and y is a number
+    // literal or a symbol is lowered to a cmov, so data-dependent conditions
+    // do not cost a (possibly mispredicted) branch.
+    bool Compiler::emitConditionalMove(IfStatement* ifStm) {
+        const auto& body = ifStm->body()->body();
+        if (body.size() != 1) return false;
+        auto assign = dynamic_cast<Assignment*>(body.front());
+        if (!assign) return false;
+        auto lval = dynamic_cast<SymbolExpression*>(assign->lval());
+        if (!lval || lval->type->isArray() || lval->type->isStruct() || lval->type->isFloat()) return false; // cmov only takes general registers
+        
+        Expression* rval = assign->rval();
+        auto literal = dynamic_cast<Literal*>(rval);
+        const bool isSimpleValue = dynamic_cast<SymbolExpression*>(rval) || (literal && literal->type() != Literal::LType::cString && literal->type() != Literal::LType::wideString);
+        if (!isSimpleValue) return false;
+        
+        // Only conditions that end in a single flag-setting instruction
+        Expression* condition = ifStm->condition();
+        if (auto binary = dynamic_cast<BinaryExpression*>(condition)) {
+            switch (binary->op()->tkntype()) {
+                case TokenType::equal:
+                case TokenType::unequal:
+                case TokenType::less:
+                case TokenType::greater:
+                case TokenType::lessEqual:
+                case TokenType::greaterEqual:
+                case TokenType::bool_not:
+                    break;
+                default:
+                    return false;
             }
-        } else {
-            emit(new JumpOperation(cond, name), SectionType::text);
-            if (IS_REG(loc)) {
-                returnRegister(static_cast<Register>(loc.reg));
+        } else if (!dynamic_cast<SymbolExpression*>(condition)) {
+            return false;
+        }
+        
+        const auto result = lookup(lval->value().contents);
+        if (!result.second || result.first.loc.isLbl) return false;
+        const Location varloc = result.first.loc;
+        
+        // cmov cannot take an immediate, so the new value always goes through a register
+        Location value = emitExpression(rval);
+        if (!IS_REG(value)) {
+            const Register temp = GET_REG(currentFrame());
+            emit(new MoveOperation(RegisterLocation(temp), value, SizeType::qword, "value for conditional move"), SectionType::text);
+            value = RegisterLocation(temp);
+        }
+        
+        const auto [condloc, cond] = emitCondition(condition, false, true);
+        if (condloc.isLiteral) {
+            if (condloc.value.u) {
+                emit(new MoveOperation(varloc, value, SizeType::qword, "assignment"), SectionType::text);
             }
-            emitBlock(ifStm->body()); // skipped if condition is false
-            emit(new Label(name, false), SectionType::text); // label to skip to
+        } else if (IS_REG(varloc)) {
+            emit(new ConditionalMoveOperation(cond, varloc, value, "conditional assignment"), SectionType::text);
+        } else {
+            // mov does not affect the flags set by the condition
+            const Register temp = GET_REG(currentFrame());
+            emit(new MoveOperation(RegisterLocation(temp), varloc, SizeType::qword, "current value"), SectionType::text);
+            emit(new ConditionalMoveOperation(cond, RegisterLocation(temp), value, "conditional assignment"), SectionType::text);
+            emit(new MoveOperation(varloc, RegisterLocation(temp), SizeType::qword, "store"), SectionType::text);
+            returnRegister(temp);
         }
+        returnRegister(static_cast<Register>(value.reg));
+        return true;
     }
 
-    // MARK: While statement
-    void Compiler::emitWhileStatement(WhileStatement* whileStm) {
-        static int counter {};
-        static int counter2 {};
+    // MARK: Rotated loop
+    // Loops are emitted in rotated form: the condition is tested once up front
+    // as a guard, and again at the bottom of the body where a single conditional
+    // jump forms the back-edge. Each iteration therefore takes one branch rather
+    // than a conditional exit at the top plus an unconditional jump at the bottom.
+    void Compiler::emitLoop(Expression* condition, Block* body, Statement* modify) {
+        const int loopID = _labels.loops++;
+        const std::string name = currentFrame().id + "_#loop_head_" + std::to_string(loopID);
+        const std::string skipName = currentFrame().id + "_#loop_skip_" + std::to_string(loopID);
+        
+        const StaticBranch guard = emitBranch(condition, false, skipName); // loop guard
+        if (guard == StaticBranch::always) {
+            emit(new Label(skipName, false, false), SectionType::text);
+            return; // the body can never execute
+        }
         
-        const std::string name =  currentFrame().id + "_#while_loop_" + std::to_string(counter++);
-        const std::string skipName =  currentFrame().id + "_#while_skip_" + std::to_string(counter2++);
+        if (optimization) {
+            emit(new Align(LOOP_HEAD_ALIGNMENT), SectionType::text);
+        }
         emit(new Label(name, false, false), SectionType::text); // label to loop to
-        const auto [loc, cond] = emitCondition(whileStm->condition(), true, true); // calculate condition
-        emit(new JumpOperation(cond, skipName), SectionType::text);
-        if (IS_REG(loc)) {
-            returnRegister(static_cast<Register>(loc.reg));
+        emitBlock(body);
+        if (modify) {
+            emitStatement(modify);
+        }
+        
+        if (guard == StaticBranch::never) {
+            emit(new JumpOperation(JumpOperation::JType::normal, name), SectionType::text); // unconditionally loop block
+        } else {
+            emitBranch(condition, true, name); // back-edge
         }
-        emitBlock(whileStm->body());
+        emit(new Label(skipName, false, false), SectionType::text); // label to exit to
+    }
 
-        if (loc.isLiteral) {
-            if (loc.value.u) {
-                emit(new JumpOperation(JumpOperation::JType::normal, name), SectionType::text); // unconditionally loop block
-            } else {
-                return;
+    // MARK: Loop vectorization
+    // A counted loop whose statements only touch arrays at the counter runs a vector's worth of iterations
+    // at a time; the unchanged scalar loop then finishes whatever is left over
+    #define VECTOR_REGISTER_COUNT 16
+    static bool fitsImmediate(int64_t n);
+    struct VectorLoop {
+        enum class Kind {
+            store, sum, min, max
+        };
+        struct Statement {
+            Kind kind;
+            std::string target; // array stored to, or the reduction variable
+            const Type* targetType;
+            Expression* value;
+            int accumulator;
+        };
+        struct Array {
+            std::string name;
+            const Type* type;
+            bool isStored;
+            Register base;
+        };
+        
+        std::string induction;
+        const Type* inductionType = nullptr;
+        Expression* bound = nullptr;
+        size_t elementSize = 0;
+        std::vector<Statement> statements;
+        std::vector<Array> arrays;
+        std::vector<std::pair<std::string, int>> invariants; // broadcast once before the loop, keyed by source text
+        size_t leaves = 0;
+        
+        bool isWide = false;
+        Register counter;
+        std::bitset<VECTOR_REGISTER_COUNT> used;
+        
+        bool isWritten(const std::string& name) const {
+            if (name == induction) return true;
+            return std::any_of(statements.begin(), statements.end(), [&name](const Statement& stm) {
+                return stm.kind != Kind::store && stm.target == name;
+            });
+        }
+        Array* array(const std::string& name) {
+            for (auto& array: arrays) if (array.name == name) return &array;
+            return nullptr;
+        }
+        int allocate() {
+            for (int vreg = 0; vreg < VECTOR_REGISTER_COUNT; vreg++) {
+                if (!used[vreg]) {
+                    used[vreg] = true;
+                    return vreg;
+                }
+            }
+            assert(false && "planVectorLoop bounds register pressure");
+            return -1;
+        }
+        VectorOperand vector(int vreg) const {
+            return VectorOperand::vector(vreg, isWide);
+        }
+        size_t lanes() const {
+            return (isWide ? 32 : 16) / elementSize;
+        }
+    };
+    
+    static const SymbolExpression* asSymbol(const Expression* expr, const std::string& name = "") {
+        auto symbol = dynamic_cast<const SymbolExpression*>(expr);
+        return symbol && (name.empty() || symbol->value().contents == name) ? symbol : nullptr;
+    }
+    static const BinaryExpression* asBinary(const Node* node, TokenType op) {
+        auto binary = dynamic_cast<const BinaryExpression*>(node);
+        return binary && binary->left() && binary->right() && binary->op()->tkntype() == op ? binary : nullptr;
+    }
+    static bool isIntegerLiteral(const Expression* expr) {
+        auto literal = dynamic_cast<const Literal*>(expr);
+        return literal && literal->type() != Literal::LType::floatingPointNumber && literal->type() != Literal::LType::cString && literal->type() != Literal::LType::wideString && literal->type() != Literal::LType::boolean;
+    }
+    static bool isLiteralOne(const Expression* expr) {
+        return isIntegerLiteral(expr) && static_cast<const Literal*>(expr)->value().contents == "1";
+    }
+    // The counter of `i = i + 1`, `i = 1 + i` or `i += 1`, or "" when stm is not a unit increment
+    static std::string unitIncrement(const Node* stm) {
+        if (auto assign = dynamic_cast<const Assignment*>(stm)) {
+            auto counter = asSymbol(assign->lval());
+            auto sum = asBinary(assign->rval(), TokenType::plus);
+            if (counter && sum && ((asSymbol(sum->left(), counter->value().contents) && isLiteralOne(sum->right())) || (isLiteralOne(sum->left()) && asSymbol(sum->right(), counter->value().contents)))) {
+                return counter->value().contents;
+            }
+        } else if (auto exprStm = dynamic_cast<const ExpressionStatement*>(stm)) {
+            auto increment = asBinary(exprStm->expr(), TokenType::plusEqu);
+            if (increment && asSymbol(increment->left()) && isLiteralOne(increment->right())) {
+                return asSymbol(increment->left())->value().contents;
+            }
+        }
+        return "";
+    }
+    // `array[induction]` over integer elements
+    static const BinaryExpression* asElementAccess(const Expression* expr, const std::string& induction) {
+        auto subscript = asBinary(expr, TokenType::leftBracket);
+        if (!subscript || !asSymbol(subscript->left()) || !asSymbol(subscript->right(), induction)) return nullptr;
+        const Type* type = subscript->left()->type;
+        return type->isPointer() && type->pointee()->isInteger() ? subscript : nullptr;
+    }
+    // The element width of the first array read by expr, or 0 if it reads none
+    static size_t elementSizeOf(const Expression* expr, const std::string& induction) {
+        if (auto access = asElementAccess(expr, induction)) return access->left()->type->pointee()->size();
+        auto binary = dynamic_cast<const BinaryExpression*>(expr);
+        if (!binary || !binary->left() || !binary->right()) return 0;
+        const size_t left = elementSizeOf(binary->left(), induction);
+        return left ? left : elementSizeOf(binary->right(), induction);
+    }
+    static bool hasPackedMultiply(size_t elementSize, bool isWide) {
+        return elementSize == 2 || (elementSize == 4 && isWide); // pmullw is SSE2, pmulld needs SSE4.1 or AVX2
+    }
+    static bool hasPackedMinMax(size_t elementSize, bool isSigned, bool isWide) {
+        if (elementSize == 8) return false; // 64-bit lanes need AVX-512
+        return isWide || elementSize == (isSigned ? 2 : 1); // SSE2 has only pminsw and pminub
+    }
+    static std::string laneSuffix(size_t elementSize) {
+        return elementSize == 1 ? "b" : elementSize == 2 ? "w" : elementSize == 4 ? "d" : "q";
+    }
+    // Whether expr can be computed lane-wise; records the arrays it reads
+    static bool isVectorizable(const Expression* expr, VectorLoop& loop) {
+        loop.leaves++;
+        if (auto access = asElementAccess(expr, loop.induction)) {
+            const auto name = asSymbol(access->left())->value().contents;
+            if (access->left()->type->pointee()->size() != loop.elementSize) return false; // lanes must share a width
+            if (!loop.array(name)) loop.arrays.push_back({name, access->left()->type, false, Register::rax});
+            return true;
+        }
+        if (dynamic_cast<const Literal*>(expr)) return isIntegerLiteral(expr);
+        if (auto symbol = asSymbol(expr)) { // loop invariant scalar
+            return symbol->type->isInteger() && !loop.isWritten(symbol->value().contents);
+        }
+        for (auto op: { TokenType::plus, TokenType::minus, TokenType::multiply, TokenType::bit_and }) {
+            if (auto binary = asBinary(expr, op)) {
+                if (op == TokenType::multiply && !hasPackedMultiply(loop.elementSize, loop.isWide)) return false;
+                return isVectorizable(binary->left(), loop) && isVectorizable(binary->right(), loop);
+            }
+        }
+        return false;
+    }
+    // Sorts each statement of the body into a lane-wise store or a reduction, or fails
+    static bool planVectorLoop(Block* body, size_t statementCount, VectorLoop& loop) {
+        using Kind = VectorLoop::Kind;
+        const auto& nodes = body->body();
+        for (size_t i = 0; i < statementCount; i++) {
+            if (auto assign = dynamic_cast<const Assignment*>(nodes[i])) {
+                if (auto access = asElementAccess(assign->lval(), loop.induction)) {
+                    const auto name = asSymbol(access->left())->value().contents;
+                    if (!loop.elementSize) loop.elementSize = access->left()->type->pointee()->size();
+                    if (!loop.array(name)) loop.arrays.push_back({name, access->left()->type, true, Register::rax});
+                    loop.array(name)->isStored = true;
+                    loop.statements.push_back({Kind::store, name, access->left()->type->pointee(), assign->rval(), -1});
+                    continue;
+                }
+                auto sum = asBinary(assign->rval(), TokenType::plus);
+                if (auto target = asSymbol(assign->lval()); target && sum) { // s = s + e or s = e + s
+                    const auto name = target->value().contents;
+                    Expression* value = asSymbol(sum->left(), name) ? sum->right() : asSymbol(sum->right(), name) ? sum->left() : nullptr;
+                    if (value) {
+                        loop.statements.push_back({Kind::sum, name, target->type, value, -1});
+                        continue;
+                    }
+                }
+            } else if (auto exprStm = dynamic_cast<const ExpressionStatement*>(nodes[i])) {
+                auto increment = asBinary(exprStm->expr(), TokenType::plusEqu);
+                if (increment && asSymbol(increment->left())) { // s += e
+                    loop.statements.push_back({Kind::sum, asSymbol(increment->left())->value().contents, increment->left()->type, increment->right(), -1});
+                    continue;
+                }
+            } else if (auto ifStm = dynamic_cast<const IfStatement*>(nodes[i])) {
+                // if (a[i] < m) { m = a[i]; } and its mirrored and maximum forms
+                auto condition = dynamic_cast<const BinaryExpression*>(ifStm->condition());
+                auto assign = ifStm->body()->body().size() == 1 ? dynamic_cast<const Assignment*>(ifStm->body()->body().front()) : nullptr;
+                auto target = assign ? asSymbol(assign->lval()) : nullptr;
+                auto access = assign ? asElementAccess(assign->rval(), loop.induction) : nullptr;
+                if (condition && condition->left() && condition->right() && target && access) {
+                    const auto name = target->value().contents;
+                    const auto array = asSymbol(access->left())->value().contents;
+                    const bool elementFirst = asSymbol(condition->right(), name) && asElementAccess(condition->left(), loop.induction) && asSymbol(asElementAccess(condition->left(), loop.induction)->left(), array);
+                    const bool elementSecond = asSymbol(condition->left(), name) && asElementAccess(condition->right(), loop.induction) && asSymbol(asElementAccess(condition->right(), loop.induction)->left(), array);
+                    const TokenType op = condition->op()->tkntype();
+                    const bool isLess = op == TokenType::less || op == TokenType::lessEqual;
+                    const bool isGreater = op == TokenType::greater || op == TokenType::greaterEqual;
+                    if ((elementFirst || elementSecond) && (isLess || isGreater)) {
+                        const bool isMin = elementFirst == isLess; // e < m and m > e both keep the smaller
+                        loop.statements.push_back({isMin ? Kind::min : Kind::max, name, target->type, assign->rval(), -1});
+                        continue;
+                    }
+                }
             }
+            return false;
+        }
+        if (loop.statements.empty()) return false;
+        for (size_t i = 0; !loop.elementSize && i < loop.statements.size(); i++) { // reductions only
+            loop.elementSize = elementSizeOf(loop.statements[i].value, loop.induction);
+        }
+        if (!loop.elementSize) return false;
+        
+        size_t persistent = 0, temporaries = 0;
+        for (auto& stm: loop.statements) {
+            loop.leaves = 0;
+            if (!isVectorizable(stm.value, loop)) return false;
+            persistent += loop.leaves; // at most one broadcast per leaf
+            temporaries = max(temporaries, loop.leaves);
+            if (stm.kind == Kind::store) {
+                if (loop.isWritten(stm.target) || stm.targetType->size() != loop.elementSize) return false;
+                continue;
+            }
+            // a reduction variable feeds nothing but its own reduction, and its lanes are as wide as the elements
+            const auto uses = std::count_if(loop.statements.begin(), loop.statements.end(), [&stm](const VectorLoop::Statement& other) {
+                return other.target == stm.target;
+            });
+            if (uses != 1 || stm.target == loop.induction || loop.array(stm.target) || !stm.targetType->isInteger() || stm.targetType->size() != loop.elementSize) return false;
+            if (stm.kind != Kind::sum && !hasPackedMinMax(loop.elementSize, stm.targetType->isSigned(), loop.isWide)) return false;
+            if (stm.kind != Kind::sum && stm.targetType->isSigned() != dynamic_cast<const BinaryExpression*>(stm.value)->left()->type->pointee()->isSigned()) return false;
+            persistent++; // its accumulator
+        }
+        return persistent + temporaries <= VECTOR_REGISTER_COUNT;
+    }
+    
+    int Compiler::emitBroadcast(Location value, VectorLoop& loop) {
+        Register scalar;
+        if (IS_REG(value)) {
+            scalar = static_cast<Register>(value.reg);
+        } else {
+            scalar = GET_REG(currentFrame());
+            emit(new MoveOperation(RegisterLocation(scalar), value, SizeType::qword, "scalar to broadcast"), SectionType::text);
+        }
+        const int vreg = loop.allocate();
+        const VectorOperand narrow = VectorOperand::vector(vreg, false);
+        if (loop.isWide) {
+            emit(new VectorOperation("vmovq", { narrow, VectorOperand::general(scalar) }), SectionType::text);
+            emit(new VectorOperation("vpbroadcast" + laneSuffix(loop.elementSize), { loop.vector(vreg), narrow }, "splat across lanes"), SectionType::text);
         } else {
-            emit(new JumpOperation(JumpOperation::JType::normal, name), SectionType::text); // nonzero difference = false
-            emit(new Label(skipName, false, false), SectionType::text); // label to loop to
+            emit(new VectorOperation("movq", { narrow, VectorOperand::general(scalar) }), SectionType::text);
+            if (loop.elementSize == 1) emit(new VectorOperation("punpcklbw", { narrow, narrow }), SectionType::text);
+            if (loop.elementSize <= 2) emit(new VectorOperation("pshuflw", { narrow, narrow, VectorOperand::immediate(0) }), SectionType::text);
+            if (loop.elementSize == 4) emit(new VectorOperation("pshufd", { narrow, narrow, VectorOperand::immediate(0) }, "splat across lanes"), SectionType::text);
+            else emit(new VectorOperation("punpcklqdq", { narrow, narrow }, "splat across lanes"), SectionType::text);
+        }
+        returnRegister(scalar);
+        return vreg;
+    }
+    
+    int Compiler::emitVectorExpression(Expression* expr, VectorLoop& loop, bool& isTemporary) {
+        if (auto access = asElementAccess(expr, loop.induction)) {
+            const int vreg = loop.allocate();
+            const Register base = loop.array(asSymbol(access->left())->value().contents)->base;
+            emit(new VectorOperation(loop.isWide ? "vmovdqu" : "movdqu", { loop.vector(vreg), VectorOperand::memory(base, loop.counter, static_cast<int>(loop.elementSize)) }, expr->prettystr()), SectionType::text);
+            isTemporary = true;
+            return vreg;
         }
+        if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
+            bool leftIsTemporary, rightIsTemporary;
+            const int left = emitVectorExpression(binary->left(), loop, leftIsTemporary);
+            const int right = emitVectorExpression(binary->right(), loop, rightIsTemporary);
+            const TokenType op = binary->op()->tkntype();
+            const std::string mnemonic = op == TokenType::plus ? "padd" + laneSuffix(loop.elementSize) : op == TokenType::minus ? "psub" + laneSuffix(loop.elementSize) : op == TokenType::multiply ? "pmull" + laneSuffix(loop.elementSize) : "pand";
+            const bool isCommutative = op != TokenType::minus;
+            int result;
+            if (loop.isWide) { // VEX forms take a separate destination
+                result = leftIsTemporary ? left : rightIsTemporary ? right : loop.allocate();
+                emit(new VectorOperation('v' + mnemonic, { loop.vector(result), loop.vector(left), loop.vector(right) }), SectionType::text);
+            } else if (leftIsTemporary) {
+                result = left;
+                emit(new VectorOperation(mnemonic, { loop.vector(left), loop.vector(right) }), SectionType::text);
+            } else if (rightIsTemporary && isCommutative) {
+                result = right;
+                emit(new VectorOperation(mnemonic, { loop.vector(right), loop.vector(left) }), SectionType::text);
+            } else { // both operands outlive this operation
+                result = loop.allocate();
+                emit(new VectorOperation("movdqa", { loop.vector(result), loop.vector(left) }), SectionType::text);
+                emit(new VectorOperation(mnemonic, { loop.vector(result), loop.vector(right) }), SectionType::text);
+            }
+            if (leftIsTemporary && left != result) loop.used[left] = false;
+            if (rightIsTemporary && right != result) loop.used[right] = false;
+            isTemporary = true;
+            return result;
+        }
+        // loop invariant, broadcast before the loop
+        isTemporary = false;
+        const auto key = expr->prettystr();
+        for (auto& invariant: loop.invariants) {
+            if (invariant.first == key) return invariant.second;
+        }
+        assert(false && "Invariants are broadcast before the loop");
+        return -1;
     }
-
-    // MARK: Emit for statement
-    void Compiler::emitForStatement(ForStatement *forStm) {
+    
+    bool Compiler::emitVectorizedLoop(Expression* check, Block* body, size_t statementCount, const std::string& induction) {
+        if (!optimization || induction.empty()) return false;
+        auto guard = asBinary(check, TokenType::less);
+        if (!guard || !asSymbol(guard->left(), induction) || !guard->left()->type->isInteger()) return false;
+        if (!dynamic_cast<Literal*>(guard->right()) && !asSymbol(guard->right())) return false; // evaluated once, so it must not have effects
         
-        emitStatement(forStm->init());
+        VectorLoop loop;
+        loop.induction = induction;
+        loop.inductionType = guard->left()->type;
+        loop.bound = guard->right();
+        loop.isWide = _avx2;
+        if (!planVectorLoop(body, statementCount, loop)) return false;
+        if (asSymbol(loop.bound) && loop.isWritten(asSymbol(loop.bound)->value().contents)) return false;
         
-//        static int counter {};
-//
-//        const std::string name =  currentFrame().id + "_#for_loop_" + std::to_string(counter++);
-//        emit(new Label(name, false), SectionType::text); // label to loop to
-//
-//        const Location loc = emitExpression(forStm->check()); // calculate condition
-//        emitBlock(forStm->body());
-//
-//        if (loc.isLiteral) {
-//            if (loc.value.u) {
-//                emitStatement(forStm->modify());
-//                emit(new JumpOperation(JumpOperation::JType::normal, name), SectionType::text); // unconditionally loop block
-//            } else {
-//                leaveFrame();
-//                return;
-//            }
-//        } else {
-//            emitStatement(forStm->modify());
-//            emit(new CmpOperation(loc, NumLL(false, SU(0ULL))), SectionType::text); // subtract from itself
-//            emit(new JumpOperation(JumpOperation::JType::nonzero, name), SectionType::text); // nonzero difference = false
-//            if (IS_REG(loc)) {
-//                returnRegister(static_cast<Register>(loc.reg));
-//            }
-//        }
+        const std::string id = std::to_string(_labels.vectorLoops++);
+        const std::string head = currentFrame().id + "_#vector_head_" + id;
+        const std::string done = currentFrame().id + "_#vector_done_" + id;
+        const std::string scalar = currentFrame().id + "_#vector_scalar_" + id;
+        const long long width = static_cast<long long>(loop.lanes() * loop.elementSize);
+        
+        for (auto& array: loop.arrays) {
+            const auto found = lookup(array.name);
+            array.base = GET_REG(currentFrame());
+            if (array.type->isArray()) {
+                emit(new LoadAddressOperation(RegisterLocation(array.base), found.first.loc, SizeType::qword, "base of " + array.name), SectionType::text);
+            } else {
+                emit(new MoveOperation(RegisterLocation(array.base), found.first.loc, SizeType::qword, "base of " + array.name), SectionType::text);
+            }
+        }
+        
+        // Pointers may overlap what else the loop touches; within a vector of each other the lanes would
+        // observe each other's stores, so such loops stay scalar
+        for (size_t a = 0; a < loop.arrays.size(); a++) {
+            for (size_t b = a + 1; b < loop.arrays.size(); b++) {
+                const auto& first = loop.arrays[a];
+                const auto& second = loop.arrays[b];
+                const bool bothStatic = first.type->isArray() && second.type->isArray();
+                if (bothStatic || !(first.isStored || second.isStored)) continue;
+                const Register distance = GET_REG(currentFrame());
+                const std::string disjoint = currentFrame().id + "_#vector_disjoint_" + id + '_' + std::to_string(a) + '_' + std::to_string(b);
+                emit(new MoveOperation(RegisterLocation(distance), RegisterLocation(first.base), SizeType::qword, "@ " + first.name + " - " + second.name), SectionType::text);
+                emit(new SubOperation(RegisterLocation(distance), RegisterLocation(second.base)), SectionType::text);
+                emit(new AddOperation(RegisterLocation(distance), NumLL(false, SU((uint64_t)width - 1)), SizeType::qword), SectionType::text);
+                emit(new CmpOperation(RegisterLocation(distance), NumLL(false, SU((uint64_t)(2 * width - 2)))), SectionType::text);
+                emit(new JumpOperation(JumpOperation::JType::above, disjoint, "at least a vector apart"), SectionType::text);
+                emit(new CmpOperation(RegisterLocation(distance), NumLL(false, SU((uint64_t)width - 1))), SectionType::text);
+                emit(new JumpOperation(JumpOperation::JType::unequal, scalar, "overlapping within a vector"), SectionType::text);
+                emit(new Label(disjoint, false, false), SectionType::text);
+                returnRegister(distance);
+            }
+        }
+        
+        // Everything the lanes share is computed once
+        for (auto& stm: loop.statements) {
+            std::vector<Expression*> pending { stm.value };
+            while (!pending.empty()) {
+                Expression* expr = pending.back();
+                pending.pop_back();
+                if (asElementAccess(expr, induction)) continue;
+                if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
+                    pending.push_back(binary->left());
+                    pending.push_back(binary->right());
+                    continue;
+                }
+                const auto key = expr->prettystr();
+                if (std::any_of(loop.invariants.begin(), loop.invariants.end(), [&key](const std::pair<std::string, int>& invariant) { return invariant.first == key; })) continue;
+                const Location value = emitExpression(expr);
+                loop.invariants.push_back({key, emitBroadcast(value, loop)});
+            }
+            if (stm.kind == VectorLoop::Kind::sum) {
+                stm.accumulator = loop.allocate();
+                emit(new VectorOperation(loop.isWide ? "vpxor" : "pxor", loop.isWide ? std::vector<VectorOperand>{ loop.vector(stm.accumulator), loop.vector(stm.accumulator), loop.vector(stm.accumulator) } : std::vector<VectorOperand>{ loop.vector(stm.accumulator), loop.vector(stm.accumulator) }, "partial sums of " + stm.target), SectionType::text);
+            } else if (stm.kind != VectorLoop::Kind::store) {
+                const Register current = GET_REG(currentFrame());
+                emitLoad(current, lookup(stm.target).first.loc, stm.targetType, "running " + stm.target);
+                stm.accumulator = emitBroadcast(RegisterLocation(current), loop);
+            }
+        }
+        
+        loop.counter = GET_REG(currentFrame());
+        const Location inductionLoc = lookup(induction).first.loc;
+        emitLoad(loop.counter, inductionLoc, loop.inductionType, induction);
+        Location limit = emitExpression(loop.bound);
+        if (!IS_REG(limit) && !(limit.isLiteral && fitsImmediate(limit.value.s))) {
+            const Register reg = GET_REG(currentFrame());
+            emitLoad(reg, limit, loop.bound->type, "loop bound");
+            limit = RegisterLocation(reg);
+        }
+        const Register next = GET_REG(currentFrame());
+        
+        if (optimization) {
+            emit(new Align(LOOP_HEAD_ALIGNMENT), SectionType::text);
+        }
+        emit(new Label(head, false, false), SectionType::text);
+        emit(new LoadAddressOperation(RegisterLocation(next), ValueAtOffsetRegisterLocation(loop.counter, loop.lanes()), SizeType::qword, "end of this vector"), SectionType::text);
+        emit(new CmpOperation(RegisterLocation(next), limit), SectionType::text);
+        emit(new JumpOperation(loop.inductionType->isSigned() ? JumpOperation::JType::greater : JumpOperation::JType::above, done, "fewer than a vector left"), SectionType::text);
+        for (auto& stm: loop.statements) {
+            bool isTemporary;
+            const int value = emitVectorExpression(stm.value, loop, isTemporary);
+            switch (stm.kind) {
+                case VectorLoop::Kind::store:
+                    emit(new VectorOperation(loop.isWide ? "vmovdqu" : "movdqu", { VectorOperand::memory(loop.array(stm.target)->base, loop.counter, static_cast<int>(loop.elementSize)), loop.vector(value) }, stm.target + '[' + induction + "] = " + stm.value->prettystr()), SectionType::text);
+                    break;
+                case VectorLoop::Kind::sum:
+                case VectorLoop::Kind::min:
+                case VectorLoop::Kind::max: {
+                    const std::string mnemonic = stm.kind == VectorLoop::Kind::sum ? "padd" : (stm.kind == VectorLoop::Kind::min ? "pmin" : "pmax") + std::string(stm.targetType->isSigned() ? "s" : "u");
+                    const std::string full = (loop.isWide ? "v" : "") + mnemonic + laneSuffix(loop.elementSize);
+                    emit(new VectorOperation(full, loop.isWide ? std::vector<VectorOperand>{ loop.vector(stm.accumulator), loop.vector(stm.accumulator), loop.vector(value) } : std::vector<VectorOperand>{ loop.vector(stm.accumulator), loop.vector(value) }, "accumulate " + stm.target), SectionType::text);
+                    break;
+                }
+            }
+            if (isTemporary) loop.used[value] = false;
+        }
+        emit(new AddOperation(RegisterLocation(loop.counter), NumLL(false, SU((uint64_t)loop.lanes())), SizeType::qword, "next vector"), SectionType::text);
+        emit(new JumpOperation(JumpOperation::JType::normal, head), SectionType::text);
+        emit(new Label(done, false, false), SectionType::text);
+        emitStore(inductionLoc, RegisterLocation(loop.counter), loop.inductionType, "@ " + induction + " after the vector loop");
         
-        forStm->body()->insert(forStm->modify());
-        emitWhileStatement(new WhileStatement(forStm->_loc, forStm->check(), forStm->body()));
+        // Fold each accumulator's lanes into one and merge it into the variable
+        for (auto& stm: loop.statements) {
+            if (stm.kind == VectorLoop::Kind::store) continue;
+            const std::string mnemonic = (loop.isWide ? "v" : "") + (stm.kind == VectorLoop::Kind::sum ? std::string("padd") : (stm.kind == VectorLoop::Kind::min ? "pmin" : "pmax") + std::string(stm.targetType->isSigned() ? "s" : "u")) + laneSuffix(loop.elementSize);
+            const int fold = loop.allocate();
+            const VectorOperand acc = VectorOperand::vector(stm.accumulator, false);
+            const VectorOperand half = VectorOperand::vector(fold, false);
+            if (loop.isWide) {
+                emit(new VectorOperation("vextracti128", { half, loop.vector(stm.accumulator), VectorOperand::immediate(1) }), SectionType::text);
+                emit(new VectorOperation(mnemonic, { acc, acc, half }), SectionType::text);
+            }
+            for (long long shift = 8; shift >= static_cast<long long>(loop.elementSize); shift /= 2) {
+                if (loop.isWide) {
+                    emit(new VectorOperation("vpsrldq", { half, acc, VectorOperand::immediate(shift) }), SectionType::text);
+                    emit(new VectorOperation(mnemonic, { acc, acc, half }), SectionType::text);
+                } else {
+                    emit(new VectorOperation("movdqa", { half, acc }), SectionType::text);
+                    emit(new VectorOperation("psrldq", { half, VectorOperand::immediate(shift) }), SectionType::text);
+                    emit(new VectorOperation(mnemonic, { acc, half }), SectionType::text);
+                }
+            }
+            const Register lane = GET_REG(currentFrame());
+            emit(new VectorOperation(loop.isWide ? "vmovq" : "movq", { VectorOperand::general(lane), acc }, "lane 0 = " + stm.target), SectionType::text);
+            const Location variable = lookup(stm.target).first.loc;
+            if (stm.kind == VectorLoop::Kind::sum) {
+                const Register total = GET_REG(currentFrame());
+                emitLoad(total, variable, stm.targetType);
+                emit(new AddOperation(RegisterLocation(total), RegisterLocation(lane), SizeType::qword, "add the partial sums"), SectionType::text);
+                emitStore(variable, RegisterLocation(total), stm.targetType, "@ " + stm.target);
+                returnRegister(total);
+            } else {
+                emitStore(variable, RegisterLocation(lane), stm.targetType, "@ " + stm.target);
+            }
+            returnRegister(lane);
+            loop.used[fold] = false;
+        }
+        if (loop.isWide) {
+            emit(new VectorOperation("vzeroupper", {}, "avoid SSE transition stalls after AVX"), SectionType::text);
+        }
         
+        returnRegister(next);
+        if (IS_REG(limit)) returnRegister(static_cast<Register>(limit.reg));
+        returnRegister(loop.counter);
+        for (auto& array: loop.arrays) returnRegister(array.base);
+        emit(new Label(scalar, false, false), SectionType::text); // the scalar loop finishes the remaining iterations
+        return true;
+    }
+
+    // MARK: While statement
+    void Compiler::emitWhileStatement(WhileStatement* whileStm) {
+        const auto& body = whileStm->body()->body();
+        if (!body.empty()) emitVectorizedLoop(whileStm->condition(), whileStm->body(), body.size() - 1, unitIncrement(body.back()));
+        emitLoop(whileStm->condition(), whileStm->body());
+    }
+
+    // MARK: Emit for statement
+    void Compiler::emitForStatement(ForStatement *forStm) {
+        const FrameScope scope = currentFrame().openScope(); // the loop variable lives only as long as the loop
+        emitStatement(forStm->init());
+        emitVectorizedLoop(forStm->check(), forStm->body(), forStm->body()->body().size(), unitIncrement(forStm->modify()));
+        emitLoop(forStm->check(), forStm->body(), forStm->modify()); // modify runs at the end of each iteration
+        currentFrame().closeScope(scope);
     }
 
     // MARK: Block statement
     void Compiler::emitBlock(Block* block) {
         // MARK: BAD BUT WILL DO FOR NOW
-        for (auto node: block->body()) {
-            if (auto stm = dynamic_cast<Statement*>(node)) {
+        const FrameScope scope = currentFrame().openScope();
+        const auto& body = block->body();
+        for (size_t i = 0; i < body.size(); i++) {
+            if (auto stm = dynamic_cast<Statement*>(body[i])) {
+                auto callStm = dynamic_cast<CallStatement*>(stm);
+                if (callStm && i + 1 < body.size() && isBareReturn(body[i + 1]) && emitTailCall(callStm->call)) {
+                    i++;
+                    continue;
+                }
                 emitStatement(stm);
-            } else if (auto decl = dynamic_cast<Declaration*>(node)) {
+            } else if (auto decl = dynamic_cast<Declaration*>(body[i])) {
                 emitDeclaration(decl);
             }
         }
+        currentFrame().closeScope(scope); // locals of this block are dead, so siblings may reuse their slots
     }
 
     // MARK: Emit general declaration
@@ -406,15 +983,77 @@ namespace Floral {
     }
 
     // MARK: Emit global constant
+    // A global's value goes into the constant pool under an alias when it is a string or a list of integers,
+    // so it shares storage with equal literals and globals
+    static bool qwordBytes(const std::string& values, std::string& bytes) {
+        const char* cursor = values.c_str();
+        while (*cursor) {
+            char* end;
+            const long long value = strtoll(cursor, &end, 0);
+            if (end == cursor) return false;
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof value);
+            cursor = end;
+            if (*cursor == ',') cursor++;
+            while (*cursor == ' ') cursor++;
+        }
+        return !bytes.empty();
+    }
     void Compiler::emitGlobal(GlobalDeclaration *gbl) {
+        // An integer or Bool global is substituted at its uses, so often needs no storage at all
+        if ((gbl->type->isInteger() || gbl->type->isBool()) && gbl->type->size() <= 8) {
+            Expression* expr = nullptr;
+            if (auto direct = dynamic_cast<const DirectInitializer*>(gbl->initializer())) {
+                expr = direct->expr();
+            } else if (auto copy = dynamic_cast<const CopyInitializer*>(gbl->initializer())) {
+                expr = copy->expr();
+            }
+            const std::string value = expr ? staticEvalulate(expr) : "0";
+            char* end;
+            const bool isNegative = value[0] == '-';
+            const uint64_t bits = isNegative ? static_cast<uint64_t>(strtoll(value.c_str(), &end, 0)) : strtoull(value.c_str(), &end, 0);
+            if (!value.empty() && !*end) {
+                _globalConstants[gbl->name.contents] = isNegative ? NumLL(true, SU(static_cast<int64_t>(bits))) : NumLL(gbl->type->isSigned(), SU(bits));
+            }
+        }
+        _globals.push_back(gbl);
+    }
+    void Compiler::emitGlobalStorage(GlobalDeclaration *gbl) {
         Initializer* init = gbl->initializer();
         if (init->type == Initializer::zero) {
             emit(new ZeroData(gbl->name.contents, OPSIZE_FROM_NUM(gbl->type->alignment()), 1), SectionType::bss);
-        } else if (auto direct = dynamic_cast<const DirectInitializer*>(init)) {
-            emit(new RawText(INDENT + prefixed(gbl->name.contents) + ": " + ((direct->expr()->type->isPointer() && GET_PTRTYYPE(direct->expr()->type)->size() == 1) ? "db " : "dq ") + staticEvalulate(direct->expr())), SectionType::rodata);
+            return;
+        }
+        Expression* expr = nullptr;
+        if (auto direct = dynamic_cast<const DirectInitializer*>(init)) {
+            expr = direct->expr();
         } else if (auto copy = dynamic_cast<const CopyInitializer*>(init)) {
-            emit(new RawText(INDENT + prefixed(gbl->name.contents) + ": " + ((copy->expr()->type->isPointer() && GET_PTRTYYPE(copy->expr()->type)->size() == 1) ? "db " : "dq ") + staticEvalulate(copy->expr())), SectionType::rodata);
+            expr = copy->expr();
+        }
+        if (!expr) return;
+        const bool isByteString = expr->type->isPointer() && GET_PTRTYYPE(expr->type)->size() == 1;
+        auto literal = dynamic_cast<Literal*>(expr);
+        if (isByteString && literal && literal->type() == Literal::LType::cString) {
+            _constants.alias(gbl->name.contents, _constants.internString(literalBytes(literal->value().contents)));
+            return;
+        }
+        Interpreter::Value evaluated;
+        if (!isByteString && analyzer._interpreter.evaluated(expr, evaluated)) {
+            // computed by a const func, so laid out exactly as the global's type would be in memory
+            const std::string bytes = Interpreter::image(evaluated, gbl->type);
+            Location image = _constants.intern(bytes, bytes.size() % 8 ? 1 : 8, 8);
+            if (gbl->type->isStruct()) {
+                image.offset = static_cast<long>(gbl->type->size()) - 8; // a struct's address is its first member
+            }
+            _constants.alias(gbl->name.contents, image);
+            return;
+        }
+        const std::string value = staticEvalulate(expr);
+        std::string bytes;
+        if (!isByteString && qwordBytes(value, bytes)) {
+            _constants.alias(gbl->name.contents, _constants.intern(bytes, 8, 8));
+            return;
         }
+        emit(new RawText(INDENT + prefixed(gbl->name.contents) + ": " + (isByteString ? "db " : "dq ") + value), SectionType::rodata);
     }
 
     // MARK: Emit forward-declared global constant
@@ -427,36 +1066,34 @@ namespace Floral {
     void Compiler::emitStructConstructor(StructDeclaration* strct, StructConstructor* constr) {
         const std::string str = analyzer.strFromFunctionSignature({ strct->name().contents + "._CONSTR", constr->params });
         emit(new Label(str, false), SectionType::text);
-        const long structStart = currentFrame().nextOffset();
+        const long structStart = currentFrame().top;
         const long dif = currentFrame().size + 8;
-        emitEnter();
+        emitEnter(); currentFrame().id = str;
+        const RecursionEntry enclosing = _recursion;
+        _recursion = {}; // a constructor's frame is not a function body
+        SubOperation* allocation = new SubOperation(RegisterLocation(Register::rsp), NumLL(true, SU(0LL)), "allocate space on the stack for local variables");
+        emit(allocation, SectionType::text);
         loadParametersIntoFrame(constr->params);
         for (auto init: constr->inits) {
-            Location result = emitExpression(init.second);
+            const Location result = emitExpression(init.second);
             const long localizedStructStart = dif - structStart;
             const long offset = strct->offsetOf(init.first.contents);
             const long memberOffset = localizedStructStart - offset;
             
-            if (result.isDereference) {
-                const Register reg = GET_REG(currentFrame());
-                emit(new MoveOperation(RegisterLocation(reg), result, SizeType::qword, "move result into temp reg"), SectionType::text);
-                result = RegisterLocation(reg);
-
-                returnRegister(reg);
-            }
-            
-            emit(new MoveOperation(RBPOffsetLocation(memberOffset), result, SizeType::qword, "member init"), SectionType::text);
+            emitStore(RBPOffsetLocation(memberOffset), result, init.second->type, "member init");
         }
         emitStatement(constr->after);
-        leaveFrame();
+        _recursion = enclosing;
         emitLeave();
         emitRet();
+        finishFrameAllocation(allocation);
+        leaveFrame();
     }
 
     // MARK: Emit struct
     void Compiler::emitStruct(StructDeclaration* strct) {
         frames.push_back({});
-        auto t = new Type(0, strct->name().contents);
+        auto t = new Type(strct);
         currentFrame().addData(RegisterLocation(Register::rdi), 8, "this");
         for (auto fnmem: strct->functionMembers()) {
             fnmem->_name.contents.insert(0, strct->name().contents + ".");
@@ -469,87 +1106,66 @@ namespace Floral {
         delete t;
     }
 
-    // If array literal, sequentially initialize the elements
+    // If array literal, initialize the elements in bulk where possible
    #define ARRAY_BRANCH(d, n) if ((d)->type()->isArray()) {\
        if (auto arraylit = dynamic_cast<ArrayLiteralExpression*>(init->expr())) {\
-           size_t i = arraylit->values().size();\
-           for (auto iter = arraylit->values().rbegin(); iter != arraylit->values().rend(); iter++) {\
-               auto val = *iter;\
-               Location result = emitExpression(val);\
-               if (result.isDereference) {\
-                   const Register reg = GET_REG(currentFrame());\
-                   emit(new MoveOperation(RegisterLocation(reg), result, SizeType::qword, "store result in temp reg"), SectionType::text);\
-                   result = RegisterLocation(reg);\
-                   returnRegister(reg);\
-               }\
-                emit(new MoveOperation(RBPOffsetLocation(currentFrame().nextOffset()), result, OPSIZE_FROM_NUM(val->type->size()), #n " " + name + '[' + std::to_string(--i) + "];"), SectionType::text);\
-                if (!i) {\
-                    currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), val->type->size(), name);\
-                } else {\
-                    currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), val->type->size(), name + " + " + std::to_string(i));\
-                }\
-               if (IS_REG(result)) {\
-                   returnRegister(static_cast<Register>(result.reg));\
-               }\
-           }\
+           const long base = currentFrame().allocate((d)->type()->alignment());\
+           emitArrayLiteral(arraylit, (d)->type(), base, #n " " + name);\
+           currentFrame().addData(RBPOffsetLocation(base), (d)->type()->alignment(), name);\
            break;\
        }\
    }
+    // If another struct variable, copy all of its slots at once
+   #define STRUCT_BRANCH(d, n) if ((d)->type()->isStruct() && dynamic_cast<SymbolExpression*>(init->expr())) {\
+       const long size = static_cast<long>((d)->type()->alignment());\
+       const long base = currentFrame().allocate(size);\
+       emitStructCopy(RBPOffsetLocation(base), init->expr(), "@ " #n " " + name + ": " + (d)->type()->des());\
+       currentFrame().addData(RBPOffsetLocation(base + size - 8), size, name);\
+       break;\
+   }
 
     // MARK: Emit local variable
     void Compiler::emitLocalVar(VarStatement *v) {
         if (!v->initializer()) {
             const std::string name = v->name().contents;
-            currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), v->type()->alignment(), name);
+            currentFrame().addData(RBPOffsetLocation(currentFrame().allocate(v->type()->alignment())), v->type()->alignment(), name);
             return;
         }
         switch (v->initializer()->type) {
             case Initializer::zero: {
-                const size_t size = v->type()->size();
                 const std::string name = v->name().contents;
                 
-                 if (v->type()->isArray()) {
-                     const std::string lbl = name + "#zeroarray";
-                     const size_t elementSize = GET_PTRTYYPE(v->type())->size();
-                     const size_t arrayCount = v->type()->_staticArray->second;
-                     currentFrame().addData(RelLabelL(lbl), elementSize * arrayCount, name);
-                     //currentFrame().data.back().loc.isDereference = false;
-                     // If array literal, sequentially initialize the elements
-                     emit(new ZeroData(lbl, OPSIZE_FROM_NUM(elementSize), arrayCount), SectionType::bss);
-                 } else {
-                    emit(
-                         new MoveOperation(
-                            RBPOffsetLocation(currentFrame().nextOffset()),
-                            NumLL(false, SU(0ULL)),
-                            SizeType::qword, //OPSIZE_FROM_NUM(size),
-                            "@ var " + name + " = 0"
-                        ),
-                        SectionType::text
-                    );
-                    currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), size, name);
+                if (v->type()->isArray()) {
+                    // Each call gets its own zeroed copy, which also keeps recursive and reentrant calls apart
+                    const long size = static_cast<long>(v->type()->alignment());
+                    const long base = currentFrame().allocate(size);
+                    emitMemoryZero(RBPOffsetLocation(base), size, "@ var " + name + " = 0");
+                    currentFrame().addData(RBPOffsetLocation(base), size, name);
+                } else if (v->type()->isStruct()) {
+                    const long size = static_cast<long>(v->type()->alignment());
+                    const long base = currentFrame().allocate(size);
+                    emitMemoryZero(RBPOffsetLocation(base), size, "@ var " + name + " = 0");
+                    currentFrame().addData(RBPOffsetLocation(base + size - 8), size, name);
+                } else {
+                    const Location slot = RBPOffsetLocation(currentFrame().allocate(v->type()->alignment()));
+                    emitStore(slot, NumLL(false, SU(0ULL)), v->type(), "@ var " + name + " = 0");
+                    currentFrame().addData(slot, v->type()->alignment(), name);
                 }
                 break;
             }
             case Initializer::direct: {
                 const auto init {static_cast<const DirectInitializer*>(v->initializer())};
                 auto exprtype = init->expr()->type;
-                const size_t size = v->type()->size();
                 const std::string name = v->name().contents;
                 ARRAY_BRANCH(v, var)
+                STRUCT_BRANCH(v, var)
                 const Location result = emitExpression(init->expr(), false, exprtype->isPointer() ? !GET_PTRTYYPE(exprtype)->isConst() : !exprtype->isConst());
-                emit(
-                    new MoveOperation(
-                        RBPOffsetLocation(currentFrame().nextOffset()),
-                        result,
-                        SizeType::qword, //OPSIZE_FROM_NUM(size),
-                        "@ var " + name + ": " + v->type()->des()
-                    ),
-                    SectionType::text
-                );
+                const Location slot = RBPOffsetLocation(currentFrame().allocate(v->type()->alignment()));
+                emitStore(slot, result, v->type(), "@ var " + name + ": " + v->type()->des());
                 if (IS_REG(result)) {
                     returnRegister(static_cast<Register>(result.reg));
                 }
-                currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), size, name);
+                currentFrame().addData(slot, v->type()->alignment(), name);
                 break;
             }
             case Initializer::copy: {
@@ -558,24 +1174,18 @@ namespace Floral {
                 const size_t size = v->type()->size();
                 const std::string name = v->name().contents;
                 ARRAY_BRANCH(v, var)
+                STRUCT_BRANCH(v, var)
                 const Location result = emitExpression(init->expr(), false, exprtype->isPointer() ? !GET_PTRTYYPE(exprtype)->isConst() : !exprtype->isConst());
                 if (dynamic_cast<ConstructExpression*>(init->expr())) {
                     currentFrame().addData(result, size, name);
                     return;
                 }
-                emit(
-                    new MoveOperation(
-                        RBPOffsetLocation(currentFrame().nextOffset()),
-                        result,
-                        SizeType::qword, //OPSIZE_FROM_NUM(size),
-                        "@ var " + name + ": " + v->type()->des()
-                    ),
-                    SectionType::text
-                );
+                const Location slot = RBPOffsetLocation(currentFrame().allocate(v->type()->alignment()));
+                emitStore(slot, result, v->type(), "@ var " + name + ": " + v->type()->des());
                 if (IS_REG(result)) {
                     returnRegister(static_cast<Register>(result.reg));
                 }
-                currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), size, name);
+                currentFrame().addData(slot, v->type()->alignment(), name);
                 break;
             }
         }
@@ -585,73 +1195,65 @@ namespace Floral {
     void Compiler::emitLocalConst(LetStatement *l) {
         switch (l->initializer()->type) {
             case Initializer::zero: {
-                const size_t size = l->type()->size();
                 const std::string name = l->name().contents;
                 
                 if (l->type()->isArray()) {
-                    const std::string lbl = name + "#zeroarray";
-                    const size_t elementSize = GET_PTRTYYPE(l->type())->size();
-                    const size_t arrayCount = l->type()->_staticArray->second;
-                    currentFrame().addData(RelLabelL(lbl), elementSize * arrayCount, name);
-                    //currentFrame().data.back().loc.isDereference = false;
-                        // If array literal, sequentially initialize the elements
-                    emit(new ZeroData(lbl, OPSIZE_FROM_NUM(elementSize), arrayCount), SectionType::bss);
+                    const long size = static_cast<long>(l->type()->alignment());
+                    const long base = currentFrame().allocate(size);
+                    emitMemoryZero(RBPOffsetLocation(base), size, "@ let " + name + " = 0");
+                    currentFrame().addData(RBPOffsetLocation(base), size, name);
+                } else if (l->type()->isStruct()) {
+                    const long size = static_cast<long>(l->type()->alignment());
+                    const long base = currentFrame().allocate(size);
+                    emitMemoryZero(RBPOffsetLocation(base), size, "@ let " + name + " = 0");
+                    currentFrame().addData(RBPOffsetLocation(base + size - 8), size, name);
                 } else {
-                    emit(
-                        new MoveOperation(
-                            RBPOffsetLocation(currentFrame().nextOffset()),
-                            NumLL(false, SU(0ULL)),
-                            SizeType::qword, //OPSIZE_FROM_NUM(size),
-                            "@ let " + name + " = 0"
-                        ),
-                        SectionType::text
-                    );
-                    currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), size, name);
+                    const Location slot = RBPOffsetLocation(currentFrame().allocate(l->type()->alignment()));
+                    emitStore(slot, NumLL(false, SU(0ULL)), l->type(), "@ let " + name + " = 0");
+                    if (l->type()->isInteger() || l->type()->isBool()) {
+                        currentFrame().addConstant(slot, l->type()->alignment(), name, NumLL(false, SU(0ULL)));
+                    } else {
+                        currentFrame().addData(slot, l->type()->alignment(), name);
+                    }
                 }
                 break;
             }
             case Initializer::direct: {
                 const auto init {static_cast<const DirectInitializer*>(l->initializer())};
                 auto exprtype = init->expr()->type;
-                const size_t size = l->type()->size();
                 const std::string name = l->name().contents;
                 ARRAY_BRANCH(l, let)
+                STRUCT_BRANCH(l, let)
                 const Location result = emitExpression(init->expr(), false, exprtype->isPointer() ? !GET_PTRTYYPE(exprtype)->isConst() : !exprtype->isConst());
-                emit(
-                    new LoadAddressOperation(
-                        RBPOffsetLocation(currentFrame().nextOffset()),
-                        result,
-                        SizeType::qword, //OPSIZE_FROM_NUM(size),
-                        "@ let " + name + ": " + l->type()->des()
-                    ),
-                    SectionType::text
-                );
+                const Location slot = RBPOffsetLocation(currentFrame().allocate(l->type()->alignment()));
+                emitStore(slot, result, l->type(), "@ let " + name + ": " + l->type()->des());
                 if (IS_REG(result)) {
                     returnRegister(static_cast<Register>(result.reg));
                 }
-                currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), size, name);
+                if (result.isLiteral && (l->type()->isInteger() || l->type()->isBool())) {
+                    currentFrame().addConstant(slot, l->type()->alignment(), name, result); // the slot is only read through &name
+                } else {
+                    currentFrame().addData(slot, l->type()->alignment(), name);
+                }
                 break;
             }
             case Initializer::copy: {
                 const auto init {static_cast<const CopyInitializer*>(l->initializer())};
                 auto exprtype = init->expr()->type;
-                const size_t size = l->type()->size();
                 const std::string name = l->name().contents;
                 ARRAY_BRANCH(l, let)
+                STRUCT_BRANCH(l, let)
                 const Location result = emitExpression(init->expr(), false, exprtype->isPointer() ? !GET_PTRTYYPE(exprtype)->isConst() : !exprtype->isConst());
-                emit(
-                    new MoveOperation(
-                        RBPOffsetLocation(currentFrame().nextOffset()),
-                        result,
-                        SizeType::qword, //OPSIZE_FROM_NUM(size),
-                        "@ let " + name + ": " + l->type()->des()
-                    ),
-                    SectionType::text
-                );
+                const Location slot = RBPOffsetLocation(currentFrame().allocate(l->type()->alignment()));
+                emitStore(slot, result, l->type(), "@ let " + name + ": " + l->type()->des());
                 if (IS_REG(result)) {
                     returnRegister(static_cast<Register>(result.reg));
                 }
-                currentFrame().addData(RBPOffsetLocation(currentFrame().nextOffset()), size, name);
+                if (result.isLiteral && (l->type()->isInteger() || l->type()->isBool())) {
+                    currentFrame().addConstant(slot, l->type()->alignment(), name, result); // the slot is only read through &name
+                } else {
+                    currentFrame().addData(slot, l->type()->alignment(), name);
+                }
                 break;
             }
         }
@@ -663,54 +1265,113 @@ namespace Floral {
         const auto flbl {analyzer.strFromFunctionSignature(funsig)};
         emit(new Label(flbl, !func->isStatic()), SectionType::text); // label this code
         emitEnter(); currentFrame().id = flbl; // create new frame
-                
+        
+        const RecursionEntry enclosing = _recursion;
+        _recursion = { func, new Label('#' + flbl + "#recurse", false, false), {}, false };
+        
+        // [rbp] = old stack frame
+        // [rbp-8] = first local variable or spilled parameter
+        // The amount to allocate is only known once every slot in the body has been assigned
+        SubOperation* allocation = new SubOperation(RegisterLocation(Register::rsp), NumLL(true, SU(0LL)), "allocate space on the stack for local variables");
+        emit(allocation, SectionType::text);
+        
         if (func->body().size() == 1) {
             if (auto ret = dynamic_cast<ReturnStatement*>(func->body().front())) {
                 loadParametersIntoFrame(func->parameters(), false, isFunctionMember);
+                if (!isFunctionMember) emitRecursionEntry(func->parameters().size());
                 emitReturnStatement(ret);
+                finishRecursionEntry(enclosing);
+                finishFrameAllocation(allocation);
                 leaveFrame();
                 return;
             }
         }
         
-        // [rbp-N] = first function parameter, where N is the
-        //           sum of the sizes of the function parameter
-        //           aligned to 16 bytes
-        // [rbp] = old stack frame
-        // [rbp-8] = first local variable
-        auto sz = (long long)(func->staticAllocationSize + func->parameters().size() * 8);
-        long long staticAllocationSize { (sz + 15) & (-16) };
-        if (_stackGuard) {
-            staticAllocationSize += 16;
-        }
-
-        if (staticAllocationSize && (!(staticAllocationSize > 128 && func->isLeaf()) || _stackGuard)) {
-            emit(new SubOperation(RegisterLocation(Register::rsp), NumLL(true, SU(staticAllocationSize)), "allocate space on the stack for local variables"), SectionType::text);
-            currentFrame().size = staticAllocationSize;
-        }
-        
         emitSGPrologue();
 
         loadParametersIntoFrame(func->parameters(), true);
+        if (!isFunctionMember) emitRecursionEntry(func->parameters().size());
         
-        size_t i = 0;
-        for (auto node: func->body()) {
-            if (auto stm = dynamic_cast<Statement*>(node)) {
-                if (i + 2 == func->body().size() && !_stackGuard && func->returnType()->isVoid()) if (auto callStm = dynamic_cast<CallStatement*>(stm)) {
-                    emitCall(callStm->call, true);
-                    leaveFrame();
-                    return;
+        const auto& body = func->body();
+        for (size_t i = 0; i < body.size(); i++) {
+            if (auto stm = dynamic_cast<Statement*>(body[i])) {
+                auto callStm = dynamic_cast<CallStatement*>(stm);
+                if (callStm && i + 1 < body.size() && isBareReturn(body[i + 1]) && emitTailCall(callStm->call)) {
+                    i++; // the jump leaves the function, so the return is never reached
+                    continue;
                 }
                 emitStatement(stm);
             }
-            if (auto decl = dynamic_cast<Declaration*>(node)) emitDeclaration(decl);
-            i++;
+            if (auto decl = dynamic_cast<Declaration*>(body[i])) emitDeclaration(decl);
         }
         
         // Integer return values up to 64 bits in size are stored in RAX while values up to 128 bit are stored in RAX and RDX
+        finishRecursionEntry(enclosing);
+        finishFrameAllocation(allocation);
         leaveFrame(); // pop_back the current Frame from std::vector frames
     }
 
+    // MARK: Tail calls
+    void Compiler::emitRecursionEntry(size_t parameterCount) {
+        emit(_recursion.label, SectionType::text);
+        const auto& data = currentFrame().data;
+        for (auto i = data.end() - parameterCount; i != data.end(); ++i) {
+            _recursion.parameters.push_back(i->loc); // the parameters are the last variables loaded by the prologue
+        }
+    }
+    void Compiler::finishRecursionEntry(const RecursionEntry& enclosing) {
+        if (!_recursion.used) { // no self tail call jumped back, so the label would only split peephole windows
+            auto& instructions = textSection.instructions;
+            const auto position = std::find(instructions.begin(), instructions.end(), _recursion.label);
+            if (position != instructions.end()) instructions.erase(position);
+            delete _recursion.label;
+        }
+        _recursion = enclosing;
+    }
+    bool Compiler::isBareReturn(const Node* node) const {
+        auto rtnStm = dynamic_cast<const ReturnStatement*>(node);
+        return rtnStm && !rtnStm->value();
+    }
+    static long long stackArgumentCount(const std::vector<Expression*>& args);
+    bool Compiler::emitTailCall(Call* call) {
+        // A stack guard must be checked before leaving, stack arguments would need the caller's incoming
+        // argument area, and a substituted body has no frame of its own to leave
+        if (!_recursion.function || _stackGuard || !_inlineSites.empty() || stackArgumentCount(call->args)) return false;
+        if (std::find(call->args.begin(), call->args.end(), nullptr) != call->args.end()) return false;
+        
+        const FunctionSignature funsig {call->name.contents, call->_spa_params};
+        const std::string label = analyzer.strFromFunctionSignature(funsig);
+        Function* callee = dynamic_cast<Function*>(analyzer.lookupFunction(call->name.contents, call->_spa_params));
+        if (callee && shouldInline(callee, label)) return false; // substituting the body beats jumping to it
+        
+        if (callee == _recursion.function && _recursion.parameters.size() == call->args.size()) {
+            // Self recursion rebinds the parameters and restarts the body in the same frame, so it runs as a loop
+            std::vector<Location> values;
+            for (auto arg: call->args) {
+                Location value = emitExpression(arg);
+                if (!IS_REG(value) && !value.isLiteral) {
+                    const Register temp = GET_REG(currentFrame());
+                    emitLoad(temp, value, arg->type);
+                    value = RegisterLocation(temp);
+                }
+                values.push_back(value);
+            }
+            const auto& params = callee->parameters();
+            for (size_t index = 0; index < values.size(); index++) {
+                emitStore(_recursion.parameters[index], values[index], params[index].type, "rebind " + params[index].name.contents);
+                if (IS_REG(values[index])) returnRegister(static_cast<Register>(values[index].reg));
+            }
+            emit(new JumpOperation(JumpOperation::JType::normal, _recursion.label->lbl, call->generateTypeDescription() + " && self tail call"), SectionType::text);
+            _recursion.used = true;
+            return true;
+        }
+        
+        emitCallArguments(call->args); // evaluated while this frame's locals are still addressable
+        emitLeave();
+        emit(new JumpOperation(JumpOperation::JType::normal, label, call->generateTypeDescription() + " && tail call optimization"), SectionType::text);
+        return true;
+    }
+
     void Compiler::emitExternFunc(FunctionForwardDeclaration* ffunc) {
         const FunctionSignature funsig {ffunc->name().contents, ffunc->parameters()};
         std::string acc = "@ " + ffunc->name().contents + '(';
@@ -730,24 +1391,78 @@ namespace Floral {
     }
 
     // MARK: Various subroutine components
+    #define STACK_PAGE_SIZE 4096
+    void Compiler::finishFrameAllocation(SubOperation* allocation) {
+        Frame& frame = currentFrame();
+        auto& instructions = textSection.instructions;
+        // Borrowed callee-saved registers get slots below every local, filled once after the allocation
+        frame.top = frame.deepest;
+        for (auto reg: frame.calleeSaved) {
+            const Location slot = RBPOffsetLocation(frame.allocate(8));
+            const auto after = std::find(instructions.begin(), instructions.end(), allocation) + 1;
+            instructions.insert(after, new MoveOperation(slot, RegisterLocation(reg), SizeType::qword, "@ preserve callee-saved " + registerNames[static_cast<int>(reg)]));
+            for (auto epilogue: frame.epilogues) {
+                const auto exit = std::find(instructions.begin(), instructions.end(), epilogue);
+                if (exit != instructions.end()) instructions.insert(exit, new MoveOperation(RegisterLocation(reg), slot, SizeType::qword, "@ restore callee-saved " + registerNames[static_cast<int>(reg)]));
+            }
+        }
+        
+        const long long frameSize = (-frame.deepest + 15) & -16;
+        const auto position = std::find(instructions.begin(), instructions.end(), allocation);
+        // A body that neither calls nor pushes can leave its locals in the 128-byte red zone below rsp
+        const bool fitsRedZone = !_stackGuard && frameSize <= 128 && std::none_of(position, instructions.end(), [](Instruction* instr) {
+            return dynamic_cast<PushOperation*>(instr) || dynamic_cast<CallOperation*>(instr);
+        });
+        if (!frameSize || fitsRedZone) {
+            instructions.erase(position);
+            delete allocation;
+            return;
+        }
+        allocation->src = NumLL(true, SU(frameSize));
+        currentFrame().size = frameSize;
+        _stackFromMain += frameSize;
+        if (_stackProbe && frameSize > STACK_PAGE_SIZE) {
+            // Move rsp down a page at a time and touch each page, so a large frame cannot step over the guard page
+            const std::string probe = frame.id + "_#stack_probe";
+            instructions.insert(std::find(instructions.begin(), instructions.end(), allocation), {
+                new MoveOperation(RegisterLocation(Register::r11), NumLL(false, SU((uint64_t)(frameSize / STACK_PAGE_SIZE))), SizeType::qword, "@ pages to probe"),
+                new Label(probe, false, false),
+                new SubOperation(RegisterLocation(Register::rsp), NumLL(true, SU((long long)STACK_PAGE_SIZE)), "allocate a page"),
+                new MoveOperation(ValueAtRegisterLocation(Register::rsp), ZeroLL, SizeType::qword, "@ probe it"),
+                new SubOperation(RegisterLocation(Register::r11), OneLL, "@ count pages"),
+                new JumpOperation(Condition::nonzero, probe)
+            });
+            if (frameSize % STACK_PAGE_SIZE) {
+                allocation->src = NumLL(true, SU(frameSize % STACK_PAGE_SIZE));
+            } else {
+                instructions.erase(std::find(instructions.begin(), instructions.end(), allocation));
+                delete allocation;
+            }
+        }
+    }
     void Compiler::emitEnter() {
         enterFrame(); // create a new Frame and push_back it to the std::vector frames
         emit(new PushOperation(RegisterLocation(Register::rbp), "store old frame"), SectionType::text); // save old stack frame pointer
         emit(new MoveOperation(RegisterLocation(Register::rbp), RegisterLocation(Register::rsp), SizeType::qword, "push new frame"), SectionType::text); // create new stack frame pointer
         currentFrame().addData(RBPOffsetLocation(0), 8, "old_rbp"); // the old rbp is pushed and thus stored at offset 0 in this frame
+        currentFrame().pushed = 0; // rsp is 16-byte aligned once rbp is pushed
     }
         void Compiler::emitLeave() {
             //emit(new LeaveOperation("restore old frame"), SectionType::text); // leave current stack frame
-            emit(new MoveOperation(RegisterLocation(Register::rsp), RegisterLocation(Register::rbp), SizeType::qword, "pop this frame"), SectionType::text);
+            const long pushed = currentFrame().pushed; // code after this exit still runs with the frame in place
+            MoveOperation* pop = new MoveOperation(RegisterLocation(Register::rsp), RegisterLocation(Register::rbp), SizeType::qword, "pop this frame");
+            currentFrame().epilogues.push_back(pop);
+            emit(pop, SectionType::text);
             emit(new PopOperation(RegisterLocation(Register::rbp), "restore old frame"), SectionType::text);
+            currentFrame().pushed = pushed;
         }
         void Compiler::emitRet() {
             emit(new ReturnOperation("return from function"), SectionType::text); // pop return address from stack and jump to it
         }
     void Compiler::emitSGPrologue() {
         if (_stackGuard) {
-            currentFrame().addData(RBPOffsetLocation(-8), 8, "Stack Guard");
-            currentFrame().addData(RBPOffsetLocation(-16), 8, "Null Qword");
+            currentFrame().addData(RBPOffsetLocation(currentFrame().allocate(8)), 8, "Stack Guard"); // first slot, so always [rbp-8]
+            currentFrame().addData(RBPOffsetLocation(currentFrame().allocate(8)), 8, "Null Qword");
             emit(new MoveOperation(RETURN_VALUE_LOC, RBPOffsetLocation(0), SizeType::qword, "load old rbp"), SectionType::text);
             emit(new XorOperation(RETURN_VALUE_LOC, RBPOffsetLocation(8), "xor with return address"), SectionType::text);
             emit(new MoveOperation(RBPOffsetLocation(-8), RETURN_VALUE_LOC, SizeType::qword, "stack guard"), SectionType::text);
@@ -760,8 +1475,7 @@ namespace Floral {
             emit(new MoveOperation(RegisterLocation(reg), RBPOffsetLocation(0), SizeType::qword, "load old rbp "), SectionType::text);
             emit(new XorOperation(RegisterLocation(reg), RBPOffsetLocation(8), "xor with return address"), SectionType::text);
             emit(new CmpOperation(RegisterLocation(reg), RBPOffsetLocation(-8), "check if different than stack guard"), SectionType::text);
-            static int skipper = 0;
-            const std::string skiplbl = '#' + currentFrame().id + "#check_skip_" + std::to_string(skipper++);
+            const std::string skiplbl = '#' + currentFrame().id + "#check_skip_" + std::to_string(_labels.stackChecks++);
             emit(new JumpOperation(JumpOperation::JType::equal, skiplbl, "no failure"), SectionType::text);
             emit(new MoveOperation(RegisterLocation(Register::rdi), RBPOffsetLocation(8), SizeType::qword, "return address"), SectionType::text);
             emit(new MoveOperation(RegisterLocation(Register::rsi), RegisterLocation(Register::rbp), SizeType::qword, "base pointer"), SectionType::text);
@@ -775,36 +1489,34 @@ namespace Floral {
                 if (size == 0) return;
                 
                 int integers = isFunctionMember ? 1 : 0;
-        //        int floats{};
+                int floats {};
                 
                 static const Register integerRegs[] {
                     Register::rdi, Register::rsi, Register::rdx, Register::rcx, Register::r8, Register::r9
                 };
-        //        static const Register floatRegs[] {
-        //
-        //        };
+                static const Register floatRegs[] {
+                    Register::xmm0, Register::xmm1, Register::xmm2, Register::xmm3, Register::xmm4, Register::xmm5, Register::xmm6, Register::xmm7
+                };
                         
                 std::vector<Function::Parameter> stackArgs;
                 stackArgs.reserve(max(6, size) - 6);
                         
                 for (size_t index = 0; index < size; index++) {
                     Function::Parameter param {params[index]};
-                    if ((true) || param.type->isInteger()) {
-                        if (integers >= 6) { // only 6 registers for arguments
-                            stackArgs.push_back(param);
-                        } else {
-                            if (storeAsLocalVars) {
-                                const Location dest = RBPOffsetLocation(currentFrame().nextOffset());
-                                emit(new MoveOperation(dest, RegisterLocation(integerRegs[integers++]), SizeType::qword, "@ load register parameter to local var"), SectionType::text);
-                                currentFrame().addData(dest, param.type->alignment(), param.name.contents);
-                            } else {
-                                currentFrame().addData(RegisterLocation(integerRegs[integers++]), param.type->alignment(), param.name.contents);
-                            }
-                        }
+                    const bool isFloat = param.type->isFloat(); // Floats and integers draw on separate register sequences
+                    if (isFloat ? floats >= 8 : integers >= 6) { // only 6 integer and 8 Float registers for arguments
+                        stackArgs.push_back(param);
+                        continue;
+                    }
+                    const Register reg = isFloat ? floatRegs[floats++] : integerRegs[integers++];
+                    if (storeAsLocalVars) {
+                        const Location dest = RBPOffsetLocation(currentFrame().allocate(8));
+                        emit(new MoveOperation(dest, RegisterLocation(reg), SizeType::qword, "@ load register parameter to local var"), SectionType::text);
+                        currentFrame().addData(dest, param.type->alignment(), param.name.contents);
+                    } else {
+                        currentFrame().registersInUse.push_back(reg); // keep scratch allocation off the parameter
+                        currentFrame().addData(RegisterLocation(reg), param.type->alignment(), param.name.contents);
                     }
-        //            else {
-        //                floats++;
-        //            }
                 }
         }
 
@@ -814,6 +1526,7 @@ namespace Floral {
         std::pair<Variable, bool> Compiler::lookup(const std::string& name) {
             long framesOffset = 0;
             if (auto gbl = analyzer.lookupGlobal(name)) {
+                _referencedGlobals.insert(name);
                 Variable v;
                 v.loc = RelLabelL(name);
                 v.size = gbl->type->size();
@@ -831,6 +1544,24 @@ namespace Floral {
             return { {0, 0}, false };
         }
 
+        // Globals are searched first, as in lookup, but without counting as a reference to their storage
+        bool Compiler::lookupConstant(const std::string& name, Location& value) {
+            if (analyzer.lookupGlobal(name)) {
+                const auto constant = _globalConstants.find(name);
+                if (constant == _globalConstants.end()) return false;
+                value = constant->second;
+                return true;
+            }
+            for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+                const auto result = frame->localLookup(name);
+                if (result.second) {
+                    value = result.first.constant;
+                    return result.first.isConstant;
+                }
+            }
+            return false;
+        }
+
         // MARK: Emit general expression (COMPLEX)
         Location Compiler::emitExpression(Expression* expr, bool wantsAddressResult, bool mut) {
             if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
@@ -846,17 +1577,27 @@ namespace Floral {
                             const int r = currentFrame().avaliableScratch();
                             const Location leftloc = emitExpression(left);
                             const Location rightloc = emitExpression(right);
+                            const std::string comment = "pointer arithmetic (" + left->type->des() + " + " + right->prettystr() + ")";
+                            const long long size = static_cast<long long>(GET_PTRTYYPE(left->type)->size());
+                            Register base = static_cast<Register>(r);
+                            if (IS_REG(leftloc)) {
+                                base = static_cast<Register>(leftloc.reg);
+                            } else {
+                                emit(new MoveOperation(RegisterLocation(base), leftloc, SizeType::qword, "pointer"), SectionType::text);
+                            }
                             if (rightloc.isLiteral) {
-                                if (rightloc.isSigned) {
-                                    emit(new RawText(INDENT "lea " + registerNames[r] + ", [" + leftloc.str() + '+' + std::to_string(GET_PTRTYYPE(left->type)->size() * rightloc.value.s) + "] ; pointer arithmetic (" + left->type->des() + " + " + right->prettystr() + ")"), SectionType::text);
-                                } else {
-                                    emit(new RawText(INDENT "lea " + registerNames[r] + ", [" + leftloc.str() + '+' + std::to_string(GET_PTRTYYPE(left->type)->size() * rightloc.value.u) + "] ; pointer arithmetic (" + left->type->des() + " + " + right->prettystr() + ")"), SectionType::text);
-                                }
+                                const long long offset = size * (rightloc.isSigned ? rightloc.value.s : static_cast<long long>(rightloc.value.u));
+                                emit(new LoadAddressOperation(RegisterLocation(static_cast<Register>(r)), ValueAtOffsetRegisterLocation(base, offset), SizeType::qword, comment), SectionType::text);
                             } else {
-                                auto size = GET_PTRTYYPE(left->type)->size();
-                                std::string mult = size == 1 ? "" : ('*' + std::to_string(size));
-                                emit(new RawText(INDENT "lea " + registerNames[r] + ", [" + leftloc.str() + '+' + rightloc.str() + mult + "] ; pointer arithmetic (" + left->type->des() + " + " + right->prettystr() + ")"), SectionType::text);
-
+                                const bool isScale = size == 1 || size == 2 || size == 4 || size == 8; // the factors an address can apply itself
+                                Register index = static_cast<Register>(rightloc.reg);
+                                if (!IS_REG(rightloc) || !isScale) {
+                                    index = GET_REG(currentFrame());
+                                    emit(new MoveOperation(RegisterLocation(index), rightloc, SizeType::qword, "index"), SectionType::text);
+                                    if (!isScale) emit(new MulOperation(RegisterLocation(index), NumLL(false, SU(static_cast<uint64_t>(size))), "index * element size"), SectionType::text);
+                                }
+                                emit(new ScaledLoadAddressOperation(RegisterLocation(static_cast<Register>(r)), base, index, isScale ? static_cast<int>(size) : 1, 0, comment), SectionType::text);
+                                if (index != static_cast<Register>(rightloc.reg)) returnRegister(index);
                             }
                             if (IS_REG(leftloc)) returnRegister(static_cast<const Register>(leftloc.reg));
                             if (IS_REG(rightloc)) returnRegister(static_cast<const Register>(rightloc.reg));
@@ -868,6 +1609,17 @@ namespace Floral {
                     case TokenType::minus: {
                         if (left && right) return emitBinaryExpr(left, right, OpType::sub);
                         else if (!left && right) {
+                            if (right->type->isFloat()) {
+                                auto literal = dynamic_cast<Literal*>(right);
+                                if (literal && literal->type() == Literal::LType::floatingPointNumber) {
+                                    return emitFloatConstant(-atof(literal->value().contents.c_str()));
+                                }
+                                const Register result = emitFloatOperand(emitExpression(right));
+                                const Location sign = emitFloatConstant(-0.0);
+                                emit(new FloatOperation(FloatOpType::bitXor, RegisterLocation(result), sign, "flip sign bit"), SectionType::text);
+                                returnRegister(static_cast<Register>(sign.reg));
+                                return RegisterLocation(result);
+                            }
                             const Location result = emitExpression(right);
                             if (result.isLiteral) {
                                 if (result.isSigned) {
@@ -889,13 +1641,13 @@ namespace Floral {
                             Location loc = emitExpression(right, true);
                             if (IS_REG(loc)) {
                                 const Register reg = static_cast<Register>(loc.reg);
-                                emit(new MoveOperation(RegisterLocation(reg), ValueAtRegisterLocation(reg), SizeType::qword, "dereference"), SectionType::text);
+                                emitLoad(reg, ValueAtRegisterLocation(reg), expr->type, "dereference");
                                 return RegisterLocation(reg);
                             } 
                         }
                     }
                     case TokenType::bit_and: {
-                        if (left && right) emitBinaryExpr(left, right, OpType::and_);
+                        if (left && right) return emitBinaryExpr(left, right, OpType::and_);
                         else if (!left && right) {
                             if (auto symbol = dynamic_cast<SymbolExpression*>(right)) {
                                 const auto result = lookup(symbol->value().contents);
@@ -924,30 +1676,10 @@ namespace Floral {
                         }
                     }
                     case TokenType::divide: {
-                        const Location lhs = emitExpression(left);
-                        const Location rhs = emitExpression(right);
-                        
-                        emitSaveRegisters({ Register::rax, Register::rdx });
-                        
-                        emit(new XorOperation(RegisterLocation(Register::edx), RegisterLocation(Register::edx), "clear rdx"), SectionType::text);
-                        emit(new MoveOperation(RETURN_VALUE_LOC, lhs, SizeType::qword, "lhs of division into rax"), SectionType::text);
-                        emit(new DivOperation(rhs), SectionType::text);
-
-                        if (IS_REG(lhs) && lhs.reg) {
-                            returnRegister(static_cast<Register>(lhs.reg));
-                        }
-                        if (IS_REG(rhs)) {
-                            returnRegister(static_cast<Register>(rhs.reg));
-                        }
-                        
-                        Location result = RETURN_VALUE_LOC;
-                        
-                        emitRestoreRegisters({ Register::rax, Register::rdx });
-                        const Register reg = static_cast<Register>(currentFrame().avaliableScratch());
-                        emit(new MoveOperation(RegisterLocation(reg), RETURN_VALUE_LOC, SizeType::qword, "save result of div"), SectionType::text);
-                        emit(new PopOperation(RegisterLocation(Register::rax)), SectionType::text);
-                        emit(new PopOperation(RegisterLocation(Register::rdx)), SectionType::text);
-                        return result;
+                        return emitDivision(left, right, false);
+                    }
+                    case TokenType::modulus: {
+                        return emitDivision(left, right, true);
                     }
                     case TokenType::plusEqu: {
                         Location pointer = emitExpression(left, true);
@@ -966,7 +1698,17 @@ namespace Floral {
                         }
                         const Location increment = emitExpression(right);
                         pointer.isDereference = true;
-                        emit(new AddOperation(pointer, increment, SizeType::qword, "add then assign"), SectionType::text);
+                        if (left->type->isFloat()) { // SSE arithmetic has no memory destination
+                            const Register sum = emitFloatOperand(pointer);
+                            const Register addend = emitFloatOperand(increment);
+                            emit(new FloatOperation(FloatOpType::add, RegisterLocation(sum), RegisterLocation(addend), "add then assign"), SectionType::text);
+                            emit(new MoveOperation(pointer, RegisterLocation(sum), SizeType::qword, "store sum"), SectionType::text);
+                            returnRegister(addend);
+                            returnRegister(sum);
+                        } else {
+                            emit(new AddOperation(pointer, increment, SizeType::qword, "add then assign"), SectionType::text);
+                            if (IS_REG(increment) && increment.reg != pointer.reg) returnRegister(static_cast<Register>(increment.reg)); // the sum is in memory now
+                        }
                         if (wantsAddressResult) {
                             pointer.isDereference = false;
                             return pointer;
@@ -1005,51 +1747,36 @@ namespace Floral {
                             const Register pointerReg = static_cast<Register>(pointer.reg);
                             const int resultint = currentFrame().avaliableScratch();
                             const Register resultreg = static_cast<Register>(resultint);
-                            if (opsize != SizeType::qword) emit(new XorOperation(RegisterLocation(resultreg), RegisterLocation(resultreg), "zero out result"), SectionType::text);
                             if (wantsAddressResult) {
                                 emit(new LoadAddressOperation(RegisterLocation(resultreg), ValueAtOffsetRegisterLocation(pointerReg, index.value.s * size), opsize, "subscript into result"), SectionType::text);
                             } else {
-                                emit(new MoveOperation(RegisterLocation(static_cast<Register>(resultint + REG_IMPL_OFFSET_FOR_SIZE(opsize))), ValueAtOffsetRegisterLocation(pointerReg, index.value.s * size), opsize, "subscript into result"), SectionType::text);
-
+                                emitLoad(resultreg, ValueAtOffsetRegisterLocation(pointerReg, index.value.s * size), GET_PTRTYYPE(left->type), "subscript into result");
                             }
                             returnRegister(pointerReg);
                             return RegisterLocation(resultreg);
                         } else if (IS_REG(index) && IS_REG(pointer)) {
                             const auto size = GET_PTRTYYPE(left->type)->size();
-                            const auto opsize = OPSIZE_FROM_NUM(size);
-                            returnRegister(static_cast<Register>(index.reg));
-                            if (wantsAddressResult) {
-                                
-                            } else {
-                                if (size-1) emit(new MulOperation(index, NumLL(false, SU((uint64_t)size)), "calculate subscript offset"), SectionType::text);
-                                if (opsize == SizeType::qword) {
-                                    emit(new RawText(
-                                    INDENT "mov " + pointer.str() + ", [" + pointer.str() + "+" + index.str() + "] ; offset"
-                                    ), SectionType::text);
-                                    return pointer;
-                                }
-                                //const int resultint = pointer.reg;
-                                const static std::string sizeTypeNames[] {
-                                    "byte", "word", "dword"
-                                };
-                                emit(new RawText(
-                                                 INDENT "movzx " +
-                                                 /*RegisterLocation(static_cast<Register>(resultint + REG_IMPL_OFFSET_FOR_SIZE(opsize)))*/pointer.str() +
-                                                 ", " + sizeTypeNames[static_cast<int>(opsize)] +
-                                                 " [" + pointer.str() + "+" + index.str() + "] ; offset"
-                                                 ), SectionType::text);
-//                                if (opsize == SizeType::byte) {
-//                                    emit(new AndOperation(RegisterLocation(static_cast<Register>(pointer.reg)), NumLL(false, SU(0xFFULL)), "clear high bytes"), SectionType::text);
-//                                } else if (opsize == SizeType::word) {
-//                                    emit(new AndOperation(RegisterLocation(static_cast<Register>(pointer.reg)), NumLL(false, SU(0xFFFFULL)), "clear high bytes"), SectionType::text);
-//                                }
-                                return pointer;
+                            const Register pointerReg = static_cast<Register>(pointer.reg);
+                            const Register indexReg = static_cast<Register>(index.reg);
+                            int scale = static_cast<int>(size);
+                            if (size != 1 && size != 2 && size != 4 && size != 8) {
+                                emit(new MulOperation(index, NumLL(false, SU((uint64_t)size)), "calculate subscript offset"), SectionType::text);
+                                scale = 1;
+                            }
+                            emit(new ScaledLoadAddressOperation(pointer, pointerReg, indexReg, scale, 0, "address of element"), SectionType::text);
+                            returnRegister(indexReg);
+                            if (!wantsAddressResult) {
+                                emitLoad(pointerReg, ValueAtRegisterLocation(pointerReg), GET_PTRTYYPE(left->type), "subscript into result");
                             }
+                            return pointer;
                         }
                         break;
                     }
                     case TokenType::invert: {
                         const Location loc = emitExpression(right);
+                        if (loc.isLiteral) {
+                            return NumLL(loc.isSigned, SU(~loc.value.u));
+                        }
                         emit(new NotOperation(loc, "bitwise not"), SectionType::text);
                         return loc;
                     }
@@ -1062,47 +1789,13 @@ namespace Floral {
                     case TokenType::unequal: {
                         return emitCondition(expr).first;
                     }
-                    case TokenType::less: {
-                        const Location lhsloc = emitExpression(left);
-                        const Location rhsloc = emitExpression(right);
-                        const Location resultloc = RegisterLocation(static_cast<Register>(currentFrame().avaliableScratch()));
-                        
-                        if (lhsloc.isLiteral && rhsloc.isLiteral) {
-                            const Register r = static_cast<Register>(currentFrame().avaliableScratch());
-                            if (lhsloc.isSigned) {
-                                if (lhsloc.value.s < rhsloc.value.s) {
-                                    emit(new MoveOperation(RegisterLocation(r), NumLL(false, SU(1ULL)), SizeType::qword), SectionType::text);
-                                } else {
-                                    emit(new XorOperation(RegisterLocation(r), RegisterLocation(r)), SectionType::text);
-                                }
-                            } else {
-                                if (lhsloc.value.u < rhsloc.value.u) {
-                                    emit(new MoveOperation(RegisterLocation(r), NumLL(false, SU(1ULL)), SizeType::qword), SectionType::text);
-                                } else {
-                                    emit(new XorOperation(RegisterLocation(r), RegisterLocation(r)), SectionType::text);
-                                }
-                            }
-                            return RegisterLocation(r);
-                        }
-                        
-                        emit(new MoveOperation(resultloc, ZeroLL, SizeType::qword), SectionType::text);
-                        emit(new CmpOperation(lhsloc, rhsloc), SectionType::text);
-                        
-                        Register reg = static_cast<Register>(currentFrame().avaliableScratch());
-                        
-                        emit(new MoveOperation(RegisterLocation(reg), NumLL(false, SU(1ULL)), SizeType::qword), SectionType::text);
-                        emit(new RawText(INDENT "cmovb " + resultloc.str() + ", " + RegisterLocation(reg).str()), SectionType::text);
-                        
-                        returnRegister(reg);
-                        
-                        if (IS_REG(rhsloc)) {
-                            returnRegister(static_cast<Register>(rhsloc.reg));
-                        }
-                        if (IS_REG(lhsloc)) {
-                            returnRegister(static_cast<Register>(lhsloc.reg));
-                        }
-                        
-                        return resultloc;
+                    case TokenType::less:
+                    case TokenType::greater:
+                    case TokenType::lessEqual:
+                    case TokenType::greaterEqual:
+                    case TokenType::bool_and:
+                    case TokenType::bool_or: {
+                        return emitCondition(expr).first;
                     }
                     case TokenType::dot: {
                         Location lhsloc = emitExpression(left, true);
@@ -1129,7 +1822,7 @@ namespace Floral {
                                 }
                                 return RegisterLocation(temp);
                             }
-                            emit(new MoveOperation(RegisterLocation(temp), ValueAtRegisterLocation(temp), SizeType::qword, "member access"), SectionType::text);
+                            emitLoad(temp, ValueAtRegisterLocation(temp), expr->type, "member access");
     //                        emit(new MoveOperation(RegisterLocation(result), ValueAtOffsetRegisterLocation(result, offset), SizeType::qword, "member access"), SectionType::text);
                             return RegisterLocation(temp);
                         } else if (auto call = dynamic_cast<Call*>(right)) {
@@ -1150,28 +1843,38 @@ namespace Floral {
             else if (auto literal = dynamic_cast<Literal*>(expr)) {
                 switch (literal->type()) {
                     case Literal::LType::cString: {
-                        static long strlitCount = 0;
-                        const std::string lbl {"#str_literal_" + std::to_string(strlitCount++)}; // create the label
-                        std::string stringLiteral {literal->value().contents};
-                        _strprocess(stringLiteral);
-                        emit(new StringData(lbl, stringLiteral), mut ? SectionType::data : SectionType::rodata); // add the labeled string as bytes in section .rodata
+                        Location constant;
+                        if (mut) { // a string that may be written to needs storage of its own
+                            const std::string lbl {"#str_literal_" + std::to_string(_labels.strings++)}; // create the label
+                            std::string stringLiteral {literal->value().contents};
+                            _strprocess(stringLiteral);
+                            emit(new StringData(lbl, stringLiteral), SectionType::data); // add the labeled string as bytes in section .data
+                            constant = RelLabelL(lbl);
+                        } else {
+                            constant = _constants.internString(literalBytes(literal->value().contents)); // identical strings share storage
+                        }
                         
                         const Register resultr = static_cast<Register>(frames.back().avaliableScratch()); // get a new register
-                        emit(new LoadAddressOperation(RegisterLocation(resultr), RelLabelL(lbl), SizeType::qword, "string literal"), SectionType::text); // dump the string into this new register
+                        emit(new LoadAddressOperation(RegisterLocation(resultr), constant, SizeType::qword, "string literal"), SectionType::text); // dump the string into this new register
                         return RegisterLocation(resultr);
                     }
                     case Literal::LType::wideString: {
-                        static long wstrlitCount = 0;
-                        const std::string lbl {"#wstr_literal_" + std::to_string(wstrlitCount++)}; // create the label
-                        auto wstrData = new Data(lbl, SizeType::dword, false);
-                        const auto wchars = literal->value()._wstr;
-                        for (auto codepoint: wchars) {
-                            wstrData->values.push_back(SU((long long)codepoint));
+                        Location constant;
+                        if (mut) {
+                            const std::string lbl {"#wstr_literal_" + std::to_string(_labels.wideStrings++)}; // create the label
+                            auto wstrData = new Data(lbl, SizeType::dword, false);
+                            const auto wchars = literal->value()._wstr;
+                            for (auto codepoint: wchars) {
+                                wstrData->values.push_back(SU((long long)codepoint));
+                            }
+                            wstrData->values.push_back(SU(0ULL));
+                            emit(wstrData, SectionType::data);
+                            constant = RelLabelL(lbl);
+                        } else {
+                            constant = _constants.internWideString(literal->value()._wstr);
                         }
-                        wstrData->values.push_back(SU(0ULL));
-                        emit(wstrData, mut ? SectionType::data : SectionType::rodata);
                         const Register resultr = static_cast<Register>(frames.back().avaliableScratch()); // get a new register
-                        emit(new LoadAddressOperation(RegisterLocation(resultr), RelLabelL(lbl), SizeType::qword, "wide string literal"), SectionType::text); // dump the string into this new register
+                        emit(new LoadAddressOperation(RegisterLocation(resultr), constant, SizeType::qword, "wide string literal"), SectionType::text); // dump the string into this new register
                         return RegisterLocation(resultr);
                     }
                     case Literal::LType::boolean: {
@@ -1195,17 +1898,15 @@ namespace Floral {
                         return NumLL(false, SU((uint64_t)strtoul(literal->value().contents.c_str(), NULL, 16))); // simply return the hex integer value
                     }
                     case Literal::LType::floatingPointNumber: {
-                        // WRONG!!!!!!! should return an xmm register but WILL FIX
-                        union {
-                            double f;
-                            uint64_t b;
-                        } floatbits;
-                        floatbits.f = atof(literal->value().contents.c_str());
-                        return NumLL(false, SU(floatbits.b)); // return the floating point bits
+                        return emitFloatConstant(atof(literal->value().contents.c_str())); // loaded from .rodata, as there are no SSE immediates
                     }
                 }
             }
             else if (auto symbol = dynamic_cast<SymbolExpression*>(expr)) {
+                Location constant;
+                if (!wantsAddressResult && lookupConstant(symbol->value().contents, constant)) {
+                    return constant; // a let known at compile time is used as an immediate
+                }
                 // MARK: literally looks for defined stuff in this frame will fix later
                 const auto result = lookup(symbol->value().contents); // PROBLEM: only valid in reference to that frame. Add member to struct variable called TOTAL OFFSET or ABSOLUTE OFFSET which contains the offset FROM THE START and hence make the calculation of the offset from the current rbp possible
                 if (!result.second) {
@@ -1223,7 +1924,7 @@ namespace Floral {
                     return loc;
                 }
                 loc.isDereference = d;
-                const Register resultr = static_cast<Register>(frames.back().avaliableScratch());
+                const Register resultr = symbol->type->isFloat() && !loc.isLbl ? GET_FLOAT_REG(currentFrame()) : static_cast<Register>(frames.back().avaliableScratch());
                 if (loc.isLbl) {
                     emit(new LoadAddressOperation(RegisterLocation(resultr), loc, OPSIZE_FROM_NUM(result.first.size), "store " + result.first.name + " in " + registerNames[static_cast<int>(resultr)]), SectionType::text);
 //                    if (wantsAddressResult) {
@@ -1232,36 +1933,47 @@ namespace Floral {
 //                        emit(new MoveOperation(RegisterLocation(resultr), loc, OPSIZE_FROM_NUM(result.first.size), "store " + result.first.name + " in " + registerNames[static_cast<int>(resultr)]), SectionType::text);
 //                    }
                 } else {
-                    emit(new MoveOperation(RegisterLocation(resultr), loc, OPSIZE_FROM_NUM(result.first.size), "store " + result.first.name + " in " + registerNames[static_cast<int>(resultr)]), SectionType::text);
+                    emitLoad(resultr, loc, symbol->type, "store " + result.first.name + " in " + registerNames[static_cast<int>(resultr)]);
                 }
                 return RegisterLocation(resultr);
             }
             else if (auto call = dynamic_cast<Call*>(expr)) {
+                Interpreter::Value value;
+                if (call->info.isStaticEval && analyzer._interpreter.evaluated(call, value)) {
+                    // a const func the analyzer already ran costs nothing at runtime
+                    if (call->type->isFloat()) {
+                        return emitFloatConstant(value.real);
+                    } else if (call->type->isInteger() || call->type->isBool()) {
+                        return NumLL(call->type->isSigned(), SU(value.bits));
+                    }
+                }
                 return emitCall(call);
             }
             else if (auto sizeofexpr = dynamic_cast<SizeOfType*>(expr)) {
                 return NumLL(false, SU((unsigned long long)sizeofexpr->size()));
             }
             else if (auto unsafecast = dynamic_cast<UnsafeCast*>(expr)) {
-                return emitExpression(unsafecast->expr());
+                const Location result = emitExpression(unsafecast->expr());
+                if (!unsafecast->type()->isFloat() && IS_REG(result) && isFloatRegister(static_cast<Register>(result.reg))) {
+                    // reinterpreting a Float's bits as an integer moves them to a general register
+                    const Register bits = GET_REG(currentFrame());
+                    emit(new MoveOperation(RegisterLocation(bits), result, SizeType::qword, "reinterpret Float bits"), SectionType::text);
+                    returnRegister(static_cast<Register>(result.reg));
+                    return RegisterLocation(bits);
+                }
+                return result;
             }
             else if (auto constructor = dynamic_cast<ConstructExpression*>(expr)) {
                 auto strct = constructor->type()->structValue();
-                long offset = 0;
                 size_t index = 0;
-                long start = currentFrame().nextOffset();
+                // members are laid out downward from the first one, so reserve the whole struct up front
+                const long size = static_cast<long>(constructor->type()->alignment());
+                const long start = currentFrame().allocate(size) + size - 8;
                 for (auto datam: strct->dataMembers()) {
                     if (auto var = dynamic_cast<VarStatement*>(datam)) {
-                        offset += var->type()->alignment();
-                        if (!start) start = offset;
-                        Location argresult = emitExpression(constructor->args()[index++]);
-                        if (argresult.isDereference) {
-                            const Register temp = static_cast<Register>(currentFrame().avaliableScratch());
-                            emit(new MoveOperation(RegisterLocation(temp), argresult, SizeType::qword, "store arg in temp reg"), SectionType::text);
-                            argresult = RegisterLocation(temp);
-                            returnRegister(temp);
-                        }
-                        emit(new MoveOperation(RBPOffsetLocation(-offset), argresult, SizeType::qword, "@ initialize data member"), SectionType::text);
+                        const long offset = strct->offsetOf(var->name().contents);
+                        const Location argresult = emitExpression(constructor->args()[index++]);
+                        emitStore(RBPOffsetLocation(start + offset), argresult, var->type(), "@ initialize data member");
                         if (IS_REG(argresult)) {
                             returnRegister(static_cast<Register>(argresult.reg));
                         }
@@ -1285,13 +1997,37 @@ namespace Floral {
                     currentFrame().returnScratchRegister(static_cast<Register>(i));
                 }
             }
+            if (isFloatRegister(r)) currentFrame().returnScratchRegister(r);
         }
 
         // MARK: Emit binary expression
         Location Compiler::emitBinaryExpr(Expression *left, Expression *right, const OpType op) {
+            if (left->type && left->type->isFloat()) {
+                return emitFloatBinaryExpr(left, right, op == OpType::add ? FloatOpType::add : (op == OpType::sub ? FloatOpType::sub : FloatOpType::mul));
+            }
             const Location lhs = emitExpression(left); // evaluate the left-hand side
             const Location rhs = emitExpression(right); // evaluate the right-hand side
             
+            // Fold operations on two constants
+            if (lhs.isLiteral && rhs.isLiteral) {
+                const bool isSigned = lhs.isSigned && rhs.isSigned;
+                uint64_t value {};
+                switch (op) {
+                    case OpType::add: value = lhs.value.u + rhs.value.u; break;
+                    case OpType::sub: value = lhs.value.u - rhs.value.u; break;
+                    case OpType::imul: value = lhs.value.u * rhs.value.u; break;
+                    case OpType::and_: value = lhs.value.u & rhs.value.u; break;
+                    case OpType::or_: value = lhs.value.u | rhs.value.u; break;
+                    default: assert(false && "Should never reach here");
+                }
+                return isSigned ? NumLL(true, SU(static_cast<int64_t>(value))) : NumLL(false, SU(value));
+            }
+            
+            // Multiplication by a constant never needs the constant in a register
+            if (op == OpType::imul && (lhs.isLiteral || rhs.isLiteral)) {
+                return emitMultiplyByConstant(lhs.isLiteral ? rhs : lhs, (lhs.isLiteral ? lhs : rhs).value.s);
+            }
+            
             // avaliableScratch can return -1 if no regs avaliable, but ignore for now
             // get a result and rhs temporary register for calculation
             Register resultr;
@@ -1340,15 +2076,718 @@ namespace Floral {
                 }
             }
             
-            // Return all unused registers
-            if (lhs.reg != LOC_IS_NOT_REG) returnRegister(static_cast<Register>(lhs.reg));
+            // Return all unused registers; the lhs register, if any, now holds the result
             if (rhs.reg != LOC_IS_NOT_REG) returnRegister(static_cast<Register>(rhs.reg));
             returnRegister(rhsr);
             
             return RegisterLocation(resultr);
         }
 
+    // MARK: Strength reduction
+    // Magic numbers for division by a constant: see Hacker's Delight, 2nd ed., 10-4 and 10-8.
+    struct DivisionMagic {
+        uint64_t multiplier;
+        int shift;
+        bool needsAdd; // unsigned only: the multiplier needed 65 bits
+    };
+    static DivisionMagic signedDivisionMagic(int64_t d) {
+        const uint64_t two63 = 1ULL << 63;
+        const uint64_t ad = d < 0 ? -static_cast<uint64_t>(d) : static_cast<uint64_t>(d);
+        const uint64_t t = two63 + (static_cast<uint64_t>(d) >> 63);
+        const uint64_t anc = t - 1 - t % ad; // absolute value of nc
+        int p = 63;
+        uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+        uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+        uint64_t delta;
+        do {
+            p++;
+            q1 *= 2; r1 *= 2;
+            if (r1 >= anc) { q1++; r1 -= anc; }
+            q2 *= 2; r2 *= 2;
+            if (r2 >= ad) { q2++; r2 -= ad; }
+            delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+        uint64_t multiplier = q2 + 1;
+        if (d < 0) multiplier = -multiplier;
+        return { multiplier, p - 64, false };
+    }
+    static DivisionMagic unsignedDivisionMagic(uint64_t d) {
+        const uint64_t two63 = 1ULL << 63;
+        const uint64_t nc = -1ULL - (-d) % d;
+        bool needsAdd = false;
+        int p = 63;
+        uint64_t q1 = two63 / nc, r1 = two63 - q1 * nc;
+        uint64_t q2 = (two63 - 1) / d, r2 = (two63 - 1) - q2 * d;
+        uint64_t delta;
+        do {
+            p++;
+            if (r1 >= nc - r1) { q1 = 2 * q1 + 1; r1 = 2 * r1 - nc; }
+            else { q1 = 2 * q1; r1 = 2 * r1; }
+            if (r2 + 1 >= d - r2) {
+                if (q2 >= two63 - 1) needsAdd = true;
+                q2 = 2 * q2 + 1; r2 = 2 * r2 + 1 - d;
+            } else {
+                if (q2 >= two63) needsAdd = true;
+                q2 = 2 * q2; r2 = 2 * r2 + 1;
+            }
+            delta = d - 1 - r2;
+        } while (p < 128 && (q1 < delta || (q1 == delta && r1 == 0)));
+        return { q2 + 1, p - 64, needsAdd };
+    }
+    static int exactLog2(uint64_t n) {
+        if (n == 0 || (n & (n - 1))) return -1;
+        int k {};
+        while ((1ULL << k) != n) k++;
+        return k;
+    }
+    static bool fitsImmediate(int64_t n) {
+        return n >= INT32_MIN && n <= INT32_MAX;
+    }
+    Location Compiler::emitMultiplyByConstant(Location operand, long long factor) {
+        Register r;
+        if (IS_REG(operand)) {
+            r = static_cast<Register>(operand.reg);
+        } else {
+            r = GET_REG(currentFrame());
+            emit(new MoveOperation(RegisterLocation(r), operand, SizeType::qword), SectionType::text);
+        }
+        const Location result = RegisterLocation(r);
+        const auto shift = [&](int k) {
+            emit(new ShiftOperation(ShiftType::shl, result, NumLL(false, SU(static_cast<uint64_t>(k))), "multiply by " + std::to_string(1ULL << k)), SectionType::text);
+        };
+        
+        if (factor == 0) {
+            emit(new XorOperation(RegisterLocation(sizedRegister(r, SizeType::dword)), RegisterLocation(sizedRegister(r, SizeType::dword)), "multiply by 0"), SectionType::text);
+            return result;
+        }
+        
+        // x * -c is -(x * c) whenever x * c is cheap
+        const uint64_t magnitude = factor < 0 ? -static_cast<uint64_t>(factor) : static_cast<uint64_t>(factor);
+        int k = exactLog2(magnitude);
+        int leaScale {};
+        if (k < 0) {
+            for (const int scale: { 2, 4, 8 }) {
+                if (magnitude % (scale + 1) == 0 && exactLog2(magnitude / (scale + 1)) >= 0) {
+                    leaScale = scale;
+                    k = exactLog2(magnitude / (scale + 1));
+                    break;
+                }
+            }
+        }
+        if (k >= 0 && magnitude != (1ULL << 63)) {
+            if (leaScale) {
+                emit(new ScaledLoadAddressOperation(result, r, r, leaScale, 0, "multiply by " + std::to_string(leaScale + 1)), SectionType::text);
+            }
+            if (k > 0) shift(k);
+            if (factor < 0) {
+                emit(new NegationOperation(result, "negate product"), SectionType::text);
+            }
+            return result;
+        }
+        
+        if (fitsImmediate(factor)) {
+            emit(new MulOperation(result, NumLL(true, SU(static_cast<int64_t>(factor))), "multiply"), SectionType::text);
+            return result;
+        }
+        const Register temp = GET_REG(currentFrame());
+        emit(new MoveOperation(RegisterLocation(temp), NumLL(true, SU(static_cast<int64_t>(factor))), SizeType::qword), SectionType::text);
+        emit(new MulOperation(RegisterLocation(temp), result, "multiply"), SectionType::text);
+        returnRegister(r);
+        return RegisterLocation(temp);
+    }
+    Register Compiler::emitDivisionOperand(const Location& operand) {
+        // rax and rdx are implicit operands of div and the widening multiply, so keep operands out of them
+        if (IS_REG(operand) && operand.reg != static_cast<int>(Register::rax) && operand.reg != static_cast<int>(Register::rdx)) {
+            return static_cast<Register>(operand.reg);
+        }
+        std::vector<Register> held;
+        for (const Register reg: { Register::rax, Register::rdx }) {
+            if (currentFrame().isAvaliable(reg)) {
+                currentFrame().registersInUse.push_back(reg);
+                held.push_back(reg);
+            }
+        }
+        const Register r = GET_REG(currentFrame());
+        for (const Register reg: held) {
+            returnRegister(reg);
+        }
+        emit(new MoveOperation(RegisterLocation(r), operand, SizeType::qword, "division operand"), SectionType::text);
+        if (IS_REG(operand)) returnRegister(static_cast<Register>(operand.reg));
+        return r;
+    }
+    std::vector<Register> Compiler::emitClaimAccumulator() {
+        std::vector<Register> saved;
+        for (const Register reg: { Register::rax, Register::rdx }) {
+            if (currentFrame().isAvaliable(reg)) {
+                currentFrame().registersInUse.push_back(reg);
+            } else {
+                emit(new PushOperation(RegisterLocation(reg), "preserve across division"), SectionType::text);
+                saved.push_back(reg);
+            }
+        }
+        return saved;
+    }
+    void Compiler::emitReleaseAccumulator(const std::vector<Register>& saved) {
+        for (auto riter = saved.rbegin(); riter != saved.rend(); riter++) {
+            emit(new PopOperation(RegisterLocation(*riter)), SectionType::text);
+        }
+        for (const Register reg: { Register::rax, Register::rdx }) {
+            if (std::find(saved.begin(), saved.end(), reg) == saved.end()) {
+                returnRegister(reg);
+            }
+        }
+    }
+    Location Compiler::emitDivisionByConstant(Location dividend, union SignedUnsigned divisor, bool isSigned, bool wantsRemainder) {
+        const Register x = emitDivisionOperand(dividend);
+        const Location xloc = RegisterLocation(x);
+        const auto number = [](int64_t n) {
+            return NumLL(true, SU(n));
+        };
+        
+        // x / 1 and x / -1
+        if (divisor.u == 1 || (isSigned && divisor.s == -1)) {
+            if (wantsRemainder) {
+                emit(new XorOperation(RegisterLocation(sizedRegister(x, SizeType::dword)), RegisterLocation(sizedRegister(x, SizeType::dword)), "remainder is 0"), SectionType::text);
+            } else if (divisor.u != 1) {
+                emit(new NegationOperation(xloc, "divide by -1"), SectionType::text);
+            }
+            return xloc;
+        }
+        
+        const uint64_t magnitude = (isSigned && divisor.s < 0) ? -divisor.u : divisor.u;
+        const int k = exactLog2(magnitude);
+        
+        // Powers of two are shifts; signed dividends are biased by 2^k - 1 when negative so the shift truncates toward zero
+        if (k > 0) {
+            if (!isSigned) {
+                if (!wantsRemainder) {
+                    emit(new ShiftOperation(ShiftType::shr, xloc, number(k), "divide by " + std::to_string(magnitude)), SectionType::text);
+                } else if (fitsImmediate(static_cast<int64_t>(magnitude - 1))) {
+                    emit(new AndOperation(xloc, number(static_cast<int64_t>(magnitude - 1)), "modulo " + std::to_string(magnitude)), SectionType::text);
+                } else {
+                    const Register mask = GET_REG(currentFrame());
+                    emit(new MoveOperation(RegisterLocation(mask), NumLL(false, SU(magnitude - 1)), SizeType::qword), SectionType::text);
+                    emit(new AndOperation(xloc, RegisterLocation(mask), "modulo " + std::to_string(magnitude)), SectionType::text);
+                    returnRegister(mask);
+                }
+                return xloc;
+            }
+            const Register t = GET_REG(currentFrame());
+            const Location tloc = RegisterLocation(t);
+            // The bias reads x again after the copy, so the peephole must not fold the copy into x's load
+            emit(new MoveOperation(tloc, xloc, SizeType::qword, "@ dividend for the sign mask"), SectionType::text);
+            if (k > 1) {
+                emit(new ShiftOperation(ShiftType::sar, tloc, number(63), "sign mask"), SectionType::text);
+            }
+            emit(new ShiftOperation(ShiftType::shr, tloc, number(64 - k), "2^k - 1 if negative"), SectionType::text);
+            emit(new AddOperation(tloc, xloc, SizeType::qword, "bias toward zero"), SectionType::text);
+            emit(new ShiftOperation(ShiftType::sar, tloc, number(k), "divide by " + std::to_string(magnitude)), SectionType::text);
+            if (wantsRemainder) {
+                emit(new ShiftOperation(ShiftType::shl, tloc, number(k)), SectionType::text);
+                emit(new SubOperation(xloc, tloc, "remainder"), SectionType::text);
+                returnRegister(t);
+                return xloc;
+            }
+            if (divisor.s < 0) {
+                emit(new NegationOperation(tloc, "negative divisor"), SectionType::text);
+            }
+            returnRegister(x);
+            return tloc;
+        }
+        
+        // Everything else multiplies by a fixed-point reciprocal and keeps the high half
+        const Location rax = RegisterLocation(Register::rax);
+        const Location rdx = RegisterLocation(Register::rdx);
+        const std::vector<Register> saved = emitClaimAccumulator();
+        if (isSigned) {
+            const DivisionMagic magic = signedDivisionMagic(divisor.s);
+            const int64_t multiplier = static_cast<int64_t>(magic.multiplier);
+            emit(new MoveOperation(rax, number(multiplier), SizeType::qword, "reciprocal of " + std::to_string(divisor.s)), SectionType::text);
+            emit(new WideMulOperation(xloc, true), SectionType::text);
+            if (divisor.s > 0 && multiplier < 0) {
+                emit(new AddOperation(rdx, xloc, SizeType::qword), SectionType::text);
+            } else if (divisor.s < 0 && multiplier > 0) {
+                emit(new SubOperation(rdx, xloc), SectionType::text);
+            }
+            if (magic.shift) {
+                emit(new ShiftOperation(ShiftType::sar, rdx, number(magic.shift)), SectionType::text);
+            }
+            emit(new MoveOperation(rax, rdx, SizeType::qword), SectionType::text);
+            emit(new ShiftOperation(ShiftType::shr, rax, number(63)), SectionType::text);
+            emit(new AddOperation(rdx, rax, SizeType::qword, "round toward zero"), SectionType::text);
+        } else {
+            const DivisionMagic magic = unsignedDivisionMagic(divisor.u);
+            emit(new MoveOperation(rax, NumLL(false, SU(magic.multiplier)), SizeType::qword, "reciprocal of " + std::to_string(divisor.u)), SectionType::text);
+            emit(new WideMulOperation(xloc, false), SectionType::text);
+            if (magic.needsAdd) {
+                // q = (((x - hi) >> 1) + hi) >> (s - 1)
+                emit(new MoveOperation(rax, rdx, SizeType::qword), SectionType::text);
+                emit(new NegationOperation(rax), SectionType::text);
+                emit(new AddOperation(rax, xloc, SizeType::qword), SectionType::text);
+                emit(new ShiftOperation(ShiftType::shr, rax, number(1)), SectionType::text);
+                emit(new AddOperation(rdx, rax, SizeType::qword), SectionType::text);
+                if (magic.shift > 1) {
+                    emit(new ShiftOperation(ShiftType::shr, rdx, number(magic.shift - 1)), SectionType::text);
+                }
+            } else if (magic.shift) {
+                emit(new ShiftOperation(ShiftType::shr, rdx, number(magic.shift)), SectionType::text);
+            }
+        }
+        
+        // rdx holds the quotient
+        if (wantsRemainder) {
+            if (fitsImmediate(divisor.s)) {
+                emit(new MulOperation(rdx, number(divisor.s)), SectionType::text);
+                emit(new SubOperation(xloc, rdx, "remainder"), SectionType::text);
+            } else {
+                emit(new MoveOperation(rax, NumLL(isSigned, divisor), SizeType::qword), SectionType::text);
+                emit(new MulOperation(rax, rdx), SectionType::text);
+                emit(new SubOperation(xloc, rax, "remainder"), SectionType::text);
+            }
+        } else {
+            emit(new MoveOperation(xloc, rdx, SizeType::qword, "quotient"), SectionType::text);
+        }
+        emitReleaseAccumulator(saved);
+        return xloc;
+    }
+    Location Compiler::emitDivision(Expression* left, Expression* right, bool wantsRemainder) {
+        if (left->type->isFloat()) return emitFloatBinaryExpr(left, right, FloatOpType::div); // the analyzer rejects Float remainders
+        const bool isSigned = left->type->isSigned();
+        const Location lhs = emitExpression(left);
+        const Location rhs = emitExpression(right);
+        
+        if (rhs.isLiteral && rhs.value.u != 0) {
+            if (lhs.isLiteral && !(isSigned && rhs.value.s == -1)) {
+                if (isSigned) {
+                    return NumLL(true, SU(static_cast<int64_t>(wantsRemainder ? lhs.value.s % rhs.value.s : lhs.value.s / rhs.value.s)));
+                }
+                return NumLL(false, SU(static_cast<uint64_t>(wantsRemainder ? lhs.value.u % rhs.value.u : lhs.value.u / rhs.value.u)));
+            }
+            return emitDivisionByConstant(lhs, rhs.value, isSigned, wantsRemainder);
+        }
+        
+        const Register x = emitDivisionOperand(lhs);
+        Location divisor = rhs;
+        if (rhs.isLiteral || IS_REG(rhs)) {
+            divisor = RegisterLocation(emitDivisionOperand(rhs));
+        }
+        const std::vector<Register> saved = emitClaimAccumulator();
+        emit(new MoveOperation(RegisterLocation(Register::rax), RegisterLocation(x), SizeType::qword, "dividend"), SectionType::text);
+        if (isSigned) {
+            emit(new SignExtendAccumulatorOperation(), SectionType::text);
+        } else {
+            emit(new XorOperation(RegisterLocation(Register::edx), RegisterLocation(Register::edx), "clear rdx"), SectionType::text);
+        }
+        emit(new DivOperation(divisor, isSigned), SectionType::text);
+        emit(new MoveOperation(RegisterLocation(x), RegisterLocation(wantsRemainder ? Register::rdx : Register::rax), SizeType::qword, wantsRemainder ? "remainder" : "quotient"), SectionType::text);
+        emitReleaseAccumulator(saved);
+        if (IS_REG(divisor)) returnRegister(static_cast<Register>(divisor.reg));
+        return RegisterLocation(x);
+    }
+
+    // MARK: Floating point
+    // Floats are IEEE doubles computed with scalar SSE2 in xmm registers. A Float value may still arrive in a
+    // general register (a loaded struct member or array element) or in memory, so users go through emitFloatOperand.
+    static bool isFloatLiteral(const Expression* expr, double& value) {
+        auto literal = dynamic_cast<const Literal*>(expr);
+        if (!literal || literal->type() != Literal::LType::floatingPointNumber) return false;
+        value = atof(literal->value().contents.c_str());
+        return true;
+    }
+    Location Compiler::emitFloatConstant(double value) {
+        union {
+            double f;
+            uint64_t b;
+        } bits;
+        bits.f = value;
+        const Register r = GET_FLOAT_REG(currentFrame());
+        if (!bits.b) { // +0.0 is cheaper to make than to load
+            emit(new FloatOperation(FloatOpType::bitXor, RegisterLocation(r), RegisterLocation(r), "0.0"), SectionType::text);
+            return RegisterLocation(r);
+        }
+        const Location constant = _constants.intern(std::string(reinterpret_cast<const char*>(&bits.b), sizeof bits.b), 8, 8);
+        emit(new MoveOperation(RegisterLocation(r), constant, SizeType::qword, "Float literal " + std::to_string(value)), SectionType::text);
+        return RegisterLocation(r);
+    }
+    Register Compiler::emitFloatOperand(Location operand) {
+        if (IS_REG(operand) && isFloatRegister(static_cast<Register>(operand.reg))) {
+            return static_cast<Register>(operand.reg);
+        }
+        if (operand.isLiteral) { // e.g. an integer literal cast to Float; there is no immediate form
+            const Register bits = GET_REG(currentFrame());
+            emit(new MoveOperation(RegisterLocation(bits), operand, SizeType::qword, "Float bits"), SectionType::text);
+            operand = RegisterLocation(bits);
+        }
+        const Register r = GET_FLOAT_REG(currentFrame());
+        emit(new MoveOperation(RegisterLocation(r), operand, SizeType::qword, "Float operand"), SectionType::text);
+        if (IS_REG(operand)) returnRegister(static_cast<Register>(operand.reg));
+        return r;
+    }
+    Location Compiler::emitFloatBinaryExpr(Expression* left, Expression* right, FloatOpType op) {
+        double lhsValue, rhsValue;
+        if (isFloatLiteral(left, lhsValue) && isFloatLiteral(right, rhsValue)) {
+            switch (op) {
+                case FloatOpType::add: return emitFloatConstant(lhsValue + rhsValue);
+                case FloatOpType::sub: return emitFloatConstant(lhsValue - rhsValue);
+                case FloatOpType::mul: return emitFloatConstant(lhsValue * rhsValue);
+                case FloatOpType::div: return emitFloatConstant(lhsValue / rhsValue);
+                default: break;
+            }
+        }
+        const Register result = emitFloatOperand(emitExpression(left));
+        const Register rhs = emitFloatOperand(emitExpression(right));
+        static const std::string comments[] {
+            "add", "subtract", "multiply", "divide"
+        };
+        emit(new FloatOperation(op, RegisterLocation(result), RegisterLocation(rhs), comments[static_cast<int>(op)]), SectionType::text);
+        returnRegister(rhs);
+        return RegisterLocation(result);
+    }
+    // ucomisd sets the flags like an unsigned compare, and an unordered (NaN) result sets ZF, PF and CF together.
+    // Only above and aboveEqual are false for NaN, so a < b is tested as b > a; == and != use a compare mask instead.
+    std::pair<Location, Condition> Compiler::emitFloatComparison(BinaryExpression* comparison, bool inverted, bool justFlags) {
+        const TokenType op = comparison->op()->tkntype();
+        double lhsValue, rhsValue;
+        if (isFloatLiteral(comparison->left(), lhsValue) && isFloatLiteral(comparison->right(), rhsValue)) {
+            bool truth {};
+            switch (op) {
+                case TokenType::equal: truth = lhsValue == rhsValue; break;
+                case TokenType::unequal: truth = lhsValue != rhsValue; break;
+                case TokenType::less: truth = lhsValue < rhsValue; break;
+                case TokenType::greater: truth = lhsValue > rhsValue; break;
+                case TokenType::lessEqual: truth = lhsValue <= rhsValue; break;
+                default: truth = lhsValue >= rhsValue; break;
+            }
+            return { truth ? TrueLL : FalseLL, inverted ? Condition::zero : Condition::nonzero };
+        }
+        const Register lhs = emitFloatOperand(emitExpression(comparison->left()));
+        const Register rhs = emitFloatOperand(emitExpression(comparison->right()));
+        if (op == TokenType::equal || op == TokenType::unequal) {
+            emit(new FloatOperation(op == TokenType::equal ? FloatOpType::compareEqual : FloatOpType::compareUnequal, RegisterLocation(lhs), RegisterLocation(rhs), "all ones if true"), SectionType::text);
+            const Register mask = GET_REG(currentFrame());
+            emit(new MoveOperation(RegisterLocation(mask), RegisterLocation(lhs), SizeType::qword, "comparison mask"), SectionType::text);
+            emit(new CmpOperation(RegisterLocation(mask), ZeroLL, "set zero flag if false"), SectionType::text);
+            returnRegister(mask);
+            returnRegister(lhs);
+            returnRegister(rhs);
+            return emitConditionResult(inverted ? Condition::zero : Condition::nonzero, justFlags);
+        }
+        const bool swapped = op == TokenType::less || op == TokenType::lessEqual;
+        emit(new FloatOperation(FloatOpType::compare, RegisterLocation(swapped ? rhs : lhs), RegisterLocation(swapped ? lhs : rhs)), SectionType::text);
+        returnRegister(lhs);
+        returnRegister(rhs);
+        const Condition cond = (op == TokenType::less || op == TokenType::greater) ? Condition::above : Condition::aboveEqual;
+        return emitConditionResult(inverted ? invertedCondition(cond) : cond, justFlags);
+    }
+
+    // MARK: Bulk memory
+    // Aggregates are copied and zero-filled in runs rather than element by element. Short runs are unrolled into
+    // 16-byte (or, with AVX2, 32-byte) moves, with an overlapping final move instead of a ragged tail; long runs
+    // use rep movsb/stosb, whose fast-string microcode wins once its startup cost is paid
+    #define BULK_REPEAT_THRESHOLD 256
+    #define BULK_VECTOR_REGISTER 15 // clear of xmm0-xmm7, which hold Floats
+    void Compiler::emitMemoryCopy(Location dest, Location src, size_t size, const std::string& comment) {
+        emitBulkMemory(dest, &src, size, comment);
+    }
+    void Compiler::emitMemoryZero(Location dest, size_t size, const std::string& comment) {
+        emitBulkMemory(dest, nullptr, size, comment);
+    }
+    static bool isStringRegister(const Location& memory) {
+        return !memory.isLbl && (memory.reg == static_cast<int>(Register::rdi) || memory.reg == static_cast<int>(Register::rsi) || memory.reg == static_cast<int>(Register::rcx));
+    }
+    void Compiler::emitBulkMemory(Location dest, const Location* src, size_t size, const std::string& comment) {
+        if (!size) return;
+        if (size >= BULK_REPEAT_THRESHOLD && !isStringRegister(dest) && !(src && isStringRegister(*src))) {
+            const Register implicit[] {Register::rdi, src ? Register::rsi : Register::rax, Register::rcx};
+            std::vector<Register> saved;
+            for (auto reg: implicit) {
+                if (!currentFrame().isAvaliable(reg)) {
+                    emit(new PushOperation(RegisterLocation(reg), "@ preserve " + registerNames[static_cast<int>(reg)]), SectionType::text);
+                    saved.push_back(reg);
+                }
+            }
+            emit(new LoadAddressOperation(RegisterLocation(Register::rdi), dest, SizeType::qword, "destination"), SectionType::text);
+            if (src) {
+                emit(new LoadAddressOperation(RegisterLocation(Register::rsi), *src, SizeType::qword, "source"), SectionType::text);
+            } else {
+                emit(new XorOperation(RegisterLocation(Register::eax), RegisterLocation(Register::eax), "fill with zero bytes"), SectionType::text);
+            }
+            emit(new MoveOperation(RegisterLocation(Register::rcx), NumLL(false, SU((uint64_t)size)), SizeType::qword, "byte count"), SectionType::text);
+            emit(new RepeatStringOperation(src ? StringOpType::copy : StringOpType::fill, comment), SectionType::text);
+            for (auto riter = saved.rbegin(); riter != saved.rend(); riter++) {
+                emit(new PopOperation(RegisterLocation(*riter), "@ restore " + registerNames[static_cast<int>(*riter)]), SectionType::text);
+            }
+            return;
+        }
+        
+        // Vector moves take a base register and displacement, so labels are first loaded into a register
+        std::vector<Register> temps;
+        auto base = [&](Location memory) -> std::pair<Register, long long> {
+            if (!memory.isLbl) {
+                return { static_cast<Register>(memory.reg), memory.offset };
+            }
+            const Register temp = GET_REG(currentFrame());
+            emit(new LoadAddressOperation(RegisterLocation(temp), memory, SizeType::qword, "address of " + memory.lbl), SectionType::text);
+            temps.push_back(temp);
+            return { temp, 0 };
+        };
+        const auto to = base(dest);
+        const auto from = src ? base(*src) : to;
+        auto move = [&](size_t offset, bool isWide) {
+            const VectorOperand vreg = VectorOperand::vector(BULK_VECTOR_REGISTER, isWide);
+            const std::string mnemonic = _avx2 ? "vmovdqu" : "movdqu"; // VEX-encoded throughout once AVX is in use
+            if (src) {
+                emit(new VectorOperation(mnemonic, {vreg, VectorOperand::memory(from.first, from.second + static_cast<long long>(offset))}, comment), SectionType::text);
+            }
+            emit(new VectorOperation(mnemonic, {VectorOperand::memory(to.first, to.second + static_cast<long long>(offset)), vreg}, comment), SectionType::text);
+        };
+        if (size >= 16) {
+            const bool isWide = _avx2 && size >= 32;
+            if (!src) {
+                const VectorOperand zero = VectorOperand::vector(BULK_VECTOR_REGISTER, isWide);
+                if (_avx2) {
+                    emit(new VectorOperation("vpxor", {zero, zero, zero}, "zero"), SectionType::text);
+                } else {
+                    emit(new VectorOperation("pxor", {zero, zero}, "zero"), SectionType::text);
+                }
+            }
+            size_t done = 0;
+            for (; isWide && size - done >= 32; done += 32) {
+                move(done, true);
+            }
+            for (; size - done >= 16; done += 16) {
+                move(done, false);
+            }
+            if (done < size) { // the last move overlaps bytes already written, which is harmless
+                move(size - 16, false);
+            }
+            if (isWide) {
+                emit(new VectorOperation("vzeroupper", {}, "avoid SSE transition stalls after AVX"), SectionType::text);
+            }
+        } else {
+            const Register temp = src ? GET_REG(currentFrame()) : Register::rax; // only used when copying
+            for (size_t done = 0, piece = 8; done < size; piece /= 2) {
+                for (; size - done >= piece; done += piece) {
+                    const SizeType opsize = OPSIZE_FROM_NUM(piece);
+                    const Location at = ValueAtOffsetRegisterLocation(to.first, to.second + static_cast<long long>(done));
+                    if (!src) {
+                        emit(new MoveOperation(at, ZeroLL, opsize, comment), SectionType::text);
+                        continue;
+                    }
+                    const Location value = ValueAtOffsetRegisterLocation(from.first, from.second + static_cast<long long>(done));
+                    if (piece >= 4) { // a dword load zero-extends, so never merges into a stale register
+                        emit(new MoveOperation(RegisterLocation(sizedRegister(temp, opsize)), value, opsize, comment), SectionType::text);
+                    } else {
+                        emit(new MoveExtendOperation(RegisterLocation(temp), value, opsize, false, comment), SectionType::text);
+                    }
+                    emit(new MoveOperation(at, RegisterLocation(sizedRegister(temp, opsize)), opsize, comment), SectionType::text);
+                }
+            }
+            if (src) {
+                returnRegister(temp);
+            }
+        }
+        for (auto temp: temps) {
+            returnRegister(temp);
+        }
+    }
+
+    // A struct is addressed by its first member, which occupies its highest slot
+    static Location structMemory(Location address, const Type* type) {
+        const long below = static_cast<long>(type->size()) - 8;
+        if (IS_REG(address)) {
+            return ValueAtOffsetRegisterLocation(static_cast<Register>(address.reg), -below);
+        }
+        address.isDereference = true;
+        address.offset -= below;
+        return address;
+    }
+    bool Compiler::emitStructCopy(Location dest, Expression* src, const std::string& comment) {
+        Location from;
+        if (dynamic_cast<SymbolExpression*>(src)) {
+            from = emitExpression(src, true);
+        } else if (dynamic_cast<ConstructExpression*>(src)) {
+            from = emitExpression(src);
+        } else {
+            return false; // only variables and constructions have storage to copy from
+        }
+        emitMemoryCopy(dest, structMemory(from, src->type), src->type->size(), comment);
+        if (IS_REG(from)) {
+            returnRegister(static_cast<Register>(from.reg));
+        }
+        return true;
+    }
+
+    // The bit pattern of an array element known at compile time
+    static bool constantBits(Expression* expr, uint64_t& bits) {
+        bool negated = false;
+        if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
+            if (binary->left() || binary->op()->tkntype() != TokenType::minus) return false;
+            expr = binary->right();
+            negated = true;
+        }
+        auto literal = dynamic_cast<Literal*>(expr);
+        if (!literal) return false;
+        const char* contents = literal->value().contents.c_str();
+        switch (literal->type()) {
+            case Literal::LType::boolean:
+                bits = literal->value().type == TokenType::boolTrue;
+                break;
+            case Literal::LType::decimalInteger:
+            case Literal::LType::decimalByte:
+            case Literal::LType::decimalWideChar:
+            case Literal::LType::decimalShort:
+            case Literal::LType::decimalInt32:
+                bits = static_cast<uint64_t>(atoll(contents));
+                break;
+            case Literal::LType::decimalUInteger:
+            case Literal::LType::decimalUByte:
+            case Literal::LType::decimalWideUChar:
+            case Literal::LType::decimalUShort:
+            case Literal::LType::decimalUInt32:
+                bits = strtoull(contents, NULL, 10);
+                break;
+            case Literal::LType::hexadecimalInteger:
+                bits = strtoull(contents, NULL, 16);
+                break;
+            case Literal::LType::floatingPointNumber: {
+                const double value = atof(contents);
+                memcpy(&bits, &value, sizeof bits);
+                if (negated) bits ^= 1ULL << 63;
+                return true;
+            }
+            default:
+                return false;
+        }
+        if (negated) bits = -bits;
+        return true;
+    }
+    // Constant elements are laid out in an image of the whole array in .rodata and copied in with one bulk
+    // copy, or just zero-filled when they are all zero; only the remaining elements are stored one by one
+    void Compiler::emitArrayLiteral(ArrayLiteralExpression* arraylit, const Type* type, long base, const std::string& description) {
+        const size_t elementSize = GET_PTRTYYPE(type)->size();
+        const size_t count = type->_staticArray->second;
+        const auto& values = arraylit->values();
+        const bool isScalar = elementSize == 1 || elementSize == 2 || elementSize == 4 || elementSize == 8;
+        const uint64_t mask = elementSize == 8 ? ~0ULL : (1ULL << (elementSize * 8)) - 1;
+        std::vector<union SignedUnsigned> image(count, SU(0ULL));
+        std::vector<bool> isConstant(values.size());
+        bool anyConstant = false, anyNonzero = false;
+        for (size_t i = 0; isScalar && i < values.size() && i < count; i++) {
+            uint64_t bits;
+            if (constantBits(values[i], bits)) {
+                image[i] = SU(bits & mask);
+                isConstant[i] = anyConstant = true;
+                anyNonzero = anyNonzero || (bits & mask);
+            }
+        }
+        if (anyNonzero) {
+            std::string bytes;
+            for (auto element: image) {
+                bytes.append(reinterpret_cast<const char*>(&element.u), elementSize); // little-endian, like the target
+            }
+            bytes.resize(type->size());
+            const Location constant = _constants.intern(bytes, elementSize, elementSize);
+            emitMemoryCopy(RBPOffsetLocation(base), constant, type->size(), description + " = " + constant.lbl);
+        } else if (anyConstant) {
+            emitMemoryZero(RBPOffsetLocation(base), type->size(), description + " = 0");
+        }
+        for (size_t i = 0; i < values.size(); i++) {
+            if (isConstant[i]) continue;
+            const Location result = emitExpression(values[i]);
+            emitStore(RBPOffsetLocation(base + static_cast<long>(i * elementSize)), result, values[i]->type, description + '[' + std::to_string(i) + "];");
+            if (IS_REG(result)) {
+                returnRegister(static_cast<Register>(result.reg));
+            }
+        }
+    }
+
+    // MARK: Sized loads and stores
+    // Integers and Bools narrower than a register are loaded and stored at their own width
+    static SizeType operandSize(const Type* type) {
+        if (type && (type->isInteger() || type->isBool()) && type->size() < 8) {
+            return OPSIZE_FROM_NUM(type->size());
+        }
+        return SizeType::qword;
+    }
+    void Compiler::emitLoad(Register dest, Location src, const Type* type, const std::string& comment) {
+        const SizeType opsize = operandSize(type);
+        if (opsize == SizeType::qword || src.isLiteral) {
+            emit(new MoveOperation(RegisterLocation(dest), src, SizeType::qword, comment), SectionType::text);
+            return;
+        }
+        if (IS_REG(src)) {
+            src.reg = static_cast<int>(sizedRegister(static_cast<Register>(src.reg), opsize));
+        }
+        // Always write the whole register so later 64-bit uses neither see stale bits nor stall on a partial write
+        if (opsize == SizeType::dword && !type->isSigned()) {
+            emit(new MoveOperation(RegisterLocation(sizedRegister(dest, SizeType::dword)), src, SizeType::dword, comment), SectionType::text); // implicitly zero-extends
+        } else {
+            emit(new MoveExtendOperation(RegisterLocation(dest), src, opsize, type->isSigned(), comment), SectionType::text);
+        }
+    }
+    void Compiler::emitStore(Location dest, Location src, const Type* type, const std::string& comment) {
+        const SizeType opsize = IS_REG(dest) ? SizeType::qword : operandSize(type);
+        if (src.isDereference || (src.isLiteral && opsize == SizeType::qword && !fitsImmediate(src.value.s))) {
+            // there is no memory-to-memory mov, nor a store of a 64-bit immediate
+            const Register temp = GET_REG(currentFrame());
+            emitLoad(temp, src, type, "store through temp reg");
+            src = RegisterLocation(temp);
+            returnRegister(temp);
+        }
+        if (IS_REG(src)) {
+            src.reg = static_cast<int>(sizedRegister(static_cast<Register>(src.reg), opsize));
+        }
+        emit(new MoveOperation(dest, src, opsize, comment), SectionType::text);
+    }
+
+    // MARK: Condition helpers
+    static Condition comparisonCondition(TokenType op, bool isSigned) {
+        switch (op) {
+            case TokenType::equal: return Condition::equal;
+            case TokenType::unequal: return Condition::unequal;
+            case TokenType::less: return isSigned ? Condition::less : Condition::below;
+            case TokenType::greater: return isSigned ? Condition::greater : Condition::above;
+            case TokenType::lessEqual: return isSigned ? Condition::lessEqual : Condition::belowEqual;
+            case TokenType::greaterEqual: return isSigned ? Condition::greaterEqual : Condition::aboveEqual;
+            default:
+                assert(false && "Not a comparison");
+                return Condition::normal;
+        }
+    }
+    static bool foldComparison(Condition cond, const Location& lhs, const Location& rhs) {
+        switch (cond) {
+            case Condition::equal: return lhs.value.u == rhs.value.u;
+            case Condition::unequal: return lhs.value.u != rhs.value.u;
+            case Condition::less: return lhs.value.s < rhs.value.s;
+            case Condition::greater: return lhs.value.s > rhs.value.s;
+            case Condition::lessEqual: return lhs.value.s <= rhs.value.s;
+            case Condition::greaterEqual: return lhs.value.s >= rhs.value.s;
+            case Condition::below: return lhs.value.u < rhs.value.u;
+            case Condition::above: return lhs.value.u > rhs.value.u;
+            case Condition::belowEqual: return lhs.value.u <= rhs.value.u;
+            case Condition::aboveEqual: return lhs.value.u >= rhs.value.u;
+            default: return false;
+        }
+    }
+
+    // Either leaves the flags for the caller to branch on, or materializes the
+    // condition as 0 or 1 with setcc + movzx (no partial-register write is read)
+    std::pair<Location, Condition> Compiler::emitConditionResult(Condition cond, bool justFlags) {
+        if (justFlags) {
+            return { RelLabelL("N/A"), cond };
+        }
+        const Register r = GET_REG(currentFrame());
+        emit(new SetOperation(cond, RegisterLocation(sizedRegister(r, SizeType::byte)), "materialize condition"), SectionType::text);
+        emit(new MoveExtendOperation(RegisterLocation(sizedRegister(r, SizeType::dword)), RegisterLocation(sizedRegister(r, SizeType::byte)), SizeType::byte, false, "zero extend condition"), SectionType::text);
+        return { RegisterLocation(r), cond };
+    }
+
     // MARK: Emit condition to set specified flags
+    // With justFlags, only the flags are set and the returned condition holds
+    // when expr is true (false if inverted). Otherwise the result is also
+    // materialized as 0 or 1. Conditions known at compile time are returned as
+    // literals holding the truth value of expr.
     std::pair<Location, Condition> Compiler::emitCondition(Expression* expr, bool inverted, bool justFlags) {
         if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
             Expression* left = binary->left();
@@ -1361,270 +2800,396 @@ namespace Floral {
                     }
                     const Location resultloc = emitExpression(right);
                     if (resultloc.isLiteral) {
-                        if (resultloc.value.u) {
-                            const Register reg = static_cast<Register>(currentFrame().avaliableScratch());
-                            emit(new XorOperation(RegisterLocation(reg), RegisterLocation(reg), "set the zero flag"), SectionType::text);
-                            returnRegister(reg);
-                            return { TrueLL, inverted ? Condition::nonzero : Condition::zero };
-                        } else {
-                            const Register reg = static_cast<Register>(currentFrame().avaliableScratch());
-                            emit(new XorOperation(RegisterLocation(reg), RegisterLocation(reg), "set the zero flag"), SectionType::text);
-                            return { FalseLL, inverted ? Condition::zero : Condition::nonzero };
-                        }
+                        return { NumLL(false, SU((uint64_t)!resultloc.value.u)), inverted ? Condition::nonzero : Condition::zero };
                     }
                     
                     emit(new CmpOperation(resultloc, ZeroLL, "set zero flag if false"), SectionType::text); // zero flag set = false
-                    emit(new MoveOperation(resultloc, FalseLL, SizeType::qword, "zero result"), SectionType::text); // assume false
-                    const Register reg = static_cast<Register>(currentFrame().avaliableScratch());
-                    emit(new MoveOperation(RegisterLocation(reg), TrueLL, SizeType::qword, "temp reg for conditional move"), SectionType::text);
-                    emit(new RawText(INDENT "cmovz " + RegisterLocation(static_cast<Register>(resultloc.reg + 8)).str() + ", " + registerNames[static_cast<int>(reg) + 8] + " ; set true if zero flag"), SectionType::text); // if false set to true
-                    returnRegister(reg);
-                    return { resultloc, inverted ? Condition::nonzero : Condition::zero };
-                }
-                case TokenType::equal: {
-                    const Location resultloc = emitExpression(left);
-                    const Location rhsloc = emitExpression(right);
-                    
-                    if (resultloc.isLiteral && rhsloc.isLiteral) {
-                        if (justFlags) {
-                            return { NumLL(false, SU((uint64_t)(resultloc.value.u == rhsloc.value.u))), inverted ? Condition::unequal : Condition::equal };
-                        }
-                        const Register r = GET_REG(currentFrame());
-                        if (resultloc.value.u != rhsloc.value.u) {
-                            emit(new XorOperation(RegisterLocation(r), RegisterLocation(r)), SectionType::text);
-                        } else {
-                            emit(new XorOperation(RegisterLocation(r), RegisterLocation(r)), SectionType::text);
-                            emit(new CmpOperation(RegisterLocation(r), OneLL), SectionType::text);
-                        }
-                        return { RegisterLocation(r), inverted ? Condition::nonzero : Condition::zero };
-                    }
-                    
-                    emit(new XorOperation(resultloc, resultloc), SectionType::text);
-                    emit(new CmpOperation(resultloc, rhsloc), SectionType::text);
-                    
-                    if (justFlags) {
-                        return { RelLabelL("N/A"), inverted ? Condition::zero : Condition::nonzero };
-                    }
-                    
-                    emit(new RawText(INDENT "cmovnz " + RegisterLocation(static_cast<Register>(static_cast<int>(resultloc.reg) + 8)).str() + " ; equal condition = nonzero for true"), SectionType::text);
-                    
-                    if (IS_REG(rhsloc)) {
-                        returnRegister(static_cast<Register>(rhsloc.reg));
+                    if (IS_REG(resultloc)) {
+                        returnRegister(static_cast<Register>(resultloc.reg));
                     }
-                    
-                    return { resultloc, inverted ? Condition::zero : Condition::nonzero };
+                    return emitConditionResult(inverted ? Condition::nonzero : Condition::zero, justFlags);
                 }
-                case TokenType::unequal: {
-                    const Location resultloc = emitExpression(left);
+                case TokenType::equal:
+                case TokenType::unequal:
+                case TokenType::less:
+                case TokenType::greater:
+                case TokenType::lessEqual:
+                case TokenType::greaterEqual: {
+                    if (left->type && left->type->isFloat()) return emitFloatComparison(binary, inverted, justFlags);
+                    const Condition cond = comparisonCondition(binary->op()->tkntype(), left->type && left->type->isSigned());
+                    Location lhsloc = emitExpression(left);
                     const Location rhsloc = emitExpression(right);
                     
-                    if (resultloc.isLiteral && rhsloc.isLiteral) {
-                        const Register r = static_cast<Register>(currentFrame().avaliableScratch());
-                        if (resultloc.value.u != rhsloc.value.u) {
-                            emit(new XorOperation(RegisterLocation(r), RegisterLocation(r)), SectionType::text);
-                        } else {
-                            emit(new MoveOperation(RegisterLocation(r), NumLL(false, SU(1ULL)), SizeType::qword), SectionType::text);
-                        }
-                        return { RegisterLocation(r), inverted ? Condition::nonzero : Condition::zero };
+                    if (lhsloc.isLiteral && rhsloc.isLiteral) {
+                        return { NumLL(false, SU((uint64_t)foldComparison(cond, lhsloc, rhsloc))), inverted ? invertedCondition(cond) : cond };
                     }
                     
-                    emit(new SubOperation(resultloc, rhsloc, resultloc.str() + " becomes 0 if equal"), SectionType::text);
-                    
-                    if (IS_REG(rhsloc)) {
-                        returnRegister(static_cast<Register>(rhsloc.reg));
+                    // cmp needs its first operand in a register unless the other is one
+                    if (lhsloc.isLiteral || (lhsloc.isDereference && rhsloc.isDereference)) {
+                        const Register temp = GET_REG(currentFrame());
+                        emit(new MoveOperation(RegisterLocation(temp), lhsloc, SizeType::qword, "lhs of comparison into temp reg"), SectionType::text);
+                        lhsloc = RegisterLocation(temp);
                     }
+                    emit(new CmpOperation(lhsloc, rhsloc), SectionType::text);
                     
-                    return { resultloc, inverted ? Condition::nonzero : Condition::zero };
-                }
-                case TokenType::less: {
-                    const Location resultloc = emitExpression(left);
-                    const Location rhsloc = emitExpression(right);
-                    
-                    if (resultloc.isLiteral && rhsloc.isLiteral) {
-                        const Register r = GET_REG(currentFrame());
-                        if (resultloc.value.s < rhsloc.value.s) {
-                            emit(new XorOperation(RegisterLocation(r), RegisterLocation(r)), SectionType::text);
-                        } else {
-                            emit(new MoveOperation(RegisterLocation(r), NumLL(false, SU(1ULL)), SizeType::qword), SectionType::text);
-                        }
-                        return { RegisterLocation(r), inverted ? Condition::nonzero : Condition::zero };
-                    }
-                    
-                    emit(new CmpOperation(resultloc, rhsloc), SectionType::text);
-                    
-                    if (IS_REG(resultloc)) {
-                        returnRegister(static_cast<Register>(resultloc.reg));
+                    if (IS_REG(lhsloc)) {
+                        returnRegister(static_cast<Register>(lhsloc.reg));
                     }
                     if (IS_REG(rhsloc)) {
                         returnRegister(static_cast<Register>(rhsloc.reg));
                     }
                     
-                    if (justFlags) {
-                        return { RelLabelL("N/A"), inverted ? Condition::greaterEqual : Condition::less };
-                    }
-                    
-                    const Register r = GET_REG(currentFrame());
-                    emit(new MoveOperation(RegisterLocation(r), ZeroLL, SizeType::qword), SectionType::text);
-                    const Register r8bit = static_cast<Register>(static_cast<int>(r) + 32);
-                    emit(new RawText(INDENT "setl " + RegisterLocation(r8bit).str()), SectionType::text);
-                    
-                    return { RegisterLocation(r), inverted ? Condition::greaterEqual : Condition::less };
+                    return emitConditionResult(inverted ? invertedCondition(cond) : cond, justFlags);
                 }
-                default:
-                    break;
-            }
-        } else if (auto literal = dynamic_cast<Literal*>(expr)) {
-            switch (literal->type()) {
-                case Literal::LType::boolean: {
+                case TokenType::bool_and:
+                case TokenType::bool_or: {
+                    // Short-circuit evaluation needs control flow; the value is
+                    // 1 unless the threaded branch jumps past the store of 1
+                    const std::string skipName = currentFrame().id + "_#cond_value_" + std::to_string(_labels.conditions++);
                     const Register r = GET_REG(currentFrame());
-                    if (literal->value().type == TokenType::boolTrue) {
-                        emit(new XorOperation(RegisterLocation(r), RegisterLocation(r)), SectionType::text);
-                    } else {
-                        emit(new MoveOperation(RegisterLocation(r), NumLL(false, SU(1ULL)), SizeType::qword), SectionType::text);
+                    emit(new XorOperation(RegisterLocation(sizedRegister(r, SizeType::dword)), RegisterLocation(sizedRegister(r, SizeType::dword)), "assume false"), SectionType::text);
+                    const StaticBranch branch = emitBranch(expr, false, skipName);
+                    if (branch != StaticBranch::always) {
+                        emit(new MoveOperation(RegisterLocation(sizedRegister(r, SizeType::dword)), OneLL, SizeType::dword, "condition is true"), SectionType::text);
                     }
-                    emit(new CmpOperation(RegisterLocation(r), FalseLL), SectionType::text);
-                    returnRegister(r);
-                    if (literal->value().type == TokenType::boolTrue) {
-                        return { TrueLL, inverted ? Condition::zero : Condition::nonzero };
-                    } else {
-                        return { FalseLL, inverted ? Condition::nonzero : Condition::zero };
+                    emit(new Label(skipName, false, false), SectionType::text);
+                    if (branch != StaticBranch::conditional) {
+                        returnRegister(r);
+                        return { NumLL(false, SU((uint64_t)(branch == StaticBranch::never))), inverted ? Condition::zero : Condition::nonzero };
                     }
+                    emit(new CmpOperation(RegisterLocation(r), ZeroLL), SectionType::text);
+                    if (justFlags) {
+                        returnRegister(r);
+                        return { RelLabelL("N/A"), inverted ? Condition::zero : Condition::nonzero };
+                    }
+                    return { RegisterLocation(r), inverted ? Condition::zero : Condition::nonzero };
                 }
                 default:
                     break;
             }
-        } else if (auto symbol = dynamic_cast<SymbolExpression*>(expr)) {
-            // MARK: literally looks for defined stuff in this frame will fix later
-            const auto result = lookup(symbol->value().contents); // PROBLEM: only valid in reference to that frame. Add member to struct variable called TOTAL OFFSET or ABSOLUTE OFFSET which contains the offset FROM THE START and hence make the calculation of the offset from the current rbp possible
-            if (!result.second) {
-                assert(false && "Static analyzer should catch this");
+        } else if (auto literal = dynamic_cast<Literal*>(expr)) {
+            if (literal->type() == Literal::LType::boolean) {
+                const bool truth = literal->value().type == TokenType::boolTrue;
+                return { truth ? TrueLL : FalseLL, inverted ? Condition::zero : Condition::nonzero };
             }
-            auto loc = result.first.loc;
-            const Register resultr = static_cast<Register>(frames.back().avaliableScratch());
-            emit(new MoveOperation(RegisterLocation(resultr), loc, OPSIZE_FROM_NUM(result.first.size), "store " + result.first.name + " in " + registerNames[static_cast<int>(resultr)]), SectionType::text);
-            emit(new CmpOperation(RegisterLocation(resultr), NumLL(false, SU(0ULL))), SectionType::text);
-            return { RegisterLocation(resultr), inverted ? Condition::zero : Condition::nonzero };
         }
-        assert(false && "Unimplemented condition");
+        
+        // Any other value is true when nonzero
+        const Location loc = emitExpression(expr);
+        if (loc.isLiteral) {
+            return { loc.value.u ? TrueLL : FalseLL, inverted ? Condition::zero : Condition::nonzero };
+        }
+        emit(new CmpOperation(loc, ZeroLL, "set zero flag if false"), SectionType::text);
+        if (IS_REG(loc)) {
+            returnRegister(static_cast<Register>(loc.reg));
+        }
+        return emitConditionResult(inverted ? Condition::zero : Condition::nonzero, justFlags);
     }
 
-    // MARK: Caller save registers
-    void Compiler::emitSaveRegisters(const std::vector<Register> &registers) {
-        for (std::vector<Register>::const_reverse_iterator i = registers.rbegin(); i != registers.rend(); ++i) {
-            currentFrame().returnScratchRegister(*i);
-            emit(new PushOperation(RegisterLocation(*i)), SectionType::text);
+    // MARK: Emit branch
+    // Jumps to target when expr evaluates to jumpIfTrue and falls through
+    // otherwise. && and || are threaded: every sub-condition jumps straight to
+    // the final target (or past the rest of the chain) instead of materializing
+    // intermediate booleans.
+    StaticBranch Compiler::emitBranch(Expression* expr, bool jumpIfTrue, const std::string& target) {
+        if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
+            const TokenType op = binary->op()->tkntype();
+            if (op == TokenType::bool_not && !binary->left() && binary->right()) {
+                return emitBranch(binary->right(), !jumpIfTrue, target);
+            }
+            if (op == TokenType::bool_and || op == TokenType::bool_or) {
+                // (a && b) jumps on false as soon as either is false, and (a || b)
+                // jumps on true as soon as either is true; otherwise the first
+                // operand has to skip over the second
+                const bool shortCircuits = (op == TokenType::bool_and) != jumpIfTrue;
+                if (shortCircuits) {
+                    const StaticBranch first = emitBranch(binary->left(), jumpIfTrue, target);
+                    if (first == StaticBranch::always) return StaticBranch::always;
+                    const StaticBranch second = emitBranch(binary->right(), jumpIfTrue, target);
+                    if (first == StaticBranch::never) return second;
+                    return second == StaticBranch::always ? StaticBranch::always : StaticBranch::conditional;
+                }
+                const std::string skipName = currentFrame().id + "_#cond_skip_" + std::to_string(_labels.branches++);
+                const StaticBranch first = emitBranch(binary->left(), !jumpIfTrue, skipName);
+                StaticBranch second = StaticBranch::never;
+                if (first != StaticBranch::always) {
+                    second = emitBranch(binary->right(), jumpIfTrue, target);
+                }
+                emit(new Label(skipName, false, false), SectionType::text);
+                if (first == StaticBranch::always || second == StaticBranch::never) return StaticBranch::never;
+                return first == StaticBranch::never ? second : StaticBranch::conditional;
+            }
         }
-    }
-    void Compiler::emitRestoreRegisters(const std::vector<Register> &registers) {
-        for (auto reg: registers) {
-            currentFrame().registersInUse.push_back(reg);
+        
+        const auto [loc, cond] = emitCondition(expr, !jumpIfTrue, true);
+        if (loc.isLiteral) {
+            if (static_cast<bool>(loc.value.u) == jumpIfTrue) {
+                emit(new JumpOperation(JumpOperation::JType::normal, target), SectionType::text);
+                return StaticBranch::always;
+            }
+            return StaticBranch::never;
+        }
+        if (IS_REG(loc)) {
+            returnRegister(static_cast<Register>(loc.reg));
         }
+        emit(new JumpOperation(cond, target), SectionType::text);
+        return StaticBranch::conditional;
     }
 
     // MARK: Load arguments pre-call
-    std::pair<long long, std::vector<Register>> Compiler::emitCallArguments(const std::vector<Expression*>& args) {
-        // https://en.wikipedia.org/wiki/X86_calling_conventions#System_V_AMD64_ABI -
-        // The first six integer or pointer arguments are passed in registers RDI, RSI, RDX, RCX, R8, R9
-        // while XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6 and XMM7 are used for the first floating point arguments. As in the Microsoft x64 calling convention, additional arguments are passed on the stack.
-        const size_t size = args.size();
-        if (size == 0) return {0, {}};
-            
-        int integers{};
-//        int floats{};
-            
+    // https://en.wikipedia.org/wiki/X86_calling_conventions#System_V_AMD64_ABI -
+    // The first six integer or pointer arguments are passed in registers RDI, RSI, RDX, RCX, R8, R9
+    // while XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6 and XMM7 are used for the first floating point arguments. As in the Microsoft x64 calling convention, additional arguments are passed on the stack.
+    // Each argument's register, or LOC_IS_NOT_REG if it goes on the stack; a null argument is an already loaded this pointer
+    static std::vector<int> argumentRegisters(const std::vector<Expression*>& args) {
         static const Register integerRegs[] {
             Register::rdi, Register::rsi, Register::rdx, Register::rcx, Register::r8, Register::r9
         };
-//        static const Register floatRegs[] {
-//
-//        };
-                    
-        std::vector<Expression*> stackArgs;
-        std::vector<Register> overwrittenRegs;
-        stackArgs.reserve(max(6, size) - 6);
-                    
+        std::vector<int> registers;
+        int integers {}, floats {};
+        for (auto arg: args) {
+            if (arg && arg->type && arg->type->isFloat()) {
+                registers.push_back(floats < 8 ? static_cast<int>(Register::xmm0) + floats++ : LOC_IS_NOT_REG);
+            } else {
+                registers.push_back(integers < 6 ? static_cast<int>(integerRegs[integers++]) : LOC_IS_NOT_REG);
+            }
+        }
+        return registers;
+    }
+    static long long stackArgumentCount(const std::vector<Expression*>& args) {
+        const std::vector<int> registers = argumentRegisters(args);
+        return std::count(registers.begin(), registers.end(), LOC_IS_NOT_REG);
+    }
+    long long Compiler::emitCallArguments(const std::vector<Expression*>& args) {
+        const size_t size = args.size();
+        if (size == 0) return 0;
+        const std::vector<int> registers = argumentRegisters(args);
+        
+        // Stack arguments are pushed first, as evaluating them could otherwise disturb loaded argument registers
+        long long stackArgC {};
+        for (size_t index = size; index-- > 0;) {
+            if (registers[index] != LOC_IS_NOT_REG) continue;
+            Location result = emitExpression(args[index]);
+            if (IS_REG(result) && isFloatRegister(static_cast<Register>(result.reg))) { // push only takes general registers
+                const Register bits = GET_REG(currentFrame());
+                emit(new MoveOperation(RegisterLocation(bits), result, SizeType::qword, "Float argument bits"), SectionType::text);
+                returnRegister(static_cast<Register>(result.reg));
+                result = RegisterLocation(bits);
+            }
+            emit(new PushOperation(result, "push argument onto stack"), SectionType::text);
+            if (IS_REG(result)) returnRegister(static_cast<Register>(result.reg));
+            stackArgC++;
+        }
+        
+        // Every register argument is evaluated before any is loaded, since a later argument may read a
+        // parameter living in an argument register an earlier one would overwrite
+        std::vector<Location> results(size, RegisterLocation(Register::rip));
         for (size_t index = 0; index < size; index++) {
+            if (registers[index] == LOC_IS_NOT_REG) continue;
+            const Register dest = static_cast<Register>(registers[index]);
             Expression* arg {args[index]};
-            if ((true) || arg->type->isInteger()) {
-                if (integers >= 6) { // only 6 registers for arguments
-                    stackArgs.push_back(arg);
-                } else {
-                    const Register argreg = integerRegs[integers++];
-                    if (std::find_if(currentFrame().data.begin(), currentFrame().data.end(), [argreg](Variable v) -> bool {
-                        return v.loc == RegisterLocation(argreg);
-                    }) != currentFrame().data.end()) {
-                        emit(new PushOperation(RegisterLocation(argreg)), SectionType::text);
-                        overwrittenRegs.push_back(argreg);
-                    }
-                    if (!arg)
-                        continue;
-                    const Location result = emitExpression(arg);
-                    if (result.reg != static_cast<int>(argreg)) emit(new MoveOperation(RegisterLocation(argreg), result, SizeType::qword, "argument " + std::to_string(index)), SectionType::text);
-                    if (IS_REG(result)) returnRegister(static_cast<Register>(result.reg));
-                }
+            if (!arg) { // already loaded by the caller, e.g. a this pointer
+                currentFrame().registersInUse.push_back(dest);
+                results[index] = RegisterLocation(dest);
+                continue;
+            }
+            Location result = emitExpression(arg);
+            if (isFloatRegister(dest)) {
+                result = RegisterLocation(emitFloatOperand(result)); // there are no Float immediates to load later
+            } else if (!IS_REG(result) && !result.isLiteral) {
+                const Register temp = GET_REG(currentFrame());
+                emitLoad(temp, result, arg->type, "argument " + std::to_string(index));
+                result = RegisterLocation(temp);
             }
-    //            else {
-    //                floats++;
-    //            }
+            results[index] = result;
         }
-                    
-        const long long stackArgC = stackArgs.size();
-        while (!stackArgs.empty()) {
-            Expression* arg = stackArgs.back();
-            stackArgs.pop_back();
-                    
-            const Location result = emitExpression(arg);
-            emit(new PushOperation(result, "push argument onto stack"), SectionType::text);
+        
+        // Moving the results into place is a parallel move: a register is only written once nothing still reads it
+        std::vector<std::pair<Location, Register>> pending;
+        for (size_t index = 0; index < size; index++) {
+            if (registers[index] != LOC_IS_NOT_REG && IS_REG(results[index]) && results[index].reg != registers[index]) {
+                pending.push_back({results[index], static_cast<Register>(registers[index])});
+            }
+        }
+        while (!pending.empty()) {
+            auto ready = std::find_if(pending.begin(), pending.end(), [&pending](const std::pair<Location, Register>& move) {
+                return std::none_of(pending.begin(), pending.end(), [&move](const std::pair<Location, Register>& other) {
+                    return other.first.reg == static_cast<int>(move.second);
+                });
+            });
+            if (ready == pending.end()) { // every destination is still read, so break the cycle through a free register
+                const Location& blocked = pending.front().first;
+                const Register temp = isFloatRegister(static_cast<Register>(blocked.reg)) ? GET_FLOAT_REG(currentFrame()) : GET_REG(currentFrame());
+                emit(new MoveOperation(RegisterLocation(temp), blocked, SizeType::qword, "break argument cycle"), SectionType::text);
+                returnRegister(static_cast<Register>(blocked.reg));
+                pending.front().first = RegisterLocation(temp);
+                continue;
+            }
+            const size_t index = std::find(registers.begin(), registers.end(), static_cast<int>(ready->second)) - registers.begin();
+            emit(new MoveOperation(RegisterLocation(ready->second), ready->first, SizeType::qword, "argument " + std::to_string(index)), SectionType::text);
+            returnRegister(static_cast<Register>(ready->first.reg));
+            pending.erase(ready);
         }
-        return { stackArgC, overwrittenRegs };
+        for (size_t index = 0; index < size; index++) {
+            if (registers[index] == LOC_IS_NOT_REG) continue;
+            const Register dest = static_cast<Register>(registers[index]);
+            if (results[index].isLiteral) {
+                emitLoad(dest, results[index], args[index]->type, "argument " + std::to_string(index));
+            } else if (results[index].reg == registers[index] && !currentFrame().holdsVariable(dest)) {
+                returnRegister(dest); // nothing runs between here and the call
+            }
+        }
+        return stackArgC;
     }
 
     // MARK: Emit call
-    Location Compiler::emitCall(Call *call, bool isTailCall) {
+    Location Compiler::emitCall(Call *call) {
         const FunctionSignature funsig {call->name.contents, call->_spa_params};
         
-        if (isTailCall) {
-            emitLeave();
-            emitCallArguments(call->args); // load the arguments
-            emit(new JumpOperation(JumpOperation::JType::normal, analyzer.strFromFunctionSignature(funsig), call->generateTypeDescription() + " && tail call optimization"), SectionType::text);
-            return RETURN_VALUE_LOC;
+        Function* callee = dynamic_cast<Function*>(analyzer.lookupFunction(call->name.contents, call->_spa_params));
+        if (callee && shouldInline(callee, analyzer.strFromFunctionSignature(funsig))) {
+            return emitInlineCall(call, callee);
         }
         
-        std::vector<Register> registersInUse;
-        if (!frames.empty()) registersInUse = currentFrame().registersInUse;
-        if (!registersInUse.empty() && (registersInUse.size() & 1)) registersInUse.push_back(registersInUse.back());
-        emitSaveRegisters(registersInUse); // push all registers in use onto the stack, as the callee may modify them
+        // Only caller-saved registers holding values still needed after the call are preserved, and they are
+        // parked in callee-saved registers, which the function saves once instead of at every call
+        std::vector<std::pair<Register, Location>> preserved;
+        if (!frames.empty()) {
+            const std::vector<Register> live = currentFrame().registersInUse;
+            for (auto reg: live) {
+                if (isFloatRegister(reg)) { // every xmm register is caller-saved
+                    const Location home = RBPOffsetLocation(currentFrame().allocate(8));
+                    emit(new MoveOperation(home, RegisterLocation(reg), SizeType::qword, "@ preserve across call"), SectionType::text);
+                    preserved.push_back({reg, home});
+                    continue;
+                }
+                if (!isScratch(reg)) continue; // callee-saved registers already survive the call
+                const int parking = currentFrame().avaliableCalleeSaved();
+                const Location home = parking != -1 ? RegisterLocation(static_cast<Register>(parking)) : RBPOffsetLocation(currentFrame().allocate(8));
+                emit(new MoveOperation(home, RegisterLocation(reg), SizeType::qword, "@ preserve across call"), SectionType::text);
+                preserved.push_back({reg, home});
+            }
+        }
         
-        auto loadresult {emitCallArguments(call->args)}; // load the arguments
-        const long long stackArgC = loadresult.first;
+        // The frame keeps rsp 16-byte aligned, so only stack arguments and outstanding pushes can misalign the call
+        const long long stackArgC = stackArgumentCount(call->args);
+        const long long padding = !frames.empty() && ((currentFrame().pushed + stackArgC * 8) & 15) ? 8 : 0;
+        if (padding) emit(new SubOperation(RegisterLocation(Register::rsp), NumLL(false, SU(padding)), "align call"), SectionType::text);
+        emitCallArguments(call->args); // load the arguments
         
         emit(new CallOperation(analyzer.strFromFunctionSignature(funsig), call->generateTypeDescription()), SectionType::text); // call the function
         
-        bool savedrax = false;
-        for (size_t i = 0; i < registersInUse.size(); i++) {
-            if (registersInUse[i] == Register::rax) {
-                savedrax = true;
+        if (stackArgC || padding) emit(new AddOperation(RegisterLocation(Register::rsp), NumLL(false, SU(stackArgC * 8 + padding)), SizeType::qword, "remove args"), SectionType::text); // remove arguments
+        
+        const bool returnsFloat = call->type && call->type->isFloat();
+        const Register returned = returnsFloat ? Register::xmm0 : Register::rax;
+        Location r = RegisterLocation(returned);
+        if (frames.empty()) return r;
+        if (currentFrame().isAvaliable(returned)) {
+            currentFrame().registersInUse.push_back(returned); // the result is live until the caller returns it
+        } else { // the register held a value from before the call, which is about to be restored
+            const Register result = returnsFloat ? GET_FLOAT_REG(currentFrame()) : GET_REG(currentFrame());
+            emit(new MoveOperation(RegisterLocation(result), RegisterLocation(returned), SizeType::qword, "save return value"), SectionType::text);
+            r = RegisterLocation(result);
+        }
+        for (auto& save: preserved) {
+            emit(new MoveOperation(RegisterLocation(save.first), save.second, SizeType::qword, "@ restore after call"), SectionType::text);
+            if (IS_REG(save.second)) returnRegister(static_cast<Register>(save.second.reg));
+        }
+                
+        return r;
+    }
+
+    // MARK: Inlining
+    #define INLINE_COST_LIMIT 24 // rough node count under which a static function is inlined without being asked
+    #define INLINE_DEPTH_LIMIT 4
+    #define INLINE_IMPOSSIBLE (1 << 20) // large enough to dominate any sum, small enough never to overflow one
+    static size_t inlineCost(const Node* node);
+    static size_t inlineCost(const Initializer* init) {
+        if (auto direct = dynamic_cast<const DirectInitializer*>(init)) return inlineCost(direct->expr());
+        if (auto copy = dynamic_cast<const CopyInitializer*>(init)) return inlineCost(copy->expr());
+        return 1;
+    }
+    static size_t inlineCost(const Node* node) {
+        if (!node) return 0;
+        if (auto binary = dynamic_cast<const BinaryExpression*>(node)) return 1 + inlineCost(binary->left()) + inlineCost(binary->right());
+        if (auto call = dynamic_cast<const Call*>(node)) {
+            size_t cost = 8; // argument marshalling and caller saves
+            for (auto arg: call->args) cost += inlineCost(arg);
+            return cost;
+        }
+        if (auto cast = dynamic_cast<const UnsafeCast*>(node)) return inlineCost(cast->expr());
+        if (dynamic_cast<const Expression*>(node)) return 1;
+        if (auto callStm = dynamic_cast<const CallStatement*>(node)) return inlineCost(callStm->call);
+        if (auto rtnStm = dynamic_cast<const ReturnStatement*>(node)) return 1 + inlineCost(rtnStm->value());
+        if (auto exprStm = dynamic_cast<const ExpressionStatement*>(node)) return inlineCost(exprStm->expr());
+        if (auto let = dynamic_cast<const LetStatement*>(node)) return 1 + inlineCost(let->initializer());
+        if (auto var = dynamic_cast<const VarStatement*>(node)) return 1 + (var->initializer() ? inlineCost(var->initializer()) : 0);
+        if (auto assign = dynamic_cast<const Assignment*>(node)) return 1 + inlineCost(assign->lval()) + inlineCost(assign->rval());
+        if (auto ptrAssign = dynamic_cast<const PointerAssignment*>(node)) return 1 + inlineCost(ptrAssign->ptrExpr()) + inlineCost(ptrAssign->newValue());
+        if (auto ifStm = dynamic_cast<const IfStatement*>(node)) return 2 + inlineCost(ifStm->condition()) + inlineCost(ifStm->body());
+        if (auto whileStm = dynamic_cast<const WhileStatement*>(node)) return INLINE_COST_LIMIT / 2 + inlineCost(whileStm->condition()) + inlineCost(whileStm->body()); // loops rarely pay back their copy
+        if (auto forStm = dynamic_cast<const ForStatement*>(node)) return INLINE_COST_LIMIT / 2 + inlineCost(forStm->init()) + inlineCost(forStm->check()) + inlineCost(forStm->modify()) + inlineCost(forStm->body());
+        if (auto block = dynamic_cast<const Block*>(node)) {
+            size_t cost {};
+            for (auto child: block->body()) {
+                if (dynamic_cast<const Declaration*>(child)) return INLINE_IMPOSSIBLE; // nested declarations cannot be emitted mid-function
+                cost += inlineCost(child);
             }
+            return cost;
         }
-        if (stackArgC) emit(new AddOperation(RegisterLocation(Register::rsp), NumLL(false, SU(stackArgC * 8)), SizeType::qword, "remove args"), SectionType::text); // remove arguments
-        
-        Location r = RETURN_VALUE_LOC;
-        
-        emitRestoreRegisters(registersInUse); // restore all the saved registers to original state
+        return 1;
+    }
+    bool Compiler::shouldInline(Function* callee, const std::string& label) {
+        if (frames.empty() || currentFrame().id == label) return false; // direct recursion
+        if (_inlineSites.size() >= INLINE_DEPTH_LIMIT) return false;
+        for (const InlineSite& site: _inlineSites) {
+            if (site.callee == callee) return false; // a recursive cycle through substituted bodies
+        }
+        size_t cost {};
+        for (auto stm: callee->body()) {
+            cost += inlineCost(stm);
+        }
+        if (cost >= INLINE_IMPOSSIBLE) return false;
+        if (callee->isInline()) return true;
+        return optimization && callee->isStatic() && cost <= INLINE_COST_LIMIT;
+    }
+    Location Compiler::emitInlineCall(Call* call, Function* callee) {
+        const FrameScope scope = currentFrame().openScope();
+        const Function::Parameters& params = callee->parameters();
         
-        if (savedrax) {
-            const Register result = static_cast<Register>(currentFrame().avaliableScratch());
-            if (!(RegisterLocation(result) == RETURN_VALUE_LOC)) {
-                emit(new MoveOperation(RegisterLocation(result), RETURN_VALUE_LOC, SizeType::qword, "save return value"), SectionType::text);
-                r = RegisterLocation(result);
-            }
+        // Spill every argument before binding any parameter name, as an argument may mention a caller variable a parameter shadows
+        std::vector<long> slots;
+        for (size_t i = 0; i < params.size(); i++) {
+            const Location arg = emitExpression(call->args[i]);
+            const long slot = currentFrame().allocate(params[i].type->alignment());
+            emitStore(RBPOffsetLocation(slot), arg, params[i].type, "@ inline " + callee->name().contents + " parameter " + params[i].name.contents);
+            if (IS_REG(arg)) returnRegister(static_cast<Register>(arg.reg));
+            slots.push_back(slot);
+        }
+        for (size_t i = 0; i < params.size(); i++) {
+            currentFrame().addData(RBPOffsetLocation(slots[i]), params[i].type->alignment(), params[i].name.contents);
         }
         
-        for (auto reg: registersInUse) {
-            emit(new PopOperation(RegisterLocation(reg)), SectionType::text);
+        InlineSite site {
+            callee,
+            currentFrame().id + "_#inline_" + callee->name().contents + '_' + std::to_string(_labels.inlineCalls++),
+            callee->returnType()->isVoid() ? LOC_IS_NOT_REG : (callee->returnType()->isFloat() ? currentFrame().avaliableFloat() : currentFrame().avaliableScratch()),
+            callee->body().empty() ? nullptr : callee->body().back(),
+            false
+        };
+        if (!dynamic_cast<ReturnStatement*>(site.finalReturn)) site.finalReturn = nullptr;
+        _inlineSites.push_back(site);
+        for (auto stm: callee->body()) {
+            emitStatement(stm);
         }
-                
-        return r;
+        if (_inlineSites.back().exitUsed) {
+            emit(new Label(site.exitLabel, false, false), SectionType::text);
+        }
+        _inlineSites.pop_back();
+        currentFrame().closeScope(scope);
+        
+        return site.result == LOC_IS_NOT_REG ? RETURN_VALUE_LOC : RegisterLocation(static_cast<Register>(site.result));
     }
 
     // MARK: Frame handling
@@ -1640,28 +3205,39 @@ namespace Floral {
 
     // MARK: Emit entry point for execution
     void Compiler::generateEntryPoint(Function* main) {
-        emit(new RawText(
-                         "\nextern _init_floral ; initialization procedure\n"
-                         "global _main ; _main is the entry point in macOS nasm\n" // make entry point visible to linker
-                         "_main:" // _main is the entry point in macOS nasm
-                         ), SectionType::text);
+        const bool isLinux = _target == Target::Linux;
+        emit(new Extern("_init_floral", "initialization procedure", false), SectionType::text);
+        if (isLinux) {
+            emit(new Label("_start", true, true, false), SectionType::text); // the kernel jumps straight to _start, there is no libc to call main
+        } else {
+            emit(new Label("_main", true, true, false), SectionType::text); // _main is the entry point in macOS nasm, global so the linker sees it
+        }
         
         const std::string nameOfMain = analyzer.strFromFunctionSignature({main->name().contents, main->parameters()});
         if (!(nameOfMain == "main" || nameOfMain == "main_i32_u")) {
             report(Error::resolutionDomain, "Cannot find function main(Int32, &&Char)", main->_loc.path, main->_loc, { main->_name.pos(), main->_name.contents.size() });
         }
         
-        emit(new SubOperation(RegisterLocation(Register::rsp), NumLL(false, SU(8LLU)), "@ so stack is aligned upon calls"), SectionType::text); // align stack to 16 bytes
-        emit(new RawText(INDENT "call _init_floral ; @ call initialization procedure"), SectionType::text);
-        emit(new CallOperation(nameOfMain, "@ call the floral main function"), SectionType::text); // call the Floral main function
-        emit(new AddOperation(RegisterLocation(Register::rsp), NumLL(false, SU(8LLU)), SizeType::qword, "@ restore stack pointer"), SectionType::text); // restore stack pointer
+        if (isLinux) {
+            // rsp is already 16-byte aligned at _start, and argc sits on top of the stack followed by argv
+            emit(new CallOperation("_init_floral", "@ call initialization procedure", false), SectionType::text);
+            if (nameOfMain == "main_i32_u") {
+                emit(new MoveOperation(RegisterLocation(Register::rdi), ValueAtRegisterLocation(Register::rsp), SizeType::qword, "@ argc"), SectionType::text);
+                emit(new LoadAddressOperation(RegisterLocation(Register::rsi), ValueAtOffsetRegisterLocation(Register::rsp, 8), SizeType::qword, "@ argv"), SectionType::text);
+            }
+            emit(new CallOperation(nameOfMain, "@ call the floral main function"), SectionType::text);
+        } else {
+            emit(new SubOperation(RegisterLocation(Register::rsp), NumLL(false, SU(8LLU)), "@ so stack is aligned upon calls"), SectionType::text); // align stack to 16 bytes
+            emit(new CallOperation("_init_floral", "@ call initialization procedure", false), SectionType::text);
+            emit(new CallOperation(nameOfMain, "@ call the floral main function"), SectionType::text); // call the Floral main function
+            emit(new AddOperation(RegisterLocation(Register::rsp), NumLL(false, SU(8LLU)), SizeType::qword, "@ restore stack pointer"), SectionType::text); // restore stack pointer
+        }
         emit(
              new MoveOperation(RegisterLocation(Register::rdi), RETURN_VALUE_LOC, SizeType::qword, "@ exit code"),
              SectionType::text
              ); // store return value (rax) as exit code in rdi (first syscall argment)
         emit(
-             //new MoveOperation(RegisterLocation(Register::rax), NumLL(false, SU(0x2000001ULL)), SizeType::qword, "0x200001 = exit"),
-             new RawText("  mov eax, 0x2000001 ; @ exit syscall"),
+             new MoveOperation(RegisterLocation(Register::eax), NumLL(false, SU(isLinux ? 60ULL : 0x2000001ULL)), SizeType::dword, "@ exit syscall"),
              SectionType::text
              ); // set rax to indicate the exit syscall
         emit(new Syscall(), SectionType::text); // perform syscall
@@ -1721,6 +3297,13 @@ namespace Floral {
         }
     }
 
+    // movsd/movq have no immediate or memory-to-memory forms, and other operations cannot take an xmm operand,
+    // so the peephole patterns below leave moves of Floats alone
+    static bool movesFloat(const Instruction* instr) {
+        auto mov = dynamic_cast<const MoveOperation*>(instr);
+        return mov && ((IS_REG(mov->dest) && isFloatRegister(static_cast<Register>(mov->dest.reg))) || (IS_REG(mov->src) && isFloatRegister(static_cast<Register>(mov->src.reg))));
+    }
+
     // MARK: Match patterns one long
     void Compiler::optimizeMatch1(size_t instrc) {
         for (auto iter = textSection.instructions.rbegin(); iter != textSection.instructions.rend(); iter++) {
@@ -1752,12 +3335,15 @@ namespace Floral {
                 const size_t old_i = i;
                 Instruction* a {textSection.instructions[i]};
                 Instruction* b {textSection.instructions[i + 1]};
+                if (movesFloat(a) || movesFloat(b)) {
+                    continue;
+                }
                 if (auto amov = dynamic_cast<MoveOperation*>(a)) {
                     if (auto bmov = dynamic_cast<MoveOperation*>(b)) {
                         if (NO_OPTM(amov) || NO_OPTM(bmov)) {
                             continue;
                         }
-                        if (amov->dest == bmov->src && IS_REG(amov->dest)) {
+                        if (amov->dest == bmov->src && IS_REG(amov->dest) && !ARE_BOTH_MEM(amov->src, bmov->dest)) {
                             amov->dest = bmov->dest;
                             CAT_COMMENTS(amov, bmov);
                             textSection.instructions.erase(textSection.instructions.begin() + i + 1);
@@ -1778,13 +3364,13 @@ namespace Floral {
                             textSection.instructions.erase(textSection.instructions.begin() + i);
                             i--;
                         }
-                        else if (amov->dest == bmov->src && !amov->src.isDereference && !bmov->dest.isDereference) {
+                        else if (amov->dest == bmov->src && !amov->src.isDereference && !bmov->dest.isDereference && !ARE_BOTH_MEM(amov->src, bmov->dest)) {
                             bmov->src = amov->src;
                             bmov->comment += " (with " + amov->dest.str() + " = " + amov->src.str() + ')';
                         }
                     }
                     else if (auto badd = dynamic_cast<AddOperation*>(b)) {
-                        if (amov->dest == badd->src && IS_REG(amov->dest)) {
+                        if (amov->dest == badd->src && IS_REG(amov->dest) && !ARE_BOTH_MEM(amov->src, badd->dest)) {
                             badd->src = amov->src;
                             INSRT_COMMENTS(badd, amov);
                             textSection.instructions.erase(textSection.instructions.begin() + i);
@@ -1823,7 +3409,7 @@ namespace Floral {
                         }
                     }
                     else if (auto bmul = dynamic_cast<MulOperation*>(b)) {
-                        if (amov->dest == bmul->src && IS_REG(amov->dest)) {
+                        if (amov->dest == bmul->src && IS_REG(amov->dest) && !ARE_BOTH_MEM(amov->src, bmul->dest)) {
                             bmul->src = amov->src;
                             INSRT_COMMENTS(bmul, amov);
                             textSection.instructions.erase(textSection.instructions.begin() + i);
@@ -1849,7 +3435,7 @@ namespace Floral {
                         }
                     }
                     else if (auto bcmp = dynamic_cast<CmpOperation*>(b)) {
-                        if (IS_REG(amov->dest) && amov->dest == bcmp->dest && !bcmp->src.isDereference && IS_RBPOFFSET(amov->src)) {
+                        if (IS_REG(amov->dest) && amov->dest == bcmp->dest && !bcmp->src.isDereference && IS_RBPOFFSET(amov->src) && !ARE_BOTH_MEM(amov->src, bcmp->src)) {
                             bcmp->dest = amov->src;
                             INSRT_COMMENTS(bcmp, amov);
                             textSection.instructions.erase(textSection.instructions.begin() + i);
@@ -1863,7 +3449,7 @@ namespace Floral {
                             CAT_COMMENTS(alea, bmov);
                             textSection.instructions.erase(textSection.instructions.begin() + i + 1);
                             i--;
-                        } else if (IS_REG(alea->dest) && bmov->dest.reg == alea->dest.reg && !bmov->dest.isDereference && bmov->dest.isDereference && !bmov->src.isDereference) {
+                        } else if (IS_REG(alea->dest) && bmov->dest.reg == alea->dest.reg && !bmov->dest.isDereference && bmov->dest.isDereference && !bmov->src.isDereference && !ARE_BOTH_MEM(alea->src, bmov->src)) {
                             bmov->dest = alea->src;
                             INSRT_COMMENTS(bmov, alea);
                             textSection.instructions.erase(textSection.instructions.begin() + i);
@@ -1873,7 +3459,7 @@ namespace Floral {
                             bmov->src = alea->src;
                             textSection.instructions.erase(textSection.instructions.begin() + i);
                             i--;
-                        } else if (alea->dest.reg == bmov->dest.reg && IS_REG(alea->dest) && bmov->dest.isDereference && !bmov->src.isDereference) {
+                        } else if (alea->dest.reg == bmov->dest.reg && IS_REG(alea->dest) && bmov->dest.isDereference && !bmov->src.isDereference && !ARE_BOTH_MEM(alea->src, bmov->src)) {
                             bmov->dest = alea->src;
                             INSRT_COMMENTS(bmov, alea);
                             textSection.instructions.erase(textSection.instructions.begin() + i);
@@ -1921,6 +3507,9 @@ namespace Floral {
                 Instruction* a {textSection.instructions[i]};
                 Instruction* b {textSection.instructions[i + 1]};
                 Instruction* c {textSection.instructions[i + 2]};
+                if (movesFloat(a) || movesFloat(b) || movesFloat(c)) {
+                    continue;
+                }
                 if (auto amov = dynamic_cast<MoveOperation*>(a)) {
                     if (auto badd = dynamic_cast<AddOperation*>(b)) {
                         if (auto cmov = dynamic_cast<MoveOperation*>(c)) {
@@ -1936,7 +3525,7 @@ namespace Floral {
                                     cmov->comment = badd->comment + " && " + cmov->comment;
                                     textSection.instructions.erase(textSection.instructions.begin() + i + 1); // not two since its all shifted
                                 }
-                            } else if (IS_RBPOFFSET(amov->src) && IS_REG(amov->dest) && badd->dest == amov->dest && !badd->src.isDereference && cmov->dest == amov->src && cmov->src == badd->dest) {
+                            } else if (IS_RBPOFFSET(amov->src) && IS_REG(amov->dest) && badd->dest == amov->dest && !badd->src.isDereference && !ARE_BOTH_MEM(amov->src, badd->src) && cmov->dest == amov->src && cmov->src == badd->dest) {
                                 badd->dest = amov->src;
                                 badd->opsize = amov->opsize;
                                 CAT_COMMENTS(amov, badd);
@@ -1959,7 +3548,7 @@ namespace Floral {
                                     INSRT_COMMENTS(cmov, bsub);
                                     textSection.instructions.erase(textSection.instructions.begin() + i + 1); // not two since its all shifted
                                 }
-                            } else if (amov->src == cmov->dest && amov->dest == cmov->src && bsub->dest == amov->dest) {
+                            } else if (amov->src == cmov->dest && amov->dest == cmov->src && bsub->dest == amov->dest && !ARE_BOTH_MEM(amov->src, bsub->src)) {
                                 bsub->dest = amov->src;
                                 INSRT_COMMENTS(bsub, amov);
                                 CAT_COMMENTS(bsub, cmov);
@@ -2068,21 +3657,15 @@ namespace Floral {
         analyzer.analyze(file); // perform static analysis to gain control flow and type information
         if (_showTypeTrace) analyzer.dumpTypeTrace();
         
-        ColoredStream out(std::cerr);
-        if (analyzer.hasWarnings() || analyzer.hasErrors()) {
-            out << Color::blue << Color::bold << "Analyzer Output" << Color::reset << "\n---------------\n";
-        }
-        
-        if (analyzer.hasWarnings()) {
-            for (auto warning: analyzer.warnings()) {
-                warning.path = _path;
-                warning.print(_src);
-            }
+        // kept for the caller to print, since files compiled side by side must not interleave their output
+        for (auto warning: analyzer.warnings()) {
+            warning.path = _path;
+            _warnings.push_back(warning);
         }
         if (analyzer.hasErrors()) {
             for (auto err: analyzer.errors()) {
                 err.path = _path;
-                err.print(_src);
+                _errors.push_back(err);
             }
             return;
         }
@@ -2119,30 +3702,52 @@ namespace Floral {
             generateEntryPoint(main); // if this is a file with `func main(): Int` then emit the assembly for an entry point
         }
         
+        for (auto gbl: _globals) {
+            if (_referencedGlobals.count(gbl->name.contents)) { // the rest were folded into their uses, or never used
+                emitGlobalStorage(gbl);
+            }
+        }
+        _constants.emit(rodataSection);
         optimize(optimization);
 
-        Floral::write(outputDest, result());
+        if (outputDest.empty()) return; // kept in memory, for result() or object()
+        if (_emitAssembly) {
+            if (auto file = std::ofstream { outputDest }) {
+                file.rdbuf()->pubsetbuf(nullptr, 0); // the writer already batches its output
+                AssemblyWriter out { file };
+                writeAssembly(out);
+            }
+            return;
+        }
+        const std::string image = object();
+        if (!hasErrors()) Floral::write(outputDest, image);
+    }
+    void Compiler::writeAssembly(AssemblyWriter& out) const {
+        // sections after text are separated by a blank line, empty ones are left out
+        textSection.write(out);
+        for (const Section* section: {&bssSection, &rodataSection, &dataSection}) {
+            if (section->instructions.empty()) continue;
+            out << "\n\n";
+            section->write(out);
+        }
     }
     const std::string Compiler::result() const {
-        // join all sections into one string
-        std::string joined = textSection.str() + '\n';
-        if (!bssSection.str().empty()) {
-            joined.push_back('\n');
-            joined += bssSection.str();
-            joined.push_back('\n');
-        }
-        if (!rodataSection.str().empty()) {
-            joined.push_back('\n');
-            joined += rodataSection.str();
-            joined.push_back('\n');
-        }
-        if (!dataSection.str().empty()) {
-            joined.push_back('\n');
-            joined += dataSection.str();
-            joined.push_back('\n');
-        }
-        while (joined.back() == '\n') joined.pop_back();
-        return joined;
+        AssemblyWriter out;
+        writeAssembly(out);
+        return out.text();
+    }
+
+    std::string Compiler::object() {
+        Encoder encoder;
+        textSection.encode(encoder);
+        bssSection.encode(encoder);
+        rodataSection.encode(encoder);
+        dataSection.encode(encoder);
+        const std::string image = encoder.object();
+        for (const auto& error: encoder.errors()) {
+            report(error.domain, error.text, _path, { 0, 0, 0, 0 }, { 0, 0 }, error.fix);
+        }
+        return image;
     }
 
     void Compiler::setSource(const std::string& src) {
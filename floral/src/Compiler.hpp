@@ -14,15 +14,26 @@
 #include "SPA.hpp"
 #include "Error.hpp"
 #include <map>
+#include <set>
 #include <bitset>
 #include "Frame.hpp"
 #include "Instruction.hpp"
+#include "ConstantPool.hpp"
+#include "Target.hpp"
 
 #define FLORAL_ID_PREFIX "_floralid_"
 #define ALIGN_COMMENTS
+#define LOOP_HEAD_ALIGNMENT 16
 #define max(x, y) ((x) > (y) ? (x) : (y))
 
 namespace Floral {
+    // Whether a branch emitted by Compiler::emitBranch is known to be taken at compile time
+    enum class StaticBranch {
+        never, conditional, always
+    };
+
+    struct VectorLoop; // a counted loop being vectorized, see Compiler::emitVectorizedLoop
+    
     class Compiler: public ErrorReporting {
         std::string _src;
         
@@ -51,6 +62,32 @@ namespace Floral {
         void emitEnter(void);
         void emitLeave(void);
         void emitRet(void);
+        void finishFrameAllocation(SubOperation* allocation);
+        
+        // Inlining
+        struct InlineSite {
+            Function* callee;
+            std::string exitLabel; // where returns in the substituted body jump to
+            int result; // register receiving the return value, or LOC_IS_NOT_REG for Void
+            Statement* finalReturn; // falls through to exitLabel, so needs no jump
+            bool exitUsed;
+        };
+        std::vector<InlineSite> _inlineSites;
+        bool shouldInline(Function* callee, const std::string& label);
+        Location emitInlineCall(Call* call, Function* callee);
+        
+        // Tail calls
+        struct RecursionEntry {
+            Function* function; // function being emitted, or nullptr outside a function body
+            Label* label; // start of the body proper, after the prologue
+            std::vector<Location> parameters; // where each parameter lives on entry
+            bool used;
+        };
+        RecursionEntry _recursion {};
+        void emitRecursionEntry(size_t parameterCount);
+        void finishRecursionEntry(const RecursionEntry& enclosing);
+        bool emitTailCall(Call* call);
+        bool isBareReturn(const Node* node) const;
         void emitSGPrologue(void);
         void emitSGEpilogue(void);
         void loadParametersIntoFrame(const Function::Parameters& params, bool storeAsLocalVars = true, bool isFunctionMember = false);
@@ -59,10 +96,17 @@ namespace Floral {
         void emitDeclaration(Declaration* decl);
         void emitNamespace(NamespaceDeclaration* nmspace);
         void emitGlobal(GlobalDeclaration* gbl);
+        void emitGlobalStorage(GlobalDeclaration* gbl);
         void emitExternGlobal(GlobalForwardDeclaration* fgbl);
         void emitStructConstructor(StructDeclaration* strct, StructConstructor* constr);
         void emitStruct(StructDeclaration* strct);
         
+        // Constant propagation
+        std::map<std::string, Location> _globalConstants; // globals with a compile-time integer value, as literals
+        std::vector<GlobalDeclaration*> _globals; // given storage once the module is compiled, if still referenced
+        std::set<std::string> _referencedGlobals; // globals whose storage some instruction names
+        bool lookupConstant(const std::string& name, Location& value);
+        
         // Statement related
         void emitStatement(Statement* stm);
         void emitLocalConst(LetStatement* l);
@@ -75,24 +119,56 @@ namespace Floral {
         void emitIfStatement(IfStatement* ifStm);
         void emitWhileStatement(WhileStatement* whileStm);
         void emitForStatement(ForStatement* forStm);
+        void emitLoop(Expression* condition, Block* body, Statement* modify = nullptr);
+        
+        // Loop vectorization
+        bool emitVectorizedLoop(Expression* check, Block* body, size_t statementCount, const std::string& induction);
+        int emitVectorExpression(Expression* expr, VectorLoop& loop, bool& isTemporary);
+        int emitBroadcast(Location value, VectorLoop& loop);
         void emitBlock(Block* block);
         
         // Misc
-        void emitReturnSpecificValue(Location src);
+        void emitReturnSpecificValue(Location src, const Type* type = nullptr);
         Location emitBinaryExpr(Expression* left, Expression* right, const OpType op);
+        Location emitMultiplyByConstant(Location operand, long long factor);
+        Location emitDivision(Expression* left, Expression* right, bool wantsRemainder);
+        Location emitDivisionByConstant(Location dividend, union SignedUnsigned divisor, bool isSigned, bool wantsRemainder);
+        Register emitDivisionOperand(const Location& operand);
+        
+        // Constants
+        ConstantPool _constants; // .rodata contents, laid out once the module is compiled
+        
+        // Floating point
+        Location emitFloatConstant(double value);
+        Register emitFloatOperand(Location operand);
+        Location emitFloatBinaryExpr(Expression* left, Expression* right, FloatOpType op);
+        std::pair<Location, Condition> emitFloatComparison(BinaryExpression* comparison, bool inverted, bool justFlags);
+        
+        // Bulk memory
+        void emitMemoryCopy(Location dest, Location src, size_t size, const std::string& comment = "");
+        void emitMemoryZero(Location dest, size_t size, const std::string& comment = "");
+        void emitBulkMemory(Location dest, const Location* src, size_t size, const std::string& comment);
+        void emitArrayLiteral(ArrayLiteralExpression* arraylit, const Type* type, long base, const std::string& description);
+        bool emitStructCopy(Location dest, Expression* src, const std::string& comment);
+        std::vector<Register> emitClaimAccumulator(void);
+        void emitReleaseAccumulator(const std::vector<Register>& saved);
+        void emitLoad(Register dest, Location src, const Type* type, const std::string& comment = "");
+        void emitStore(Location dest, Location src, const Type* type, const std::string& comment = "");
         std::pair<Location, Condition> emitCondition(Expression* expr, bool inverted = false, bool justFlags = false);
-        void emitSaveRegisters(const std::vector<Register>& registers);
-        void emitRestoreRegisters(const std::vector<Register>& registers);
+        std::pair<Location, Condition> emitConditionResult(Condition cond, bool justFlags);
+        StaticBranch emitBranch(Expression* expr, bool jumpIfTrue, const std::string& target);
+        bool emitConditionalMove(IfStatement* ifStm);
         void enterFrame(void);
         void leaveFrame(void);
         Frame& currentFrame(void);
         void returnRegister(const Register r);
+        void checkRegistersReleased(const std::vector<Register>& live);
         std::pair<Variable, bool> lookup(const std::string& name);
         
         // Expression related
         Location emitExpression(Expression* expr, bool wantsAddressResult = false, bool mut = false);
-        std::pair<long long, std::vector<Register>> emitCallArguments(const std::vector<Expression*>& args);
-        Location emitCall(Call* call, bool isTailCall = false);
+        long long emitCallArguments(const std::vector<Expression*>& args);
+        Location emitCall(Call* call);
         
         // Optimization
         void optimizeMatch1(size_t instrc);
@@ -101,6 +177,13 @@ namespace Floral {
         void optimizeOutRedundancy(size_t instrc);
         void optimize(int passes);
         
+        // Labels
+        struct LabelCounters {
+            int ifs, loops, vectorLoops, conditions, branches, inlineCalls, stackChecks;
+            long strings, wideStrings;
+        };
+        LabelCounters _labels {}; // numbers the labels of this compilation, so its output never depends on an earlier one
+        
         // Other
         std::string _path;
         bool _showTypeTrace = false;
@@ -115,8 +198,13 @@ namespace Floral {
         
         int optimization;
         int _stackGuard;
+        int _avx2 {}; // vectorized loops may use 256-bit AVX2 rather than SSE2
+        int _stackProbe {}; // frames larger than a page are allocated one page at a time
+        int _emitAssembly {}; // write nasm source to the output destination rather than an object file
+        Target _target = hostTarget;
         
         void setOutputDestination(const std::string &dest);
+        const std::string& outputDestination() const; // empty when the output is kept in memory
         void showTypeTrace(bool show);
         bool hasErrors() const;
         const std::vector<Error>& errors() const;
@@ -125,6 +213,8 @@ namespace Floral {
         
         void compile(const File *file);
         const std::string result() const;
+        void writeAssembly(AssemblyWriter& out) const; // streams what result() returns
+        std::string object();
         
         void setSource(const std::string& src);
         
@@ -0,0 +1,162 @@
+#include "ConstantPool.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include "Compiler.hpp"
+
+namespace Floral {
+    // Resolves the escapes nasm would have resolved in a backquoted string
+    std::string literalBytes(const std::string& contents) {
+        std::string bytes;
+        for (size_t i = 0; i < contents.size(); i++) {
+            if (contents[i] != '\\' || i + 1 == contents.size()) {
+                bytes.push_back(contents[i]);
+                continue;
+            }
+            const char escape = contents[++i];
+            switch (escape) {
+                case 'n': bytes.push_back('\n'); break;
+                case 't': bytes.push_back('\t'); break;
+                case 'r': bytes.push_back('\r'); break;
+                case 'e': bytes.push_back('\x1B'); break;
+                case 'a': bytes.push_back('\a'); break;
+                case 'b': bytes.push_back('\b'); break;
+                case 'f': bytes.push_back('\f'); break;
+                case 'v': bytes.push_back('\v'); break;
+                case 'x': {
+                    int value = 0, digits = 0;
+                    while (digits < 2 && i + 1 < contents.size() && isxdigit(static_cast<unsigned char>(contents[i + 1]))) {
+                        value = value * 16 + (isdigit(static_cast<unsigned char>(contents[i + 1])) ? contents[i + 1] - '0' : (tolower(contents[i + 1]) - 'a' + 10));
+                        i++; digits++;
+                    }
+                    bytes.push_back(static_cast<char>(value));
+                    break;
+                }
+                default:
+                    if (escape >= '0' && escape <= '7') {
+                        int value = escape - '0', digits = 1;
+                        while (digits < 3 && i + 1 < contents.size() && contents[i + 1] >= '0' && contents[i + 1] <= '7') {
+                            value = value * 8 + (contents[++i] - '0');
+                            digits++;
+                        }
+                        bytes.push_back(static_cast<char>(value));
+                    } else {
+                        bytes.push_back(escape); // \\, \", \', \` and \? stand for themselves
+                    }
+                    break;
+            }
+        }
+        return bytes;
+    }
+
+    // MARK: Interning
+    Location ConstantPool::intern(const std::string& bytes, size_t unit, size_t alignment, bool isTerminated) {
+        const std::string key = std::to_string(unit) + (isTerminated ? 't' : 'u') + bytes;
+        const auto found = _index.find(key);
+        if (found != _index.end()) {
+            Entry& entry = _entries[found->second];
+            entry.alignment = max(entry.alignment, alignment);
+            return RelLabelL(entry.label);
+        }
+        if (bytes.size() >= 16) {
+            alignment = max(alignment, 16); // so a vector load never splits a cache line needlessly
+        }
+        const std::string label = "#const_" + std::to_string(_entries.size());
+        _index[key] = _entries.size();
+        _entries.push_back({ label, bytes, unit, alignment, isTerminated });
+        return RelLabelL(label);
+    }
+    Location ConstantPool::internString(const std::string& bytes) {
+        return intern(bytes + '\0', 1, 1, true);
+    }
+    Location ConstantPool::internWideString(const std::vector<int32_t>& codepoints) {
+        std::string bytes;
+        for (auto codepoint: codepoints) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                bytes.push_back(static_cast<char>((static_cast<uint32_t>(codepoint) >> shift) & 0xFF));
+            }
+        }
+        return intern(bytes + std::string(4, '\0'), 4, 4, true);
+    }
+    void ConstantPool::alias(const std::string& name, const Location& constant) {
+        _aliases.push_back({ name, constant });
+    }
+
+    // MARK: Emission
+    // A terminated string is stored as text, with anything nasm cannot quote spliced in as a number
+    static std::string quoted(const std::string& bytes) {
+        std::string text;
+        for (const char c: bytes) {
+            if (c == '`' || c == '\\') {
+                text.push_back('\\');
+                text.push_back(c);
+            } else if (c >= 0x20 && c < 0x7F) {
+                text.push_back(c);
+            } else {
+                char number[8];
+                snprintf(number, sizeof number, "0x%X", static_cast<unsigned char>(c));
+                text += std::string("`, ") + number + ", `";
+            }
+        }
+        return text;
+    }
+    void ConstantPool::emit(Section& rodata) {
+        // Sorting the terminated entries by their reversed payload places every string right after the
+        // ones it is a suffix of, so one pass finds the longest string each can live inside
+        std::vector<size_t> strings;
+        for (size_t i = 0; i < _entries.size(); i++) {
+            if (_entries[i].isTerminated) strings.push_back(i);
+        }
+        std::sort(strings.begin(), strings.end(), [&](size_t lhs, size_t rhs) {
+            const Entry& l = _entries[lhs];
+            const Entry& r = _entries[rhs];
+            if (l.unit != r.unit) return l.unit < r.unit;
+            return std::lexicographical_compare(r.bytes.rbegin(), r.bytes.rend(), l.bytes.rbegin(), l.bytes.rend());
+        });
+        std::map<size_t, std::pair<size_t, size_t>> tails; // entry to the entry and offset it lives inside
+        const Entry* host = nullptr;
+        size_t hostIndex = 0;
+        for (auto index: strings) {
+            const Entry& entry = _entries[index];
+            const size_t offset = host ? host->bytes.size() - entry.bytes.size() : 0;
+            if (host && host->unit == entry.unit && host->bytes.size() >= entry.bytes.size() && offset % entry.unit == 0 && std::equal(entry.bytes.rbegin(), entry.bytes.rend(), host->bytes.rbegin())) {
+                tails[index] = { hostIndex, offset };
+            } else {
+                host = &entry;
+                hostIndex = index;
+            }
+        }
+
+        for (size_t i = 0; i < _entries.size(); i++) {
+            const Entry& entry = _entries[i];
+            if (tails.count(i)) continue;
+            if (entry.alignment > 1) {
+                rodata.add(new Align(entry.alignment));
+            }
+            if (entry.unit == 1 && entry.isTerminated) {
+                rodata.add(new StringData(entry.label, quoted(entry.bytes.substr(0, entry.bytes.size() - 1))));
+                continue;
+            }
+            Data* data = new Data(entry.label, OPSIZE_FROM_NUM(entry.unit), false);
+            for (size_t at = 0; at + entry.unit <= entry.bytes.size(); at += entry.unit) {
+                uint64_t value = 0;
+                for (size_t byte = 0; byte < entry.unit; byte++) {
+                    value |= static_cast<uint64_t>(static_cast<unsigned char>(entry.bytes[at + byte])) << (byte * 8);
+                }
+                data->values.push_back(SU(value));
+            }
+            rodata.add(data);
+        }
+        for (const auto& tail: tails) {
+            rodata.add(new Equate(_entries[tail.first].label, _entries[tail.second.first].label, static_cast<long long>(tail.second.second)));
+        }
+        for (const auto& alias: _aliases) {
+            rodata.add(new Equate(alias.first, alias.second.lbl, alias.second.offset));
+        }
+    }
+    void ConstantPool::clear() {
+        _entries.clear();
+        _index.clear();
+        _aliases.clear();
+    }
+}
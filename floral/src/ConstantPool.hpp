@@ -0,0 +1,38 @@
+#ifndef ConstantPool_hpp
+#define ConstantPool_hpp
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Instruction.hpp"
+
+namespace Floral {
+    // The bytes a string literal stands for, with its escape sequences resolved
+    std::string literalBytes(const std::string& contents);
+
+    // The read-only constants of a module. Each distinct payload is stored once, and a NUL-terminated
+    // string that ends another one is given a label inside it rather than a copy of its own.
+    class ConstantPool {
+        struct Entry {
+            std::string label;
+            std::string bytes;
+            size_t unit; // element size, so 1 for strings and 4 for wide strings
+            size_t alignment;
+            bool isTerminated; // ends in a NUL element, and so may share its tail with a longer string
+        };
+        std::vector<Entry> _entries;
+        std::map<std::string, size_t> _index; // entry by unit, termination and payload
+        std::vector<std::pair<std::string, Location>> _aliases; // other names for an entry's label, or a place inside it
+
+    public:
+        Location intern(const std::string& bytes, size_t unit, size_t alignment, bool isTerminated = false);
+        Location internString(const std::string& bytes);
+        Location internWideString(const std::vector<int32_t>& codepoints);
+        void alias(const std::string& name, const Location& constant);
+
+        void emit(Section& rodata);
+        void clear();
+    };
+}
+
+#endif /* ConstantPool_hpp */
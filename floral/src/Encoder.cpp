@@ -0,0 +1,1056 @@
+#include "Encoder.hpp"
+#include <climits>
+#include <cstring>
+#include "ConstantPool.hpp"
+#include "Compiler.hpp"
+
+#define ELF_REL_TYPE 1
+#define ELF_MACHINE_X86_64 62
+#define R_X86_64_PC32 2
+#define R_X86_64_PLT32 4
+
+namespace Floral {
+    // MARK: Registers
+    // Hardware number and width of each Register, in the order the enum lists them
+    static const struct {
+        int number;
+        int size;
+    } registerEncodings[] {
+        {0, 8}, {3, 8}, {1, 8}, {2, 8}, {7, 8}, {6, 8}, {5, 8}, {4, 8}, // rax ... rsp
+        {0, 4}, {3, 4}, {1, 4}, {2, 4}, {7, 4}, {6, 4}, {5, 4}, {4, 4}, // eax ... esp
+        {8, 8}, {9, 8}, {10, 8}, {11, 8}, {12, 8}, {13, 8}, {14, 8}, {15, 8}, // r8 ... r15
+        {0, 16}, {1, 16}, {2, 16}, {3, 16}, {4, 16}, {5, 16}, {6, 16}, {7, 16}, // xmm0 ... xmm7
+        {0, 1}, {3, 1}, {1, 1}, {2, 1}, {7, 1}, {6, 1}, {5, 1}, {4, 1}, // al ... spl
+        {0, 2}, {3, 2}, {1, 2}, {2, 2}, {6, 2}, {7, 2}, {5, 2}, {4, 2}, // ax ... sp
+        {8, 4}, {9, 4}, {10, 4}, {11, 4}, {12, 4}, {13, 4}, {14, 4}, {15, 4}, // r8d ... r15d
+        {-1, 8}, // rip
+        {8, 1}, {9, 1}, {10, 1}, {11, 1}, {12, 1}, {13, 1}, {14, 1}, {15, 1}, // r8b ... r15b
+        {8, 2}, {9, 2}, {10, 2}, {11, 2}, {12, 2}, {13, 2}, {14, 2}, {15, 2} // r8w ... r15w
+    };
+    static int sizeInBytes(SizeType type) {
+        return 1 << static_cast<int>(type);
+    }
+    static bool fitsInByte(long long value) {
+        return value >= -128 && value <= 127;
+    }
+    // Narrows an immediate to the operand size, as the processor will sign-extend it
+    static bool fitImmediate(long long& value, int size) {
+        switch (size) {
+            case 1:
+                if (value < -128 || value > 255) return false;
+                value = static_cast<int8_t>(value);
+                return true;
+            case 2:
+                if (value < -32768 || value > 65535) return false;
+                value = static_cast<int16_t>(value);
+                return true;
+            case 4:
+                if (value < INT_MIN || value > UINT_MAX) return false;
+                value = static_cast<int32_t>(value);
+                return true;
+            default:
+                return value >= INT_MIN && value <= INT_MAX;
+        }
+    }
+    // The low nibble of jcc, setcc and cmovcc, by Condition
+    static const uint8_t conditionCodes[] {
+        0x0, 0x4, 0x5, 0x4, 0x5, 0xE, 0xD, 0xC, 0xF, 0x7, 0x2, 0x0, 0x1, 0x2, 0x3, 0x3, 0x6
+    };
+
+    // MARK: Operands
+    // A register index outside the table means the code generator handed over no register at all,
+    // e.g. -1 from GET_REG once every scratch register was taken
+    bool Encoder::isRegister(int reg) {
+        if (reg >= 0 && reg < static_cast<int>(sizeof(registerEncodings) / sizeof(*registerEncodings))) return true;
+        fail("Internal compiler error: an instruction refers to register " + std::to_string(reg) + ", which does not exist");
+        return false;
+    }
+    int Encoder::registerNumber(int reg) {
+        return isRegister(reg) ? registerEncodings[reg].number : 0;
+    }
+    Encoder::Operand Encoder::operand(Register reg) {
+        if (!isRegister(static_cast<int>(reg))) return {Operand::Kind::reg, 0, 8, false, -1, 1, 0, ""};
+        const auto encoding = registerEncodings[static_cast<int>(reg)];
+        return {Operand::Kind::reg, encoding.number, encoding.size, encoding.size == 1 && encoding.number >= 4, -1, 1, 0, ""};
+    }
+    Encoder::Operand Encoder::operand(const Location& loc) {
+        if (loc.isLiteral) {
+            return {Operand::Kind::imm, 0, 8, false, -1, 1, loc.isSigned ? loc.value.s : static_cast<long long>(loc.value.u), ""};
+        }
+        if (loc.isLbl) {
+            return {Operand::Kind::mem, -1, 8, false, -1, 1, loc.offset, prefixed(loc.lbl)};
+        }
+        if (loc.isDereference || loc.offset) { // an offset register without brackets is an address, as lea takes it
+            return {Operand::Kind::mem, registerNumber(loc.reg), 8, false, -1, 1, loc.offset, ""};
+        }
+        return operand(static_cast<Register>(loc.reg));
+    }
+    Encoder::Operand Encoder::operand(const VectorOperand& vop) {
+        switch (vop.kind) {
+            case VectorOperand::Kind::vector:
+                return {Operand::Kind::reg, vop.vreg, vop.isWide ? 32 : 16, false, -1, 1, 0, ""};
+            case VectorOperand::Kind::general:
+                return operand(vop.reg);
+            case VectorOperand::Kind::memory:
+                return {Operand::Kind::mem, registerNumber(static_cast<int>(vop.reg)), 8, false, vop.scale ? registerNumber(static_cast<int>(vop.index)) : -1, vop.scale ? vop.scale : 1, vop.value, ""};
+            case VectorOperand::Kind::immediate:
+                return {Operand::Kind::imm, 0, 8, false, -1, 1, vop.value, ""};
+        }
+        return {};
+    }
+    Encoder::Operand Encoder::memory(Register base, Register index, int scale, long long displacement) {
+        return {Operand::Kind::mem, registerNumber(static_cast<int>(base)), 8, false, registerNumber(static_cast<int>(index)), scale, displacement, ""};
+    }
+
+    // MARK: Errors
+    Encoder::Encoder() {}
+    bool Encoder::hasErrors() const {
+        return !_errors.empty();
+    }
+    const std::vector<Error>& Encoder::errors() const {
+        return _errors;
+    }
+    bool Encoder::hasWarnings() const {
+        return !_warnings.empty();
+    }
+    const std::vector<Error>& Encoder::warnings() const {
+        return _warnings;
+    }
+    void Encoder::fail(const std::string& text) {
+        report(Error::compileDomain, text, "", { 0, 0, 0, 0 }, { 0, 0 }, "compile with -S and assemble the output with nasm");
+    }
+
+    // MARK: Symbols and data
+    std::string& Encoder::bytes() {
+        auto& fragments = _sections[_current].fragments;
+        if (fragments.empty() || fragments.back().kind != Fragment::Kind::bytes) {
+            fragments.push_back({});
+        }
+        return fragments.back().bytes;
+    }
+    Encoder::Symbol& Encoder::symbol(const std::string& name) {
+        const auto found = _symbolIndex.find(name);
+        if (found != _symbolIndex.end()) return _symbols[found->second];
+        _symbolIndex[name] = _symbols.size();
+        _symbols.push_back({});
+        _symbols.back().name = name;
+        return _symbols.back();
+    }
+    const Encoder::Symbol* Encoder::find(const std::string& name) const {
+        const auto found = _symbolIndex.find(name);
+        return found == _symbolIndex.end() ? nullptr : &_symbols[found->second];
+    }
+    uint64_t Encoder::address(const Symbol& sym) const {
+        if (sym.isAbsolute) return sym.value;
+        return _sections[sym.section].fragments[sym.fragment].offset + sym.offset;
+    }
+    void Encoder::section(SectionType type) {
+        _current = static_cast<int>(type);
+    }
+    void Encoder::label(const std::string& name, bool isGlobal) {
+        Symbol& sym = symbol(name);
+        if (sym.section >= 0 || sym.isAbsolute) {
+            fail("Label " + name + " is defined more than once");
+            return;
+        }
+        auto& fragments = _sections[_current].fragments;
+        if (fragments.empty() || fragments.back().kind != Fragment::Kind::bytes || !fragments.back().bytes.empty()) {
+            fragments.push_back({});
+        }
+        sym.section = _current;
+        sym.fragment = fragments.size() - 1;
+        sym.isGlobal |= isGlobal;
+    }
+    void Encoder::global(const std::string& name) {
+        symbol(name).isGlobal = true;
+    }
+    void Encoder::external(const std::string& name) {
+        symbol(name).isGlobal = true;
+    }
+    void Encoder::equate(const std::string& name, const std::string& target, long long offset) {
+        _equations.push_back({ name, target, offset, 0, 0, false });
+    }
+    void Encoder::lengthOf(const std::string& name, const std::string& start) {
+        auto& fragments = _sections[_current].fragments;
+        fragments.push_back({}); // marks `$`
+        _equations.push_back({ name, start, 0, _current, fragments.size() - 1, true });
+    }
+    void Encoder::align(size_t boundary) {
+        if (boundary <= 1) return;
+        Fragment fragment;
+        fragment.kind = Fragment::Kind::align;
+        fragment.count = boundary;
+        _sections[_current].fragments.push_back(fragment);
+    }
+    void Encoder::data(const std::string& contents) {
+        if (_current == static_cast<int>(SectionType::bss)) {
+            fail("Section .bss cannot hold initialized data");
+            return;
+        }
+        bytes() += contents;
+    }
+    void Encoder::reserve(size_t size) {
+        if (_current != static_cast<int>(SectionType::bss)) {
+            bytes().append(size, '\0');
+            return;
+        }
+        Fragment fragment;
+        fragment.kind = Fragment::Kind::zeros;
+        fragment.count = size;
+        _sections[_current].fragments.push_back(fragment);
+    }
+
+    // MARK: Instructions
+    void Encoder::raw(const std::vector<uint8_t>& code) {
+        std::string& out = bytes();
+        for (auto byte: code) out.push_back(static_cast<char>(byte));
+    }
+    void Encoder::fixup(const std::string& symbol, long long addend, bool isCall) {
+        std::string& out = bytes();
+        _sections[_current].fragments.back().fixups.push_back({ out.size(), symbol, addend, isCall });
+        out.append(4, '\0');
+    }
+    void Encoder::immediate(long long value, int size) {
+        std::string& out = bytes();
+        for (int i = 0; i < size; i++) {
+            out.push_back(static_cast<char>((static_cast<unsigned long long>(value) >> (i * 8)) & 0xFF));
+        }
+    }
+    void Encoder::prefixes(uint8_t prefix, bool w, int reg, bool regNeedsRex, const Operand& rm) {
+        std::string& out = bytes();
+        if (prefix) out.push_back(static_cast<char>(prefix));
+        int rex = (w ? 8 : 0) | (((reg >> 3) & 1) << 2);
+        if (rm.kind == Operand::Kind::mem && rm.index >= 0) rex |= ((rm.index >> 3) & 1) << 1;
+        if (rm.kind != Operand::Kind::imm && rm.number >= 0) rex |= (rm.number >> 3) & 1;
+        if (rex || regNeedsRex || (rm.kind == Operand::Kind::reg && rm.needsRex)) {
+            out.push_back(static_cast<char>(0x40 | rex));
+        }
+    }
+    void Encoder::modrm(int reg, const Operand& rm, int immSize) {
+        std::string& out = bytes();
+        if (rm.kind == Operand::Kind::reg) {
+            out.push_back(static_cast<char>(0xC0 | ((reg & 7) << 3) | (rm.number & 7)));
+            return;
+        }
+        if (rm.kind != Operand::Kind::mem) {
+            fail("An immediate cannot be addressed");
+            return;
+        }
+        if (rm.number < 0) { // rip-relative, so the displacement is only known once the label is placed
+            out.push_back(static_cast<char>(((reg & 7) << 3) | 5));
+            fixup(rm.label, rm.value - 4 - immSize, false);
+            return;
+        }
+        const int base = rm.number & 7;
+        const bool hasSIB = rm.index >= 0 || base == 4; // rsp and r12 can only be a base through a SIB byte
+        const int mod = (rm.value == 0 && base != 5) ? 0 : fitsInByte(rm.value) ? 1 : 2; // rbp and r13 always take a displacement
+        out.push_back(static_cast<char>((mod << 6) | ((reg & 7) << 3) | (hasSIB ? 4 : base)));
+        if (hasSIB) {
+            const int scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+            out.push_back(static_cast<char>((scale << 6) | (((rm.index >= 0 ? rm.index : 4) & 7) << 3) | base));
+        }
+        if (mod == 1) {
+            immediate(rm.value, 1);
+        } else if (mod == 2) {
+            if (rm.value < INT_MIN || rm.value > INT_MAX) fail("Displacement " + std::to_string(rm.value) + " does not fit in 32 bits");
+            immediate(rm.value, 4);
+        }
+    }
+    void Encoder::instruction(uint8_t prefix, bool w, const std::vector<uint8_t>& opcode, const Operand& reg, const Operand& rm, int immSize, long long imm) {
+        if (reg.kind != Operand::Kind::reg) { // the ModRM reg field would otherwise take a base register or garbage
+            fail("Internal compiler error: an instruction has no register operand to encode in its ModRM byte");
+            return;
+        }
+        prefixes(prefix, w, reg.number, reg.needsRex, rm);
+        raw(opcode);
+        modrm(reg.number, rm, immSize);
+        immediate(imm, immSize);
+    }
+    void Encoder::instruction(uint8_t prefix, bool w, const std::vector<uint8_t>& opcode, int extension, const Operand& rm, int immSize, long long imm) {
+        prefixes(prefix, w, extension, false, rm);
+        raw(opcode);
+        modrm(extension, rm, immSize);
+        immediate(imm, immSize);
+    }
+    void Encoder::opcodeRegister(uint8_t prefix, bool w, uint8_t opcode, const Operand& reg, int immSize, long long imm) {
+        prefixes(prefix, w, 0, false, reg);
+        raw({ static_cast<uint8_t>(opcode + (reg.number & 7)) });
+        immediate(imm, immSize);
+    }
+    void Encoder::vex(uint8_t prefix, int map, bool w, bool isWide, uint8_t opcode, int reg, int vvvv, const Operand& rm, int immSize, long long imm) {
+        const int pp = prefix == 0x66 ? 1 : prefix == 0xF3 ? 2 : prefix == 0xF2 ? 3 : 0;
+        const int r = (reg >> 3) & 1;
+        const int x = rm.kind == Operand::Kind::mem && rm.index >= 0 ? (rm.index >> 3) & 1 : 0;
+        const int b = rm.number >= 0 ? (rm.number >> 3) & 1 : 0;
+        const int tail = ((~vvvv & 15) << 3) | (isWide ? 4 : 0) | pp;
+        if (map == 1 && !w && !x && !b) {
+            raw({ 0xC5, static_cast<uint8_t>((r ? 0 : 0x80) | tail) });
+        } else {
+            raw({ 0xC4, static_cast<uint8_t>((r ? 0 : 0x80) | (x ? 0 : 0x40) | (b ? 0 : 0x20) | map), static_cast<uint8_t>((w ? 0x80 : 0) | tail) });
+        }
+        raw({ opcode });
+        modrm(reg, rm, immSize);
+        immediate(imm, immSize);
+    }
+    void Encoder::branch(Condition condition, const std::string& target) {
+        Fragment fragment;
+        fragment.kind = Fragment::Kind::branch;
+        fragment.condition = condition;
+        fragment.target = target;
+        _sections[_current].fragments.push_back(fragment);
+    }
+    void Encoder::call(const std::string& target) {
+        raw({ 0xE8 });
+        fixup(target, -4, true);
+    }
+
+    // MARK: Layout
+    void Encoder::resolveEquations(bool lengths) {
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (auto& equation: _equations) {
+                if (equation.isLength != lengths || equation.name.empty()) continue;
+                const Symbol* target = find(equation.target);
+                if (!target || (target->section < 0 && !target->isAbsolute)) continue;
+                const Symbol resolved = *target; // symbol() may move the table
+                Symbol& sym = symbol(equation.name);
+                if (equation.isLength) {
+                    sym.isAbsolute = true;
+                    sym.value = _sections[equation.section].fragments[equation.fragment].offset - address(resolved);
+                } else {
+                    sym.section = resolved.section;
+                    sym.fragment = resolved.fragment;
+                    sym.offset = resolved.offset + equation.offset;
+                    sym.isAbsolute = resolved.isAbsolute;
+                    sym.value = resolved.value + equation.offset;
+                }
+                equation.name.clear();
+                progress = true;
+            }
+        }
+        for (const auto& equation: _equations) {
+            if (equation.isLength == lengths && !equation.name.empty()) {
+                fail("Label " + equation.target + " is not defined, so " + equation.name + " cannot refer to it");
+            }
+        }
+    }
+    // Branches start out short and are lengthened until every one reaches its target
+    void Encoder::layout(int section) {
+        auto& fragments = _sections[section].fragments;
+        bool changed = true;
+        while (changed) {
+            size_t offset = 0;
+            for (auto& fragment: fragments) {
+                fragment.offset = offset;
+                switch (fragment.kind) {
+                    case Fragment::Kind::bytes: offset += fragment.bytes.size(); break;
+                    case Fragment::Kind::zeros: offset += fragment.count; break;
+                    case Fragment::Kind::align: offset += (fragment.count - offset % fragment.count) % fragment.count; break;
+                    case Fragment::Kind::branch: offset += !fragment.isNear ? 2 : fragment.condition == Condition::normal ? 5 : 6; break;
+                }
+            }
+            _sections[section].size = offset;
+            changed = false;
+            for (auto& fragment: fragments) {
+                if (fragment.kind != Fragment::Kind::branch || fragment.isNear) continue;
+                const Symbol* target = find(fragment.target);
+                if (!target || target->section != section || target->isAbsolute || !fitsInByte(static_cast<long long>(address(*target)) - static_cast<long long>(fragment.offset + 2))) {
+                    fragment.isNear = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+    void Encoder::resolve(int section, size_t position, const std::string& name, long long addend, bool isCall) {
+        auto& image = _sections[section];
+        const Symbol* target = find(name);
+        if (target && target->section == section && !target->isAbsolute) {
+            const long long displacement = static_cast<long long>(address(*target)) + addend - static_cast<long long>(position);
+            for (int i = 0; i < 4; i++) {
+                image.bytes[position + i] = static_cast<char>((static_cast<unsigned long long>(displacement) >> (i * 8)) & 0xFF);
+            }
+            return;
+        }
+        if (target && target->isAbsolute) {
+            fail("Cannot address the number " + name);
+            return;
+        }
+        const bool isDefined = target && target->section >= 0;
+        image.relocations.push_back({ position, name, addend, isCall && !isDefined ? static_cast<uint32_t>(R_X86_64_PLT32) : static_cast<uint32_t>(R_X86_64_PC32) });
+    }
+    void Encoder::assemble(int section) {
+        // Recommended multi-byte nops, so padding before a loop head executes in as few instructions as possible
+        static const std::string nops[] {
+            "",
+            "\x90",
+            std::string("\x66\x90", 2),
+            std::string("\x0F\x1F\x00", 3),
+            std::string("\x0F\x1F\x40\x00", 4),
+            std::string("\x0F\x1F\x44\x00\x00", 5),
+            std::string("\x66\x0F\x1F\x44\x00\x00", 6),
+            std::string("\x0F\x1F\x80\x00\x00\x00\x00", 7),
+            std::string("\x0F\x1F\x84\x00\x00\x00\x00\x00", 8),
+            std::string("\x66\x0F\x1F\x84\x00\x00\x00\x00\x00", 9)
+        };
+        auto& image = _sections[section];
+        const bool isBSS = section == static_cast<int>(SectionType::bss);
+        const bool isText = section == static_cast<int>(SectionType::text);
+        for (auto& fragment: image.fragments) {
+            if (isBSS) {
+                if (!fragment.bytes.empty()) fail("Section .bss cannot hold instructions");
+                continue;
+            }
+            switch (fragment.kind) {
+                case Fragment::Kind::bytes:
+                    image.bytes += fragment.bytes;
+                    for (const auto& fix: fragment.fixups) {
+                        resolve(section, fragment.offset + fix.offset, fix.symbol, fix.addend, fix.isCall);
+                    }
+                    break;
+                case Fragment::Kind::zeros:
+                    image.bytes.append(fragment.count, '\0');
+                    break;
+                case Fragment::Kind::align: {
+                    size_t padding = (fragment.count - fragment.offset % fragment.count) % fragment.count;
+                    while (padding) {
+                        const size_t run = padding < 9 ? padding : 9;
+                        image.bytes += isText ? nops[run] : std::string(run, '\0');
+                        padding -= run;
+                    }
+                    break;
+                }
+                case Fragment::Kind::branch: {
+                    const bool isJump = fragment.condition == Condition::normal;
+                    const uint8_t cc = conditionCodes[static_cast<int>(fragment.condition)];
+                    if (!fragment.isNear) {
+                        image.bytes.push_back(static_cast<char>(isJump ? 0xEB : 0x70 | cc));
+                        const long long displacement = static_cast<long long>(address(*find(fragment.target))) - static_cast<long long>(fragment.offset + 2);
+                        image.bytes.push_back(static_cast<char>(displacement & 0xFF));
+                        break;
+                    }
+                    if (isJump) {
+                        image.bytes.push_back(static_cast<char>(0xE9));
+                    } else {
+                        image.bytes.push_back(static_cast<char>(0x0F));
+                        image.bytes.push_back(static_cast<char>(0x80 | cc));
+                    }
+                    image.bytes.append(4, '\0');
+                    resolve(section, image.bytes.size() - 4, fragment.target, -4, true);
+                    break;
+                }
+            }
+        }
+    }
+
+    // MARK: ELF64 object
+    static void put(std::string& out, uint64_t value, int size) {
+        for (int i = 0; i < size; i++) {
+            out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+        }
+    }
+    static uint32_t intern(std::string& table, const std::string& name) {
+        const uint32_t offset = static_cast<uint32_t>(table.size());
+        table += name;
+        table.push_back('\0');
+        return offset;
+    }
+    std::string Encoder::object() {
+        resolveEquations(false);
+        for (int section = 0; section < 4; section++) {
+            layout(section);
+        }
+        resolveEquations(true);
+        for (int section = 0; section < 4; section++) {
+            assemble(section);
+        }
+        return hasErrors() ? "" : elf();
+    }
+    std::string Encoder::elf() const {
+        struct SectionHeader {
+            uint32_t name;
+            uint32_t type;
+            uint64_t flags;
+            uint64_t offset;
+            uint64_t size;
+            uint32_t link;
+            uint32_t info;
+            uint64_t alignment;
+            uint64_t entrySize;
+        };
+        std::string names {'\0'};
+        std::string strings {'\0'};
+        std::string body;
+        std::vector<SectionHeader> headers { {} };
+        auto add = [&](const std::string& name, uint32_t type, uint64_t flags, const std::string& contents, uint64_t size, uint64_t alignment, uint64_t entrySize = 0) {
+            while (body.size() % 8) body.push_back('\0');
+            headers.push_back({ intern(names, name), type, flags, 64 + body.size(), size, 0, 0, alignment, entrySize });
+            body += contents;
+            return static_cast<uint32_t>(headers.size() - 1);
+        };
+
+        // Sections in SectionType order; .text always exists, the rest only when used
+        static const char* sectionNames[] { ".text", ".data", ".rodata", ".bss" };
+        static const uint64_t sectionFlags[] { 0x6, 0x3, 0x2, 0x3 }; // alloc, plus exec or write
+        uint32_t indices[4] {};
+        for (int section = 0; section < 4; section++) {
+            const auto& image = _sections[section];
+            if (section && !image.size) continue;
+            const bool isBSS = section == static_cast<int>(SectionType::bss);
+            indices[section] = add(sectionNames[section], isBSS ? 8 : 1, sectionFlags[section], isBSS ? "" : image.bytes, image.size, ELF_SECTION_ALIGNMENT);
+        }
+
+        // Locals precede globals, as the symbol table's info field requires
+        std::string symbols(24, '\0');
+        std::unordered_map<std::string, uint32_t> symbolIndices;
+        uint32_t sectionSymbols[4] {};
+        uint32_t count = 1;
+        uint32_t firstGlobal = 1;
+        auto symbol = [&](uint32_t name, int bind, int type, uint16_t shndx, uint64_t value) {
+            put(symbols, name, 4);
+            put(symbols, (bind << 4) | type, 1);
+            put(symbols, 0, 1);
+            put(symbols, shndx, 2);
+            put(symbols, value, 8);
+            put(symbols, 0, 8);
+            return count++;
+        };
+        for (int section = 0; section < 4; section++) {
+            if (indices[section]) sectionSymbols[section] = symbol(0, 0, 3, static_cast<uint16_t>(indices[section]), 0);
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            for (const auto& sym: _symbols) {
+                const bool isGlobal = sym.isGlobal || (sym.section < 0 && !sym.isAbsolute);
+                if (isGlobal != (pass == 1)) continue;
+                const uint16_t shndx = sym.isAbsolute ? 0xFFF1 : sym.section < 0 ? 0 : static_cast<uint16_t>(indices[sym.section]);
+                symbolIndices[sym.name] = symbol(intern(strings, sym.name), isGlobal ? 1 : 0, 0, shndx, sym.section < 0 && !sym.isAbsolute ? 0 : address(sym));
+            }
+            if (pass == 0) firstGlobal = count;
+        }
+
+        std::vector<std::pair<int, std::string>> relocationTables;
+        for (int section = 0; section < 4; section++) {
+            if (_sections[section].relocations.empty()) continue;
+            std::string table;
+            for (const auto& relocation: _sections[section].relocations) {
+                const Symbol* target = find(relocation.symbol);
+                uint32_t index = symbolIndices[relocation.symbol];
+                long long addend = relocation.addend;
+                if (target && !target->isGlobal && target->section >= 0) { // local labels are reached through their section
+                    index = sectionSymbols[target->section];
+                    addend += static_cast<long long>(address(*target));
+                }
+                put(table, relocation.offset, 8);
+                put(table, (static_cast<uint64_t>(index) << 32) | relocation.type, 8);
+                put(table, static_cast<uint64_t>(addend), 8);
+            }
+            relocationTables.push_back({ section, table });
+        }
+
+        const uint32_t symtab = add(".symtab", 2, 0, symbols, symbols.size(), 8, 24);
+        headers[symtab].info = firstGlobal;
+        const uint32_t strtab = add(".strtab", 3, 0, strings, strings.size(), 1);
+        headers[symtab].link = strtab;
+        for (const auto& table: relocationTables) {
+            const uint32_t rela = add(std::string(".rela") + sectionNames[table.first], 4, 0x40, table.second, table.second.size(), 8, 24);
+            headers[rela].link = symtab;
+            headers[rela].info = indices[table.first];
+        }
+        add(".note.GNU-stack", 1, 0, "", 0, 1); // the stack need not be executable
+        const uint32_t shstrtab = static_cast<uint32_t>(headers.size());
+        headers.push_back({ intern(names, ".shstrtab"), 3, 0, 0, 0, 0, 0, 1, 0 });
+        while (body.size() % 8) body.push_back('\0');
+        headers.back().offset = 64 + body.size();
+        headers.back().size = names.size();
+        body += names;
+        while (body.size() % 8) body.push_back('\0');
+
+        std::string out {"\x7F" "ELF"};
+        put(out, 2, 1); // 64-bit
+        put(out, 1, 1); // little endian
+        put(out, 1, 1); // version
+        out.append(9, '\0');
+        put(out, ELF_REL_TYPE, 2);
+        put(out, ELF_MACHINE_X86_64, 2);
+        put(out, 1, 4);
+        put(out, 0, 8); // entry
+        put(out, 0, 8); // program headers
+        put(out, 64 + body.size(), 8); // section headers
+        put(out, 0, 4);
+        put(out, 64, 2);
+        put(out, 0, 2);
+        put(out, 0, 2);
+        put(out, 64, 2);
+        put(out, headers.size(), 2);
+        put(out, shstrtab, 2);
+        out += body;
+        for (const auto& header: headers) {
+            put(out, header.name, 4);
+            put(out, header.type, 4);
+            put(out, header.flags, 8);
+            put(out, 0, 8); // address
+            put(out, header.type ? header.offset : 0, 8);
+            put(out, header.size, 8);
+            put(out, header.link, 4);
+            put(out, header.info, 4);
+            put(out, header.alignment, 8);
+            put(out, header.entrySize, 8);
+        }
+        return out;
+    }
+
+    // MARK: Instruction encodings
+    // Operand size from whichever operand is a register, else the instruction's stated size
+    static int operandSize(const Encoder::Operand& a, const Encoder::Operand& b, SizeType stated) {
+        if (a.kind == Encoder::Operand::Kind::reg) return a.size;
+        if (b.kind == Encoder::Operand::Kind::reg) return b.size;
+        return sizeInBytes(stated);
+    }
+    static uint8_t sizePrefix(int size) {
+        return size == 2 ? 0x66 : 0;
+    }
+    // x86 has no form with two memory operands, which the compiler must never produce
+    static bool isMemoryToMemory(Encoder& encoder, const Encoder::Operand& d, const Encoder::Operand& s, const std::string& mnemonic) {
+        if (d.kind != Encoder::Operand::Kind::mem || s.kind != Encoder::Operand::Kind::mem) return false;
+        encoder.fail("Internal compiler error: " + mnemonic + " has two memory operands");
+        return true;
+    }
+    // add, or, and, sub, xor and cmp share one encoding, told apart by group
+    static void encodeArithmetic(Encoder& encoder, int group, const Location& dest, const Location& src, SizeType opsize) {
+        static const char* mnemonics[] { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" };
+        const auto d = encoder.operand(dest);
+        const auto s = encoder.operand(src);
+        if (isMemoryToMemory(encoder, d, s, mnemonics[group])) return;
+        const int size = operandSize(d, s, opsize);
+        const uint8_t prefix = sizePrefix(size);
+        const bool w = size == 8;
+        if (s.kind == Encoder::Operand::Kind::imm) {
+            long long value = s.value;
+            if (!fitImmediate(value, size)) {
+                encoder.fail("Immediate " + std::to_string(s.value) + " does not fit in the operation");
+                return;
+            }
+            if (size == 1) {
+                encoder.instruction(prefix, w, { 0x80 }, group, d, 1, value);
+            } else if (fitsInByte(value)) {
+                encoder.instruction(prefix, w, { 0x83 }, group, d, 1, value);
+            } else if (d.kind == Encoder::Operand::Kind::reg && d.number == 0) { // the accumulator has a form without ModRM
+                if (prefix) encoder.raw({ prefix });
+                if (w) encoder.raw({ 0x48 });
+                encoder.raw({ static_cast<uint8_t>(group * 8 + 5) });
+                encoder.immediate(value, size == 2 ? 2 : 4);
+            } else {
+                encoder.instruction(prefix, w, { 0x81 }, group, d, size == 2 ? 2 : 4, value);
+            }
+            return;
+        }
+        if (s.kind == Encoder::Operand::Kind::reg) {
+            encoder.instruction(prefix, w, { static_cast<uint8_t>(group * 8 + (size == 1 ? 0 : 1)) }, s, d);
+        } else {
+            encoder.instruction(prefix, w, { static_cast<uint8_t>(group * 8 + (size == 1 ? 2 : 3)) }, d, s);
+        }
+    }
+    // not, neg, mul, imul, div and idiv share one encoding, told apart by extension
+    static void encodeUnary(Encoder& encoder, int extension, const Location& loc) {
+        const auto operand = encoder.operand(loc);
+        const int size = operandSize(operand, operand, SizeType::qword);
+        encoder.instruction(sizePrefix(size), size == 8, { static_cast<uint8_t>(size == 1 ? 0xF6 : 0xF7) }, extension, operand);
+    }
+    static void encodeMove(Encoder& encoder, const Location& dest, const Location& src, SizeType opsize) {
+        const auto d = encoder.operand(dest);
+        const auto s = encoder.operand(src);
+        if (isMemoryToMemory(encoder, d, s, "mov")) return;
+        const bool destIsFloat = d.kind == Encoder::Operand::Kind::reg && d.size == 16;
+        const bool srcIsFloat = s.kind == Encoder::Operand::Kind::reg && s.size == 16;
+        if (destIsFloat || srcIsFloat) {
+            if (destIsFloat && srcIsFloat) {
+                encoder.instruction(0x66, false, { 0x0F, 0x28 }, d, s); // movapd
+            } else if (d.kind == Encoder::Operand::Kind::reg && s.kind == Encoder::Operand::Kind::reg) {
+                if (destIsFloat) encoder.instruction(0x66, true, { 0x0F, 0x6E }, d, s); // movq xmm, r64
+                else encoder.instruction(0x66, true, { 0x0F, 0x7E }, s, d); // movq r64, xmm
+            } else if (destIsFloat) {
+                encoder.instruction(0xF2, false, { 0x0F, 0x10 }, d, s); // movsd xmm, m64
+            } else {
+                encoder.instruction(0xF2, false, { 0x0F, 0x11 }, s, d); // movsd m64, xmm
+            }
+            return;
+        }
+        if ((!src.isDereference && src.offset) || (!src.isDereference && src.isLbl)) { // an address, so lea
+            encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x8D }, d, s);
+            return;
+        }
+        if (s.kind == Encoder::Operand::Kind::imm) {
+            long long value = s.value;
+            if (d.kind == Encoder::Operand::Kind::reg) {
+                if (d.size == 8) {
+                    if (value >= 0 && value <= UINT_MAX) { // writing the low half zeroes the rest
+                        encoder.opcodeRegister(0, false, 0xB8, d, 4, value);
+                    } else if (value >= INT_MIN && value <= INT_MAX) {
+                        encoder.instruction(0, true, { 0xC7 }, 0, d, 4, value);
+                    } else {
+                        encoder.opcodeRegister(0, true, 0xB8, d, 8, value);
+                    }
+                    return;
+                }
+                if (!fitImmediate(value, d.size)) {
+                    encoder.fail("Immediate " + std::to_string(s.value) + " does not fit in " + std::to_string(d.size * 8) + " bits");
+                    return;
+                }
+                if (d.size == 1) encoder.opcodeRegister(0, false, 0xB0, d, 1, value);
+                else encoder.opcodeRegister(sizePrefix(d.size), false, 0xB8, d, d.size, value);
+                return;
+            }
+            const int size = sizeInBytes(opsize);
+            if (!fitImmediate(value, size)) {
+                encoder.fail("Immediate " + std::to_string(s.value) + " does not fit in " + std::to_string(size * 8) + " bits");
+                return;
+            }
+            encoder.instruction(sizePrefix(size), size == 8, { static_cast<uint8_t>(size == 1 ? 0xC6 : 0xC7) }, 0, d, size == 8 ? 4 : size, value);
+            return;
+        }
+        const int size = operandSize(d, s, opsize);
+        if (s.kind == Encoder::Operand::Kind::reg) {
+            encoder.instruction(sizePrefix(size), size == 8, { static_cast<uint8_t>(size == 1 ? 0x88 : 0x89) }, s, d);
+        } else {
+            encoder.instruction(sizePrefix(size), size == 8, { static_cast<uint8_t>(size == 1 ? 0x8A : 0x8B) }, d, s);
+        }
+    }
+
+    void RawText::encode(Encoder& encoder) const {
+        encoder.fail("Cannot encode the raw assembly '" + rawText + "'");
+    }
+    void Section::encode(Encoder& encoder) const {
+        encoder.section(type);
+        for (auto instr: instructions) {
+            instr->encode(encoder);
+        }
+    }
+    void Label::encode(Encoder& encoder) const {
+        encoder.label(isPrefixed ? prefixed(lbl) : lbl, isGlobal);
+    }
+    void Align::encode(Encoder& encoder) const {
+        encoder.align(boundary);
+    }
+    void Extern::encode(Encoder& encoder) const {
+        encoder.external(isPrefixed ? prefixed(lbl) : lbl);
+    }
+    void Global::encode(Encoder& encoder) const {
+        encoder.global(prefixed(lbl));
+    }
+    void Data::encode(Encoder& encoder) const {
+        if (!label.empty()) encoder.label(prefixed(label), false);
+        std::string contents;
+        for (auto value: values) {
+            for (int i = 0; i < sizeInBytes(sizeType); i++) {
+                contents.push_back(static_cast<char>((value.u >> (i * 8)) & 0xFF));
+            }
+        }
+        encoder.data(contents);
+    }
+    void ZeroData::encode(Encoder& encoder) const {
+        if (!label.empty()) encoder.label(prefixed(label), false);
+        encoder.reserve(count * sizeInBytes(sizeType));
+    }
+    // The text is nasm's: backquoted runs and numbers, separated by commas
+    void StringData::encode(Encoder& encoder) const {
+        if (!label.empty()) encoder.label(prefixed(label), false);
+        const std::string text { '`' + contents + "\\0`" };
+        std::string contents;
+        size_t i = 0;
+        while (i < text.size()) {
+            if (text[i] == '`') {
+                size_t end = ++i;
+                while (end < text.size() && text[end] != '`') end += text[end] == '\\' ? 2 : 1;
+                contents += literalBytes(text.substr(i, end - i));
+                i = end + 1;
+            } else if (text[i] == ',' || text[i] == ' ') {
+                i++;
+            } else {
+                char* end;
+                contents.push_back(static_cast<char>(strtol(text.c_str() + i, &end, 0)));
+                if (end == text.c_str() + i) {
+                    encoder.fail("Cannot encode the string " + this->contents);
+                    return;
+                }
+                i = end - text.c_str();
+            }
+        }
+        encoder.data(contents);
+    }
+    void LengthOf::encode(Encoder& encoder) const {
+        encoder.lengthOf(prefixed(lbl), src);
+    }
+    void Equate::encode(Encoder& encoder) const {
+        encoder.equate(prefixed(lbl), prefixed(target), offset);
+    }
+    void MoveOperation::encode(Encoder& encoder) const {
+        encodeMove(encoder, dest, src, opsize);
+    }
+    void LoadAddressOperation::encode(Encoder& encoder) const {
+        const auto d = encoder.operand(dest);
+        encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x8D }, d, encoder.operand(src));
+    }
+    void AddOperation::encode(Encoder& encoder) const {
+        encodeArithmetic(encoder, 0, dest, src, opsize);
+    }
+    void OrOperation::encode(Encoder& encoder) const {
+        encodeArithmetic(encoder, 1, dest, src, SizeType::qword);
+    }
+    void AndOperation::encode(Encoder& encoder) const {
+        encodeArithmetic(encoder, 4, dest, src, SizeType::qword);
+    }
+    void SubOperation::encode(Encoder& encoder) const {
+        encodeArithmetic(encoder, 5, dest, src, SizeType::qword);
+    }
+    void XorOperation::encode(Encoder& encoder) const {
+        encodeArithmetic(encoder, 6, dest, src, SizeType::qword);
+    }
+    void CmpOperation::encode(Encoder& encoder) const {
+        encodeArithmetic(encoder, 7, dest, src, SizeType::qword);
+    }
+    void NotOperation::encode(Encoder& encoder) const {
+        encodeUnary(encoder, 2, dest);
+    }
+    void NegationOperation::encode(Encoder& encoder) const {
+        encodeUnary(encoder, 3, src);
+    }
+    void WideMulOperation::encode(Encoder& encoder) const {
+        encodeUnary(encoder, isSigned ? 5 : 4, src);
+    }
+    void DivOperation::encode(Encoder& encoder) const {
+        encodeUnary(encoder, isSigned ? 7 : 6, src);
+    }
+    void MulOperation::encode(Encoder& encoder) const {
+        const auto d = encoder.operand(dest);
+        const auto s = encoder.operand(src);
+        if (isMemoryToMemory(encoder, d, s, "imul")) return;
+        if (s.kind == Encoder::Operand::Kind::imm) { // imul dest, dest, imm
+            long long value = s.value;
+            if (!fitImmediate(value, d.size == 2 ? 2 : 4) || (d.size == 8 && !fitImmediate(value, 8))) {
+                encoder.fail("Immediate " + std::to_string(s.value) + " does not fit in the multiplication");
+                return;
+            }
+            if (fitsInByte(value)) encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x6B }, d, d, 1, value);
+            else encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x69 }, d, d, d.size == 2 ? 2 : 4, value);
+            return;
+        }
+        encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x0F, 0xAF }, d, s);
+    }
+    void SignExtendAccumulatorOperation::encode(Encoder& encoder) const {
+        encoder.raw({ 0x48, 0x99 }); // cqo
+    }
+    void ShiftOperation::encode(Encoder& encoder) const {
+        static const int extensions[] { 4, 5, 7 };
+        const auto d = encoder.operand(dest);
+        const int size = operandSize(d, d, SizeType::qword);
+        const bool isByte = size == 1;
+        if (count.isLiteral) {
+            if (count.value.u == 1) {
+                encoder.instruction(sizePrefix(size), size == 8, { static_cast<uint8_t>(isByte ? 0xD0 : 0xD1) }, extensions[static_cast<int>(type)], d);
+            } else {
+                encoder.instruction(sizePrefix(size), size == 8, { static_cast<uint8_t>(isByte ? 0xC0 : 0xC1) }, extensions[static_cast<int>(type)], d, 1, static_cast<long long>(count.value.u & 0xFF));
+            }
+        } else { // by cl
+            encoder.instruction(sizePrefix(size), size == 8, { static_cast<uint8_t>(isByte ? 0xD2 : 0xD3) }, extensions[static_cast<int>(type)], d);
+        }
+    }
+    void ScaledLoadAddressOperation::encode(Encoder& encoder) const {
+        const auto d = encoder.operand(dest);
+        encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x8D }, d, encoder.memory(base, index, scale, displacement));
+    }
+    void PushOperation::encode(Encoder& encoder) const {
+        const auto s = encoder.operand(src);
+        switch (s.kind) {
+            case Encoder::Operand::Kind::reg:
+                encoder.opcodeRegister(0, false, 0x50, s);
+                break;
+            case Encoder::Operand::Kind::imm:
+                if (fitsInByte(s.value)) encoder.raw({ 0x6A, static_cast<uint8_t>(s.value & 0xFF) });
+                else if (s.value >= INT_MIN && s.value <= INT_MAX) {
+                    encoder.raw({ 0x68 });
+                    encoder.immediate(s.value, 4);
+                } else {
+                    encoder.fail("Cannot push the 64-bit immediate " + std::to_string(s.value));
+                }
+                break;
+            case Encoder::Operand::Kind::mem:
+                encoder.instruction(0, false, { 0xFF }, 6, s);
+                break;
+        }
+    }
+    void PopOperation::encode(Encoder& encoder) const {
+        const auto d = encoder.operand(dest);
+        if (d.kind == Encoder::Operand::Kind::reg) encoder.opcodeRegister(0, false, 0x58, d);
+        else encoder.instruction(0, false, { 0x8F }, 0, d);
+    }
+    void CallOperation::encode(Encoder& encoder) const {
+        encoder.call(isPrefixed ? prefixed(lbl) : lbl);
+    }
+    void LeaveOperation::encode(Encoder& encoder) const {
+        encoder.raw({ 0xC9 });
+    }
+    void ReturnOperation::encode(Encoder& encoder) const {
+        encoder.raw({ 0xC3 });
+    }
+    void Syscall::encode(Encoder& encoder) const {
+        encoder.raw({ 0x0F, 0x05 });
+    }
+    void JumpOperation::encode(Encoder& encoder) const {
+        encoder.branch(type, prefixed(lbl));
+    }
+    void SetOperation::encode(Encoder& encoder) const {
+        encoder.instruction(0, false, { 0x0F, static_cast<uint8_t>(0x90 | conditionCodes[static_cast<int>(cond)]) }, 0, encoder.operand(dest));
+    }
+    void ConditionalMoveOperation::encode(Encoder& encoder) const {
+        const auto d = encoder.operand(dest);
+        const auto s = encoder.operand(src);
+        if (isMemoryToMemory(encoder, d, s, "cmov")) return;
+        encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x0F, static_cast<uint8_t>(0x40 | conditionCodes[static_cast<int>(cond)]) }, d, s);
+    }
+    void MoveExtendOperation::encode(Encoder& encoder) const {
+        const auto d = encoder.operand(dest);
+        const auto s = encoder.operand(src);
+        if (isMemoryToMemory(encoder, d, s, isSigned ? "movsx" : "movzx")) return;
+        const int size = s.kind == Encoder::Operand::Kind::reg ? s.size : sizeInBytes(srcsize);
+        if (size == 4) {
+            if (isSigned) encoder.instruction(0, true, { 0x63 }, d, s); // movsxd
+            else encoder.instruction(0, false, { 0x8B }, d, s); // a 32-bit mov zero-extends by itself
+            return;
+        }
+        const uint8_t opcode = (isSigned ? 0xBE : 0xB6) + (size == 2 ? 1 : 0);
+        encoder.instruction(sizePrefix(d.size), d.size == 8, { 0x0F, opcode }, d, s);
+    }
+    void FloatOperation::encode(Encoder& encoder) const {
+        static const struct {
+            uint8_t prefix;
+            uint8_t opcode;
+            int predicate; // cmpsd's comparison, or -1
+        } floatOpEncodings[] {
+            {0xF2, 0x58, -1}, {0xF2, 0x5C, -1}, {0xF2, 0x59, -1}, {0xF2, 0x5E, -1}, {0x66, 0x2E, -1}, {0xF2, 0xC2, 0}, {0xF2, 0xC2, 4}, {0x66, 0x57, -1}
+        };
+        const auto encoding = floatOpEncodings[static_cast<int>(type)];
+        const auto d = encoder.operand(dest);
+        const auto s = encoder.operand(src);
+        if (isMemoryToMemory(encoder, d, s, "a scalar float operation")) return;
+        if (encoding.predicate < 0) {
+            encoder.instruction(encoding.prefix, false, { 0x0F, encoding.opcode }, d, s);
+        } else {
+            encoder.instruction(encoding.prefix, false, { 0x0F, encoding.opcode }, d, s, 1, encoding.predicate);
+        }
+    }
+    void RepeatStringOperation::encode(Encoder& encoder) const {
+        encoder.raw({ 0xF3, static_cast<uint8_t>(type == StringOpType::copy ? 0xA4 : 0xAA) });
+    }
+
+    // MARK: Vector encodings
+    // Every packed instruction the vectorizer and bulk moves use. Each also has a VEX form, spelled
+    // with a leading v, that takes a separate destination and can address ymm registers.
+    enum class VectorForm {
+        binary, // op x, x/m
+        move, // op x, x/m or op m, x
+        transfer, // movq between a general and a vector register
+        shuffle, // op x, x/m, imm
+        shiftImmediate, // op x, imm
+        extract, // vextracti128 x/m, y, imm
+        broadcast // vpbroadcast x, x
+    };
+    static const struct VectorEncoding {
+        const char* mnemonic;
+        uint8_t prefix;
+        int map; // 1 for 0F, 2 for 0F 38 and 3 for 0F 3A
+        uint8_t opcode;
+        VectorForm form;
+    } vectorEncodings[] {
+        {"paddb", 0x66, 1, 0xFC, VectorForm::binary}, {"paddw", 0x66, 1, 0xFD, VectorForm::binary},
+        {"paddd", 0x66, 1, 0xFE, VectorForm::binary}, {"paddq", 0x66, 1, 0xD4, VectorForm::binary},
+        {"psubb", 0x66, 1, 0xF8, VectorForm::binary}, {"psubw", 0x66, 1, 0xF9, VectorForm::binary},
+        {"psubd", 0x66, 1, 0xFA, VectorForm::binary}, {"psubq", 0x66, 1, 0xFB, VectorForm::binary},
+        {"pmullw", 0x66, 1, 0xD5, VectorForm::binary}, {"pmulld", 0x66, 2, 0x40, VectorForm::binary},
+        {"pand", 0x66, 1, 0xDB, VectorForm::binary}, {"pxor", 0x66, 1, 0xEF, VectorForm::binary},
+        {"pminub", 0x66, 1, 0xDA, VectorForm::binary}, {"pminsw", 0x66, 1, 0xEA, VectorForm::binary},
+        {"pmaxub", 0x66, 1, 0xDE, VectorForm::binary}, {"pmaxsw", 0x66, 1, 0xEE, VectorForm::binary},
+        {"pminsb", 0x66, 2, 0x38, VectorForm::binary}, {"pminsd", 0x66, 2, 0x39, VectorForm::binary},
+        {"pminuw", 0x66, 2, 0x3A, VectorForm::binary}, {"pminud", 0x66, 2, 0x3B, VectorForm::binary},
+        {"pmaxsb", 0x66, 2, 0x3C, VectorForm::binary}, {"pmaxsd", 0x66, 2, 0x3D, VectorForm::binary},
+        {"pmaxuw", 0x66, 2, 0x3E, VectorForm::binary}, {"pmaxud", 0x66, 2, 0x3F, VectorForm::binary},
+        {"punpcklbw", 0x66, 1, 0x60, VectorForm::binary}, {"punpcklqdq", 0x66, 1, 0x6C, VectorForm::binary},
+        {"movdqa", 0x66, 1, 0x6F, VectorForm::move}, {"movdqu", 0xF3, 1, 0x6F, VectorForm::move},
+        {"movq", 0x66, 1, 0x6E, VectorForm::transfer},
+        {"pshufd", 0x66, 1, 0x70, VectorForm::shuffle}, {"pshuflw", 0xF2, 1, 0x70, VectorForm::shuffle},
+        {"psrldq", 0x66, 1, 0x73, VectorForm::shiftImmediate},
+        {"vextracti128", 0x66, 3, 0x39, VectorForm::extract},
+        {"vpbroadcastb", 0x66, 2, 0x78, VectorForm::broadcast}, {"vpbroadcastw", 0x66, 2, 0x79, VectorForm::broadcast},
+        {"vpbroadcastd", 0x66, 2, 0x58, VectorForm::broadcast}, {"vpbroadcastq", 0x66, 2, 0x59, VectorForm::broadcast}
+    };
+    void VectorOperation::encode(Encoder& encoder) const {
+        if (mnemonic == "vzeroupper") {
+            encoder.raw({ 0xC5, 0xF8, 0x77 });
+            return;
+        }
+        const VectorEncoding* encoding = nullptr;
+        bool isVEX = false;
+        for (const auto& candidate: vectorEncodings) {
+            if (mnemonic == candidate.mnemonic) {
+                encoding = &candidate;
+                isVEX = candidate.form == VectorForm::extract || candidate.form == VectorForm::broadcast;
+            } else if (mnemonic[0] == 'v' && mnemonic.substr(1) == candidate.mnemonic) {
+                encoding = &candidate;
+                isVEX = true;
+            }
+            if (encoding) break;
+        }
+        if (!encoding) {
+            encoder.fail("Cannot encode the vector instruction " + mnemonic);
+            return;
+        }
+        std::vector<Encoder::Operand> ops;
+        for (const auto& vop: operands) ops.push_back(encoder.operand(vop));
+        auto legacy = [&](uint8_t prefix, uint8_t opcode, bool w, const Encoder::Operand& reg, int extension, const Encoder::Operand& rm, int immSize, long long imm) {
+            std::vector<uint8_t> code { 0x0F };
+            if (encoding->map == 2) code.push_back(0x38);
+            if (encoding->map == 3) code.push_back(0x3A);
+            code.push_back(opcode);
+            if (extension >= 0) encoder.instruction(prefix, w, code, extension, rm, immSize, imm);
+            else encoder.instruction(prefix, w, code, reg, rm, immSize, imm);
+        };
+        const bool isWide = !ops.empty() && ops[0].kind == Encoder::Operand::Kind::reg && ops[0].size == 32;
+        switch (encoding->form) {
+            case VectorForm::binary:
+                if (isVEX) encoder.vex(encoding->prefix, encoding->map, false, isWide, encoding->opcode, ops[0].number, ops[1].number, ops[2]);
+                else legacy(encoding->prefix, encoding->opcode, false, ops[0], -1, ops[1], 0, 0);
+                break;
+            case VectorForm::move: {
+                const bool isStore = ops[0].kind == Encoder::Operand::Kind::mem;
+                const auto& reg = isStore ? ops[1] : ops[0];
+                const auto& rm = isStore ? ops[0] : ops[1];
+                const uint8_t opcode = isStore ? 0x7F : 0x6F;
+                if (isVEX) encoder.vex(encoding->prefix, encoding->map, false, reg.size == 32, opcode, reg.number, 0, rm);
+                else legacy(encoding->prefix, opcode, false, reg, -1, rm, 0, 0);
+                break;
+            }
+            case VectorForm::transfer: {
+                const bool toGeneral = ops[0].size <= 8;
+                const auto& reg = toGeneral ? ops[1] : ops[0];
+                const auto& rm = toGeneral ? ops[0] : ops[1];
+                const uint8_t opcode = toGeneral ? 0x7E : 0x6E;
+                if (isVEX) encoder.vex(encoding->prefix, encoding->map, true, false, opcode, reg.number, 0, rm);
+                else legacy(encoding->prefix, opcode, true, reg, -1, rm, 0, 0);
+                break;
+            }
+            case VectorForm::shuffle:
+                if (isVEX) encoder.vex(encoding->prefix, encoding->map, false, isWide, encoding->opcode, ops[0].number, 0, ops[1], 1, ops[2].value);
+                else legacy(encoding->prefix, encoding->opcode, false, ops[0], -1, ops[1], 1, ops[2].value);
+                break;
+            case VectorForm::shiftImmediate: // the shifted register is the r/m operand; VEX writes the result to vvvv
+                if (isVEX) encoder.vex(encoding->prefix, encoding->map, false, isWide, encoding->opcode, 3, ops[0].number, ops[1], 1, ops[2].value);
+                else legacy(encoding->prefix, encoding->opcode, false, ops[0], 3, ops[0], 1, ops[1].value);
+                break;
+            case VectorForm::extract:
+                encoder.vex(encoding->prefix, encoding->map, false, true, encoding->opcode, ops[1].number, 0, ops[0], 1, ops[2].value);
+                break;
+            case VectorForm::broadcast:
+                encoder.vex(encoding->prefix, encoding->map, false, isWide, encoding->opcode, ops[0].number, 0, ops[1]);
+                break;
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef Encoder_hpp
+#define Encoder_hpp
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Error.hpp"
+#include "Instruction.hpp"
+#include "Frame.hpp"
+
+#define ELF_SECTION_ALIGNMENT 16
+
+namespace Floral {
+    // Turns the compiler's sections into x86-64 machine code and writes them out as an ELF64
+    // relocatable object, the same object nasm would have assembled from their text. Each Instruction
+    // encodes itself through the methods below; see Instruction::encode.
+    class Encoder: public ErrorReporting {
+    public:
+        // An operand as the ModRM byte sees it
+        struct Operand {
+            enum class Kind {
+                reg, mem, imm
+            };
+            Kind kind;
+            int number; // hardware register number, or a memory operand's base; -1 for a rip-relative label
+            int size; // register width in bytes, 16 or 32 for vector registers
+            bool needsRex; // spl, bpl, sil and dil only exist with a REX prefix
+            int index; // memory operand index register, or -1
+            int scale;
+            long long value; // displacement or immediate
+            std::string label; // symbol a rip-relative operand refers to
+        };
+        Operand operand(const Location& loc);
+        Operand operand(const VectorOperand& vop);
+        Operand operand(Register reg);
+        Operand memory(Register base, Register index, int scale, long long displacement);
+
+    private:
+        struct Fixup {
+            size_t offset; // of a rel32 field within its fragment
+            std::string symbol;
+            long long addend;
+            bool isCall; // goes through the PLT if the symbol is not defined here
+        };
+        // A run of a section whose size is known once the fragments before it are laid out
+        struct Fragment {
+            enum class Kind {
+                bytes, zeros, align, branch
+            };
+            Kind kind = Kind::bytes;
+            std::string bytes;
+            std::vector<Fixup> fixups;
+            size_t count {}; // zeros to reserve, or the alignment boundary
+            Condition condition {}; // of a branch; Condition::normal for jmp
+            std::string target;
+            bool isNear {}; // a branch with a rel32 rather than a rel8 displacement
+            size_t offset {}; // from the start of the section, once laid out
+        };
+        struct Relocation {
+            size_t offset;
+            std::string symbol;
+            long long addend;
+            uint32_t type;
+        };
+        struct SectionImage {
+            std::vector<Fragment> fragments;
+            size_t size {};
+            std::string bytes;
+            std::vector<Relocation> relocations;
+        };
+        struct Symbol {
+            std::string name;
+            int section = -1; // index of the section defining it, or -1 while undefined
+            size_t fragment {}; // defined at the start of this fragment
+            long long offset {}; // and this far past it, for equates
+            bool isGlobal {};
+            bool isAbsolute {}; // a number rather than an address, as LengthOf defines
+            uint64_t value {};
+        };
+        struct Equation {
+            std::string name;
+            std::string target;
+            long long offset;
+            int section; // where `$` was, for a LengthOf
+            size_t fragment;
+            bool isLength;
+        };
+
+        SectionImage _sections[4]; // indexed by SectionType
+        int _current {};
+        std::vector<Symbol> _symbols; // in the order they were first named
+        std::unordered_map<std::string, size_t> _symbolIndex;
+        std::vector<Equation> _equations;
+
+        std::string& bytes();
+        Symbol& symbol(const std::string& name);
+        const Symbol* find(const std::string& name) const;
+        uint64_t address(const Symbol& sym) const;
+        void fixup(const std::string& symbol, long long addend, bool isCall);
+        void prefixes(uint8_t prefix, bool w, int reg, bool regNeedsRex, const Operand& rm);
+        void modrm(int reg, const Operand& rm, int immSize);
+        void resolveEquations(bool lengths);
+        void layout(int section);
+        void assemble(int section);
+        void resolve(int section, size_t position, const std::string& symbol, long long addend, bool isCall);
+        std::string elf() const;
+        bool isRegister(int reg); // reports an internal compiler error for an index that names no register
+        int registerNumber(int reg);
+
+    public:
+        Encoder();
+
+        bool hasErrors() const override;
+        const std::vector<Error>& errors() const override;
+        bool hasWarnings() const override;
+        const std::vector<Error>& warnings() const override;
+        void fail(const std::string& text);
+
+        // Symbols and data
+        void section(SectionType type);
+        void label(const std::string& name, bool isGlobal);
+        void global(const std::string& name);
+        void external(const std::string& name);
+        void equate(const std::string& name, const std::string& target, long long offset);
+        void lengthOf(const std::string& name, const std::string& start);
+        void align(size_t boundary);
+        void data(const std::string& contents);
+        void reserve(size_t size);
+
+        // Instructions
+        void raw(const std::vector<uint8_t>& code);
+        void instruction(uint8_t prefix, bool w, const std::vector<uint8_t>& opcode, const Operand& reg, const Operand& rm, int immSize = 0, long long imm = 0);
+        void instruction(uint8_t prefix, bool w, const std::vector<uint8_t>& opcode, int extension, const Operand& rm, int immSize = 0, long long imm = 0);
+        void opcodeRegister(uint8_t prefix, bool w, uint8_t opcode, const Operand& reg, int immSize = 0, long long imm = 0);
+        void vex(uint8_t prefix, int map, bool w, bool isWide, uint8_t opcode, int reg, int vvvv, const Operand& rm, int immSize = 0, long long imm = 0);
+        void immediate(long long value, int size);
+        void branch(Condition condition, const std::string& target);
+        void call(const std::string& target);
+
+        std::string object(); // the ELF64 image of everything encoded
+    };
+}
+
+#endif /* Encoder_hpp */
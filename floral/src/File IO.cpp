@@ -10,6 +10,9 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
 
 namespace Floral {
     void read(const std::string& path, std::string &result) {
@@ -37,7 +40,19 @@ namespace Floral {
 //        fwrite(contents.c_str(), sizeof(char), contents.size(), file);
 //        fclose(file);
         
-        if (auto fileStream = std::ofstream { path })
-            fileStream << contents.data();
+        if (auto fileStream = std::ofstream { path, std::ios::binary }) // object files hold NULs
+            fileStream.write(contents.data(), contents.size());
+    }
+    bool makeDirectories(const std::string& path) {
+        for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+            const std::string prefix { path.substr(0, slash) };
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) return false;
+            if (slash == std::string::npos) return true;
+        }
+    }
+    std::string expandHome(const std::string& path) {
+        if (path.empty() || path.front() != '~') return path;
+        const char* home = getenv("HOME");
+        return (home ? home : "") + path.substr(1);
     }
 }
@@ -14,6 +14,8 @@
 namespace Floral {
     void read(const std::string& path, std::string &result);
     void write(const std::string& path, const std::string &contents);
+    bool makeDirectories(const std::string& path); // creating any parents, as mkdir -p does
+    std::string expandHome(const std::string& path); // a leading ~ becomes $HOME
 }
 
 #endif /* Files_h */
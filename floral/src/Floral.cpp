@@ -0,0 +1,65 @@
+#include "Floral.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Compiler.hpp"
+
+namespace Floral {
+    CompileResult compile(const std::string& source, const CompileOptions& options) {
+        Compiler compiler;
+        compiler.optimization = options.optimization;
+        compiler._stackGuard = options.stackGuard;
+        compiler._stackProbe = options.stackProbe;
+        compiler._avx2 = options.avx2;
+        compiler._target = options.target;
+        compiler._emitAssembly = options.emitAssembly || options.target == Target::macOS;
+        return compile(source, options.path, compiler);
+    }
+    
+    CompileResult compile(const std::string& source, const std::string& path, Compiler& compiler, const CompileHooks& hooks) {
+        CompileResult result;
+        
+        // Lexing, which preprocesses the source first
+        v2::Lexer lexer { source, path };
+        std::vector<Token> tokens { lexer.lex() };
+        result.source = lexer.source();
+        result.includes = lexer.preprocessor().includes();
+        if (lexer.hasErrors()) {
+            for (auto &error: lexer.errors()) result.diagnostics.push_back(error);
+            return result;
+        }
+        if (hooks.preprocessed && !hooks.preprocessed(result)) return result;
+        
+        // Parsing
+        Parser parser { tokens };
+        parser.setPath(path);
+        File* file { parser.parse() };
+        for (auto &error: parser.errors()) result.diagnostics.push_back(error);
+        if (!file || parser.hasErrors()) {
+            if (file) dealloc(file);
+            return result;
+        }
+        for (auto &use: parser.use()) {
+            result.libs.insert(use == Use::libc ? "libc" : "stl");
+        }
+        if (hooks.parsed) hooks.parsed(file);
+        
+        // Compiling
+        compiler.setSource(result.source);
+        compiler.setPath(path);
+        compiler.compile(file);
+        if (!compiler.hasErrors() && compiler.outputDestination().empty()) {
+            if (compiler._emitAssembly) {
+                result.assembly = compiler.result();
+            } else {
+                result.object = compiler.object();
+            }
+        }
+        result.isAnalyzed = true;
+        for (auto &warning: compiler.warnings()) result.diagnostics.push_back(warning);
+        for (auto &error: compiler.errors()) result.diagnostics.push_back(error);
+        result.succeeded = !compiler.hasErrors();
+        
+        dealloc(file);
+        return result;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef Floral_hpp
+#define Floral_hpp
+
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+#include "Error.hpp"
+#include "Target.hpp"
+
+namespace Floral {
+    // What the command line would otherwise configure
+    struct CompileOptions {
+        int optimization {};
+        bool stackGuard {};
+        bool stackProbe {};
+        bool avx2 {};
+        bool emitAssembly {}; // nasm source rather than an object; always the case for macOS, as objects are ELF64
+        Target target = hostTarget;
+        std::string path { "source.floral" }; // names the source in diagnostics
+    };
+
+    struct CompileResult {
+        bool succeeded {};
+        std::string object; // an ELF64 relocatable object
+        std::string assembly; // nasm source, when it was asked for instead
+        std::string source; // preprocessed, which the diagnostics point into
+        std::vector<std::string> includes; // files the preprocessor read, nested ones too
+        std::vector<Error> diagnostics; // warnings, then any errors
+        bool isAnalyzed {}; // the diagnostics come from the analyzer and compiler rather than the lexer or parser
+        std::set<std::string> libs; // libraries the source uses, for the caller to link
+    };
+
+    // Compiles one module held in memory. Nothing is written to disk and no process is started; only
+    // an #include reads the file it names.
+    CompileResult compile(const std::string& source, const CompileOptions& options = {});
+
+    class Compiler;
+    class File;
+    // Where a caller that configures the compiler itself, as floralc does, steps in between the stages
+    struct CompileHooks {
+        std::function<bool(const CompileResult&)> preprocessed; // sees the source and includes; false stops before parsing
+        std::function<void(const File*)> parsed;
+    };
+
+    // What compile() does with the options applied, for a compiler configured by the caller. The output goes
+    // to the compiler's output destination when it has one, and into the result otherwise.
+    CompileResult compile(const std::string& source, const std::string& path, Compiler& compiler, const CompileHooks& hooks = {});
+}
+
+#endif /* Floral_hpp */
@@ -16,19 +16,51 @@ namespace Floral {
         return reg == Register::rax || reg == Register::rcx || reg == Register::rdx || reg == Register::rsi || reg == Register::rdi || reg == Register::r8 || reg == Register::r9 || reg == Register::r10 || reg == Register::r11;
     }
 
-    long Frame::nextOffset() const {
-        if (data.empty()) return 0;
-        long long minOffset = 0;
+    bool isCalleeSaved(Register reg) {
+        return reg == Register::rbx || reg == Register::r12 || reg == Register::r13 || reg == Register::r14 || reg == Register::r15;
+    }
+
+    bool isFloatRegister(Register reg) {
+        return reg >= Register::xmm0 && reg <= Register::xmm7;
+    }
+
+    Register sizedRegister(Register reg, SizeType opsize) {
+        const int r = static_cast<int>(reg);
+        const bool isLegacy = r <= static_cast<int>(Register::rsp);
+        const bool isExtended = r >= static_cast<int>(Register::r8) && r <= static_cast<int>(Register::r15);
+        if (!(isLegacy || isExtended) || opsize == SizeType::qword) return reg;
         
-        for (auto iter = data.begin(); iter != data.end(); iter++) {
-            if (IS_RBPOFFSET((*iter).loc)) {
-                const auto pos = (*iter).loc.offset - (long long)(*iter).size;
-                minOffset = min(minOffset, pos);
-            }
+        // ax, bx, cx, dx, si, di, bp, sp is not in the same order as rax...rsp
+        static const Register legacyWords[] {
+            Register::ax, Register::bx, Register::cx, Register::dx, Register::di, Register::si, Register::bp, Register::sp
+        };
+        const int index = isLegacy ? r : r - static_cast<int>(Register::r8);
+        switch (opsize) {
+            case SizeType::byte:
+                return static_cast<Register>(index + static_cast<int>(isLegacy ? Register::al : Register::r8b));
+            case SizeType::word:
+                return isLegacy ? legacyWords[index] : static_cast<Register>(index + static_cast<int>(Register::r8w));
+            case SizeType::dword:
+                return static_cast<Register>(index + static_cast<int>(isLegacy ? Register::eax : Register::r8d));
+            default:
+                return reg;
         }
-        return minOffset;
     }
-inline int Frame::isAvaliable(const Register reg) {
+
+    long Frame::allocate(size_t size, size_t alignment) {
+        const long align = alignment ? static_cast<long>(alignment) : 1;
+        top = (top - static_cast<long>(size)) & -align;
+        deepest = min(deepest, top);
+        return top;
+    }
+    FrameScope Frame::openScope() const {
+        return { data.size(), top };
+    }
+    void Frame::closeScope(const FrameScope& scope) {
+        data.resize(scope.dataCount);
+        top = scope.top;
+    }
+    int Frame::isAvaliable(const Register reg) {
         return std::find(registersInUse.begin(), registersInUse.end(), reg) == registersInUse.end();
     }
     int Frame::avaliableScratch() {
@@ -41,6 +73,27 @@ inline int Frame::isAvaliable(const Register reg) {
         }
         return -1;
     }
+    int Frame::avaliableCalleeSaved() {
+        for (int r{}; r <= static_cast<int>(Register::r15); r++) {
+            const Register reg {static_cast<Register>(r)};
+            if (isAvaliable(reg) && isCalleeSaved(reg)) {
+                registersInUse.push_back(reg);
+                if (std::find(calleeSaved.begin(), calleeSaved.end(), reg) == calleeSaved.end()) calleeSaved.push_back(reg);
+                return r;
+            }
+        }
+        return -1;
+    }
+    int Frame::avaliableFloat() {
+        for (int r = static_cast<int>(Register::xmm0); r <= static_cast<int>(Register::xmm7); r++) {
+            const Register reg {static_cast<Register>(r)};
+            if (isAvaliable(reg)) {
+                registersInUse.push_back(reg);
+                return r;
+            }
+        }
+        return -1;
+    }
     void Frame::returnScratchRegister(Register r) {
         for (int i {}; i < registersInUse.size(); i++) {
             if (registersInUse[i] == r) {
@@ -48,9 +101,17 @@ inline int Frame::isAvaliable(const Register reg) {
             }
         }
     }
+    bool Frame::holdsVariable(Register reg) const {
+        return std::any_of(data.begin(), data.end(), [reg](const Variable& v) {
+            return v.loc == RegisterLocation(reg);
+        });
+    }
     void Frame::addData(Location loc, size_t size, const std::string& name) {
         data.push_back({loc, size, name});
     }
+    void Frame::addConstant(Location loc, size_t size, const std::string& name, Location value) {
+        data.push_back({loc, size, name, true, value});
+    }
 
     std::pair<Variable, bool> Frame::localLookup(const std::string& name) const {
         std::pair<Variable, bool> result {
@@ -58,10 +119,11 @@ inline int Frame::isAvaliable(const Register reg) {
             false
         };
         
-        const auto iter = std::find_if(data.begin(), data.end(), [name](Variable v){
+        // innermost declaration wins
+        const auto iter = std::find_if(data.rbegin(), data.rend(), [name](Variable v){
             return v.name == name;
         });
-        if (iter != data.end()) {
+        if (iter != data.rend()) {
             result.first = *iter;
             result.second = true;
         }
@@ -26,6 +26,7 @@
 
 #define REG_IMPL_OFFSET_FOR_SIZE(opsize) ((opsize) == SizeType::qword ? 0 : ((opsize) == SizeType::dword ? 8 : ((opsize) == SizeType::word ? 40 : 32)))
 #define GET_REG(f) static_cast<Register>((f).avaliableScratch())
+#define GET_FLOAT_REG(f) static_cast<Register>((f).avaliableFloat())
 
 namespace Floral {
     struct Location;
@@ -37,7 +38,9 @@ namespace Floral {
         al, bl, cl, dl, dil, sil, bpl, spl,
         ax, bx, cx, dx, si, di, bp, sp,
         r8d, r9d, r10d, r11d, r12d, r13d, r14d, r15d,
-        rip
+        rip,
+        r8b, r9b, r10b, r11b, r12b, r13b, r14b, r15b,
+        r8w, r9w, r10w, r11w, r12w, r13w, r14w, r15w
     };
     const std::string registerNames[] {
         "rax",  "rbx",  "rcx",  "rdx",  "rdi",  "rsi",  "rbp",  "rsp",
@@ -46,26 +49,50 @@ namespace Floral {
         "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
         "al",   "bl",   "cl",   "dl",   "dil",  "sil",  "bpl",  "spl",
         "ax",   "bx",   "cx",   "dx",   "si",   "di",   "bp",   "sp",
-        "r8d",  "r9d",  "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
-        "rip"
+        "r8d",  "r9d",  "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+        "rip",
+        "r8b",  "r9b",  "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+        "r8w",  "r9w",  "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"
     };
     bool isScratch(Register reg);
+    bool isCalleeSaved(Register reg);
+    bool isFloatRegister(Register reg); // xmm0-xmm7, none of which survive a call
+    Register sizedRegister(Register reg, SizeType opsize); // the byte/word/dword/qword view of a 64-bit register
     struct Variable {
         Location loc;
         size_t size;
         std::string name;
+        bool isConstant {}; // a let whose value is known at compile time
+        Location constant {}; // that value, as a literal
+    };
+    struct FrameScope {
+        size_t dataCount;
+        long top;
     };
     struct Frame {
         std::vector<Register> registersInUse;
         std::vector<Variable> data;
-        long nextOffset() const;
         std::string id;
         long size{};
+        long top{}; // rbp offset of the lowest live slot; the next slot goes below it
+        long deepest{}; // lowest top ever reached, which sizes the frame
+        long pushed{}; // bytes pushed below the allocated frame, for aligning calls
+        std::vector<Register> calleeSaved; // callee-saved registers this function borrows and must restore
+        std::vector<Instruction*> epilogues; // the start of every frame exit, where they are restored
         
         int isAvaliable(const Register reg);
         int avaliableScratch();
+        int avaliableCalleeSaved(); // like avaliableScratch, but the register survives calls
+        int avaliableFloat(); // like avaliableScratch, but an xmm register for a Float
         void returnScratchRegister(Register r);
+        bool holdsVariable(Register reg) const; // a parameter kept in its argument register
         void addData(Location loc, size_t size, const std::string& name);
+        void addConstant(Location loc, size_t size, const std::string& name, Location value); // uses become immediates
+        long allocate(size_t size, size_t alignment = 8); // reserves a slot and returns its rbp offset
+        
+        // Slots allocated inside a scope are released when it closes so sibling scopes can reuse them
+        FrameScope openScope(void) const;
+        void closeScope(const FrameScope& scope);
         
 
         std::pair<Variable, bool> localLookup(const std::string& name) const;
@@ -8,166 +8,341 @@
 
 #include "Instruction.hpp"
 #include "Frame.hpp"
+#include "AssemblyWriter.hpp"
 #include <algorithm>
 #include "Compiler.hpp"
 
 namespace Floral {
-    const std::string RawText::str() const {
-        return rawText;
+    static const std::string sizeTypeNames[] {
+        "byte", "word", "dword", "qword"
+    };
+    // nasm needs the operand size spelled out when storing an immediate to memory
+    static void writeOpsize(AssemblyWriter& out, const Location& dest, const Location& src, SizeType opsize) {
+        if (src.isLiteral && dest.isDereference) out << sizeTypeNames[static_cast<int>(opsize)] << ' ';
+    }
+    static void writeLabel(AssemblyWriter& out, const std::string& lbl, bool isPrefixed = true) {
+        if (isPrefixed) out << FLORAL_ID_PREFIX;
+        out << lbl;
+    }
+
+    const std::string Instruction::str() const {
+        AssemblyWriter out;
+        write(out);
+        return out.text();
+    }
+    void RawText::write(AssemblyWriter& out) const {
+        out << rawText;
     }
-    const std::string Section::str() const {
-        if (instructions.empty()) return "";
+    void Section::write(AssemblyWriter& out) const {
+        if (instructions.empty()) return;
         const static std::string sectionNames[] {
             "text", "data", "rodata", "bss"
         };
-        return "section ." + sectionNames[static_cast<int>(type)] + "\n" + join(instructions, "\n", spaceOutLabels);
+        out << "section ." << sectionNames[static_cast<int>(type)] << '\n';
+        bool isFirstLabel = false;
+        for (size_t index = 0; index < instructions.size(); index++) {
+            const auto instr = instructions[index];
+            auto spaceOut = false;
+            if (auto lbl = dynamic_cast<Label*>(instr)) {
+                spaceOut = spaceOutLabels && lbl->isSpaced;
+            }
+            if (spaceOut) {
+                if (!isFirstLabel) isFirstLabel = true;
+                else {
+                    out << '\n';
+                }
+            }
+            instr->write(out);
+            if (dynamic_cast<Extern*>(instr)) {
+                if (index + 1 < instructions.size() && !dynamic_cast<Extern*>(instructions[index + 1])) {
+                    out << '\n';
+                }
+            }
+            if (index + 1 < instructions.size()) out << '\n';
+        }
     }
     void Section::add(Instruction* instr) {
         instructions.push_back(instr);
     }
-    const std::string Label::str() const {
-        return (isGlobal ? ("global "  + prefixed(lbl) + '\n') : "") + prefixed(lbl) + ':';
+    void Label::write(AssemblyWriter& out) const {
+        if (isGlobal) {
+            out << "global ";
+            writeLabel(out, lbl, isPrefixed);
+            out << '\n';
+        }
+        writeLabel(out, lbl, isPrefixed);
+        out << ':';
+    }
+    void Align::write(AssemblyWriter& out) const {
+        out << INDENT "align ";
+        out.integer(boundary);
     }
-    const std::string Extern::str() const {
-        return "extern " + prefixed(lbl) + ADD_COMMENT_IF_EXISTS;
+    void Extern::write(AssemblyWriter& out) const {
+        out << "extern ";
+        writeLabel(out, lbl, isPrefixed);
+        out.comment(comment);
     }
-    const std::string Global::str() const {
-        return "global " + prefixed(lbl);
+    void Global::write(AssemblyWriter& out) const {
+        out << "global ";
+        writeLabel(out, lbl);
     }
-    const std::string Data::str() const {
+    void Data::write(AssemblyWriter& out) const {
         const static std::string sizeTypeNames[] {
             "db", "dw", "dd", "dq"
         };
-        
-        return INDENT + prefixed(label) + ": " + sizeTypeNames[static_cast<int>(sizeType)] + ' ' +  join(values, isSigned, ", ");
+        out << INDENT;
+        writeLabel(out, label);
+        out << ": " << sizeTypeNames[static_cast<int>(sizeType)] << ' ';
+        for (size_t index = 0; index < values.size(); index++) {
+            if (index) out << ", ";
+            if (isSigned) out.integer(values[index].s);
+            else out.integer(values[index].u);
+        }
     }
-    const std::string ZeroData::str() const {
+    void ZeroData::write(AssemblyWriter& out) const {
         const static std::string sizeTypeNames[] {
             "resb", "resw", "resd", "resq"
         };
-        return INDENT + prefixed(label) + ": " + sizeTypeNames[static_cast<int>(sizeType)] + ' ' + std::to_string(count);
-    }
-    const std::string StringData::str() const {
-        std::string contents { '`' + this->contents };
-        std::string_view view {contents};
-        if (strncmp(view.data(), "``, ", 4) == 0) {
-            view.remove_prefix(4);
+        out << INDENT;
+        writeLabel(out, label);
+        out << ": " << sizeTypeNames[static_cast<int>(sizeType)] << ' ';
+        out.integer(count);
+    }
+    void StringData::write(AssemblyWriter& out) const {
+        out << INDENT;
+        writeLabel(out, label);
+        out << ": db ";
+        // contents continue an open backquote, unless they start with a byte list
+        if (strncmp(contents.c_str(), "`, ", 3) == 0) {
+            out << contents.c_str() + 3;
+        } else {
+            out << '`' << contents;
         }
-        std::string str {view};
-        str.append("\\0`");
-        return INDENT + prefixed(label) + ": db " + str;
+        out << "\\0`";
     }
-    const std::string LengthOf::str() const {
-        return INDENT + prefixed(lbl) + ": equ $-" + src;
+    void Equate::write(AssemblyWriter& out) const {
+        out << INDENT;
+        writeLabel(out, lbl);
+        out << ": equ ";
+        writeLabel(out, target);
+        out.offset(offset);
     }
-    const std::string Location::str() const {
-        if (isLiteral) return isSigned ? std::to_string(value.s) : std::to_string(value.u);
-        else if (isLbl) return "[rel " + prefixed(lbl) + ']';
-        const auto item = registerNames[reg] + (offset ? ((offset > 0 ? "+" : "") + std::to_string(offset)) : "");
-        return isDereference ? ('[' + item + ']') : item;
+    void LengthOf::write(AssemblyWriter& out) const {
+        out << INDENT;
+        writeLabel(out, lbl);
+        out << ": equ $-" << src;
     }
-    const std::string MoveOperation::str() const {
-        const static std::string sizeTypeNames[] {
-            "byte", "word", "dword", "qword"
-        };
-        if ((!src.isDereference && src.offset) || (!src.isDereference && src.isLbl)) {
-            return INDENT "lea " + MOVE_OPSIZE_STR_IF_NECESSARY + dest.str() + ", [" + src.str() + ']' + ADD_COMMENT_IF_EXISTS;
+    const std::string Location::str() const {
+        AssemblyWriter out;
+        write(out);
+        return out.text();
+    }
+    void Location::write(AssemblyWriter& out) const {
+        if (isLiteral) {
+            if (isSigned) out.integer(value.s);
+            else out.integer(value.u);
+        } else if (isLbl) {
+            out << "[rel ";
+            writeLabel(out, lbl);
+            out.offset(offset);
+            out << ']';
+        } else {
+            if (isDereference) out << '[';
+            out << registerNames[reg];
+            out.offset(offset);
+            if (isDereference) out << ']';
         }
-        return INDENT "mov " + MOVE_OPSIZE_STR_IF_NECESSARY + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string LoadAddressOperation::str() const {
-        const static std::string sizeTypeNames[] {
-            "byte", "word", "dword", "qword"
-        };
-        return INDENT "lea " + MOVE_OPSIZE_STR_IF_NECESSARY + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string XorOperation::str() const {
-        return INDENT "xor " + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string AndOperation::str() const {
-        return INDENT "and " + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string CallOperation::str() const {
-        return INDENT "call " + prefixed(lbl) + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string SubOperation::str() const {
-        return INDENT "sub " + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
     }
-    const std::string AddOperation::str() const {
-        const static std::string sizeTypeNames[] {
-            "byte", "word", "dword", "qword"
+    void MoveOperation::write(AssemblyWriter& out) const {
+        const bool destIsFloat = IS_REG(dest) && isFloatRegister(static_cast<Register>(dest.reg));
+        const bool srcIsFloat = IS_REG(src) && isFloatRegister(static_cast<Register>(src.reg));
+        if (destIsFloat || srcIsFloat) {
+            // movapd copies the whole register, so it does not wait on the destination's upper lane
+            out << INDENT << (destIsFloat && srcIsFloat ? "movapd " : ((IS_REG(dest) && IS_REG(src)) ? "movq " : "movsd "));
+            dest.write(out);
+            out << ", ";
+            src.write(out);
+            out.comment(comment);
+            return;
+        }
+        const bool isAddress = (!src.isDereference && src.offset) || (!src.isDereference && src.isLbl);
+        out << (isAddress ? INDENT "lea " : INDENT "mov ");
+        writeOpsize(out, dest, src, opsize);
+        dest.write(out);
+        out << (isAddress ? ", [" : ", ");
+        src.write(out);
+        if (isAddress) out << ']';
+        out.comment(comment);
+    }
+    void LoadAddressOperation::write(AssemblyWriter& out) const {
+        out << INDENT "lea ";
+        writeOpsize(out, dest, src, opsize);
+        dest.write(out);
+        out << ", ";
+        src.write(out);
+        out.comment(comment);
+    }
+    // Writes `mnemonic dest, src ; comment`
+    static void writeBinary(AssemblyWriter& out, const char* mnemonic, const Location& dest, const Location& src, const std::string& comment) {
+        out << INDENT << mnemonic << ' ';
+        dest.write(out);
+        out << ", ";
+        src.write(out);
+        out.comment(comment);
+    }
+    static void writeUnary(AssemblyWriter& out, const char* mnemonic, const Location& operand, const std::string& comment) {
+        out << INDENT << mnemonic << ' ';
+        operand.write(out);
+        out.comment(comment);
+    }
+    void XorOperation::write(AssemblyWriter& out) const {
+        writeBinary(out, "xor", dest, src, comment);
+    }
+    void AndOperation::write(AssemblyWriter& out) const {
+        writeBinary(out, "and", dest, src, comment);
+    }
+    void CallOperation::write(AssemblyWriter& out) const {
+        out << INDENT "call ";
+        writeLabel(out, lbl, isPrefixed);
+        out.comment(comment);
+    }
+    void SubOperation::write(AssemblyWriter& out) const {
+        writeBinary(out, "sub", dest, src, comment);
+    }
+    void AddOperation::write(AssemblyWriter& out) const {
+        out << INDENT "add ";
+        writeOpsize(out, dest, src, opsize);
+        dest.write(out);
+        out << ", ";
+        src.write(out);
+        out.comment(comment);
+    }
+    void NotOperation::write(AssemblyWriter& out) const {
+        writeUnary(out, "not", dest, comment);
+    }
+    void OrOperation::write(AssemblyWriter& out) const {
+        writeBinary(out, "or", dest, src, comment);
+    }
+    void MulOperation::write(AssemblyWriter& out) const {
+        writeBinary(out, "imul", dest, src, comment);
+    }
+    void DivOperation::write(AssemblyWriter& out) const {
+        out << INDENT << (isSigned ? "idiv " : "div ") << (src.isDereference ? "qword " : "");
+        src.write(out);
+        out.comment(comment);
+    }
+    void WideMulOperation::write(AssemblyWriter& out) const {
+        out << INDENT << (isSigned ? "imul " : "mul ") << (src.isDereference ? "qword " : "");
+        src.write(out);
+        out.comment(comment);
+    }
+    void SignExtendAccumulatorOperation::write(AssemblyWriter& out) const {
+        out << INDENT "cqo";
+        out.comment(comment);
+    }
+    void ShiftOperation::write(AssemblyWriter& out) const {
+        const static char* shiftNames[] {
+            "shl", "shr", "sar"
         };
-        return INDENT "add " + MOVE_OPSIZE_STR_IF_NECESSARY + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string NotOperation::str() const {
-        return INDENT "not " + dest.str() + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string OrOperation::str() const {
-        return INDENT "or " + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string MulOperation::str() const {
-        return INDENT "imul " + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
+        writeBinary(out, shiftNames[static_cast<int>(type)], dest, count, comment);
+    }
+    void ScaledLoadAddressOperation::write(AssemblyWriter& out) const {
+        out << INDENT "lea ";
+        dest.write(out);
+        out << ", [" << registerNames[static_cast<int>(base)] << '+' << registerNames[static_cast<int>(index)];
+        if (scale != 1) {
+            out << '*';
+            out.integer(scale);
+        }
+        out.offset(displacement);
+        out << ']';
+        out.comment(comment);
     }
-    const std::string DivOperation::str() const {
-        return INDENT "idiv " + src.str() + ADD_COMMENT_IF_EXISTS;
+    void Syscall::write(AssemblyWriter& out) const {
+        out << INDENT "syscall";
     }
-    const std::string Syscall::str() const {
-        return INDENT "syscall";
+    void PushOperation::write(AssemblyWriter& out) const {
+        writeUnary(out, "push", src, comment);
     }
-    const std::string PushOperation::str() const {
-        return INDENT "push " + src.str() + ADD_COMMENT_IF_EXISTS;
+    void PopOperation::write(AssemblyWriter& out) const {
+        writeUnary(out, "pop", dest, comment);
     }
-    const std::string PopOperation::str() const {
-        return INDENT "pop " + dest.str() + ADD_COMMENT_IF_EXISTS;
+    void LeaveOperation::write(AssemblyWriter& out) const {
+        out << INDENT "leave";
+        out.comment(comment);
     }
-    const std::string LeaveOperation::str() const {
-        return INDENT "leave" + ADD_COMMENT_IF_EXISTS;
+    void ReturnOperation::write(AssemblyWriter& out) const {
+        out << INDENT "ret";
+        out.comment(comment);
     }
-    const std::string ReturnOperation::str() const {
-        return INDENT "ret" + ADD_COMMENT_IF_EXISTS;
-    }
-    const std::string CmpOperation::str() const {
-        const static std::string sizeTypeNames[] {
-            "byte", "word", "dword", "qword"
-        };
-        const static SizeType opsize = SizeType::qword;
-        return INDENT "cmp " + MOVE_OPSIZE_STR_IF_NECESSARY + dest.str() + ", " + src.str() + ADD_COMMENT_IF_EXISTS;
+    void CmpOperation::write(AssemblyWriter& out) const {
+        out << INDENT "cmp ";
+        writeOpsize(out, dest, src, SizeType::qword);
+        dest.write(out);
+        out << ", ";
+        src.write(out);
+        out.comment(comment);
     }
     const std::string JumpOperation::jtypemap[] {
-        "jmp", "jz", "jnz", "je", "jne", "jle", "jge", "jl", "jg", "ja", "jb", "jo", "jno", "jc", "jnc"
+        "jmp", "jz", "jnz", "je", "jne", "jle", "jge", "jl", "jg", "ja", "jb", "jo", "jno", "jc", "jnc", "jae", "jbe"
     };
-    const std::string JumpOperation::str() const {
-        return INDENT + jtypemap[static_cast<int>(type)] + ' ' + prefixed(lbl) + ADD_COMMENT_IF_EXISTS;
+    void JumpOperation::write(AssemblyWriter& out) const {
+        out << INDENT << jtypemap[static_cast<int>(type)] << ' ';
+        writeLabel(out, lbl);
+        out.comment(comment);
+    }
+    Condition invertedCondition(Condition cond) {
+        switch (cond) {
+            case Condition::zero: return Condition::nonzero;
+            case Condition::nonzero: return Condition::zero;
+            case Condition::equal: return Condition::unequal;
+            case Condition::unequal: return Condition::equal;
+            case Condition::lessEqual: return Condition::greater;
+            case Condition::greaterEqual: return Condition::less;
+            case Condition::less: return Condition::greaterEqual;
+            case Condition::greater: return Condition::lessEqual;
+            case Condition::above: return Condition::belowEqual;
+            case Condition::below: return Condition::aboveEqual;
+            case Condition::overflow: return Condition::noOverflow;
+            case Condition::noOverflow: return Condition::overflow;
+            case Condition::carry: return Condition::noCarry;
+            case Condition::noCarry: return Condition::carry;
+            case Condition::aboveEqual: return Condition::below;
+            case Condition::belowEqual: return Condition::above;
+            default: return cond;
+        }
     }
-    const std::string NegationOperation::str() const {
-        return INDENT "neg " + src.str() + ADD_COMMENT_IF_EXISTS;
+    void SetOperation::write(AssemblyWriter& out) const {
+        // setcc uses the same condition suffixes as jcc
+        out << INDENT "set" << JumpOperation::jtypemap[static_cast<int>(cond)].c_str() + 1 << ' ';
+        dest.write(out);
+        out.comment(comment);
+    }
+    void ConditionalMoveOperation::write(AssemblyWriter& out) const {
+        out << INDENT "cmov" << JumpOperation::jtypemap[static_cast<int>(cond)].c_str() + 1 << ' ';
+        dest.write(out);
+        out << ", ";
+        src.write(out);
+        out.comment(comment);
+    }
+    void MoveExtendOperation::write(AssemblyWriter& out) const {
+        out << INDENT << (isSigned ? (srcsize == SizeType::dword ? "movsxd " : "movsx ") : "movzx ");
+        dest.write(out);
+        out << ", ";
+        if (src.isDereference) out << sizeTypeNames[static_cast<int>(srcsize)] << ' ';
+        src.write(out);
+        out.comment(comment);
+    }
+    void NegationOperation::write(AssemblyWriter& out) const {
+        writeUnary(out, "neg", src, comment);
+    }
+    void FloatOperation::write(AssemblyWriter& out) const {
+        const static char* floatOpNames[] {
+            "addsd", "subsd", "mulsd", "divsd", "ucomisd", "cmpeqsd", "cmpneqsd", "xorpd"
+        };
+        writeBinary(out, floatOpNames[static_cast<int>(type)], dest, src, comment);
     }
 
-    const std::string join(const std::vector<Instruction*>& instructions, const std::string& sep, bool spaceOutLabels) {
-        std::string result;
-        bool isFirstLabel = false;
-        for (size_t index = 0; index < instructions.size(); index++) {
-            const auto instr = instructions[index];
-            auto spaceOut = false;
-            if (auto lbl = dynamic_cast<Label*>(instr)) {
-                spaceOut = spaceOutLabels && lbl->isSpaced;
-            }
-            if (spaceOut) {
-                if (!isFirstLabel) isFirstLabel = true;
-                else {
-                    result.push_back('\n');
-                }
-            }
-            result += instr->str();
-            if (dynamic_cast<Extern*>(instr)) {
-                if (index + 1 < instructions.size() && !dynamic_cast<Extern*>(instructions[index + 1])) {
-                    result.push_back('\n');
-                }
-            }
-            if (index + 1 < instructions.size()) result += sep;
-        }
-        return result;
-    }
     const std::string join(const std::vector<union SignedUnsigned>& data, bool isSigned, const std::string& sep) {
         std::string result;
         for (size_t index = 0; index < data.size(); index++) {
@@ -202,6 +377,62 @@ namespace Floral {
     Location ValueAtRegisterLocation(Register reg) {
         return {static_cast<int>(reg), 0, false, false, 0, false, "", true};
     }
+    VectorOperand VectorOperand::vector(int vreg, bool isWide) {
+        return {Kind::vector, vreg, isWide, Register::rax, Register::rax, 1, 0};
+    }
+    VectorOperand VectorOperand::general(Register reg) {
+        return {Kind::general, 0, false, reg, Register::rax, 1, 0};
+    }
+    VectorOperand VectorOperand::memory(Register base, Register index, int scale, long long displacement) {
+        return {Kind::memory, 0, false, base, index, scale, displacement};
+    }
+    VectorOperand VectorOperand::memory(Register base, long long displacement) {
+        return {Kind::memory, 0, false, base, Register::rax, 0, displacement};
+    }
+    VectorOperand VectorOperand::immediate(long long value) {
+        return {Kind::immediate, 0, false, Register::rax, Register::rax, 1, value};
+    }
+    const std::string VectorOperand::str() const {
+        AssemblyWriter out;
+        write(out);
+        return out.text();
+    }
+    void VectorOperand::write(AssemblyWriter& out) const {
+        switch (kind) {
+            case Kind::vector:
+                out << (isWide ? "ymm" : "xmm");
+                out.integer(vreg);
+                break;
+            case Kind::general:
+                out << registerNames[static_cast<int>(reg)];
+                break;
+            case Kind::memory:
+                out << '[' << registerNames[static_cast<int>(reg)];
+                if (scale) out << '+' << registerNames[static_cast<int>(index)];
+                if (scale > 1) {
+                    out << '*';
+                    out.integer(scale);
+                }
+                out.offset(value);
+                out << ']';
+                break;
+            case Kind::immediate:
+                out.integer(value);
+                break;
+        }
+    }
+    void VectorOperation::write(AssemblyWriter& out) const {
+        out << INDENT << mnemonic;
+        for (size_t i = 0; i < operands.size(); i++) {
+            out << (i ? ", " : " ");
+            operands[i].write(out);
+        }
+        out.comment(comment);
+    }
+    void RepeatStringOperation::write(AssemblyWriter& out) const {
+        out << INDENT << (type == StringOpType::copy ? "rep movsb" : "rep stosb");
+        out.comment(comment);
+    }
     Location ValueAtOffsetRegisterLocation(Register reg, long long offset) {
         return {static_cast<int>(reg), offset, false, false, 0, false, "", true};
     }
@@ -20,13 +20,13 @@ constexpr bool NO_COMMENTS = false;
 #define RETURN_VALUE_LOC_32b (RegisterLocation(Register::eax))
 #define INDENT "  "
 #define prefixed(lbl) (FLORAL_ID_PREFIX + lbl)
-#define ADD_COMMENT_IF_EXISTS ((NO_COMMENTS || comment.empty()) ? "" : (" ; " + comment))
 #define OPSIZE_FROM_NUM(n) ((n) == 1 ? SizeType::byte : ((n) == 2 ? SizeType::word : ((n) == 4 ? SizeType::dword : SizeType::qword)))
-#define MOVE_OPSIZE_STR_IF_NECESSARY (((src.isLiteral && dest.isDereference) ? sizeTypeNames[static_cast<int>(opsize)] + ' ' : ""))
 #define IS_RBPOFFSET(loc) ((loc).reg == static_cast<int>(Register::rbp))
 #define IS_REG(loc) ((loc).reg != LOC_IS_NOT_REG && !(loc).isDereference && !(loc).offset)
 #define IS_AREG(loc) ((loc).reg != LOC_IS_NOT_REG)
 #define ARE_BOTH_LIT(leftop, rightop) ((leftop)->src.isLiteral && (rightop)->src.isLiteral)
+#define IS_MEM(loc) (!(loc).isLiteral && ((loc).isDereference || (loc).offset || (loc).isLbl))
+#define ARE_BOTH_MEM(a, b) (IS_MEM(a) && IS_MEM(b)) // no instruction takes two memory operands
 #define NO_OPTM(op) (!(op)->comment.empty() && (op)->comment.front() == '@')
 #define ZeroLL NumLL(false, SU(0ULL))
 #define OneLL NumLL(false, SU(1ULL))
@@ -36,18 +36,23 @@ constexpr bool NO_COMMENTS = false;
 namespace Floral {
     const std::string join(const std::vector<std::string>& vector, const std::string& sep);
 
+    class Encoder;
+    class AssemblyWriter;
+
     struct Instruction {
         virtual ~Instruction() {}
-        virtual const std::string str() const = 0;
+        virtual void write(AssemblyWriter& out) const = 0; // appends the nasm source, see AssemblyWriter.hpp
+        virtual void encode(Encoder& encoder) const = 0; // appends the machine code, see Encoder.cpp
+        const std::string str() const;
     };
-    const std::string join(const std::vector<Instruction*>& instructions, const std::string& sep, bool spaceOutLabels);
 
     struct RawText: public Instruction {
         RawText(const std::string& _rawText): rawText(_rawText) {}
         ~RawText() override {}
         std::string rawText;
         
-        virtual const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
 
     enum class SectionType {
@@ -62,26 +67,40 @@ namespace Floral {
         bool spaceOutLabels = false;
         void add(Instruction* instr);
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct Label: public Instruction {
-        Label(const std::string& _lbl, bool _isGlobal, bool _isSpaced = true): lbl(_lbl), isGlobal(_isGlobal), isSpaced(_isSpaced) {}
+        Label(const std::string& _lbl, bool _isGlobal, bool _isSpaced = true, bool _isPrefixed = true): lbl(_lbl), isGlobal(_isGlobal), isSpaced(_isSpaced), isPrefixed(_isPrefixed) {}
         ~Label() override {}
         
         std::string lbl;
         bool isGlobal;
         bool isSpaced;
+        bool isPrefixed; // false for symbols outside Floral, such as the entry point
                 
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    struct Align: public Instruction {
+        Align(size_t _boundary): boundary(_boundary) {}
+        ~Align() override {}
+        
+        size_t boundary;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct Extern: public Instruction {
-        Extern(const std::string& _lbl, const std::string& _comment = ""): lbl(_lbl), comment(_comment) {}
+        Extern(const std::string& _lbl, const std::string& _comment = "", bool _isPrefixed = true): lbl(_lbl), comment(_comment), isPrefixed(_isPrefixed) {}
         ~Extern() override {}
         
         std::string lbl;
         std::string comment;
+        bool isPrefixed;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct Global: public Instruction {
         Global(const std::string& _lbl): lbl(_lbl) {}
@@ -89,7 +108,8 @@ namespace Floral {
         
         std::string lbl;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     enum class SizeType {
         byte, word, dword, qword
@@ -111,7 +131,8 @@ namespace Floral {
         bool isSigned;
         std::vector<union SignedUnsigned> values;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     const std::string join(const std::vector<union SignedUnsigned>& data, bool isSigned, const std::string& sep);
 
@@ -123,7 +144,8 @@ namespace Floral {
         SizeType sizeType;
         size_t count;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct StringData: public Instruction {
         StringData(const std::string& _label, const std::string& _contents): label(_label), contents(_contents) {}
@@ -132,7 +154,8 @@ namespace Floral {
         std::string label;
         std::string contents;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct LengthOf: public Instruction {
         LengthOf(const std::string& _lbl, const std::string _src): lbl(_lbl), src(_src) {}
@@ -141,7 +164,20 @@ namespace Floral {
         std::string lbl;
         std::string src;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    // Names the address of another label, plus a byte offset
+    struct Equate: public Instruction {
+        Equate(const std::string& _lbl, const std::string& _target, long long _offset = 0): lbl(_lbl), target(_target), offset(_offset) {}
+        ~Equate() override {}
+        
+        std::string lbl;
+        std::string target;
+        long long offset;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     enum class OpType {
         mov, add, sub, xor_, imul, idiv, and_, or_, not_, push, pop, call, leave, ret
@@ -149,8 +185,6 @@ namespace Floral {
     struct Operation: public Instruction {
         OpType opType;
         virtual ~Operation() {}
-        
-        virtual const std::string str() const override = 0;
     };
     struct Location {
         int reg;
@@ -163,6 +197,7 @@ namespace Floral {
         bool isDereference;
         
         const std::string str() const;
+        void write(AssemblyWriter& out) const;
         
         friend bool operator ==(const Location& lhs, const Location& rhs);
     };
@@ -185,7 +220,8 @@ namespace Floral {
         SizeType opsize;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct LoadAddressOperation: public Operation {
         LoadAddressOperation(Location _dest, Location _src, SizeType _opsize, const std::string& _comment = ""): src(_src), dest(_dest), opsize(_opsize), comment(_comment) {}
@@ -196,7 +232,8 @@ namespace Floral {
         SizeType opsize;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct AddOperation: public Operation {
         AddOperation(Location _dest, Location _src, SizeType _opsize = SizeType::qword, const std::string& _comment = ""): src(_src), dest(_dest), opsize(_opsize), comment(_comment) {}
@@ -207,7 +244,8 @@ namespace Floral {
         SizeType opsize;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct SubOperation: public Operation {
         SubOperation(Location _dest, Location _src, const std::string& _comment = ""): src(_src), dest(_dest), comment(_comment) {}
@@ -217,7 +255,8 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct XorOperation: public Operation {
         XorOperation(Location _dest, Location _src, const std::string& _comment = ""): src(_src), dest(_dest), comment(_comment) {}
@@ -227,7 +266,8 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct AndOperation: public Operation {
         AndOperation(Location _dest, Location _src, const std::string& _comment = ""): src(_src), dest(_dest), comment(_comment) {}
@@ -237,7 +277,8 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct OrOperation: public Operation {
         OrOperation(Location _dest, Location _src, const std::string& _comment = ""): src(_src), dest(_dest), comment(_comment) {}
@@ -247,7 +288,8 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct NotOperation: public Operation {
         NotOperation(Location _dest, const std::string& _comment = ""): dest(_dest), comment(_comment) {}
@@ -256,7 +298,8 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct MulOperation: public Operation {
         MulOperation(Location _dest, Location _src, const std::string& _comment = ""): src(_src), dest(_dest), comment(_comment) {}
@@ -266,16 +309,71 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct DivOperation: public Operation {
-        DivOperation(Location _src, const std::string& _comment = ""): src(_src), comment(_comment) {}
+        DivOperation(Location _src, bool _isSigned, const std::string& _comment = ""): src(_src), isSigned(_isSigned), comment(_comment) {}
         ~DivOperation() override {}
         
         Location src;
+        bool isSigned;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    // One-operand imul/mul: rdx:rax = rax * src
+    struct WideMulOperation: public Operation {
+        WideMulOperation(Location _src, bool _isSigned, const std::string& _comment = ""): src(_src), isSigned(_isSigned), comment(_comment) {}
+        ~WideMulOperation() override {}
+        
+        Location src;
+        bool isSigned;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    // Sign-extends rax into rdx before a signed division
+    struct SignExtendAccumulatorOperation: public Operation {
+        SignExtendAccumulatorOperation(const std::string& _comment = ""): comment(_comment) {}
+        ~SignExtendAccumulatorOperation() override {}
+        
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    enum class ShiftType {
+        shl, shr, sar
+    };
+    struct ShiftOperation: public Operation {
+        ShiftOperation(ShiftType _type, Location _dest, Location _count, const std::string& _comment = ""): type(_type), dest(_dest), count(_count), comment(_comment) {}
+        ~ShiftOperation() override {}
+        
+        ShiftType type;
+        Location dest;
+        Location count;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    // lea dest, [base + index * scale + displacement]
+    struct ScaledLoadAddressOperation: public Operation {
+        ScaledLoadAddressOperation(Location _dest, Register _base, Register _index, int _scale, long long _displacement = 0, const std::string& _comment = ""): dest(_dest), base(_base), index(_index), scale(_scale), displacement(_displacement), comment(_comment) {}
+        ~ScaledLoadAddressOperation() override {}
+        
+        Location dest;
+        Register base;
+        Register index;
+        int scale;
+        long long displacement;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct PushOperation: public Operation {
         PushOperation(Location _src, const std::string& _comment = ""): src(_src), comment(_comment) {}
@@ -284,7 +382,8 @@ namespace Floral {
         Location src;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct PopOperation: public Operation {
         PopOperation(Location _dest, const std::string& _comment = ""): dest(_dest), comment(_comment) {}
@@ -293,16 +392,19 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct CallOperation: public Operation {
-        CallOperation(std::string _lbl, const std::string& _comment = ""): lbl(_lbl), comment(_comment) {}
+        CallOperation(std::string _lbl, const std::string& _comment = "", bool _isPrefixed = true): lbl(_lbl), comment(_comment), isPrefixed(_isPrefixed) {}
         ~CallOperation() override {}
         
         std::string lbl;
         std::string comment;
+        bool isPrefixed;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct LeaveOperation: public Operation {
         LeaveOperation(const std::string& _comment = ""): comment(_comment) {}
@@ -310,7 +412,8 @@ namespace Floral {
         
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct ReturnOperation: public Operation {
         ReturnOperation(const std::string& _comment = ""): comment(_comment) {}
@@ -318,7 +421,8 @@ namespace Floral {
         
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct Syscall: public Instruction {
         Syscall(const std::string& _comment = ""): comment(_comment) {}
@@ -326,7 +430,8 @@ namespace Floral {
         
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct CmpOperation: public Operation {
         CmpOperation(Location _dest, Location _src, const std::string& _comment = ""): src(_src), dest(_dest), comment(_comment) {}
@@ -336,7 +441,8 @@ namespace Floral {
         Location dest;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     enum class Condition {
         normal,
@@ -353,11 +459,14 @@ namespace Floral {
         overflow,
         noOverflow,
         carry,
-        noCarry
+        noCarry,
+        aboveEqual,
+        belowEqual
     };
+    Condition invertedCondition(Condition cond); // the condition that holds exactly when cond does not
     struct JumpOperation: public Operation {
         typedef Condition JType;
-        static const std::string jtypemap[15];
+        static const std::string jtypemap[17];
         JumpOperation(JType _type, std::string _lbl, const std::string& _comment = ""): type(_type), lbl(_lbl), comment(_comment) {}
         ~JumpOperation() override {}
         
@@ -365,7 +474,44 @@ namespace Floral {
         std::string lbl;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    struct SetOperation: public Operation {
+        SetOperation(Condition _cond, Location _dest, const std::string& _comment = ""): cond(_cond), dest(_dest), comment(_comment) {}
+        ~SetOperation() override {}
+        
+        Condition cond;
+        Location dest;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    struct ConditionalMoveOperation: public Operation {
+        ConditionalMoveOperation(Condition _cond, Location _dest, Location _src, const std::string& _comment = ""): cond(_cond), src(_src), dest(_dest), comment(_comment) {}
+        ~ConditionalMoveOperation() override {}
+        
+        Condition cond;
+        Location src;
+        Location dest;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+    struct MoveExtendOperation: public Operation {
+        MoveExtendOperation(Location _dest, Location _src, SizeType _srcsize, bool _isSigned, const std::string& _comment = ""): src(_src), dest(_dest), srcsize(_srcsize), isSigned(_isSigned), comment(_comment) {}
+        ~MoveExtendOperation() override {}
+        
+        Location src;
+        Location dest;
+        SizeType srcsize;
+        bool isSigned;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
     struct NegationOperation: public Operation {
         NegationOperation(Location _src, const std::string& _comment = ""): src(_src), comment(_comment) {}
@@ -374,7 +520,76 @@ namespace Floral {
         Location src;
         std::string comment;
         
-        const std::string str() const override;
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+
+    // MARK: Scalar SSE2 instructions
+    // Floats live in the low lane of an xmm register; MoveOperation picks movsd or movq by itself
+    enum class FloatOpType {
+        add, sub, mul, div, compare, compareEqual, compareUnequal, bitXor
+    };
+    struct FloatOperation: public Operation {
+        FloatOperation(FloatOpType _type, Location _dest, Location _src, const std::string& _comment = ""): type(_type), src(_src), dest(_dest), comment(_comment) {}
+        ~FloatOperation() override {}
+        
+        FloatOpType type;
+        Location src;
+        Location dest;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+
+    // MARK: Packed SSE2/AVX2 instructions
+    // Vector registers are named by number, since they never hold values the scalar code sees
+    struct VectorOperand {
+        enum class Kind {
+            vector, general, memory, immediate
+        };
+        Kind kind;
+        int vreg; // xmm or ymm number
+        bool isWide; // ymm rather than xmm
+        Register reg; // general register, or the base of a memory operand
+        Register index; // memory operand index, multiplied by scale
+        int scale; // 0 when a memory operand has no index
+        long long value; // memory operand displacement, or an immediate
+        
+        static VectorOperand vector(int vreg, bool isWide);
+        static VectorOperand general(Register reg);
+        static VectorOperand memory(Register base, Register index, int scale, long long displacement = 0);
+        static VectorOperand memory(Register base, long long displacement);
+        static VectorOperand immediate(long long value);
+        const std::string str() const;
+        void write(AssemblyWriter& out) const;
+    };
+    struct VectorOperation: public Operation {
+        VectorOperation(const std::string& _mnemonic, const std::vector<VectorOperand>& _operands, const std::string& _comment = ""): mnemonic(_mnemonic), operands(_operands), comment(_comment) {}
+        ~VectorOperation() override {}
+        
+        std::string mnemonic;
+        std::vector<VectorOperand> operands;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
+    };
+
+    // MARK: String instructions
+    // rep movsb/stosb take their operands implicitly: rdi, rsi, rcx and al
+    enum class StringOpType {
+        copy, fill
+    };
+    struct RepeatStringOperation: public Operation {
+        RepeatStringOperation(StringOpType _type, const std::string& _comment = ""): type(_type), comment(_comment) {}
+        ~RepeatStringOperation() override {}
+        
+        StringOpType type;
+        std::string comment;
+        
+        void write(AssemblyWriter& out) const override;
+        void encode(Encoder& encoder) const override;
     };
 }
 
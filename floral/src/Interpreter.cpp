@@ -0,0 +1,589 @@
+#include "Interpreter.hpp"
+#include <cstring>
+#include <cstdlib>
+#include "SPA.hpp"
+
+namespace Floral {
+    Interpreter::Interpreter(StaticAnalyzer& analyzer): _analyzer(analyzer) {}
+
+    // MARK: Values
+    Interpreter::Value Interpreter::scalar(uint64_t bits, const Type* type) {
+        Value value;
+        if (!type) { // untyped, so taken as an Int
+            value.bits = bits;
+            return value;
+        }
+        if (type->isBool()) {
+            value.bits = bits != 0;
+            return value;
+        }
+        const size_t size = type->size();
+        if (size < 8) {
+            const uint64_t mask = (1ULL << (size * 8)) - 1;
+            bits &= mask;
+            if (type->isSigned() && (bits >> (size * 8 - 1)) & 1) {
+                bits |= ~mask; // sign-extend, so the bits read back as the same signed value
+            }
+        }
+        value.bits = bits;
+        return value;
+    }
+    Interpreter::Value Interpreter::zero(const Type* type) {
+        Value value;
+        Type* t = const_cast<Type*>(type);
+        if (t->isStruct()) {
+            value.kind = Value::Kind::aggregate;
+            for (auto member: t->structValue()->dataMembers()) {
+                if (auto var = dynamic_cast<VarStatement*>(member)) {
+                    value.elements.push_back(zero(var->type()));
+                }
+            }
+        } else if (t->isArray()) {
+            value.kind = Value::Kind::aggregate;
+            value.elements.assign(t->_staticArray->second, zero(t->_staticArray->first));
+        } else if (t->isFloat()) {
+            value.kind = Value::Kind::real;
+        }
+        return value;
+    }
+    // The bytes of a value as it is laid out in memory. Array elements ascend from the array's
+    // address, while struct members descend from the first one, which is the struct's address.
+    std::string Interpreter::image(const Value& value, const Type* type) {
+        Type* t = const_cast<Type*>(type);
+        if (t->isStruct()) {
+            const size_t size = t->size();
+            std::string bytes(size, '\0');
+            StructDeclaration* strct = t->structValue();
+            size_t index = 0;
+            for (auto member: strct->dataMembers()) {
+                if (auto var = dynamic_cast<VarStatement*>(member)) {
+                    const std::string element = image(value.elements[index++], var->type());
+                    const size_t slot = (element.size() + 7) & -8;
+                    const long at = static_cast<long>(size) + strct->offsetOf(var->name().contents) - static_cast<long>(slot);
+                    bytes.replace(at, element.size(), element);
+                }
+            }
+            return bytes;
+        }
+        if (t->isArray()) {
+            std::string bytes;
+            for (const auto& element: value.elements) {
+                bytes += image(element, t->_staticArray->first);
+            }
+            return bytes;
+        }
+        uint64_t bits = value.bits;
+        if (value.kind == Value::Kind::real) {
+            memcpy(&bits, &value.real, sizeof bits);
+        }
+        std::string bytes;
+        for (size_t byte = 0; byte < t->size(); byte++) {
+            bytes.push_back(static_cast<char>((bits >> (byte * 8)) & 0xFF));
+        }
+        return bytes;
+    }
+    // A value as Compiler::staticEvalulate spells it: a number, or a comma separated list for an aggregate
+    std::string Interpreter::describe(const Value& value, const Type* type) {
+        Type* t = const_cast<Type*>(type);
+        if (value.kind == Value::Kind::aggregate) {
+            std::string acc;
+            size_t index = 0;
+            for (const auto& element: value.elements) {
+                const Type* elementType = t->isArray() ? t->_staticArray->first : nullptr;
+                if (t->isStruct()) {
+                    size_t member = 0;
+                    for (auto data: t->structValue()->dataMembers()) {
+                        if (auto var = dynamic_cast<VarStatement*>(data)) {
+                            if (member++ == index) elementType = var->type();
+                        }
+                    }
+                }
+                if (index++) acc += ", ";
+                acc += describe(element, elementType);
+            }
+            return acc;
+        }
+        if (value.kind == Value::Kind::real) {
+            uint64_t bits;
+            memcpy(&bits, &value.real, sizeof bits);
+            return std::to_string(bits); // stored as its bit pattern, which dq takes as is
+        }
+        if (t && t->isSigned()) {
+            return std::to_string(static_cast<long long>(value.bits));
+        }
+        return std::to_string(value.bits);
+    }
+
+    // MARK: Evaluation
+    bool Interpreter::evaluate(Expression* expr, Value& result) {
+        if (evaluated(expr, result)) return true;
+        _frames.clear();
+        _steps = 0;
+        _failure.clear();
+        _failureNode = nullptr;
+        if (!eval(expr, result)) return false;
+        _results[expr] = result;
+        return true;
+    }
+    bool Interpreter::evaluated(const Expression* expr, Value& result) const {
+        const auto found = _results.find(expr);
+        if (found == _results.end()) return false;
+        result = found->second;
+        return true;
+    }
+    const std::string& Interpreter::failure() const {
+        return _failure;
+    }
+    const Node* Interpreter::failureNode() const {
+        return _failureNode;
+    }
+    void Interpreter::reset() {
+        _frames.clear();
+        _results.clear();
+        _failure.clear();
+        _failureNode = nullptr;
+    }
+
+    bool Interpreter::fail(const Node* node, const std::string& text) {
+        if (_failureNode) return false; // keep the innermost reason
+        _failure = text;
+        _failureNode = node;
+        return false;
+    }
+    bool Interpreter::step(const Node* node) {
+        if (++_steps > INTERPRETER_STEP_LIMIT) {
+            return fail(node, "Compile-time evaluation did not finish within " + std::to_string(INTERPRETER_STEP_LIMIT) + " steps");
+        }
+        return true;
+    }
+    Interpreter::Value* Interpreter::local(const std::string& name) {
+        if (_frames.empty()) return nullptr;
+        auto& scopes = _frames.back();
+        for (auto iter = scopes.rbegin(); iter != scopes.rend(); iter++) {
+            const auto found = iter->find(name);
+            if (found != iter->end()) return &found->second;
+        }
+        return nullptr;
+    }
+
+    // MARK: Statements
+    bool Interpreter::executeScoped(const std::vector<Node*>& body, bool& returned) {
+        _frames.back().push_back({});
+        for (auto node: body) {
+            auto stm = dynamic_cast<Statement*>(node);
+            if (!stm) {
+                _frames.back().pop_back();
+                return fail(node, "Declarations cannot be evaluated at compile time");
+            }
+            if (!execute(stm, returned)) {
+                _frames.back().pop_back();
+                return false;
+            }
+            if (returned) break;
+        }
+        _frames.back().pop_back();
+        return true;
+    }
+    bool Interpreter::execute(Statement* stm, bool& returned) {
+        if (!step(stm)) return false;
+        if (auto rtn = dynamic_cast<ReturnStatement*>(stm)) {
+            _returnValue = {};
+            if (rtn->value() && !eval(rtn->value(), _returnValue)) return false;
+            returned = true;
+            return true;
+        } else if (auto let = dynamic_cast<LetStatement*>(stm)) {
+            Value value = zero(let->type());
+            if (auto direct = dynamic_cast<const DirectInitializer*>(let->initializer())) {
+                if (!eval(direct->expr(), value)) return false;
+            } else if (auto copy = dynamic_cast<const CopyInitializer*>(let->initializer())) {
+                if (!eval(copy->expr(), value)) return false;
+            }
+            _frames.back().back()[let->name().contents] = value;
+            return true;
+        } else if (auto var = dynamic_cast<VarStatement*>(stm)) {
+            Value value = zero(var->type());
+            if (auto direct = dynamic_cast<const DirectInitializer*>(var->initializer())) {
+                if (!eval(direct->expr(), value)) return false;
+            } else if (auto copy = dynamic_cast<const CopyInitializer*>(var->initializer())) {
+                if (!eval(copy->expr(), value)) return false;
+            }
+            _frames.back().back()[var->name().contents] = value;
+            return true;
+        } else if (auto assign = dynamic_cast<Assignment*>(stm)) {
+            Value value;
+            if (!eval(assign->rval(), value)) return false;
+            Value* slot;
+            if (!reference(assign->lval(), slot)) return false;
+            *slot = value;
+            return true;
+        } else if (auto exprStm = dynamic_cast<ExpressionStatement*>(stm)) {
+            Value discarded;
+            return eval(exprStm->expr(), discarded);
+        } else if (auto callStm = dynamic_cast<CallStatement*>(stm)) {
+            Value discarded;
+            return eval(callStm->call, discarded);
+        } else if (auto ifStm = dynamic_cast<IfStatement*>(stm)) {
+            bool condition;
+            if (!evalCondition(ifStm->condition(), condition)) return false;
+            return !condition || execute(ifStm->body(), returned);
+        } else if (auto whileStm = dynamic_cast<WhileStatement*>(stm)) {
+            while (true) {
+                bool condition;
+                if (!evalCondition(whileStm->condition(), condition)) return false;
+                if (!condition) return true;
+                if (!execute(whileStm->body(), returned)) return false;
+                if (returned) return true;
+            }
+        } else if (auto forStm = dynamic_cast<ForStatement*>(stm)) {
+            _frames.back().push_back({}); // the induction variable is scoped to the loop
+            bool succeeded = !forStm->init() || execute(forStm->init(), returned);
+            while (succeeded && !returned) {
+                bool condition;
+                succeeded = evalCondition(forStm->check(), condition);
+                if (!succeeded || !condition) break;
+                succeeded = execute(forStm->body(), returned);
+                if (succeeded && !returned && forStm->modify()) {
+                    succeeded = execute(forStm->modify(), returned);
+                }
+            }
+            _frames.back().pop_back();
+            return succeeded;
+        } else if (auto block = dynamic_cast<Block*>(stm)) {
+            return executeScoped(block->body(), returned);
+        } else if (dynamic_cast<EmptyStatment*>(stm)) {
+            return true;
+        }
+        return fail(stm, "Statement cannot be evaluated at compile time");
+    }
+
+    // MARK: Expressions
+    bool Interpreter::evalCondition(Expression* expr, bool& result) {
+        Value value;
+        if (!eval(expr, value)) return false;
+        if (value.kind != Value::Kind::scalar) {
+            return fail(expr, "Condition cannot be evaluated at compile time");
+        }
+        result = value.bits != 0;
+        return true;
+    }
+    bool Interpreter::eval(Expression* expr, Value& result) {
+        if (!step(expr)) return false;
+        if (auto literal = dynamic_cast<Literal*>(expr)) {
+            const std::string& contents = literal->value().contents;
+            switch (literal->type()) {
+                case Literal::LType::boolean:
+                    result = scalar(literal->value().type == TokenType::boolTrue, expr->type);
+                    return true;
+                case Literal::LType::hexadecimalInteger:
+                    result = scalar(strtoull(contents.c_str(), nullptr, 16), expr->type);
+                    return true;
+                case Literal::LType::floatingPointNumber:
+                    result = {};
+                    result.kind = Value::Kind::real;
+                    result.real = atof(contents.c_str());
+                    return true;
+                case Literal::LType::cString:
+                case Literal::LType::wideString:
+                    return fail(expr, "Strings cannot be evaluated at compile time");
+                default:
+                    result = scalar(strtoull(contents.c_str(), nullptr, 10), expr->type);
+                    return true;
+            }
+        } else if (auto symbol = dynamic_cast<SymbolExpression*>(expr)) {
+            return evalSymbol(symbol, result);
+        } else if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
+            return evalBinary(binary, result);
+        } else if (auto call = dynamic_cast<Call*>(expr)) {
+            return evalCall(call, result);
+        } else if (auto sizeofexpr = dynamic_cast<SizeOfType*>(expr)) {
+            result = scalar(sizeofexpr->size(), expr->type);
+            return true;
+        } else if (auto cast = dynamic_cast<UnsafeCast*>(expr)) {
+            Value value;
+            if (!eval(cast->expr(), value)) return false;
+            if (value.kind == Value::Kind::aggregate) {
+                return fail(expr, "Only scalars can be cast at compile time");
+            }
+            result = {};
+            if (cast->type()->isFloat()) { // the cast reinterprets bits rather than converting
+                result.kind = Value::Kind::real;
+                if (value.kind == Value::Kind::scalar) memcpy(&result.real, &value.bits, sizeof result.real);
+                else result.real = value.real;
+            } else {
+                uint64_t bits = value.bits;
+                if (value.kind == Value::Kind::real) memcpy(&bits, &value.real, sizeof bits);
+                result = scalar(bits, cast->type());
+            }
+            return true;
+        } else if (auto arraylit = dynamic_cast<ArrayLiteralExpression*>(expr)) {
+            result = {};
+            result.kind = Value::Kind::aggregate;
+            for (auto element: arraylit->values()) {
+                result.elements.push_back({});
+                if (!eval(element, result.elements.back())) return false;
+            }
+            return true;
+        } else if (auto constructor = dynamic_cast<ConstructExpression*>(expr)) {
+            if (constructor->mode() != ConstructExpression::Mode::stack) {
+                return fail(expr, "Heap allocation cannot be evaluated at compile time");
+            }
+            // the arguments initialize the data members in order, as in Compiler::emitExpression
+            result = zero(constructor->type());
+            for (size_t i = 0; i < constructor->args().size() && i < result.elements.size(); i++) {
+                if (!eval(constructor->args()[i], result.elements[i])) return false;
+            }
+            return true;
+        }
+        return fail(expr, "Expression cannot be evaluated at compile time");
+    }
+    bool Interpreter::evalSymbol(SymbolExpression* symbol, Value& result) {
+        const std::string& name = symbol->value().contents;
+        if (Value* value = local(name)) {
+            result = *value;
+            return true;
+        }
+        if (_frames.empty()) {
+            // outside of a call, a let of the code being analyzed is as good as its initializer
+            for (auto iter = _analyzer.scopes.rbegin(); iter + 1 < _analyzer.scopes.rend(); iter++) {
+                if (Type* type = iter->typeOf(name)) {
+                    if (type->isConst() && iter->lookup(name)) {
+                        return eval(iter->lookup(name), result);
+                    }
+                    return fail(symbol, "'" + name + "' is not known at compile time");
+                }
+            }
+        }
+        if (GlobalDeclaration* gbl = _analyzer.lookupGlobal(name)) {
+            const Initializer* init = gbl->initializer();
+            Expression* initexpr = nullptr;
+            if (auto direct = dynamic_cast<const DirectInitializer*>(init)) initexpr = direct->expr();
+            else if (auto copy = dynamic_cast<const CopyInitializer*>(init)) initexpr = copy->expr();
+            if (!initexpr) {
+                result = zero(gbl->type);
+                return true;
+            }
+            _frames.push_back({ {} }); // a global's initializer sees no locals
+            const bool succeeded = eval(initexpr, result);
+            _frames.pop_back();
+            return succeeded;
+        }
+        return fail(symbol, "'" + name + "' is not known at compile time");
+    }
+    bool Interpreter::evalCall(Call* call, Value& result) {
+        Function::Parameters params;
+        for (auto arg: call->args) {
+            params.push_back({ Token::invalid, arg->type });
+        }
+        auto func = dynamic_cast<Function*>(_analyzer.lookupFunction(call->name.contents, params));
+        if (!func || !func->isConstEval()) {
+            return fail(call, "'" + call->name.contents + "' is not a const func, so cannot be called at compile time");
+        }
+        if (_analyzer.isAnalyzing(func)) {
+            return fail(call, "'" + call->name.contents + "' cannot be called at compile time from within its own definition");
+        }
+        if (_frames.size() >= INTERPRETER_DEPTH_LIMIT) {
+            return fail(call, "Compile-time evaluation exceeded " + std::to_string(INTERPRETER_DEPTH_LIMIT) + " nested calls");
+        }
+        Scope parameters;
+        for (size_t i = 0; i < call->args.size(); i++) {
+            Value arg;
+            if (!eval(call->args[i], arg)) return false;
+            parameters[func->parameters()[i].name.contents] = arg;
+        }
+        _frames.push_back({ parameters });
+        bool returned = false;
+        bool succeeded = true;
+        for (auto stm: func->body()) {
+            if (!(succeeded = execute(stm, returned)) || returned) break;
+        }
+        _frames.pop_back();
+        if (!succeeded) return false;
+        result = _returnValue;
+        return true;
+    }
+    bool Interpreter::reference(Expression* expr, Value*& slot) {
+        if (auto symbol = dynamic_cast<SymbolExpression*>(expr)) {
+            slot = local(symbol->value().contents);
+            return slot || fail(expr, "Only locals can be assigned to at compile time");
+        } else if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
+            const TokenType op = binary->op()->tkntype();
+            if (op == TokenType::dot && binary->left()) {
+                Value* aggregate;
+                if (!reference(binary->left(), aggregate)) return false;
+                auto member = dynamic_cast<SymbolExpression*>(binary->right());
+                if (!member || aggregate->kind != Value::Kind::aggregate) {
+                    return fail(expr, "Member cannot be assigned to at compile time");
+                }
+                size_t index = 0;
+                for (auto data: binary->left()->type->structValue()->dataMembers()) {
+                    if (auto var = dynamic_cast<VarStatement*>(data)) {
+                        if (var->name().contents == member->value().contents) {
+                            slot = &aggregate->elements[index];
+                            return true;
+                        }
+                        index++;
+                    }
+                }
+            } else if (op == TokenType::leftBracket && binary->left()) {
+                Value* array;
+                Value index;
+                if (!reference(binary->left(), array) || !eval(binary->right(), index)) return false;
+                if (array->kind != Value::Kind::aggregate || index.bits >= array->elements.size()) {
+                    return fail(expr, "Index out of bounds during compile-time evaluation");
+                }
+                slot = &array->elements[index.bits];
+                return true;
+            }
+        }
+        return fail(expr, "Expression cannot be assigned to at compile time");
+    }
+    bool Interpreter::evalBinary(BinaryExpression* binary, Value& result) {
+        const TokenType op = binary->op()->tkntype();
+        Expression* left = binary->left();
+        Expression* right = binary->right();
+        if (!left) { // prefix operators
+            Value operand;
+            if (!eval(right, operand)) return false;
+            switch (op) {
+                case TokenType::minus:
+                    if (operand.kind == Value::Kind::real) {
+                        result = operand;
+                        result.real = -operand.real;
+                    } else {
+                        result = scalar(-operand.bits, binary->type);
+                    }
+                    return true;
+                case TokenType::invert:
+                    result = scalar(~operand.bits, binary->type);
+                    return true;
+                case TokenType::bool_not:
+                    result = scalar(!operand.bits, binary->type);
+                    return true;
+                default:
+                    return fail(binary, "Pointers cannot be evaluated at compile time");
+            }
+        }
+        switch (op) {
+            case TokenType::dot: {
+                Value aggregate;
+                if (!eval(left, aggregate)) return false;
+                auto member = dynamic_cast<SymbolExpression*>(right);
+                if (!member || aggregate.kind != Value::Kind::aggregate) {
+                    return fail(binary, "Member functions cannot be called at compile time");
+                }
+                size_t index = 0;
+                for (auto data: left->type->structValue()->dataMembers()) {
+                    if (auto var = dynamic_cast<VarStatement*>(data)) {
+                        if (var->name().contents == member->value().contents) {
+                            result = aggregate.elements[index];
+                            return true;
+                        }
+                        index++;
+                    }
+                }
+                return fail(binary, "No such member");
+            }
+            case TokenType::leftBracket: {
+                Value array, index;
+                if (!eval(left, array) || !eval(right, index)) return false;
+                if (array.kind != Value::Kind::aggregate || index.bits >= array.elements.size()) {
+                    return fail(binary, "Index out of bounds during compile-time evaluation");
+                }
+                result = array.elements[index.bits];
+                return true;
+            }
+            case TokenType::bool_and:
+            case TokenType::bool_or: {
+                bool lhs;
+                if (!evalCondition(left, lhs)) return false;
+                if (lhs == (op == TokenType::bool_or)) {
+                    result = scalar(lhs, binary->type);
+                    return true;
+                }
+                bool rhs;
+                if (!evalCondition(right, rhs)) return false;
+                result = scalar(rhs, binary->type);
+                return true;
+            }
+            case TokenType::plusEqu:
+            case TokenType::minusEq:
+            case TokenType::mulEq:
+            case TokenType::divEq:
+            case TokenType::modEq:
+            case TokenType::bit_andEq:
+            case TokenType::bit_orEq:
+            case TokenType::bit_xorEq: {
+                static const std::map<TokenType, TokenType> arithmetic = {
+                    { TokenType::plusEqu, TokenType::plus }, { TokenType::minusEq, TokenType::minus },
+                    { TokenType::mulEq, TokenType::multiply }, { TokenType::divEq, TokenType::divide },
+                    { TokenType::modEq, TokenType::modulus }, { TokenType::bit_andEq, TokenType::bit_and },
+                    { TokenType::bit_orEq, TokenType::bit_or }, { TokenType::bit_xorEq, TokenType::bit_xor }
+                };
+                Value rhs;
+                if (!eval(right, rhs)) return false;
+                Value* slot;
+                if (!reference(left, slot)) return false;
+                if (!evalArithmetic(binary, arithmetic.at(op), *slot, rhs, result)) return false;
+                *slot = result;
+                return true;
+            }
+            default: {
+                Value lhs, rhs;
+                if (!eval(left, lhs) || !eval(right, rhs)) return false;
+                return evalArithmetic(binary, op, lhs, rhs, result);
+            }
+        }
+    }
+    bool Interpreter::evalArithmetic(BinaryExpression* binary, TokenType op, const Value& lhs, const Value& rhs, Value& result) {
+        if (lhs.kind == Value::Kind::aggregate || rhs.kind == Value::Kind::aggregate) {
+            return fail(binary, "Operator cannot be applied to an aggregate at compile time");
+        }
+        const Type* type = binary->left()->type; // the operands', which a comparison's result is not
+        if (lhs.kind == Value::Kind::real || rhs.kind == Value::Kind::real) {
+            const double x = lhs.real, y = rhs.real;
+            result = {};
+            result.kind = Value::Kind::real;
+            switch (op) {
+                case TokenType::plus: result.real = x + y; return true;
+                case TokenType::minus: result.real = x - y; return true;
+                case TokenType::multiply: result.real = x * y; return true;
+                case TokenType::divide: result.real = x / y; return true;
+                case TokenType::equal: result = scalar(x == y, binary->type); return true;
+                case TokenType::unequal: result = scalar(x != y, binary->type); return true;
+                case TokenType::less: result = scalar(x < y, binary->type); return true;
+                case TokenType::lessEqual: result = scalar(x <= y, binary->type); return true;
+                case TokenType::greater: result = scalar(x > y, binary->type); return true;
+                case TokenType::greaterEqual: result = scalar(x >= y, binary->type); return true;
+                default: return fail(binary, "Operator cannot be applied to a Float at compile time");
+            }
+        }
+        const bool isSigned = !type || type->isSigned();
+        const uint64_t x = lhs.bits, y = rhs.bits;
+        const int64_t sx = static_cast<int64_t>(x), sy = static_cast<int64_t>(y);
+        switch (op) {
+            case TokenType::plus: result = scalar(x + y, binary->type); return true;
+            case TokenType::minus: result = scalar(x - y, binary->type); return true;
+            case TokenType::multiply: result = scalar(x * y, binary->type); return true;
+            case TokenType::divide:
+            case TokenType::modulus: {
+                if (!y) return fail(binary, "Division by zero during compile-time evaluation");
+                if (isSigned && sy == -1 && sx == INT64_MIN) return fail(binary, "Signed division overflows during compile-time evaluation");
+                const bool remainder = op == TokenType::modulus;
+                const uint64_t bits = isSigned ? static_cast<uint64_t>(remainder ? sx % sy : sx / sy) : (remainder ? x % y : x / y);
+                result = scalar(bits, binary->type);
+                return true;
+            }
+            case TokenType::bit_and: result = scalar(x & y, binary->type); return true;
+            case TokenType::bit_or: result = scalar(x | y, binary->type); return true;
+            case TokenType::bit_xor: result = scalar(x ^ y, binary->type); return true;
+            case TokenType::bool_xor: result = scalar((x != 0) != (y != 0), binary->type); return true;
+            case TokenType::equal: result = scalar(x == y, binary->type); return true;
+            case TokenType::unequal: result = scalar(x != y, binary->type); return true;
+            case TokenType::less: result = scalar(isSigned ? sx < sy : x < y, binary->type); return true;
+            case TokenType::lessEqual: result = scalar(isSigned ? sx <= sy : x <= y, binary->type); return true;
+            case TokenType::greater: result = scalar(isSigned ? sx > sy : x > y, binary->type); return true;
+            case TokenType::greaterEqual: result = scalar(isSigned ? sx >= sy : x >= y, binary->type); return true;
+            default: return fail(binary, "Operator cannot be evaluated at compile time");
+        }
+    }
+}
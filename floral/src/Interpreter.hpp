@@ -0,0 +1,70 @@
+#ifndef Interpreter_hpp
+#define Interpreter_hpp
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AST.hpp"
+
+#define INTERPRETER_STEP_LIMIT 1000000 // statements and expressions one evaluation may run
+#define INTERPRETER_DEPTH_LIMIT 256 // nested calls one evaluation may make
+
+namespace Floral {
+    class StaticAnalyzer;
+
+    // Runs calls to `const func` functions while the program is analyzed, so their results can be
+    // compiled as constants. Only pure code is modeled: integers, Bools and Floats, and arrays and
+    // structs of them. Anything else stops the evaluation, leaving the reason in failure().
+    class Interpreter {
+    public:
+        struct Value {
+            enum class Kind {
+                scalar, real, aggregate
+            };
+            Kind kind = Kind::scalar;
+            uint64_t bits {}; // an integer or Bool, already truncated to its type
+            double real {};
+            std::vector<Value> elements; // array elements, or struct members in declaration order
+        };
+
+    private:
+        typedef std::unordered_map<std::string, Value> Scope;
+        StaticAnalyzer& _analyzer;
+        std::vector<std::vector<Scope>> _frames; // the scopes of each call being run
+        std::map<const Expression*, Value> _results; // every expression evaluated so far
+        Value _returnValue;
+        size_t _steps {};
+        std::string _failure;
+        const Node* _failureNode {};
+
+        bool fail(const Node* node, const std::string& text);
+        bool step(const Node* node);
+        bool execute(Statement* stm, bool& returned);
+        bool executeScoped(const std::vector<Node*>& body, bool& returned);
+        bool eval(Expression* expr, Value& result);
+        bool evalBinary(BinaryExpression* binary, Value& result);
+        bool evalArithmetic(BinaryExpression* binary, TokenType op, const Value& lhs, const Value& rhs, Value& result);
+        bool evalCall(Call* call, Value& result);
+        bool evalSymbol(SymbolExpression* symbol, Value& result);
+        bool evalCondition(Expression* expr, bool& result);
+        bool reference(Expression* expr, Value*& slot);
+        Value* local(const std::string& name);
+
+    public:
+        Interpreter(StaticAnalyzer& analyzer);
+
+        bool evaluate(Expression* expr, Value& result);
+        bool evaluated(const Expression* expr, Value& result) const;
+        const std::string& failure() const;
+        const Node* failureNode() const;
+        void reset();
+
+        static Value zero(const Type* type);
+        static Value scalar(uint64_t bits, const Type* type);
+        static std::string image(const Value& value, const Type* type);
+        static std::string describe(const Value& value, const Type* type);
+    };
+}
+
+#endif /* Interpreter_hpp */
@@ -9,10 +9,9 @@
 #include "Lexer.hpp"
 #include "File IO.hpp"
 #include "LexerKeywords.h"
-#include "LexerOperators.h"
 
 namespace Floral { namespace v2 {
-    Lexer::Lexer(const std::string& source, const std::string& filename, const CommandParser& commandParser): _preprocessor(source, filename), _commandParser(commandParser) {}
+    Lexer::Lexer(const std::string& source, const std::string& filename): _preprocessor(source, filename), _filename(filename) {}
     bool Lexer::hasErrors() const {
         return !_errors.empty();
     }
@@ -26,9 +25,260 @@ namespace Floral { namespace v2 {
         return _warnings;
     }
     const std::vector<Token>& Lexer::lex() {
+        reset();
+        _preprocessor.preprocess();
+        for (auto &warning: _preprocessor.warnings()) _warnings.push_back(warning);
+        for (auto &error: _preprocessor.errors()) _errors.push_back(error);
+        // diagnostics expect a newline before every line, the first one too, but it is not a line of the file
+        _source = '\n' + _preprocessor.preprocessedSource();
+        _line = 0;
+        if (hasErrors()) return _tokens;
+        
+        while (skipSpaceAndComments()) {
+            const char c = current();
+            if (c == 'W' && (current(1) == '\'' || current(1) == '\"')) {
+                wide();
+            } else if (isdigit(c)) {
+                number();
+            } else if (isalpha(c) || c == '_') {
+                word();
+            } else if (c == '\"') {
+                string();
+            } else if (c == '\'') {
+                character();
+            } else {
+                symbol();
+            }
+        }
         return _tokens;
     }
     const Preprocessor& Lexer::preprocessor() const {
         return _preprocessor;
     }
+    const std::string& Lexer::source() const {
+        return _source;
+    }
+    
+    // MARK: Reading the source
+    void Lexer::reset() {
+        _tokens.clear();
+        _index = 0;
+        _line = 1;
+        _column = 1;
+    }
+    char Lexer::current(size_t ahead) const {
+        return _index + ahead < _source.size() ? _source[_index + ahead] : '\0';
+    }
+    void Lexer::advance(size_t count) {
+        for (; count && _index < _source.size(); count--) {
+            if (_source[_index] == '\n') {
+                _line++; _column = 1;
+            } else {
+                _column++;
+            }
+            _index++;
+        }
+    }
+    TokenLoc Lexer::here() const {
+        return { _index, _line, _column, _filename };
+    }
+    void Lexer::fail(const std::string& text, const std::string& fix) {
+        report(Error::lexDomain, text, _filename, TextRegion(_index, 1, _line, _line), ErrorLoc(_index, 1), fix);
+    }
+    bool Lexer::skipSpaceAndComments() {
+        while (_index < _source.size()) {
+            if (isspace(current())) {
+                advance();
+            } else if (current() == '/' && current(1) == '/') {
+                while (_index < _source.size() && current() != '\n') advance();
+            } else if (current() == '/' && current(1) == '*') {
+                advance(2);
+                while (_index < _source.size() && !(current() == '*' && current(1) == '/')) advance();
+                if (_index >= _source.size()) {
+                    fail("Unexpected end of file in comment", "Close the comment with */");
+                    return false;
+                }
+                advance(2);
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // MARK: Tokens
+    void Lexer::word() {
+        const TokenLoc loc = here();
+        const size_t start = _index;
+        while (isalnum(current()) || current() == '_') advance();
+        const std::string id { _source.substr(start, _index - start) };
+        const auto keyword = keywordMap.find(id);
+        _tokens.push_back({ loc, keyword == keywordMap.end() ? TokenType::identifier : keyword->second, id });
+    }
+    void Lexer::number() {
+        const TokenLoc loc = here();
+        std::string num;
+        if (current() == '0' && current(1) == 'x') {
+            advance(2);
+            while (isxdigit(current()) || current() == '_') {
+                if (current() != '_') num.push_back(current());
+                advance();
+            }
+            _tokens.push_back({ loc, TokenType::numIntHex, num });
+            return;
+        }
+        bool dot { false };
+        while (isdigit(current()) || current() == '_' || (!dot && current() == '.' && isdigit(current(1)))) {
+            if (current() == '.') dot = true;
+            if (current() != '_') num.push_back(current());
+            advance();
+        }
+        if (dot) {
+            _tokens.push_back({ loc, TokenType::numFloating, num });
+            return;
+        }
+        uint8_t flags {};
+        while (strchr("ubwdc", current()) && current()) {
+            flags |= 1 << (strchr("ubwdc", current()) - "ubwdc");
+            advance();
+        }
+        TokenType type;
+        switch (flags) {
+            case 0b00000: type = TokenType::numIntDec; break;
+            case 0b00001: type = TokenType::numUIntDec; break;
+            case 0b00010: type = TokenType::numByteDec; break;
+            case 0b00011: type = TokenType::numUByteDec; break;
+            case 0b00100: type = TokenType::numShortDec; break;
+            case 0b00101: type = TokenType::numUShortDec; break;
+            case 0b01000: type = TokenType::numInt32Dec; break;
+            case 0b01001: type = TokenType::numUInt32Dec; break;
+            case 0b10000: type = TokenType::numWideChar; break;
+            case 0b10001: type = TokenType::numWideUChar; break;
+            default:
+                fail("Unknown integer type suffix");
+                type = TokenType::invalid;
+                break;
+        }
+        _tokens.push_back({ loc, type, num });
+    }
+    // Escapes stay in the contents, as the compiler expands them when it emits the string
+    void Lexer::string() {
+        const TokenLoc loc = here();
+        advance();
+        const size_t start = _index;
+        while (_index < _source.size() && current() != '\"') {
+            advance(current() == '\\' ? 2 : 1);
+        }
+        if (_index >= _source.size()) {
+            fail("Unexpected end of file in string literal", "Close the string with a double quote");
+            return;
+        }
+        _tokens.push_back({ loc, TokenType::asciiString, _source.substr(start, _index - start) });
+        advance();
+    }
+    static char escaped(char c) {
+        switch (c) {
+            case 'n': return '\n';
+            case 'e': return '\e';
+            case 't': return '\t';
+            case 'r': return '\r';
+            case '0': return '\0';
+            default: return c; // \\, \' and \" stand for themselves
+        }
+    }
+    void Lexer::character() {
+        const TokenLoc loc = here();
+        advance();
+        if (current() == '\n') {
+            fail("Unexpected newline in character literal", "Did you mean to use '\\n' instead?");
+            return;
+        }
+        char c = current();
+        if (c == '\\') {
+            advance();
+            c = escaped(current());
+        }
+        advance();
+        if (current() != '\'') {
+            fail("Missing single quote in character literal", "Replace this position with a single quote");
+            return;
+        }
+        advance();
+        _tokens.push_back({ loc, TokenType::numByteDec, std::to_string(static_cast<int>(c)) });
+    }
+    
+    // UTF-8 in the source becomes UTF-32 code points, with escapes expanded
+    static std::vector<FloralWideChar> codepoints(const std::string& text) {
+        std::vector<FloralWideChar> result;
+        for (size_t i = 0; i < text.size();) {
+            const uint8_t c = text[i];
+            if (c == '\\' && i + 1 < text.size()) {
+                if (text[i + 1] == 'u') {
+                    result.push_back(static_cast<FloralWideChar>(strtoul(text.substr(i + 2, 4).c_str(), nullptr, 16)));
+                    i += 6;
+                } else {
+                    result.push_back(escaped(text[i + 1]));
+                    i += 2;
+                }
+                continue;
+            }
+            const int length = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : 4;
+            FloralWideChar codepoint = length == 1 ? c : c & (0xFF >> (length + 1));
+            for (int k = 1; k < length && i + k < text.size(); k++) {
+                codepoint = (codepoint << 6) | (text[i + k] & 0x3F);
+            }
+            result.push_back(codepoint);
+            i += length;
+        }
+        return result;
+    }
+    void Lexer::wide() {
+        const TokenLoc loc = here();
+        const char quote = current(1);
+        advance(2);
+        const size_t start = _index;
+        while (_index < _source.size() && current() != quote) {
+            advance(current() == '\\' ? 2 : 1);
+        }
+        if (_index >= _source.size()) {
+            fail(quote == '\'' ? "Unexpected end of file in wide character literal" : "Unexpected end of file in wide string literal");
+            return;
+        }
+        const std::vector<FloralWideChar> wstr { codepoints(_source.substr(start, _index - start)) };
+        advance();
+        if (quote == '\"') {
+            _tokens.push_back({ loc, TokenType::wideString, "", wstr });
+        } else if (wstr.size() == 1) {
+            _tokens.push_back({ loc, TokenType::numWideChar, std::to_string(wstr.front()) });
+        } else {
+            fail("Wide character literal must hold exactly one character");
+        }
+    }
+    void Lexer::symbol() {
+        // Longer spellings come first so that they win over their prefixes
+        static const std::pair<const char*, TokenType> symbols[] {
+            { "->", TokenType::arrow }, { "<-", TokenType::backarrow }, { "::", TokenType::scopeResolve },
+            { "++", TokenType::inc }, { "--", TokenType::dec }, { "**", TokenType::power },
+            { "+=", TokenType::plusEqu }, { "-=", TokenType::minusEq }, { "*=", TokenType::mulEq }, { "/=", TokenType::divEq },
+            { "%=", TokenType::modEq }, { "&=", TokenType::bit_andEq }, { "|=", TokenType::bit_orEq }, { "^=", TokenType::bit_xorEq },
+            { "&&", TokenType::bool_and }, { "||", TokenType::bool_or }, { "^^", TokenType::bool_xor },
+            { "==", TokenType::equal }, { "!=", TokenType::unequal }, { "<=", TokenType::lessEqual }, { ">=", TokenType::greaterEqual },
+            { "(", TokenType::leftParenthesis }, { ")", TokenType::rightParenthesis }, { "{", TokenType::leftBrace }, { "}", TokenType::rightBrace },
+            { "[", TokenType::leftBracket }, { "]", TokenType::rightBracket }, { ";", TokenType::semicolon }, { ":", TokenType::colon },
+            { ",", TokenType::comma }, { ".", TokenType::dot }, { "+", TokenType::plus }, { "-", TokenType::minus },
+            { "*", TokenType::multiply }, { "/", TokenType::divide }, { "%", TokenType::modulus }, { "=", TokenType::assign },
+            { "!", TokenType::bool_not }, { "~", TokenType::invert }, { "&", TokenType::bit_and }, { "|", TokenType::bit_or },
+            { "^", TokenType::bit_xor }, { "<", TokenType::less }, { ">", TokenType::greater }
+        };
+        for (auto &symbol: symbols) {
+            const size_t length = strlen(symbol.first);
+            if (_source.compare(_index, length, symbol.first) == 0) {
+                _tokens.push_back({ here(), symbol.second, symbol.first });
+                advance(length);
+                return;
+            }
+        }
+        fail(std::string("Unexpected character '") + current() + "' in source code");
+        advance();
+    }
 }}
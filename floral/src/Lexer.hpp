@@ -102,6 +102,7 @@ namespace Floral {
             std::vector<std::string> _fileStack;
             std::vector<FileRegion> _fileResolutionMap;
             std::unordered_map<std::string, Macro> _defines;
+            std::vector<std::string> _includes; // every file read by #include, nested ones too
             
             const bool match(const std::string& nextString);
             const bool processPotentialExpansion();
@@ -111,6 +112,7 @@ namespace Floral {
             const std::string stringTill(const char* terminators);
             const std::string& currentFile() const;
             void push(const char current);
+            void pushLiteralOrComment(); // copied as is, so nothing in it is expanded or taken as a directive
             void reset();
             
         public:
@@ -119,6 +121,7 @@ namespace Floral {
             
             const std::string& source() const;
             const std::string& preprocessedSource() const;
+            const std::vector<std::string>& includes() const;
             const FileLocation resolveLocation(size_t pos) const;
             const bool lookupMacro(const std::string& macro, Macro& value) const;
             
@@ -130,12 +133,27 @@ namespace Floral {
         class Lexer: public ErrorReporting {            
             std::vector<Token> _tokens;
             Preprocessor _preprocessor;
-            const CommandParser& _commandParser;
+            std::string _filename;
+            std::string _source;
+            size_t _index;
+            size_t _line;
+            size_t _column;
             
             void reset();
+            char current(size_t ahead = 0) const;
+            void advance(size_t count = 1);
+            TokenLoc here() const;
+            void fail(const std::string& text, const std::string& fix = "");
+            bool skipSpaceAndComments(); // false once the source is used up
+            void word();
+            void number();
+            void string();
+            void character();
+            void wide();
+            void symbol();
             
         public:
-            Lexer(const std::string& source, const std::string& filename, const CommandParser& commandParser);
+            Lexer(const std::string& source, const std::string& filename);
             
             virtual bool hasErrors() const override;
             virtual const std::vector<Error>& errors() const override;
@@ -143,7 +161,8 @@ namespace Floral {
             virtual const std::vector<Error>& warnings() const override;
             
             const Preprocessor& preprocessor() const;
-            const std::vector<Token>& lex();
+            const std::string& source() const; // what lex() tokenized, which token positions index into
+            const std::vector<Token>& lex(); // preprocesses the source, then tokenizes what the preprocessor produced
         };
     }
 }
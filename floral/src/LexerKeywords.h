@@ -54,6 +54,9 @@ namespace Floral {
         { "DWord", TokenType::uint32Type },
         { "UInt32", TokenType::uint32Type },
         { "UnsignedDWord", TokenType::uint32Type },
+        { "Float", TokenType::floatType },
+        { "Float64", TokenType::floatType },
+        { "Double", TokenType::floatType },
         { "Bool", TokenType::boolType },
         { "Void", TokenType::voidType },
         { "return", TokenType::return_ },
@@ -10,6 +10,7 @@
 #include <cassert>
 #define MOST_CONST(l, r) ((l)->isConst() ? (l) : (r))
 #define CONSTEST(l, r) ((l)->isConst() || (r)->isConst())
+#define ARITHMETIC(l, r) ((l)->isNumber() && (r)->isNumber() && (l)->isFloat() == (r)->isFloat()) // Floats never mix implicitly with integers
 
 namespace Floral {
     Operator::Operator(TokenType type): _type(type) {
@@ -19,35 +20,39 @@ namespace Floral {
         switch (_type) {
             case TokenType::plus: {
                 if (!left && right) return right->isNumber() ? right : nullptr; // +Number (+1, +3.14)
-                if (left && right && left->isPointer() && right->isNumber()) return left;
-                if (left && right) return (left->isNumber() && right->isNumber())/* || (left->isString() && right->isString()) */? MOST_CONST(left, right) : nullptr; // Number+Number or String+String (2+3, "h" + "i")
+                if (left && right && left->isPointer() && right->isInteger()) return left;
+                if (left && right) return ARITHMETIC(left, right)/* || (left->isString() && right->isString()) */? MOST_CONST(left, right) : nullptr; // Number+Number or String+String (2+3, "h" + "i")
                 return nullptr;
             }
             case TokenType::minus: {
-                if (!left && right) return(right->isNumber() && right->isSigned()) ? right : nullptr; // -Number (-1, -3.14)
-                if (left && right) return (left->isPointer() && right->isNumber() ? left : (left->isNumber() && right->isNumber() ? MOST_CONST(left, right) : nullptr)); // Number-Number (2-3, 5.8-3.2)
+                if (!left && right) return(right->isNumber() && (right->isSigned() || right->isFloat())) ? right : nullptr; // -Number (-1, -3.14)
+                if (left && right) return (left->isPointer() && right->isInteger() ? left : (ARITHMETIC(left, right) ? MOST_CONST(left, right) : nullptr)); // Number-Number (2-3, 5.8-3.2)
                 return nullptr;
             }
             case TokenType::multiply: {
                 if (!left && right) return right->isPointer() ? GET_PTRTYYPE(right) : nullptr; // *Pointer (*ptr, *null)
-                if (left && right) return (left->isNumber() && right->isNumber()) ? MOST_CONST(left, right) : nullptr; // Number*Number (3*7, 4*0.5)
+                if (left && right) return ARITHMETIC(left, right) ? MOST_CONST(left, right) : nullptr; // Number*Number (3*7, 4*0.5)
                 return nullptr;
             }
             case TokenType::divide: {
-                if (left && right) return (left->isNumber() && right->isNumber()) ? MOST_CONST(left, right) : nullptr; // Number/Number (3/7, 4/0.5)
+                if (left && right) return ARITHMETIC(left, right) ? MOST_CONST(left, right) : nullptr; // Number/Number (3/7, 4/0.5)
+                return nullptr;
+            }
+            case TokenType::modulus: {
+                if (left && right) return (left->isInteger() && right->isInteger()) ? MOST_CONST(left, right) : nullptr; // Integer%Integer (7%3)
                 return nullptr;
             }
             case TokenType::plusEqu:
             case TokenType::minusEq:
             case TokenType::mulEq:
             case TokenType::divEq: {
-                if (left && right && left->isPointer() && right->isNumber()) return left;
-                if (left && right) return (left->isNumber() && right->isNumber()) ? MOST_CONST(left, right) : nullptr;
+                if (left && right && left->isPointer() && right->isInteger()) return left;
+                if (left && right) return ARITHMETIC(left, right) ? MOST_CONST(left, right) : nullptr;
                 return nullptr;
             }
             case TokenType::bit_and: {
                 if (left && right) {
-                    if (left->isNumber() && right->isNumber()) return MOST_CONST(left, right);
+                    if (left->isInteger() && right->isInteger()) return MOST_CONST(left, right);
                     else if (left->isBool() && right->isBool()) return new Type(new Token(TokenLoc::zero, TokenType::boolType, "Bool"), CONSTEST(left, right));
                     else return nullptr;
                 }
@@ -62,6 +67,11 @@ namespace Floral {
                 if (left && right && *left == *right) return new Type(new Token(TokenLoc::zero, TokenType::boolType, "Bool"), CONSTEST(left, right));
                 else return nullptr;
             }
+            case TokenType::bool_and:
+            case TokenType::bool_or: {
+                if (left && right && left->isBool() && right->isBool()) return new Type(new Token(TokenLoc::zero, TokenType::boolType, "Bool"), CONSTEST(left, right));
+                else return nullptr;
+            }
             case TokenType::bit_or:
             case TokenType::bit_xor: {
                 if (left && right) (
@@ -71,11 +81,11 @@ namespace Floral {
             }
             case TokenType::bool_not:
             case TokenType::invert: {
-                if (!left && right) return right->isBool() ? new Type(new Token(TokenLoc::zero, TokenType::boolType, "Bool"), right->isConst()) : (right->isNumber() ? right : nullptr);
+                if (!left && right) return right->isBool() ? new Type(new Token(TokenLoc::zero, TokenType::boolType, "Bool"), right->isConst()) : (right->isInteger() ? right : nullptr);
             }
             case TokenType::leftBracket: {
                 if (left && right) return (
-                    left->isPointer() && right->isNumber()
+                    left->isPointer() && right->isInteger()
                 ) ? GET_PTRTYYPE(left) : nullptr;
             }
             default:
@@ -18,6 +18,8 @@ namespace Floral {
     void Parser::reset() {
         _errors.clear();
         index = 0;
+        _structs.clear();
+        _typealiases.clear();
     }
 
     Token Parser::current() {
@@ -99,11 +101,21 @@ namespace Floral {
         }
     }
 
+    StructDeclaration* Parser::structNamed(const std::string& name) const {
+        auto iter = std::find_if(_structs.begin(), _structs.end(), [&name](StructDeclaration* struct_) {
+            return struct_->name().contents == name;
+        });
+        return iter != _structs.end() ? *iter : nullptr;
+    }
+    bool Parser::isType(const Token& token) const {
+        return token.isType() || structNamed(token.contents);
+    }
+
     Type* Parser::type() {
         bool isConst{};
         if (current().type == TokenType::const_) isConst = true, pacman();
-        auto aliased = Type::typealiases.find(current().contents);
-        if (aliased != Type::typealiases.end()) {
+        auto aliased = _typealiases.find(current().contents);
+        if (aliased != _typealiases.end()) {
             pacman();
             return aliased->second;
         }
@@ -111,9 +123,9 @@ namespace Floral {
             pacman();
             const auto structName = match(TokenType::identifier, " in struct type");
             if (structName.isInvalid()) return nullptr;
-            return new Type(0, structName.contents, isConst);
+            return new Type(structNamed(structName.contents), isConst);
         }
-        if (current().isType()) {
+        if (isType(current())) {
             auto t { new Type(new Token(current().loc, current().type, current().contents), isConst) };
             pacman();
             
@@ -122,6 +134,15 @@ namespace Floral {
                 return new Type(t, type(), isConst);
             } else if (current().type == TokenType::leftBracket) {
                 pacman();
+                if (current().type != TokenType::numIntDec || peek().type != TokenType::rightBracket) {
+                    // any other length is evaluated once the program is analyzed
+                    Expression* length = expr(false);
+                    if (!length) return nullptr;
+                    if (match(TokenType::rightBracket, " in array type").isInvalid()) return nullptr;
+                    Type* arrt = new Type(t, size_t {}, true);
+                    arrt->_lengthExpr = length;
+                    return arrt;
+                }
                 const size_t l = strtoul(current().contents.c_str(), NULL, 10);
                 pacman();
                 if (match(TokenType::rightBracket, " in array type").isInvalid()) return nullptr;
@@ -132,7 +153,7 @@ namespace Floral {
         switch (current().type) {
             case TokenType::bit_and:
                 pacman();
-                if (current().isType() || current().type == TokenType::leftParenthesis || current().type == TokenType::leftBracket || current().type == TokenType::bit_and || current().type == TokenType::const_ || current().type == TokenType::struct_) {
+                if (isType(current()) || current().type == TokenType::leftParenthesis || current().type == TokenType::leftBracket || current().type == TokenType::bit_and || current().type == TokenType::const_ || current().type == TokenType::struct_) {
                     auto t = type();
                     return new Type(t, true, isConst);
                 } else {
@@ -283,7 +304,7 @@ namespace Floral {
         Function::Parameters parameters;
         while (!eof() && current().type != TokenType::rightParenthesis) {
             if (peek().type != TokenType::colon) {
-                parameters.push_back({ *Token::invalid, type() });
+                parameters.push_back({ Token::invalid, type() });
                 if (current().type != TokenType::rightParenthesis) {
                     if (match(TokenType::comma, " separating function parameters").isInvalid()) return nullptr;
                 }
@@ -299,7 +320,7 @@ namespace Floral {
         }
         if (match(TokenType::rightParenthesis, " in function").isInvalid()) return nullptr;
         // Return type
-        Type* rtype { new Type(Token::invalid, true) };
+        Type* rtype { new Type(new Token(Token::invalid), true) };
         if (current().type == TokenType::colon) {
             pacman();
             const Token typeStart = current();
@@ -349,6 +370,7 @@ namespace Floral {
         func->staticAllocationSize = 0;
         func->setInline(_attrs.find(Function::Attributes::inline_) != _attrs.end());
         func->setStatic(_attrs.find(Function::Attributes::static_) != _attrs.end());
+        func->setConstEval(_attrs.find(Function::Attributes::constEval) != _attrs.end());
         _attrs.clear();
         return func;
     }
@@ -356,7 +378,7 @@ namespace Floral {
         const Token start { current() };
         pacman();
         Token name { match(TokenType::identifier, " in global constant declaration") };
-        Type* gtype { new Type(Token::invalid) };
+        Type* gtype { new Type(new Token(Token::invalid)) };
         if (current().type == TokenType::colon) {
             pacman();
             gtype = type();
@@ -437,7 +459,7 @@ namespace Floral {
         const Token end = match(TokenType::semicolon, " at end of struct");
         if (end.isInvalid()) return nullptr;
         auto struct_ = new StructDeclaration({ start, end }, name, dataMembers, functionMembers, constructors);
-        Type::structs.push_back(struct_);
+        _structs.push_back(struct_);
         return struct_;
     }
 
@@ -468,6 +490,10 @@ namespace Floral {
                     _attrs.insert(Function::Attributes::inline_);
                     pacman();
                     break;
+                case TokenType::const_:
+                    _attrs.insert(Function::Attributes::constEval);
+                    pacman();
+                    break;
                 case TokenType::macro:
                     pacman();
                     break;
@@ -519,7 +545,7 @@ namespace Floral {
         const Token start { current() };
         pacman();
         const Token name { match(TokenType::identifier, " in local constant statement") };
-        Type* ltype { new Type(Token::invalid) };
+        Type* ltype { new Type(new Token(Token::invalid)) };
         if (current().type == TokenType::colon) {
             pacman();
             ltype = type();
@@ -559,7 +585,7 @@ namespace Floral {
         Token start { current() };
         pacman();
         Token name { match(TokenType::identifier, " in local variable statement") };
-        Type* vtype { new Type(Token::invalid) };
+        Type* vtype { new Type(new Token(Token::invalid)) };
         if (current().type == TokenType::colon) {
             pacman();
             vtype = type();
@@ -796,17 +822,15 @@ namespace Floral {
         } else if (current().isId()) {
             if (auto skip = isAhead(TokenType::leftParenthesis, { TokenType::identifier, TokenType::scopeResolve })) {
                 auto n = current();
-                auto iter = Type::typealiases.find(n.contents);
-                if (iter != Type::typealiases.end()) {
+                auto iter = _typealiases.find(n.contents);
+                if (iter != _typealiases.end()) {
                     auto t = iter->second;
                     if (!t->isStruct()) {
                         return nullptr;
                     }
                     n.contents = t->structValue()->name().contents;
                 }
-                if (std::find_if(Type::structs.begin(), Type::structs.end(), [n](StructDeclaration* s){
-                    return s->name().contents == n.contents;
-                }) != Type::structs.end()) {
+                if (structNamed(n.contents)) {
                     return constructexpr(n);
                 } else {
                     return callexpr();
@@ -879,7 +903,7 @@ namespace Floral {
         const Token end { match(TokenType::rightParenthesis, " in struct construction") };
         if (end.isInvalid()) return nullptr;
         TextRegion loc { name, end };
-        return new ConstructExpression(loc, n, arguments, ConstructExpression::Mode::stack);
+        return new ConstructExpression(loc, n, structNamed(n.contents), arguments, ConstructExpression::Mode::stack);
     }
     ReturnStatement* Parser::returnStm(bool checkSemicolon) {
         Token start { match(TokenType::return_, " in return statement") };
@@ -998,6 +1022,10 @@ namespace Floral {
                     _attrs.insert(Function::Attributes::inline_);
                     pacman();
                     break;
+                case TokenType::const_:
+                    _attrs.insert(Function::Attributes::constEval);
+                    pacman();
+                    break;
                 case TokenType::macro:
                     pacman();
                     break;
@@ -1060,13 +1088,11 @@ namespace Floral {
                 case TokenType::typealias: {
                     if (auto ta = typealias()) {
                         file->insert(ta);
-                        if (std::find_if(Type::typealiases.begin(), Type::typealiases.end(), [ta](auto pair){
-                            return pair.first == ta->alias().contents;
-                        }) != Type::typealiases.end()) {
+                        if (_typealiases.find(ta->alias().contents) != _typealiases.end()) {
                             report(Error::parseDomain, "Realiasing of synonym " + ta->alias().contents + " to different type", ta->_loc.path, ta->_loc, { ta->alias().pos(), ta->alias().contents.size() });
                             break;
                         }
-                        Type::typealiases.insert({ ta->alias().contents, ta->aliased() });
+                        _typealiases.insert({ ta->alias().contents, ta->aliased() });
                     } else {
                         synchronize();
                     }
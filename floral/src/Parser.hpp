@@ -12,6 +12,7 @@
 #include <cstddef>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include "Token.hpp"
 #include "AST.hpp"
 #include "Error.hpp"
@@ -65,6 +66,12 @@ namespace Floral {
         UnsafeCast* unsafecastexpr();
         ConstructExpression* constructexpr(const Token& n);
         
+        // Declared so far in this file, which decides whether a name is a type
+        std::vector<StructDeclaration*> _structs;
+        std::unordered_map<std::string, Type*> _typealiases;
+        StructDeclaration* structNamed(const std::string& name) const;
+        bool isType(const Token& token) const;
+        
         std::vector<Use> _use;
         std::set<Function::Attributes> _attrs;
         std::string _path;
@@ -8,6 +8,7 @@
 
 #include "Lexer.hpp"
 #include "File IO.hpp"
+#include <fstream>
 
 namespace Floral { namespace v2 {
     #define ERROR(msg) report(Error::prepError, #msg, currentFile(), TextRegion(index, 0, line, line), ErrorLoc(index, 0))
@@ -30,6 +31,9 @@ namespace Floral { namespace v2 {
     const std::string& Preprocessor::preprocessedSource() const {
         return _preprocessedSource;
     }
+    const std::vector<std::string>& Preprocessor::includes() const {
+        return _includes;
+    }
     const FileLocation Preprocessor::resolveLocation(size_t pos) const {
         for (auto range: _fileResolutionMap) {
             if (range.contains(pos)) {
@@ -120,7 +124,7 @@ namespace Floral { namespace v2 {
         return _fileStack.back();
     }
     void Preprocessor::push(const char current) {
-        if (!accepts.back()) {
+        if (!accepts.back() && current != '\n') { // lines left out still count, so later tokens keep their line numbers
             index++;
             return;
         }
@@ -131,6 +135,27 @@ namespace Floral { namespace v2 {
         index++;
         col++;
     }
+    void Preprocessor::pushLiteralOrComment() {
+        if (_source[index] == '/' && _source[index + 1] == '/') {
+            while (index < _source.size() && _source[index] != '\n') push(_source[index]);
+            return;
+        }
+        if (_source[index] == '/') {
+            push('/'); push('*');
+            while (index < _source.size() && !(_source[index] == '*' && _source[index + 1] == '/')) push(_source[index]);
+            if (index < _source.size()) {
+                push('*'); push('/');
+            }
+            return;
+        }
+        const char quote = _source[index];
+        push(quote);
+        while (index < _source.size() && _source[index] != quote && _source[index] != '\n') {
+            if (_source[index] == '\\') push('\\');
+            if (index < _source.size()) push(_source[index]);
+        }
+        if (_source[index] == quote) push(quote);
+    }
     void Preprocessor::reset() {
         index = 0;
         line = 1;
@@ -138,6 +163,9 @@ namespace Floral { namespace v2 {
         temp = 0;
         accepts = { true };
         _wrapQuotes = false;
+        _preprocessedSource.clear();
+        _fileResolutionMap.clear();
+        _includes.clear();
     }
     void Preprocessor::preprocess() {
         reset();
@@ -146,8 +174,16 @@ namespace Floral { namespace v2 {
                 index++;
             }
             const char current = _source[index];
+            if (current == '\"' || current == '\'' || (current == '/' && (_source[index + 1] == '/' || _source[index + 1] == '*'))) {
+                pushLiteralOrComment();
+                continue;
+            }
             if (isalpha(current) || current == '_') {
-                processPotentialExpansion();
+                // an expansion is spliced into the source after the macro, where it is read next
+                if (!processPotentialExpansion()) {
+                    while (isalnum(_source[index]) || _source[index] == '_') push(_source[index]);
+                }
+                continue;
             }
             if (current == ')' && _wrapQuotes) {
                 _preprocessedSource.push_back('\"');
@@ -186,6 +222,7 @@ namespace Floral { namespace v2 {
                     const char current = _source[index];
                     if (current == '\n') {
                         line++; col = 1; index++;
+                        _preprocessedSource.push_back('\n');
                         define(macro, arg, value);
                     } else {
                         ERROR(Expected newline after #define macro);
@@ -202,6 +239,7 @@ namespace Floral { namespace v2 {
                     const char current = _source[index];
                     if (current == '\n') {
                         line++; col = 1; index++;
+                        _preprocessedSource.push_back('\n');
                         undef(macro);
                     } else {
                         ERROR(Expected newline after #undef macro);
@@ -218,6 +256,7 @@ namespace Floral { namespace v2 {
                     }
                     if (current == '\n') {
                         line++; col = 1; index++;
+                        _preprocessedSource.push_back('\n');
                         if (isdef(macro)) {
                             accepts.push_back(true);
                         } else {
@@ -238,6 +277,7 @@ namespace Floral { namespace v2 {
                     const char current = _source[index];
                     if (current == '\n') {
                         line++; col = 1; index++;
+                        _preprocessedSource.push_back('\n');
                         if (isdef(macro)) {
                             accepts.push_back(false);
                         } else {
@@ -250,6 +290,7 @@ namespace Floral { namespace v2 {
                     const char current = _source[index];
                     if (current == '\n') {
                         line++; col = 1; index++;
+                        _preprocessedSource.push_back('\n');
                         accepts.pop_back();
                     } else {
                         ERROR(Expected newline after #endif macro);
@@ -263,7 +304,7 @@ namespace Floral { namespace v2 {
                     switch (_source[index]) {
                         case '<': {
                             index++;
-                            path = FLORAL_HDR(stringTill(">\n"));
+                            path = FLORAL_HDRS + stringTill(">\n") + ".fh";
                             if (_source[++index] == '\n') {
                                 line++; col = 1; index++;
                             } else {
@@ -274,6 +315,9 @@ namespace Floral { namespace v2 {
                         case '\"': {
                             index++;
                             path = stringTill("\"\n");
+                            if (!path.empty() && path.front() != '/' && path.front() != '~' && currentFile().rfind('/') != std::string::npos) { // beside the file including it
+                                path = currentFile().substr(0, currentFile().rfind('/') + 1) + path;
+                            }
                             if (_source[++index] == '\n') {
                                 line++; col = 1; index++;
                             } else {
@@ -287,7 +331,13 @@ namespace Floral { namespace v2 {
                     }
                     _fileResolutionMap.push_back({ temp, index, currentFile() });
                     temp = index;
+                    path = expandHome(path);
+                    if (!std::ifstream { path }) {
+                        ERROR(Unable to locate included file);
+                        continue;
+                    }
                     _fileStack.push_back(path);
+                    _includes.push_back(path);
                     std::string buffer;
                     read(path, buffer);
                     Preprocessor preprocessor(buffer, path);
@@ -295,6 +345,7 @@ namespace Floral { namespace v2 {
                         preprocessor._defines.insert({ pair.first, pair.second });
                     }
                     preprocessor.preprocess();
+                    _defines = preprocessor._defines; // what a header defines holds for the rest of the file too
                     for (auto error: preprocessor._errors) {
                         _errors.push_back(error);
                     }
@@ -302,6 +353,7 @@ namespace Floral { namespace v2 {
                         _warnings.push_back(warning);
                     }
                     _preprocessedSource += preprocessor.preprocessedSource();
+                    _includes.insert(_includes.end(), preprocessor._includes.begin(), preprocessor._includes.end());
                     _fileStack.pop_back();
                     _fileResolutionMap.push_back({ temp, index, path });
                     temp = index;
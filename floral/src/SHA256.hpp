@@ -0,0 +1,26 @@
+#ifndef SHA256_hpp
+#define SHA256_hpp
+
+#include <string>
+#include <cstdint>
+
+namespace Floral {
+    // Incremental SHA-256, so a digest can be taken over several pieces without joining them first
+    class SHA256 {
+        uint32_t _state[8];
+        unsigned char _block[64];
+        size_t _blockSize {};
+        uint64_t _length {};
+
+        void transform(const unsigned char* block);
+
+    public:
+        SHA256();
+
+        SHA256& update(const std::string& data);
+        SHA256& update(const void* data, size_t size);
+        std::string hex(); // the digest in lowercase hex; no more data may follow
+    };
+}
+
+#endif /* SHA256_hpp */
@@ -54,6 +54,24 @@ namespace Floral {
     }
 
 
+    // Whether an expression calls a function, so needs the interpreter to be evaluated
+    static bool containsCall(Expression* expr) {
+        if (!expr) return false;
+        if (dynamic_cast<Call*>(expr)) return true;
+        if (auto binary = dynamic_cast<BinaryExpression*>(expr)) {
+            return containsCall(binary->left()) || containsCall(binary->right());
+        }
+        if (auto cast = dynamic_cast<UnsafeCast*>(expr)) {
+            return containsCall(cast->expr());
+        }
+        if (auto arraylit = dynamic_cast<ArrayLiteralExpression*>(expr)) {
+            for (auto value: arraylit->values()) {
+                if (containsCall(value)) return true;
+            }
+        }
+        return false;
+    }
+
     int StaticAnalyzer::analyze(const File *file) {
         _path = file->path();
         pushScope();
@@ -202,6 +220,7 @@ namespace Floral {
             }
             popScope();
         } else if (auto let = dynamic_cast<LetStatement*>(stm)) {
+                   if (resolveArrayLength(const_cast<Type*>(let->type()), let) != 0) return 1;
                    const Initializer* init = let->initializer();
                    switch (init->type) {
                        case Initializer::zero: {
@@ -292,6 +311,7 @@ namespace Floral {
                        }
                    }
                } else if (auto var = dynamic_cast<VarStatement*>(stm)) {
+                   if (resolveArrayLength(var->type(), var) != 0) return 1;
                    const Initializer* init = var->initializer();
                    if (!init) {
                        if (_warnUninit) warn(
@@ -526,17 +546,23 @@ namespace Floral {
             } else {
                 globalSymbolTable[gbl->name.contents] = gbl;
             }
+            if (resolveArrayLength(gbl->type, gbl) != 0) return 1;
             auto initializer {gbl->initializer()};
             if (initializer->type == Initializer::zero) {
                 gbl->info.isStaticEval = true;
             } else if (auto direct = dynamic_cast<const DirectInitializer*>(initializer)) {
                 auto initexpr = direct->expr();
-                gbl->info.isStaticEval = isStaticEval(initexpr);
                 if (analyze(initexpr) != 0) return 1;
+                gbl->info.isStaticEval = isStaticEval(initexpr);
                 if (!gbl->info.isStaticEval) {
                     report(Error::compileDomain, "Global constant expression could not be statically evaluated", gbl->_loc.path, gbl->_loc, { initexpr->_loc.pos, initexpr->_loc.length });
                     return 1;
                 }
+                Interpreter::Value value;
+                if (containsCall(initexpr) && !_interpreter.evaluate(initexpr, value)) {
+                    reportEvaluationFailure("Global constant expression could not be evaluated", gbl);
+                    return 1;
+                }
                 Type* declaredType { gbl->type };
                 if (!declaredType->isIncomplete()) {
                     if (!(*declaredType == *initexpr->type)) {
@@ -558,13 +584,17 @@ namespace Floral {
                 scope().insert(gbl->name.contents, gbl->type, initexpr);
             } else if (auto copy = dynamic_cast<const CopyInitializer*>(initializer)) {
                 auto initexpr = copy->expr();
-                gbl->info.isStaticEval = isStaticEval(initexpr);
                 if (analyze(initexpr) != 0) return 1;
+                gbl->info.isStaticEval = isStaticEval(initexpr);
                 if (!gbl->info.isStaticEval) {
                     report(Error::compileDomain, "Global constant expression could not be statically evaluated", gbl->_loc.path, gbl->_loc, { initexpr->_loc.pos, initexpr->_loc.length });
                     return 1;
                 }
-                if (analyze(initexpr) != 0) return 1;
+                Interpreter::Value value;
+                if (containsCall(initexpr) && !_interpreter.evaluate(initexpr, value)) {
+                    reportEvaluationFailure("Global constant expression could not be evaluated", gbl);
+                    return 1;
+                }
                 Type* declaredType { gbl->type };
                 if (!declaredType->isIncomplete()) {
                     if (!(*declaredType == *initexpr->type)) {
@@ -596,7 +626,7 @@ namespace Floral {
             }
         } else if (auto structdecl = dynamic_cast<StructDeclaration*>(decl)) {
             pushScope();
-            scope().insert("this", new Type(new Type(0, structdecl->name().contents), true, true), new SymbolExpression({ structdecl->name(), structdecl->name() }, { structdecl->name().loc, TokenType::identifier, "this" }));
+            scope().insert("this", new Type(new Type(structdecl), true, true), new SymbolExpression({ structdecl->name(), structdecl->name() }, { structdecl->name().loc, TokenType::identifier, "this" }));
             _warnUninit = false;
             for (auto &stm: structdecl->dataMembers()) {
                 if (analyze(stm) != 0) return 1;
@@ -628,12 +658,16 @@ namespace Floral {
     }
 
     int StaticAnalyzer::analyze(Expression* expr) {
-        expr->info.isStaticEval = isStaticEval(expr);
         expr->type = type(expr); // get the type
+        expr->info.isStaticEval = isStaticEval(expr); // after typing, as a call is resolved by its argument types
         _typeTrace.push_back(expr);
         if (!expr->type) {
             return 1;
         }
+        if (auto call = dynamic_cast<Call*>(expr); call && call->info.isStaticEval) {
+            Interpreter::Value value;
+            _interpreter.evaluate(call, value); // the compiler uses the result if there is one, and calls the function otherwise
+        }
         return 0;
     }
 
@@ -791,6 +825,9 @@ namespace Floral {
                 case Literal::LType::decimalUInt32: {
                     return new Type(new Token(literal->value().loc, TokenType::uint32Type, "UInt32"), true);
                 }
+                case Literal::LType::floatingPointNumber: {
+                    return new Type(new Token(literal->value().loc, TokenType::floatType, "Float"), true);
+                }
                 case Literal::LType::cString: {
                     return new Type(new Type(new Token(literal->value().loc, TokenType::charType, "Char"), true), literal->value().contents.size() + 1, true);
                 }
@@ -823,7 +860,7 @@ namespace Floral {
             for (auto arg: call->args) {
                 analyze(arg);
                 argtypes.push_back({
-                    *Token::invalid,
+                    Token::invalid,
                     arg->type
                 });
             }
@@ -862,6 +899,9 @@ namespace Floral {
             unsafecast->expr()->type = unsafecast->type();
             return unsafecast->type();
         } else if (auto constructor = dynamic_cast<ConstructExpression*>(expr)) {
+            for (auto arg: constructor->args()) {
+                if (analyze(arg) != 0) return nullptr;
+            }
             return constructor->type();
         } else if (auto arraylit = dynamic_cast<ArrayLiteralExpression*>(expr)) {
             if (arraylit->values().empty()) return nullptr;
@@ -893,9 +933,18 @@ namespace Floral {
             literal->info.isStaticEval = true;
             return true;
         } else if (auto call = dynamic_cast<Call*>(expr)) {
-            //if (!functionSymbolTable[call->id()]) report error that no overload exists or smth
-            call->info.isStaticEval = false;
-            return false;
+            // a const func is evaluated at compile time when all of its arguments can be
+            Function::Parameters params;
+            for (auto arg: call->args) {
+                if (!arg->type || !isStaticEval(arg)) {
+                    call->info.isStaticEval = false;
+                    return false;
+                }
+                params.push_back({ Token::invalid, arg->type });
+            }
+            auto func = dynamic_cast<Function*>(lookupFunction(call->name.contents, params));
+            call->info.isStaticEval = func && func->isConstEval();
+            return call->info.isStaticEval;
         } else if (auto op = dynamic_cast<OperatorComponentExpression*>(expr)) {
             op->info.isStaticEval = true;
             return true;
@@ -932,6 +981,39 @@ namespace Floral {
         }
         return false;
     }
+    // MARK: Compile-time evaluation
+    bool StaticAnalyzer::isAnalyzing(const Function* func) const {
+        for (const auto& s: scopes) {
+            if (s.func == func) return true;
+        }
+        return false;
+    }
+    int StaticAnalyzer::resolveArrayLength(Type* type, const Node* site) {
+        if (!type || !type->_lengthExpr) return 0;
+        Expression* length = type->_lengthExpr;
+        if (analyze(length) != 0) return 1;
+        if (!length->type->isInteger()) {
+            report(Error::typeDomain, "Array length must be an integer", site->_loc.path, length->_loc, { length->_loc.pos, length->_loc.length });
+            return 1;
+        }
+        Interpreter::Value value;
+        if (!_interpreter.evaluate(length, value)) {
+            reportEvaluationFailure("Array length could not be evaluated at compile time", site);
+            return 1;
+        }
+        if (length->type->isSigned() && static_cast<int64_t>(value.bits) < 0) {
+            report(Error::typeDomain, "Array length cannot be negative", site->_loc.path, length->_loc, { length->_loc.pos, length->_loc.length });
+            return 1;
+        }
+        type->_staticArray->second = value.bits;
+        type->_lengthExpr = nullptr;
+        return 0;
+    }
+    void StaticAnalyzer::reportEvaluationFailure(const std::string& text, const Node* site) {
+        const Node* at = _interpreter.failureNode() ? _interpreter.failureNode() : site;
+        report(Error::compileDomain, text, site->_loc.path, at->_loc, { at->_loc.pos, at->_loc.length }, _interpreter.failure());
+    }
+
     GlobalDeclaration* StaticAnalyzer::lookupGlobal(std::string symbol) {
         return globalSymbolTable[symbol];
     }
@@ -948,5 +1030,6 @@ namespace Floral {
         functionForwardDeclSymbolTable.clear();
         scopes.clear();
         _typeTrace.clear();
+        _interpreter.reset();
     }
 }
@@ -12,6 +12,7 @@
 #include "AST.hpp"
 #include "Error.hpp"
 #include "Scope.hpp"
+#include "Interpreter.hpp"
 #include <map>
 
 namespace Floral {
@@ -19,6 +20,7 @@ namespace Floral {
 
     class StaticAnalyzer: public ErrorReporting {
         friend class Compiler;
+        friend class Interpreter;
         
         std::string _path;
         int _warnUninit = true;
@@ -45,6 +47,12 @@ namespace Floral {
         Type* lookupRType(const std::string& name, const Function::Parameters& params);
         Function* currentFunc();
         
+        // Compile-time evaluation
+        Interpreter _interpreter {*this};
+        bool isAnalyzing(const Function* func) const;
+        int resolveArrayLength(Type* type, const Node* site);
+        void reportEvaluationFailure(const std::string& text, const Node* site);
+        
         std::vector<Expression*> _typeTrace;
         
     public:
@@ -0,0 +1,19 @@
+#ifndef Target_hpp
+#define Target_hpp
+
+namespace Floral {
+    // The operating system a program is compiled for, which decides its entry point, syscall numbers,
+    // object format and how it is linked
+    enum class Target {
+        macOS, // _main, Mach-O objects through nasm, linked against libSystem
+        Linux // _start, ELF64 objects, linked statically unless C is used
+    };
+
+#ifdef __APPLE__
+    constexpr Target hostTarget = Target::macOS;
+#else
+    constexpr Target hostTarget = Target::Linux;
+#endif
+}
+
+#endif /* Target_hpp */
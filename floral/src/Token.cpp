@@ -66,9 +66,7 @@ namespace Floral {
     }
     bool Token::isType() const {
         auto intType { static_cast<int>(type) };
-        return (intType >= static_cast<int>(TokenType::int64Type) && intType <= static_cast<int>(TokenType::voidType)) || (std::find_if(Type::structs.begin(), Type::structs.end(), [this](StructDeclaration* struct_) -> bool {
-                return struct_->name().contents == contents;
-            }) != Type::structs.end());
+        return intType >= static_cast<int>(TokenType::int64Type) && intType <= static_cast<int>(TokenType::voidType);
     }
     bool Token::isValid() const {
         return !isInvalid();
@@ -80,7 +78,7 @@ namespace Floral {
         return type == TokenType::identifier;
     }
 
-    Token* Token::invalid;
+    const Token Token::invalid = Token(TokenLoc::zero, TokenType::invalid, "");
 
     bool operator ==(const Token& lhs, const Token& rhs) {
         return lhs.contents == rhs.contents;
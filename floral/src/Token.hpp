@@ -49,6 +49,7 @@ namespace Floral {
         charType, ucharType, wideCharType, wideUCharType,
         shortType, ushortType,
         int32Type, uint32Type,
+        floatType,
         boolType,
         voidType,
         plus, minus, inc, dec, multiply, divide, plusEqu, minusEq, mulEq, divEq, assign, bool_not, invert, bit_and, bit_or, modulus, bit_xor, bit_xorEq, bit_andEq, bit_orEq, modEq, bool_and, bool_or, bool_xor, less, greater, lessEqual, greaterEqual, equal, unequal, power, scopeResolve,
@@ -69,6 +70,7 @@ namespace Floral {
         "charType", "ucharType", "wideCharType", "wideUCharType",
         "shortType", "ushortType",
         "int32Type", "uint32Type",
+        "floatType",
         "boolType",
         "voidType",
         "plus", "minus", "inc", "dec", "multiply", "divide", "plusEqu", "minusEqu", "mulEqu", "divEqu", "assign", "not", "invert", "and", "or", "modulus", "bit_xor", "bit_xorEq", "bit_andEq", "bit_orEq", "modEq", "bool_and", "bool_or", "bool_xor", "less", "greater", "lessEqual", "greaterEqual", "equal", "unequal", "power", "scopeResolve",
@@ -99,12 +101,12 @@ namespace Floral {
         bool isLiteral() const;
         bool isOperator() const;
         bool isDeclarator() const;
-        bool isType() const;
+        bool isType() const; // a builtin type, as struct names are only known to the parser
         bool isValid() const;
         bool isInvalid() const;
         bool isId() const;
         
-        static Token* invalid;
+        static const Token invalid;
         
         std::vector<FloralWideChar> _wstr;
     };
@@ -13,14 +13,7 @@
 
 namespace Floral {
     Type::Type(Token* value, bool isConst): _tknValue(value), _stdlib_arrType(nullptr), _structValue(nullptr), _ptrType(nullptr), _tupleType{}, _functionType{}, _isConst(isConst) {}
-    Type::Type(int, const std::string& name, bool isConst): _tknValue(nullptr), _stdlib_arrType(nullptr), _ptrType(nullptr), _tupleType{}, _functionType{}, _isConst(isConst) {
-        auto iter = std::find_if(structs.begin(), structs.end(), [name](StructDeclaration* struct_) -> bool {
-            return struct_->name().contents == name;
-        });
-        if (iter != structs.end()) {
-            _structValue = *iter;
-        }
-    }
+    Type::Type(StructDeclaration* value, bool isConst): _tknValue(nullptr), _stdlib_arrType(nullptr), _structValue(value), _ptrType(nullptr), _tupleType{}, _functionType{}, _isConst(isConst) {}
     Type::Type(Type* value, bool isPtr, bool isConst): _tknValue(nullptr), _stdlib_arrType(isPtr ? nullptr : value), _structValue(nullptr), _ptrType(isPtr ? value : nullptr), _tupleType{}, _functionType{}, _isConst(isConst) {}
     Type::Type(Type* elementType, size_t length, bool isConst): _tknValue(nullptr), _stdlib_arrType(nullptr), _structValue(nullptr), _staticArray({elementType, length}), _ptrType(nullptr), _tupleType{}, _functionType{}, _isConst(isConst) {}
     Type::Type(Type* tuple[MAX_TUPLE_SIZE], const size_t size, bool isConst): _tknValue(nullptr), _stdlib_arrType(nullptr), _structValue(nullptr), _ptrType(nullptr), _functionType{}, _isConst(isConst) {
@@ -128,6 +121,9 @@ namespace Floral {
     bool Type::isWideUChar() const {
         return _tknValue && _tknValue->type == TokenType::wideUCharType;
     }
+    bool Type::isFloat() const {
+        return _tknValue && _tknValue->type == TokenType::floatType;
+    }
     bool Type::isVoid() const {
         return _tknValue && _tknValue->type == TokenType::voidType;
     }
@@ -176,7 +172,8 @@ namespace Floral {
             _tknValue->type == TokenType::charType ||
             _tknValue->type == TokenType::ucharType ||
             _tknValue->type == TokenType::wideCharType ||
-            _tknValue->type == TokenType::wideUCharType // || float types...
+            _tknValue->type == TokenType::wideUCharType ||
+            _tknValue->type == TokenType::floatType
         );
     }
 
@@ -227,13 +224,16 @@ namespace Floral {
         if (isChar() || isUChar()) return 1;
         if (isShort() || isUShort()) return 2;
         if (isInt32() || isUInt32() || isWideChar() || isWideUChar()) return 4;
-        if (isInt() || isUInt()) return 8;
+        if (isInt() || isUInt() || isFloat()) return 8;
         if (isVoid()) return 0;
         if (isTuple()) return std::reduce(_tupleType, _tupleType + (_tupleLen - 1), 0UL, [](unsigned long lhs, Type* rhs) -> unsigned long {
             return lhs + rhs->size();
         });
         assert(false && "Not implemented");
     }
+    const Type* Type::pointee() const {
+        return GET_PTRTYYPE(this);
+    }
     size_t Type::alignment() const {
         if (isStruct() || isArray())
             return (size() + 7) & -8;
@@ -243,7 +243,7 @@ namespace Floral {
         if (isChar() || isUChar()) return 8;
         if (isShort() || isUShort()) return 8;
         if (isInt32() || isUInt32() || isWideChar() || isWideUChar()) return 8;
-        if (isInt() || isUInt()) return 8;
+        if (isInt() || isUInt() || isFloat()) return 8;
         if (isVoid()) return 0;
         assert(false && "Not implemented");
     }
@@ -287,6 +287,7 @@ namespace Floral {
         if (isUChar()) return "uch";
         if (isWideChar()) return "wch";
         if (isWideUChar()) return "wuch";
+        if (isFloat()) return "f";
         
         if (isStruct()) return _structValue->name().contents + "struct";
 //        if (isPointer()) return _ptrType->shortID() + "ptr";
@@ -301,8 +302,6 @@ namespace Floral {
     }
 
 
-    std::vector<StructDeclaration*> Type::structs;
-    std::unordered_map<std::string, Type*> Type::typealiases;
 }
 //bool isString() const;
 //bool isBool() const;
@@ -28,14 +28,18 @@ namespace Floral {
     class Compiler;
     class StaticAnalyzer;
     class StructDeclaration;
+    struct Expression;
     class Type {
         friend class StaticAnalyzer;
         friend class Compiler;
         friend class Operator;
+        friend class Parser;
+        friend class Interpreter;
                 
         Token* _tknValue;
         StructDeclaration* _structValue;
         std::optional<std::pair<Type*, size_t>> _staticArray;
+        Expression* _lengthExpr {}; // a static array length still to be evaluated by the analyzer
         Type* _ptrType;
         Type* _stdlib_arrType;
         Type* _functionType[2];
@@ -45,11 +49,8 @@ namespace Floral {
         Type* _tupleType[MAX_TUPLE_SIZE];
         
     public:
-        static std::vector<StructDeclaration*> structs;
-        static std::unordered_map<std::string, Type*> typealiases;
-
         Type(Token* value, bool isConst = false);                     // single type literal
-        Type(int, const std::string& name, bool isConst = false);     // struct type
+        Type(StructDeclaration* value, bool isConst = false);         // struct type
         Type(Type* elementType, size_t length, bool isConst = false); // static arr type
         Type(Type* value, bool isPtr, bool isConst = false);          // array/ptr types
         Type(Type* tuple[MAX_TUPLE_SIZE], const size_t size, bool isConst = false); // tuple types
@@ -76,6 +77,7 @@ namespace Floral {
         bool isUChar(void) const;
         bool isWideChar(void) const;
         bool isWideUChar(void) const;
+        bool isFloat(void) const;
         bool isVoid(void) const;
         
         bool isToken(void) const;
@@ -98,6 +100,7 @@ namespace Floral {
         
         size_t size(void) const;
         size_t alignment(void) const;
+        const Type* pointee(void) const; // element type of a pointer or static array
         
         const std::string shortID(void) const;
         
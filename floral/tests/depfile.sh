@@ -0,0 +1,38 @@
+#!/bin/sh
+# Compiles a source that includes a header, which includes another, with -MD: the depfile has to name both.
+# Usage: tests/depfile.sh [floralc]
+floralc=${1:-floralc}
+case $floralc in
+    */*) floralc="$(cd "$(dirname "$floralc")" && pwd)/$(basename "$floralc")" ;;
+esac
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+mkdir include
+cat > include/outer.fh <<'EOF'
+#include "inner.fh"
+EOF
+cat > include/inner.fh <<'EOF'
+func value(): Int {
+    var v: Int = 0;
+    return v;
+}
+EOF
+cat > main.floral <<'EOF'
+#include "include/outer.fh"
+func main(): Int {
+    return value();
+}
+EOF
+
+"$floralc" -S -MD -no-cache main.floral
+failures=0
+for header in include/outer.fh include/inner.fh; do
+    if grep -q "$header" main.d 2>/dev/null; then
+        echo "pass $header listed"
+    else
+        echo "FAIL $header listed"
+        failures=$((failures + 1))
+    fi
+done
+exit $failures
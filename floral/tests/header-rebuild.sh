@@ -0,0 +1,53 @@
+#!/bin/sh
+# Builds a project whose only source includes a header, then edits just the header: the next build has to
+# compile the source again, and the one after it, with nothing changed, must not.
+# Usage: tests/header-rebuild.sh [floralc]
+floralc=${1:-floralc}
+case $floralc in
+    */*) floralc="$(cd "$(dirname "$floralc")" && pwd)/$(basename "$floralc")" ;;
+esac
+project=$(mktemp -d)
+trap 'rm -rf "$project"' EXIT
+cd "$project" || exit 1
+mkdir src
+cat > config.floralattr <<'EOF'
+Folder: "src";
+Target: "out";
+EOF
+cat > src/value.fh <<'EOF'
+func value(): Int {
+    var v: Int = 1;
+    return v;
+}
+EOF
+cat > src/main.floral <<'EOF'
+#include "value.fh"
+func main(): Int {
+    return value() - 1;
+}
+EOF
+
+# the units to rebuild, from the verbose summary; linking may fail without the runtime, which does not matter here
+rebuilt() {
+    "$floralc" -project-build -v -no-cache 2>/dev/null | sed -n 's/.*[^0-9]\([0-9][0-9]*\) of [0-9]* files to rebuild.*/\1/p'
+}
+failures=0
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "pass $1"
+    else
+        echo "FAIL $1: rebuilt $2 units, expected $3"
+        failures=$((failures + 1))
+    fi
+}
+check "first build" "$(rebuilt)" 1
+check "nothing changed" "$(rebuilt)" 0
+cat > src/value.fh <<'EOF'
+func value(): Int {
+    var v: Int = 2;
+    return v - 1;
+}
+EOF
+check "header changed" "$(rebuilt)" 1
+grep -q "value.fh" internal/filechange.txt && echo "pass header recorded" || { echo "FAIL header recorded"; failures=$((failures + 1)); }
+exit $failures
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Compiles, links and runs each program in this directory; a program passes when main returns 0.
+# Usage: tests/run.sh [floralc] [options...], e.g. tests/run.sh ./floralc -O
+# A program that needs options of its own lists them on a "// options:" line, e.g. "// options: -O".
+floralc=${1:-floralc}
+[ $# -gt 0 ] && shift
+out=$(mktemp)
+failures=0
+for test in "$(dirname "$0")"/*.floral; do
+    options=$(sed -n 's|^// options: ||p' "$test")
+    if "$floralc" -o "$out" "$@" $options "$test" && "$out"; then
+        echo "pass $(basename "$test")"
+    else
+        echo "FAIL $(basename "$test")"
+        failures=$((failures + 1))
+    fi
+done
+rm -f "$out"
+exit $failures